@@ -6,10 +6,12 @@
 #include "europa/common.h"
 #include "europa/object.h"
 #include "europa/bytevector.h"
+#include "europa/cache.h"
 #include "europa/ccont.h"
 #include "europa/character.h"
 #include "europa/error.h"
 #include "europa/gc.h"
+#include "europa/image.h"
 #include "europa/number.h"
 #include "europa/pair.h"
 #include "europa/port.h"
@@ -20,6 +22,7 @@
 #include "europa/string.h"
 #include "europa/symbol.h"
 #include "europa/table.h"
+#include "europa/task.h"
 #include "europa/vector.h"
 #include "europa/util.h"
 
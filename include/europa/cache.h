@@ -0,0 +1,49 @@
+#ifndef __EUROPA_CACHE_H__
+#define __EUROPA_CACHE_H__
+
+#include "europa/europa.h"
+
+#include "europa/common.h"
+#include "europa/int.h"
+#include "europa/object.h"
+#include "europa/rt.h"
+
+#include <stddef.h>
+
+typedef struct europa_cache_entry eu_centry;
+typedef struct europa_cache eu_cache;
+
+/** A compiled form kept by the compile cache. */
+struct europa_cache_entry {
+	eu_value text; /*!< the form's source text (a string), the entry's key */
+	eu_proto* proto; /*!< the form's top level prototype */
+	eu_value assumed; /*!< (name . value) pairs of the globals the code was
+	                       specialized for */
+	size_t size; /*!< bytes the entry is accounted for */
+	eu_centry* newer; /*!< the entry used right after this one */
+	eu_centry* older; /*!< the entry used right before this one */
+};
+
+/** The compile cache, which keeps recently compiled forms by source text. */
+struct europa_cache {
+	eu_table* entries; /*!< entries (as C pointers) by source text */
+	eu_centry* newest; /*!< the most recently used entry */
+	eu_centry* oldest; /*!< the least recently used entry */
+	size_t size; /*!< bytes the entries take */
+	size_t limit; /*!< bytes the entries may take */
+	eu_value* assumed; /*!< where to note the globals the form being compiled
+	                        is specialized for, NULL when not noting them */
+};
+
+/* function declarations */
+int eucache_set_limit(europa* s, size_t limit);
+int eucache_clear(europa* s);
+int eucache_lookup(europa* s, const char* text, eu_value* chunk);
+int eucache_store(europa* s, const char* text, eu_proto* proto,
+	eu_value* assumed);
+int eucache_compile_string(europa* s, const char* text, eu_value* chunk);
+int eucache_assume(europa* s, eu_value* name, eu_value* value);
+int eucache_mark(europa* s, eu_gcmark mark, eu_cache* cache);
+int eucache_destroy(europa* s);
+
+#endif /* __EUROPA_CACHE_H__ */
@@ -60,6 +60,19 @@
  * store all state inside their 'env'. This is probably inefficient, but a solution
  * nonetheless.
  *
+ * C frames are the cheaper way of doing this. eucc_cframe gives the running
+ * activation a small array of value slots and a resume tag, which are saved
+ * with its continuations and restored when it is resumed. eucc_call sets the
+ * tag and calls a procedure, and the closure dispatches on the tag when it is
+ * called again:
+ *
+ *     _eu_checkreturn(eucc_cframe(s, 1, &f));
+ *     switch (_eucframe_tag(f)) {
+ *     case 0: ... return eucc_call(s, 1, proc, &args);
+ *     case 1: ... the result is in the accumulator ...
+ *     }
+ *
+ * New frames have tag 0 and their slots set to the empty list.
  */
 
 #define _eucc_dispatcher(s, dcl) do { \
@@ -100,6 +113,14 @@
 		(v) = eulist_ref(s, _euvalue_to_pair(&((s)->rib)), (index));\
 	} while (0)
 
+/* gets an argument that may not have been passed, v is set to NULL if so */
+#define _eucc_optional_argument(s, v, index) \
+	do {\
+		(v) = (_euvalue_is_pair(&((s)->rib)) &&\
+			eulist_length(s, _euvalue_to_pair(&((s)->rib))) > (index)) ?\
+			eulist_ref(s, _euvalue_to_pair(&((s)->rib)), (index)) : NULL;\
+	} while (0)
+
 #define _eucc_argument_type(s, v, index, type) \
 	do {\
 		(v) = eulist_ref(s, _euvalue_to_pair(&((s)->rib)), (index));\
@@ -157,6 +178,10 @@
 
 #define _eucc_arguments(s) (&((s)->rib))
 
+/* whether a value is a C closure that never calls back into Europa code */
+#define _eucc_is_leaf(v) \
+	(_euvalue_is_type(v, EU_TYPE_CLOSURE) && _euvalue_to_closure(v)->leaf)
+
 #define _eucc_return(s) (_eu_acc(s))
 
 #define _eucc_check_type(s, v, what, expected) \
@@ -171,7 +196,15 @@
 
 
 int eucc_frame(europa* s);
+int eucc_cframe(europa* s, int slotc, eu_cframe** out);
+int eucc_call(europa* s, int tag, eu_value* proc, eu_value* args);
 int eucc_define_cclosure(europa* s, eu_table* t, eu_table* env, void* text, eu_cfunc cf);
+int eucc_define_leaf_cclosure(europa* s, eu_table* t, eu_table* env,
+	void* text, eu_cfunc cf);
+int eucc_apply_leaf(europa* s, eu_closure* cl, eu_value* args, eu_value* out);
+int eucc_register_cfunc(europa* s, void* text, eu_cfunc cf);
+int eucc_cfunc_name(europa* s, eu_cfunc cf, eu_value* out);
+int eucc_find_cfunc(europa* s, eu_value* name, eu_cfunc* out);
 
 
 
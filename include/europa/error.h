@@ -35,6 +35,11 @@ struct europa_error {
 	.type = EU_TYPE_ERROR | EU_TYPEFLAG_COLLECTABLE, \
 	.value = { .object = (s) }}
 
+#define _eu_makeerror(vptr, e) do {\
+		(vptr)->type = EU_TYPE_ERROR | EU_TYPEFLAG_COLLECTABLE;\
+		(vptr)->value.object = _euerror_to_obj(e);\
+	} while (0)
+
 /* member access macros */
 
 #define _euerror_message(s) (&((s)->_msg))
@@ -21,13 +21,36 @@ typedef struct europa europa;
 typedef int (*eu_cfunc)(europa* s);
 
 typedef struct europa_table eu_table;
+
+/* symbols the compiler builds forms with, see eu_global's keywords */
+enum {
+	EU_KEYWORD_LAMBDA,
+	EU_KEYWORD_DEFINE,
+	EU_KEYWORD_LET,
+	EU_KEYWORD_IF,
+	EU_KEYWORD_BEGIN,
+	EU_KEYWORD_DO,
+	EU_KEYWORD_GUARD,
+	EU_KEYWORD_COUNT,
+};
+
 struct europa_global {
 	EU_OBJECT_HEADER
 	eu_gc gc; /*!< global state GC */
 	eu_cfunc panic; /*!< global panic function */
 	europa* main; /*!< the main state */
 	eu_table* internalized; /*!< internalized strings and symbols */
+	struct europa_symbol* keywords[EU_KEYWORD_COUNT]; /*!< compiler keywords */
 	eu_table* env; /*!< global environment */
+	eu_table* syntax; /*!< special form compilers, by keyword */
+	eu_table* unit; /*!< procedures defined by the form being compiled, by name */
+	eu_table* cfuncs; /*!< registered C function indices by name, and names by index */
+	eu_cfunc* cfunc_list; /*!< registered C functions, by index */
+	int cfuncc; /*!< number of registered C functions */
+	int cfuncs_size; /*!< size of the C function array */
+	struct europa_cache* cache; /*!< compile cache, NULL unless enabled */
+	eu_byte peephole; /*!< whether compiled code is optimized */
+	unsigned int hidden_names; /*!< count of names generated by the compiler */
 };
 
 struct europa_jmplist;
@@ -55,6 +78,20 @@ struct europa {
 	eu_value rib; /*!< argument rib */
 	eu_value* rib_lastpos; /*!< last rib position */
 	eu_continuation* previous; /*!< previous continuation */
+	struct europa_cframe* cframe; /*!< frame of the running C closure, if any */
+	eu_continuation* handler; /*!< innermost exception handler frame */
+	eu_continuation* wind; /*!< innermost dynamic-wind frame */
+
+	/* tasks */
+	struct europa_task* task; /*!< running task, NULL if the host's code */
+	struct europa_task* ready; /*!< tasks ready to run */
+	struct europa_task* ready_last; /*!< last task ready to run */
+	struct europa_task* sleeping; /*!< sleeping tasks, by wake time */
+	int budget; /*!< calls and backward jumps left before preemption */
+
+	/* fuel */
+	eu_integer fuel; /*!< calls and backward jumps the host allows, -1 if no limit */
+	int slice; /*!< the budget as of when fuel was last charged */
 };
 
 #define _euglobal_gc(g) (&((g)->gc))
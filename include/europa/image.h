@@ -0,0 +1,72 @@
+#ifndef __EUROPA_IMAGE_H__
+#define __EUROPA_IMAGE_H__
+
+#include "europa/europa.h"
+
+#include "europa/common.h"
+#include "europa/int.h"
+#include "europa/object.h"
+#include "europa/port.h"
+#include "europa/rt.h"
+
+#include <stddef.h>
+
+/** the image format's version, bumped whenever the layout changes */
+#define EU_IMAGE_VERSION 2
+
+/** the heap image format's version */
+#define EU_HEAP_IMAGE_VERSION 1
+
+/** image flag set when code is written little endian */
+#define EU_IMAGE_FLAG_LITTLE_CODE (1 << 0)
+
+/* where an image's bytes come from */
+enum {
+	EU_IMAGE_ALLOCATED, /* copied or read, freed along with the image */
+	EU_IMAGE_MAPPED, /* a file mapping, unmapped along with the image */
+	EU_IMAGE_SHARED, /* the host's, which may hand them to other states too */
+};
+
+/** A loaded image, which prototypes are read from as they are needed. */
+struct europa_image {
+	const eu_byte* data; /*!< the image's bytes */
+	size_t size; /*!< how many there are */
+	eu_byte mapped; /*!< where data comes from (EU_IMAGE_*) */
+	eu_byte native_code; /*!< whether code is in the machine's byte order */
+
+	int protoc; /*!< number of prototypes */
+	size_t table; /*!< where the prototype offset and parent table is */
+	eu_proto** protos; /*!< prototypes created so far, by index */
+
+	int refs; /*!< number of prototypes created from the image */
+};
+
+/* image macros */
+#define _euproto_is_stub(p) ((p)->image != NULL && (p)->code == NULL)
+#define _euproto_maps_code(p) ((p)->image != NULL &&\
+	cast(const eu_byte*, (p)->code) >= (p)->image->data &&\
+	cast(const eu_byte*, (p)->code) < (p)->image->data + (p)->image->size)
+
+/* function declarations */
+int euimage_write(europa* s, eu_port* port, eu_proto** protos, int count);
+int euimage_load(europa* s, const eu_byte* data, size_t size, eu_value* out);
+int euimage_load_file(europa* s, const char* filename, eu_value* out);
+int euimage_load_shared(europa* s, const eu_byte* data, size_t size,
+	eu_value* out);
+int euimage_materialize(europa* s, eu_proto* proto);
+int euimage_release(europa* s, eu_image* image);
+int euimage_compile_file(europa* s, const char* source, const char* image);
+int euimage_run(europa* s, eu_value* chunks, eu_value* out);
+int euimage_dump_heap(europa* s, eu_port* port);
+int euimage_dump_heap_file(europa* s, const char* filename);
+int euimage_restore_heap(europa* s, const eu_byte* data, size_t size);
+int euimage_restore_heap_file(europa* s, const char* filename);
+
+/* language side api */
+int euapi_register_image(europa* s);
+
+int euapi_compile_file(europa* s);
+int euapi_load_image(europa* s);
+int euapi_dump_heap(europa* s);
+
+#endif /* __EUROPA_IMAGE_H__ */
@@ -29,12 +29,14 @@ enum {
 	EU_RESULT_INVALID,
 	EU_RESULT_BAD_ALLOC,
 	EU_RESULT_CONTINUE,
+	EU_RESULT_YIELD, /* ran out of fuel, resume with eu_resume */
 };
 
 enum {
 	EU_SSTATUS_STOPPED = 0,
 	EU_SSTATUS_RUNNING,
 	EU_SSTATUS_ERROR,
+	EU_SSTATUS_YIELDED,
 };
 
 #endif /* __EUROPA_INTEGER_H__ */
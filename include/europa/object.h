@@ -14,6 +14,7 @@
 /* type definitions */
 typedef struct europa_object eu_object;
 typedef struct europa_value eu_value;
+typedef struct europa europa;
 
 /* internal value representation. */
 /** enum representing the possible types for tagged value */
@@ -37,6 +38,9 @@ enum eu_type {
 	EU_TYPE_CLOSURE,
 	EU_TYPE_CONTINUATION,
 	EU_TYPE_PROTO, /* function prototype */
+	EU_TYPE_CFRAME, /* C closure frame */
+	EU_TYPE_TASK,
+	EU_TYPE_CHANNEL,
 
 	EU_TYPE_STATE,
 	EU_TYPE_GLOBAL,
@@ -154,10 +158,16 @@ eu_bool euobj_is_null(eu_object* obj);
 eu_bool euobj_is_type(eu_object* obj, eu_byte type);
 
 eu_uinteger euvalue_hash(eu_value* v);
+eu_uinteger euvalue_equal_hash(eu_value* v);
 int euvalue_eqv(eu_value* a, eu_value* b, eu_value* out);
 int euvalue_eq(eu_value* a, eu_value* b, eu_value* out);
 int euvalue_equal(eu_value* a, eu_value* b, eu_value* out);
 
 /* language side api */
+int euapi_register_object(europa* s);
+
+int euapi_eqQ(europa* s);
+int euapi_eqvQ(europa* s);
+int euapi_equalQ(europa* s);
 
 #endif /* __EUROPA_OBJECT_H__ */
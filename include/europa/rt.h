@@ -14,8 +14,42 @@
 typedef int (*eu_pfunc)(europa* s, void* ud);
 typedef struct europa_closure eu_closure;
 typedef struct europa_continuation eu_continuation;
+typedef struct europa_cframe eu_cframe;
 typedef struct europa_proto eu_proto;
 typedef unsigned int eu_instruction;
+typedef struct europa_gcache eu_gcache;
+typedef struct europa_gref eu_gref;
+typedef struct europa_capture eu_capture;
+typedef struct europa_compile_scope eu_cscope;
+typedef struct europa_syntax eu_syntax;
+typedef struct europa_image eu_image;
+
+/** Compiles a special form into a prototype's code. */
+typedef int (*eu_syntax_compiler)(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* form, int is_tail);
+
+/** Cached location of a global variable's value, used by GREFER. */
+struct europa_gcache {
+	eu_table* env; /*!< the table the cell belongs to */
+	eu_value* cell; /*!< the variable's value slot */
+	unsigned int epoch; /*!< the table's epoch when the cell was cached */
+};
+
+/** A global variable looked up once by the host, to be called repeatedly
+ * through eu_call_global. */
+struct europa_gref {
+	eu_value name; /*!< the variable's name */
+	eu_gcache cache; /*!< where its value was last found */
+};
+
+/** Where a closure gets one of its free variables from when it is created. */
+struct europa_capture {
+	eu_byte from_free; /*!< whether it is a free variable of the creating closure */
+	eu_byte shared; /*!< whether the variable may change, so the table of the
+	                     frame binding it is captured instead of its value */
+	int index; /*!< the creating closure's free variable index, if from_free */
+	int name; /*!< constant index of the variable's name in its frame */
+};
 
 /** Function prototype. */
 struct europa_proto {
@@ -36,17 +70,39 @@ struct europa_proto {
 	eu_instruction* code; /*!< prototype code */
 	int code_length; /*!< code length */
 	int code_size; /*!< code buffer size */
+
+	eu_capture* captures; /*!< how closures get their free variables */
+	int capturec; /*!< number of free variables */
+	int captures_size; /*!< size of the capture array */
+
+	int framec; /*!< how many variables each call's frame binds */
+
+	eu_gcache* gcache; /*!< global reference caches, by instruction index */
+	eu_table* constant_index; /*!< constant to index map, while compiling */
+
+	eu_image* image; /*!< the image the prototype is read from, if any */
+	int image_index; /*!< the prototype's index in the image */
+};
+
+/** Special form definition. */
+struct europa_syntax {
+	const char* name; /*!< the form's keyword */
+	eu_syntax_compiler compile; /*!< the form's compiler */
 };
 
 /** Closure structure. */
 struct europa_closure {
 	EU_OBJECT_HEADER
 	eu_byte own_env; /*!< whether the closure should have its own environment */
+	eu_byte leaf; /*!< whether its C function never calls back into Europa code */
 
 	eu_table* env; /*!< closure creation environment */
 
 	eu_proto* proto; /*!< europa function prototype */
 	eu_cfunc cf; /*!< C function closure */
+
+	eu_value* free; /*!< free variable values (or frames), as the proto's captures */
+	int freec; /*!< number of free variables */
 };
 
 /** Continuation structure. */
@@ -61,6 +117,22 @@ struct europa_continuation {
 
 	eu_closure* cl; /*!< closure in execution */
 	unsigned int pc; /*!< saved program counter */
+	eu_cframe* cframe; /*!< state of the C closure in execution, if any */
+
+	eu_continuation* handler; /*!< innermost exception handler frame */
+	eu_continuation* wind; /*!< innermost dynamic-wind frame */
+};
+
+/** State a C closure keeps while it calls back into Europa code.
+ *
+ * Frames belong to a single activation of a C closure and are saved and
+ * restored along with the continuations of that activation. */
+struct europa_cframe {
+	EU_OBJECT_HEADER
+
+	int tag; /*!< where the closure resumes, 0 when it starts */
+	int slotc; /*!< number of slots */
+	eu_value _slots; /*!< the first slot */
 };
 
 /* vm instruction set related definitions */
@@ -79,6 +151,19 @@ enum {
 	EU_OP_FRAME,
 	EU_OP_DEFINE,
 	EU_OP_HALT,
+	EU_OP_GREFER,
+	/* fused instructions */
+	EU_OP_REFER_ARG, /* REFER; ARGUMENT */
+	EU_OP_GREFER_ARG, /* GREFER; ARGUMENT */
+	EU_OP_CONST_ARG, /* CONST; ARGUMENT */
+	EU_OP_GREFER_APPLY, /* GREFER; APPLY */
+	/* closure free variables */
+	EU_OP_FREFER,
+	EU_OP_FASSIGN,
+	/* inlined procedures and folded calls */
+	EU_OP_GUARD,
+	/* continuations */
+	EU_OP_CONTI_FRAME, /* CONTI; FRAME */
 };
 
 enum {
@@ -100,7 +185,7 @@ enum {
 #define _euobj_to_proto(o) cast(eu_proto*, o)
 #define _euvalue_to_proto(v) _euobj_to_proto((v)->value.object)
 #define _eu_makeproto(vptr, s) do {\
-		(vptr)->type = EU_TYPE_CLOSURE | EU_TYPEFLAG_COLLECTABLE;\
+		(vptr)->type = EU_TYPE_PROTO | EU_TYPEFLAG_COLLECTABLE;\
 		(vptr)->value.object = _euproto_to_obj(s);\
 	} while (0)
 #define _euproto_formals(p) (&((p)->formals))
@@ -116,6 +201,10 @@ eu_integer euproto_add_constant(europa* s, eu_proto* proto, eu_value* constant,
 	int* index);
 eu_integer euproto_add_subproto(europa* s, eu_proto* proto, eu_proto* subproto,
 	int* index);
+int euproto_add_capture(europa* s, eu_proto* proto, eu_capture* capture,
+	int* index);
+int euproto_seal(europa* s, eu_proto* proto);
+eu_gcache* euproto_global_cache(europa* s, eu_proto* proto, int pc);
 
 /* closure structure macros and functions */
 #define _euclosure_to_obj(s) cast(eu_object*, s)
@@ -143,24 +232,52 @@ eu_integer eucl_hash(eu_closure* cl);
 
 eu_continuation* eucont_new(europa* s, eu_continuation* previous,
 	eu_table* env, eu_value* rib, eu_value* rib_lastpos, eu_closure* cl,
-	unsigned int pc);
+	unsigned int pc, eu_cframe* cframe);
 
 int eucont_mark(europa* s, eu_gcmark mark, eu_continuation* cl);
 int eucont_destroy(europa* s, eu_continuation* cl);
 eu_integer eucont_hash(eu_continuation* cl);
 
+/* C closure frame macros and functions */
+#define _eucframe_to_obj(f) cast(eu_object*, f)
+#define _euobj_to_cframe(o) cast(eu_cframe*, o)
+#define _eucframe_tag(f) ((f)->tag)
+#define _eucframe_slotc(f) ((f)->slotc)
+#define _eucframe_slot(f, i) (&((f)->_slots) + (i))
+
+eu_cframe* eucframe_new(europa* s, int slotc);
+int eucframe_mark(europa* s, eu_gcmark mark, eu_cframe* f);
+
 /* code generation related macros and functions */
 int eucode_compile(europa* s, eu_value* v, eu_value* chunk);
+int eucode_compile_form(europa* s, eu_cscope* sc, eu_proto* proto, eu_value* v,
+	int is_tail);
+int eucode_define_syntax(europa* s, const eu_syntax* syntax);
+int eucode_initialize_syntax(europa* s);
+int eucode_peephole(europa* s, eu_proto* proto);
 
 /* virtual machine related functions and macros */
 int euvm_doclosure(europa* s, eu_closure* cl, eu_value* arguments,
 	eu_value* out);
 int euvm_initialize_state(europa* s);
+int euvm_execute(europa* s);
+void euvm_refuel(europa* s);
 int euvm_apply(europa* s, eu_value* v, eu_value* args, eu_value* out);
+int euvm_resume(europa* s, eu_continuation* cont, eu_value* value);
+int euvm_call(europa* s, eu_value* v, int argc, eu_value* argv, eu_value* out);
 int euvm_disassemble(europa* s, eu_port* port, eu_value* v);
+int euvm_verify(europa* s, eu_proto* proto, eu_proto* parent);
 
 /* run time macros and functions */
 int eurt_evaluate(europa* s, eu_value* value,  eu_value* out);
+int eu_call(europa* s, eu_value* fn, int argc, eu_value* argv, eu_value* out);
+int eu_global_ref(europa* s, const char* name, eu_gref* ref);
+int eu_gref_value(europa* s, eu_gref* ref, eu_value** out);
+int eu_call_global(europa* s, eu_gref* ref, int argc, eu_value* argv,
+	eu_value* out);
+int eu_set_fuel(europa* s, eu_integer fuel);
+eu_integer eu_get_fuel(europa* s);
+int eu_resume(europa* s, eu_value* out);
 
 /* library */
 int euapi_register_controls(europa* s);
@@ -169,7 +286,18 @@ int euapi_procedureQ(europa* s);
 int euapi_apply(europa* s);
 int euapi_map(europa* s);
 int euapi_for_each(europa* s);
+int euapi_vector_map(europa* s);
+int euapi_vector_for_each(europa* s);
 
 int euapi_disassemble(europa* s);
 
+int eurt_rewind(europa* s);
+int euapi_dynamic_wind(europa* s);
+int euapi_with_exception_handler(europa* s);
+int euapi_guard(europa* s);
+int euapi_raise(europa* s);
+int euapi_raise_continuable(europa* s);
+int euapi_error_objectQ(europa* s);
+int euapi_error_object_message(europa* s);
+
 #endif
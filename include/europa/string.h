@@ -61,6 +61,8 @@ int eustring_equal(eu_value* a, eu_value* b, eu_value* out);
 eu_integer eustring_equal_cstr(eu_value* vstr, const char* cstr);
 
 /* library */
+int euapi_register_string(europa* s);
+
 int euapi_stringQ(europa* s);
 int euapi_make_string(europa* s);
 int euapi_string(europa* s);
@@ -87,5 +89,6 @@ int euapi_list_to_string(europa* s);
 int euapi_string_copy(europa* s);
 int euapi_string_copyB(europa* s);
 int euapi_string_fillB(europa* s);
+int euapi_string_hash(europa* s);
 
 #endif /* __EUROPA_STRING_H__ */
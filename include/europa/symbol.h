@@ -39,6 +39,7 @@ struct europa_symbol {
 /* function declarations */
 
 eu_symbol* eusymbol_new(europa* s, void* text);
+eu_symbol* eusymbol_intern(europa* s, void* text);
 
 void* eusymbol_text(eu_symbol* sym);
 eu_uinteger eusymbol_hash(eu_symbol* sym);
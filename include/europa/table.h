@@ -28,13 +28,28 @@ struct europa_table_node {
 /* calculates 2^x */
 #define twoto(x) (1 << (x))
 
+/** how keys are compared (and hashed) in a table */
+enum eu_table_comparator {
+	EU_TABLE_EQV = 0, /*!< keys are compared with `eqv?` (the default) */
+	EU_TABLE_EQ, /*!< keys are compared with `eq?` */
+	EU_TABLE_EQUAL, /*!< keys are compared with `equal?` */
+	EU_TABLE_STRING, /*!< keys are strings compared with `string=?` */
+	EU_TABLE_COMPARATOR_LAST
+};
+
 struct europa_table {
 	EU_OBJECT_HEADER
-	eu_byte lsize; /*!< log2 of the table's size */
-	int count; /*!< the number of elements in the table */
+	eu_byte lsize; /*!< log2 of the table's hash part size */
+	eu_byte comparator; /*!< how keys are compared */
+	int count; /*!< the number of elements in the table's hash part */
 	struct europa_table_node *nodes, *last_free;
 
+	eu_value* array; /*!< the array part, for integer keys 0..asize-1 */
+	int asize; /*!< the array part's size */
+	int acount; /*!< the number of elements in the array part */
+
 	struct europa_table* index; /*!< the table's index */
+	unsigned int epoch; /*!< changes whenever value slots may have moved */
 };
 
 #define _eutable_to_obj(s) cast(eu_object*, s)
@@ -43,7 +58,7 @@ struct europa_table {
 #define _euvalue_to_table(v) _euobj_to_table((v)->value.object)
 #define _eu_maketable(vptr, t) do {\
 		(vptr)->type = EU_TYPE_TABLE | EU_TYPEFLAG_COLLECTABLE;\
-		(vptr)->value.object = (t);\
+		(vptr)->value.object = _eutable_to_obj(t);\
 	} while (0)
 
 #define _eutable_nodes(t) ((t)->nodes)
@@ -53,6 +68,17 @@ struct europa_table {
 #define _eutable_last_free(t) ((t)->last_free)
 #define _eutable_size(t) (_eutable_last_free(t) ? twoto(_eutable_lsize(t)) : 0)
 #define _eutable_index(t) ((t)->index)
+#define _eutable_comparator(t) ((t)->comparator)
+#define _eutable_epoch(t) ((t)->epoch)
+#define _eutable_array(t) ((t)->array)
+#define _eutable_asize(t) ((t)->asize)
+#define _eutable_acount(t) ((t)->acount)
+#define _eutable_aslot(t, i) (&((t)->array[(i)]))
+
+/* array part slots holding no value are tagged with an invalid type, because
+ * the null value is a valid value (the empty list) */
+#define _eutable_aslot_is_empty(v) (_euvalue_rtype(v) == EU_TYPE_LAST)
+#define _eutable_aslot_clear(v) ((v)->type = EU_TYPE_LAST)
 
 #define _eutable_set_index(t, i) (_eutable_index(t) = (i))
 
@@ -65,6 +91,11 @@ int eutable_destroy(europa* s, eu_table* t);
 int eutable_mark(europa* s, eu_gcmark mark, eu_table* t);
 eu_uinteger eutable_hash(eu_table* t);
 eu_table* eutable_set_index(eu_table* t, eu_table* i);
+int eutable_resize(europa* s, eu_table* t, size_t array_length,
+	size_t hash_length);
+int eutable_set_comparator(europa* s, eu_table* t, eu_byte comparator);
+int eutable_clear(europa* s, eu_table* t);
+eu_table* eutable_copy(europa* s, eu_table* t);
 
 int eutable_create_key(europa* s, eu_table* t, eu_value* key,
 	eu_value** val);
@@ -74,6 +105,9 @@ int eutable_get_string(europa* s, eu_table* t, const char* str,
 	eu_value** val);
 int eutable_get_symbol(europa* s, eu_table* t, const char* sym_text,
 	eu_value** val);
+int eutable_remove(europa* s, eu_table* t, eu_value* key);
+int eutable_next(europa* s, eu_table* t, eu_value* key, eu_value* nkey,
+	eu_value** nval);
 
 int eutable_rget(europa* s, eu_table* t, eu_value* key, eu_value** val);
 int eutable_rget_string(europa* s, eu_table* t, const char* str,
@@ -81,4 +115,32 @@ int eutable_rget_string(europa* s, eu_table* t, const char* str,
 int eutable_rget_symbol(europa* s, eu_table* t, const char* str,
 	eu_value** val);
 
+/* language procedures */
+
+int euapi_register_table(europa* s);
+
+int euapi_make_hash_table(europa* s);
+int euapi_hash_tableQ(europa* s);
+int euapi_make_eq_hash_table(europa* s);
+int euapi_make_eqv_hash_table(europa* s);
+int euapi_make_equal_hash_table(europa* s);
+int euapi_make_string_hash_table(europa* s);
+int euapi_hash_table_ref(europa* s);
+int euapi_hash_table_ref_default(europa* s);
+int euapi_hash_table_setB(europa* s);
+int euapi_hash_table_deleteB(europa* s);
+int euapi_hash_table_containsQ(europa* s);
+int euapi_hash_table_size(europa* s);
+int euapi_hash_table_keys(europa* s);
+int euapi_hash_table_values(europa* s);
+int euapi_hash_table_to_alist(europa* s);
+int euapi_hash_table_updateB(europa* s);
+int euapi_hash_table_updateB_default(europa* s);
+int euapi_hash_table_walk(europa* s);
+int euapi_hash_table_fold(europa* s);
+int euapi_hash_table_copy(europa* s);
+int euapi_hash_table_clearB(europa* s);
+int euapi_hash(europa* s);
+int euapi_hash_by_identity(europa* s);
+
 #endif
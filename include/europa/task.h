@@ -0,0 +1,97 @@
+/** Tasks (green threads) and channels.
+ *
+ * @file task.h
+ * @author Leonardo G.
+ */
+#ifndef __EUROPA_TASK_H__
+#define __EUROPA_TASK_H__
+
+#include "europa/europa.h"
+
+#include "europa/common.h"
+#include "europa/int.h"
+#include "europa/object.h"
+#include "europa/rt.h"
+
+/** Number of calls and backward jumps a task runs before others get a turn. */
+#define EU_TASK_BUDGET 1024
+
+typedef struct europa_task eu_task;
+typedef struct europa_channel eu_channel;
+
+enum {
+	EU_TASK_READY, /* in the run queue */
+	EU_TASK_RUNNING,
+	EU_TASK_WAITING, /* sleeping or waiting on a channel or another task */
+	EU_TASK_DONE,
+};
+
+/** Task structure.
+ *
+ * A suspended task is just the frame it resumes from and the value it resumes
+ * with. Tasks are linked into whatever queue they wait in. */
+struct europa_task {
+	EU_OBJECT_HEADER
+	eu_byte status; /*!< the task's status */
+	eu_byte root; /*!< whether it is the computation the host started */
+	eu_byte failed; /*!< whether it finished by raising its value */
+
+	eu_task* next; /*!< next task in the queue it is in */
+	eu_task* waiters; /*!< tasks waiting for it to finish */
+
+	eu_continuation* cont; /*!< where it resumes, NULL before it starts */
+	eu_value value; /*!< its thunk, the value it resumes with or its result */
+	double wake; /*!< when it wakes up, if sleeping */
+};
+
+/** Channel structure. Sending never blocks, receiving waits for a value. */
+struct europa_channel {
+	EU_OBJECT_HEADER
+
+	eu_value values; /*!< values sent but not received yet */
+	eu_value* last; /*!< where the next value is appended */
+	eu_task* receivers; /*!< tasks waiting for a value */
+	eu_task* receivers_last; /*!< the last of them */
+};
+
+/* conversion macros */
+#define _eutask_to_obj(t) cast(eu_object*, t)
+#define _euobj_to_task(o) cast(eu_task*, o)
+#define _euvalue_to_task(v) _euobj_to_task((v)->value.object)
+#define _eu_maketask(vptr, t) do {\
+		(vptr)->type = EU_TYPE_TASK | EU_TYPEFLAG_COLLECTABLE;\
+		(vptr)->value.object = _eutask_to_obj(t);\
+	} while (0)
+
+#define _euchannel_to_obj(c) cast(eu_object*, c)
+#define _euobj_to_channel(o) cast(eu_channel*, o)
+#define _euvalue_to_channel(v) _euobj_to_channel((v)->value.object)
+#define _eu_makechannel(vptr, c) do {\
+		(vptr)->type = EU_TYPE_CHANNEL | EU_TYPEFLAG_COLLECTABLE;\
+		(vptr)->value.object = _euchannel_to_obj(c);\
+	} while (0)
+
+/* function declarations */
+eu_task* eutask_new(europa* s, eu_value* thunk);
+int eutask_mark(europa* s, eu_gcmark mark, eu_task* task);
+eu_channel* euchannel_new(europa* s);
+int euchannel_mark(europa* s, eu_gcmark mark, eu_channel* chan);
+
+int eutask_preempt(europa* s);
+int eutask_fail(europa* s, eu_value* obj);
+int eutask_main(europa* s);
+
+/* library */
+int euapi_register_tasks(europa* s);
+
+int euapi_spawn(europa* s);
+int euapi_yield(europa* s);
+int euapi_sleep(europa* s);
+int euapi_join(europa* s);
+int euapi_taskQ(europa* s);
+int euapi_make_channel(europa* s);
+int euapi_channelQ(europa* s);
+int euapi_channel_send(europa* s);
+int euapi_channel_receive(europa* s);
+
+#endif /* __EUROPA_TASK_H__ */
@@ -8,8 +8,12 @@
 
 /* honestly, this is where things that don't have a home yet go */
 
+eu_uinteger eutil_hash_bytes(const void* data, size_t len, eu_uinteger seed);
 eu_uinteger eutil_strb_hash(eu_byte* str, eu_uint len);
 eu_uinteger eutil_cstr_hash(const char* str);
+void eutil_init_hash_seed(void);
+void eutil_set_hash_seed(eu_uinteger seed);
+eu_uinteger eutil_hash_seed(void);
 
 int unicodetoutf8(int c);
 
@@ -4,6 +4,7 @@
  * @author Leonardo G.
  */
 #include "europa/bytevector.h"
+#include "europa/util.h"
 
 #include <string.h>
 
@@ -30,8 +31,15 @@ eu_byte* eubvector_data(eu_bvector* vec) {
 	return _eubvector_data(vec);
 }
 
+/** Hashes the contents of a bytevector.
+ *
+ * Bytevectors are mutable, so this hash changes whenever the contents do.
+ *
+ * @param vec The target bytevector.
+ * @return The hash.
+ */
 eu_uinteger eubvector_hash(eu_bvector* vec) {
-	return cast(eu_integer, vec);
+	return eutil_strb_hash(_eubvector_data(vec), _eubvector_length(vec));
 }
 
 eu_integer eubvector_length(eu_bvector* vec) {
@@ -0,0 +1,404 @@
+/** Compile cache.
+ *
+ * @file cache.c
+ * @author Leonardo G.
+ *
+ * Keeps the prototypes of recently compiled forms by their source text, so
+ * running the same text again (as eu_do_string does with snippets that keep
+ * coming back) skips both reading and compiling it. The cache is bounded in
+ * bytes and drops the least recently used forms first.
+ *
+ * Compiled code may be specialized for the values globals had when it was
+ * compiled (calls to pure builtins are folded, for one). The compiler notes
+ * those globals through eucache_assume and entries are dropped when any of
+ * them changed.
+ */
+#include "europa/cache.h"
+
+#include "europa/error.h"
+#include "europa/gc.h"
+#include "europa/pair.h"
+#include "europa/port.h"
+#include "europa/ports/memory.h"
+#include "europa/string.h"
+#include "europa/table.h"
+
+#include <string.h>
+
+/** gets the bytes a prototype and its subprototypes take */
+static size_t proto_footprint(eu_proto* proto) {
+	size_t size;
+	int i;
+
+	size = sizeof(eu_proto) +
+		sizeof(eu_instruction) * proto->code_length +
+		sizeof(eu_value) * proto->constantc +
+		sizeof(eu_capture) * proto->capturec +
+		sizeof(eu_proto*) * proto->subprotoc;
+	for (i = 0; i < proto->subprotoc; i++) {
+		size += proto_footprint(proto->subprotos[i]);
+	}
+	return size;
+}
+
+static void unlink_entry(eu_cache* cache, eu_centry* entry) {
+	if (entry->newer) {
+		entry->newer->older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+	if (entry->older) {
+		entry->older->newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+	entry->newer = entry->older = NULL;
+}
+
+static void link_newest(eu_cache* cache, eu_centry* entry) {
+	entry->older = cache->newest;
+	entry->newer = NULL;
+	if (cache->newest) {
+		cache->newest->newer = entry;
+	} else {
+		cache->oldest = entry;
+	}
+	cache->newest = entry;
+}
+
+static int remove_entry(europa* s, eu_cache* cache, eu_centry* entry) {
+	_eu_checkreturn(eutable_remove(s, cache->entries, &entry->text));
+	unlink_entry(cache, entry);
+	cache->size -= entry->size;
+	_eugc_free(_eu_gc(s), entry);
+	return EU_RESULT_OK;
+}
+
+/** checks whether the globals an entry's code was specialized for still hold
+ * the same values */
+static int assumptions_hold(europa* s, eu_centry* entry, int* out) {
+	eu_value *current, *assumption, *slot;
+
+	*out = EU_TRUE;
+	for (current = &entry->assumed; _euvalue_is_pair(current);
+		current = _eupair_tail(_euvalue_to_pair(current))) {
+		assumption = _eupair_head(_euvalue_to_pair(current));
+		_eu_checkreturn(eutable_get(s, _eu_global_env(s),
+			_eupair_head(_euvalue_to_pair(assumption)), &slot));
+		if (slot == NULL || _euvalue_type(slot) !=
+			_euvalue_type(_eupair_tail(_euvalue_to_pair(assumption))) ||
+			_euvalue_to_obj(slot) !=
+			_euvalue_to_obj(_eupair_tail(_euvalue_to_pair(assumption)))) {
+			*out = EU_FALSE;
+			break;
+		}
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Sets how many bytes the compile cache may take.
+ *
+ * The cache is off until a limit is set. Setting it to 0 turns the cache off
+ * again, dropping every entry.
+ *
+ * @param s The Europa state.
+ * @param limit The limit, in bytes.
+ * @return The result of the operation.
+ */
+int eucache_set_limit(europa* s, size_t limit) {
+	eu_cache* cache;
+
+	if (!s)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if (limit == 0)
+		return eucache_destroy(s);
+
+	cache = _eu_global(s)->cache;
+	if (cache == NULL) {
+		cache = _eugc_malloc(_eu_gc(s), sizeof(eu_cache));
+		if (cache == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		cache->entries = eutable_new(s, 16);
+		if (cache->entries == NULL) {
+			_eugc_free(_eu_gc(s), cache);
+			return EU_RESULT_BAD_ALLOC;
+		}
+		cache->newest = cache->oldest = NULL;
+		cache->size = 0;
+		cache->assumed = NULL;
+		_eu_global(s)->cache = cache;
+	}
+
+	/* make room if the cache shrunk */
+	cache->limit = limit;
+	while (cache->size > cache->limit) {
+		_eu_checkreturn(remove_entry(s, cache, cache->oldest));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Drops every entry in the compile cache.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int eucache_clear(europa* s) {
+	eu_cache* cache;
+
+	if (!s)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	cache = _eu_global(s)->cache;
+	while (cache && cache->oldest) {
+		_eu_checkreturn(remove_entry(s, cache, cache->oldest));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Looks compiled source text up in the compile cache.
+ *
+ * @param s The Europa state.
+ * @param text The source text.
+ * @param chunk Where to place a chunk running the compiled text, or the empty
+ * list if it isn't in the cache.
+ * @return The result of the operation.
+ */
+int eucache_lookup(europa* s, const char* text, eu_value* chunk) {
+	eu_cache* cache;
+	eu_centry* entry;
+	eu_closure* cl;
+	eu_value* slot;
+	int holds;
+
+	if (!s || !text || !chunk)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_makenull(chunk);
+	cache = _eu_global(s)->cache;
+	if (cache == NULL)
+		return EU_RESULT_OK;
+
+	_eu_checkreturn(eutable_get_string(s, cache->entries, text, &slot));
+	if (slot == NULL)
+		return EU_RESULT_OK;
+	entry = cast(eu_centry*, slot->value.p);
+
+	/* code specialized for globals that changed has to be compiled again */
+	_eu_checkreturn(assumptions_hold(s, entry, &holds));
+	if (!holds)
+		return remove_entry(s, cache, entry);
+
+	unlink_entry(cache, entry);
+	link_newest(cache, entry);
+
+	cl = eucl_new(s, NULL, entry->proto, _eu_global_env(s));
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	cl->own_env = EU_FALSE;
+	_eu_makeclosure(chunk, cl);
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Keeps a compiled form in the compile cache.
+ *
+ * Forms larger than the cache's limit aren't kept. Older entries are dropped
+ * to make room for the new one.
+ *
+ * @param s The Europa state.
+ * @param text The form's source text.
+ * @param proto The form's top level prototype.
+ * @param assumed A list of (name . value) pairs of the globals the code was
+ * specialized for.
+ * @return The result of the operation.
+ */
+int eucache_store(europa* s, const char* text, eu_proto* proto,
+	eu_value* assumed) {
+	eu_cache* cache;
+	eu_centry* entry;
+	eu_string* str;
+	eu_value* slot;
+	size_t size;
+
+	if (!s || !text || !proto || !assumed)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	cache = _eu_global(s)->cache;
+	if (cache == NULL)
+		return EU_RESULT_OK;
+
+	size = sizeof(eu_centry) + strlen(text) + 1 + proto_footprint(proto);
+	if (size > cache->limit)
+		return EU_RESULT_OK;
+
+	/* replace what may be there for the same text */
+	_eu_checkreturn(eutable_get_string(s, cache->entries, text, &slot));
+	if (slot) {
+		_eu_checkreturn(remove_entry(s, cache, cast(eu_centry*, slot->value.p)));
+	}
+
+	str = eustring_new(s, cast(void*, text));
+	if (str == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	entry = _eugc_malloc(_eu_gc(s), sizeof(eu_centry));
+	if (entry == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makestring(&entry->text, str);
+	entry->proto = proto;
+	entry->assumed = *assumed;
+	entry->size = size;
+
+	if (eutable_create_key(s, cache->entries, &entry->text, &slot) || !slot) {
+		_eugc_free(_eu_gc(s), entry);
+		return EU_RESULT_BAD_ALLOC;
+	}
+	_eu_makecpointer(slot, entry);
+	link_newest(cache, entry);
+	cache->size += size;
+
+	/* drop the least recently used entries until it fits */
+	while (cache->size > cache->limit) {
+		_eu_checkreturn(remove_entry(s, cache, cache->oldest));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Compiles the first form in some source text, going through the
+ * compile cache.
+ *
+ * @param s The Europa state.
+ * @param text The source text.
+ * @param chunk Where to place the resulting chunk.
+ * @return The result of the operation.
+ */
+int eucache_compile_string(europa* s, const char* text, eu_value* chunk) {
+	eu_cache* cache;
+	eu_port* port;
+	eu_value form, assumed, *noting;
+	int result;
+
+	if (!s || !text || !chunk)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_checkreturn(eucache_lookup(s, text, chunk));
+	if (!_euvalue_is_null(chunk))
+		return EU_RESULT_OK;
+
+	port = _eumport_to_port(eumport_from_str(s,
+		EU_PORT_FLAG_INPUT | EU_PORT_FLAG_TEXTUAL, cast(void*, text)));
+	if (port == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_checkreturn(euport_read(s, port, &form));
+
+	/* compile it noting what it was specialized for */
+	cache = _eu_global(s)->cache;
+	_eu_makenull(&assumed);
+	noting = cache ? cache->assumed : NULL;
+	if (cache)
+		cache->assumed = &assumed;
+	result = eucode_compile(s, &form, chunk);
+	if (cache)
+		cache->assumed = noting;
+	if (result)
+		return result;
+
+	return eucache_store(s, text, _euvalue_to_closure(chunk)->proto, &assumed);
+}
+
+/**
+ * @brief Notes that the code being compiled relies on a global's value.
+ *
+ * Meant for the compiler, when it specializes code for what a global holds.
+ *
+ * @param s The Europa state.
+ * @param name The global's name.
+ * @param value Its value.
+ * @return The result of the operation.
+ */
+int eucache_assume(europa* s, eu_value* name, eu_value* value) {
+	eu_cache* cache;
+	eu_pair *assumption, *link;
+	eu_value v;
+
+	if (!s || !name || !value)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	cache = _eu_global(s)->cache;
+	if (cache == NULL || cache->assumed == NULL)
+		return EU_RESULT_OK;
+
+	assumption = eupair_new(s, name, value);
+	if (assumption == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&v, assumption);
+	link = eupair_new(s, &v, cache->assumed);
+	if (link == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(cache->assumed, link);
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Marks the compile cache's references.
+ *
+ * @param s The Europa state.
+ * @param mark The marking function.
+ * @param cache The cache.
+ * @return The result of the operation.
+ */
+int eucache_mark(europa* s, eu_gcmark mark, eu_cache* cache) {
+	eu_centry* entry;
+
+	if (!s || !mark || !cache)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_checkreturn(mark(s, _eutable_to_obj(cache->entries)));
+	for (entry = cache->newest; entry; entry = entry->older) {
+		_eu_checkreturn(mark(s, _euvalue_to_obj(&entry->text)));
+		_eu_checkreturn(mark(s, _euproto_to_obj(entry->proto)));
+		if (_euvalue_is_collectable(&entry->assumed)) {
+			_eu_checkreturn(mark(s, _euvalue_to_obj(&entry->assumed)));
+		}
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Turns the compile cache off, releasing it.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int eucache_destroy(europa* s) {
+	eu_cache* cache;
+	eu_centry* entry;
+
+	if (!s)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	cache = _eu_global(s)->cache;
+	if (cache == NULL)
+		return EU_RESULT_OK;
+
+	/* the entry table is left to the collector */
+	while ((entry = cache->oldest)) {
+		unlink_entry(cache, entry);
+		_eugc_free(_eu_gc(s), entry);
+	}
+	_eugc_free(_eu_gc(s), cache);
+	_eu_global(s)->cache = NULL;
+
+	return EU_RESULT_OK;
+}
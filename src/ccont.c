@@ -1,13 +1,15 @@
 #include "europa/ccont.h"
 
 #include "europa/error.h"
+#include "europa/number.h"
+#include "europa/symbol.h"
 
 int eucc_frame(europa* s) {
 	eu_continuation* cont;
 
 	/* create the continuation */
 	cont = eucont_new(s, s->previous, s->env, &(s->rib), s->rib_lastpos, s->ccl,
-		s->pc);
+		s->pc, s->cframe);
 	if (cont == NULL) {
 		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
 			"Could not create continuation."));
@@ -22,8 +24,61 @@ int eucc_frame(europa* s) {
 	return EU_RESULT_OK;
 }
 
-int eucc_define_cclosure(europa* s, eu_table* t, eu_table* env, void* text,
-	eu_cfunc cf) {
+/**
+ * @brief Gets the frame of the running C closure, creating it if needed.
+ *
+ * A new frame has all of its slots set to the empty list and tag 0, so the
+ * closure can tell it is starting. The frame has to be created before the
+ * closure calls back into Europa code, so that it is saved along with the
+ * closure's continuation.
+ *
+ * @param s The Europa state.
+ * @param slotc The number of slots the frame needs.
+ * @param out Where to place the frame.
+ * @return The result of the operation.
+ */
+int eucc_cframe(europa* s, int slotc, eu_cframe** out) {
+	if (!s || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if (s->cframe == NULL) {
+		s->cframe = eucframe_new(s, slotc);
+		if (s->cframe == NULL) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Could not create C closure frame."));
+			return EU_RESULT_ERROR;
+		}
+	}
+
+	*out = s->cframe;
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Calls a procedure from a C closure, resuming the closure when it
+ * returns.
+ *
+ * The closure is called again with the procedure's result in the accumulator
+ * and its frame's tag set to the given tag. The closure must return whatever
+ * this function returns.
+ *
+ * @param s The Europa state.
+ * @param tag The tag to resume the closure with.
+ * @param proc The procedure.
+ * @param args The procedure's arguments.
+ * @return The result of the operation.
+ */
+int eucc_call(europa* s, int tag, eu_value* proc, eu_value* args) {
+	eu_cframe* f;
+
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+	_eucframe_tag(f) = tag;
+	_eu_checkreturn(eucc_frame(s));
+	return euvm_apply(s, proc, args, NULL);
+}
+
+static int define_cclosure(europa* s, eu_table* t, eu_table* env, void* text,
+	eu_cfunc cf, eu_byte leaf) {
 	eu_closure* cl;
 	eu_value* tv, closure;
 
@@ -31,10 +86,14 @@ int eucc_define_cclosure(europa* s, eu_table* t, eu_table* env, void* text,
 	if (!s || !t || !cf)
 		return EU_RESULT_NULL_ARGUMENT;
 
+	/* remember the function's name, so heap images can refer to it */
+	_eu_checkreturn(eucc_register_cfunc(s, text, cf));
+
 	/* create a closure for the cfunction */
 	cl = eucl_new(s, cf, NULL, env);
 	if (cl == NULL)
 		return EU_RESULT_BAD_ALLOC;
+	cl->leaf = leaf;
 
 	/* set the value up */
 	_eu_makeclosure(&closure, cl);
@@ -43,3 +102,204 @@ int eucc_define_cclosure(europa* s, eu_table* t, eu_table* env, void* text,
 	/* define this closure into the table */
 	return eutable_define_symbol(s, t, text, &tv);
 }
+
+int eucc_define_cclosure(europa* s, eu_table* t, eu_table* env, void* text,
+	eu_cfunc cf) {
+	return define_cclosure(s, t, env, text, cf, EU_FALSE);
+}
+
+/**
+ * @brief Defines a C closure whose function never calls back into Europa code.
+ *
+ * Such closures are only ever called with their arguments and return, so
+ * procedures like map can call them directly instead of going through the VM.
+ * The function must never return EU_RESULT_CONTINUE.
+ *
+ * @param s The Europa state.
+ * @param t The table to define the closure in.
+ * @param env The closure's environment.
+ * @param text The closure's name.
+ * @param cf The C function.
+ * @return The result of the operation.
+ */
+int eucc_define_leaf_cclosure(europa* s, eu_table* t, eu_table* env,
+	void* text, eu_cfunc cf) {
+	return define_cclosure(s, t, env, text, cf, EU_TRUE);
+}
+
+/**
+ * @brief Calls a leaf C closure directly, without going through the VM.
+ *
+ * The state's registers are left as they were, so C closures can use this to
+ * call leaf closures in a loop.
+ *
+ * @param s The Europa state.
+ * @param cl The closure. Must have been defined as a leaf.
+ * @param args The argument list.
+ * @param out Where to place the result.
+ * @return The result of the operation.
+ */
+int eucc_apply_leaf(europa* s, eu_closure* cl, eu_value* args, eu_value* out) {
+	eu_closure* ccl;
+	eu_table* env;
+	eu_value rib, *rib_lastpos;
+	eu_continuation* previous;
+	eu_cframe* cframe;
+	unsigned int pc;
+	int result;
+
+	if (!s || !cl || !args || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* save the registers the function may touch */
+	ccl = s->ccl;
+	env = s->env;
+	rib = s->rib;
+	rib_lastpos = s->rib_lastpos;
+	previous = s->previous;
+	cframe = s->cframe;
+	pc = s->pc;
+
+	/* set the state up as the VM would */
+	s->ccl = cl;
+	s->env = cl->env;
+	s->rib = *args;
+	s->rib_lastpos = NULL;
+	s->cframe = NULL;
+	s->pc = 0;
+
+	result = (cl->cf)(s);
+	*out = s->acc;
+
+	s->ccl = ccl;
+	s->env = env;
+	s->rib = rib;
+	s->rib_lastpos = rib_lastpos;
+	s->previous = previous;
+	s->cframe = cframe;
+	s->pc = pc;
+
+	if (result == EU_RESULT_CONTINUE) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Leaf C closure tried calling back into Europa code."));
+		return EU_RESULT_ERROR;
+	}
+	return result;
+}
+
+/**
+ * @brief Registers a C function by name.
+ *
+ * Closures of C functions are written to heap images as the name their
+ * function was registered with and bound again by that name when the image is
+ * restored. Functions defined with eucc_define_cclosure are registered
+ * automatically. Registering a name again binds it to the new function.
+ *
+ * @param s The Europa state.
+ * @param text The function's name.
+ * @param cf The C function.
+ * @return The result of the operation.
+ */
+int eucc_register_cfunc(europa* s, void* text, eu_cfunc cf) {
+	eu_global* gl;
+	eu_symbol* sym;
+	eu_value name, index, *slot;
+
+	if (!s || !text || !cf)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	gl = _eu_global(s);
+	if (gl->cfuncs == NULL) {
+		gl->cfuncs = eutable_new(s, 64);
+		if (gl->cfuncs == NULL)
+			return EU_RESULT_BAD_ALLOC;
+	}
+
+	sym = eusymbol_new(s, text);
+	if (sym == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makesym(&name, sym);
+
+	_eu_checkreturn(eutable_get(s, gl->cfuncs, &name, &slot));
+	if (slot) {
+		gl->cfunc_list[_eunum_i(slot)] = cf;
+		return EU_RESULT_OK;
+	}
+
+	if (gl->cfuncc >= gl->cfuncs_size) {
+		gl->cfuncs_size = gl->cfuncs_size * 2 + 64;
+		gl->cfunc_list = _eugc_realloc(_eu_gc(s), gl->cfunc_list,
+			sizeof(eu_cfunc) * gl->cfuncs_size);
+		if (gl->cfunc_list == NULL)
+			return EU_RESULT_BAD_ALLOC;
+	}
+
+	/* map the name to the index and back */
+	_eu_makeint(&index, gl->cfuncc);
+	_eu_checkreturn(eutable_create_key(s, gl->cfuncs, &name, &slot));
+	*slot = index;
+	_eu_checkreturn(eutable_create_key(s, gl->cfuncs, &index, &slot));
+	*slot = name;
+
+	gl->cfunc_list[gl->cfuncc++] = cf;
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets the name a C function was registered with.
+ *
+ * @param s The Europa state.
+ * @param cf The C function.
+ * @param out Where to place the name (a symbol), or the empty list if the
+ * function was never registered.
+ * @return The result of the operation.
+ */
+int eucc_cfunc_name(europa* s, eu_cfunc cf, eu_value* out) {
+	eu_global* gl;
+	eu_value index, *slot;
+	int i;
+
+	if (!s || !cf || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* this is only needed when writing heap images, so a search will do */
+	gl = _eu_global(s);
+	_eu_makenull(out);
+	for (i = 0; i < gl->cfuncc; i++) {
+		if (gl->cfunc_list[i] == cf) {
+			_eu_makeint(&index, i);
+			_eu_checkreturn(eutable_get(s, gl->cfuncs, &index, &slot));
+			if (slot)
+				*out = *slot;
+			break;
+		}
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets the C function registered with a name.
+ *
+ * @param s The Europa state.
+ * @param name The name (a symbol).
+ * @param out Where to place the function, NULL if there is none.
+ * @return The result of the operation.
+ */
+int eucc_find_cfunc(europa* s, eu_value* name, eu_cfunc* out) {
+	eu_global* gl;
+	eu_value* slot;
+
+	if (!s || !name || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	gl = _eu_global(s);
+	*out = NULL;
+	if (gl->cfuncs == NULL || !_euvalue_is_type(name, EU_TYPE_SYMBOL))
+		return EU_RESULT_OK;
+
+	_eu_checkreturn(eutable_get(s, gl->cfuncs, name, &slot));
+	if (slot)
+		*out = gl->cfunc_list[_eunum_i(slot)];
+	return EU_RESULT_OK;
+}
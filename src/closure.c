@@ -10,9 +10,8 @@
 /**
  * @brief Creates a new closure.
  *
- * If the closure is an Europa one, it also intializes the closure's environment,
- * creating slots for each formal parameter and setting its "up environment"
- * to the passed argument, the creation environment.
+ * Europa closures get room for the free variables their prototype captures,
+ * which start out as the empty list.
  *
  * @param s The Europa state.
  * @param cf The C function to close. (Only if C function.)
@@ -22,12 +21,13 @@
  */
 eu_closure* eucl_new(europa* s, eu_cfunc cf, eu_proto* proto, eu_table* env) {
 	eu_closure* cl;
-	int length, improper, i;
+	int length, improper, i, freec;
 	eu_value *tv, *cv;
 
-	/* allocate the closure */
+	/* allocate the closure, with its free variables right after it */
+	freec = proto ? proto->capturec : 0;
 	cl = _euobj_to_closure(eugc_new_object(s, EU_TYPE_CLOSURE |
-		EU_TYPEFLAG_COLLECTABLE, sizeof(eu_closure)));
+		EU_TYPEFLAG_COLLECTABLE, sizeof(eu_closure) + freec * sizeof(eu_value)));
 	if (cl == NULL)
 		return NULL;
 
@@ -35,6 +35,11 @@ eu_closure* eucl_new(europa* s, eu_cfunc cf, eu_proto* proto, eu_table* env) {
 	cl->proto = proto; /* set the prototype */
 	cl->env = env; /* set the creation environment */
 	cl->own_env = 1; /* set the closure  */
+	cl->leaf = EU_FALSE; /* C functions may call back unless told otherwise */
+	cl->freec = freec;
+	cl->free = cast(eu_value*, cl + 1);
+	for (i = 0; i < freec; i++)
+		_eu_makenull(&cl->free[i]);
 
 	return cl;
 
@@ -82,6 +87,8 @@ eu_closure* eucl_new(europa* s, eu_cfunc cf, eu_proto* proto, eu_table* env) {
  * @return The result of the operation.
  */
 int eucl_mark(europa* s, eu_gcmark mark, eu_closure* cl) {
+	int i;
+
 	if (!s || !mark || !cl)
 		return EU_RESULT_NULL_ARGUMENT;
 
@@ -93,6 +100,12 @@ int eucl_mark(europa* s, eu_gcmark mark, eu_closure* cl) {
 		_eu_checkreturn(mark(s, _eutable_to_obj(cl->env)));
 	}
 
+	for (i = 0; i < cl->freec; i++) {
+		if (_euvalue_is_collectable(&cl->free[i])) {
+			_eu_checkreturn(mark(s, _euvalue_to_obj(&cl->free[i])));
+		}
+	}
+
 	return EU_RESULT_OK;
 }
 
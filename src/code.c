@@ -3,6 +3,13 @@
 #include "europa/symbol.h"
 #include "europa/error.h"
 #include "europa/util.h"
+#include "europa/number.h"
+#include "europa/string.h"
+#include "europa/cache.h"
+#include "europa/ccont.h"
+
+#include <stdio.h>
+#include <string.h>
 
 
 #define opc_part(op) ((op & OPCMASK) << OPCSHIFT)
@@ -22,8 +29,44 @@
 #define IRETURN() (opc_part(EU_OP_RETURN) | val_part(0))
 #define IFRAME(return_to) (opc_part(EU_OP_FRAME) | offset_part(return_to))
 #define IDEFINE(k) (opc_part(EU_OP_DEFINE) | val_part(k))
-
-int compile(europa* s, eu_proto* proto, eu_value* v, int is_tail);
+#define IGREFER(k) (opc_part(EU_OP_GREFER) | val_part(k))
+#define IFREFER(k) (opc_part(EU_OP_FREFER) | val_part(k))
+#define IFASSIGN(k) (opc_part(EU_OP_FASSIGN) | val_part(k))
+#define IGUARD(k) (opc_part(EU_OP_GUARD) | val_part(k))
+#define ICONTI_FRAME(return_to) (opc_part(EU_OP_CONTI_FRAME) | offset_part(return_to))
+
+/* what kind of form opened a scope */
+#define SCOPE_LAMBDA 0 /* a procedure, with its own environment */
+#define SCOPE_LET 1 /* a let form bound in the enclosing procedure's environment */
+#define SCOPE_LOOP 2 /* a named let whose self calls are jumps */
+#define SCOPE_INLINE 3 /* an inlined procedure's formals, bound like a let form's */
+
+/* tail position flags */
+#define TAIL_RETURN 1 /* the form's value is returned by the procedure */
+#define TAIL_LOOP 2 /* the form's value ends an iteration of the innermost named let */
+
+/** The variables bound by a form that is being compiled. */
+struct europa_compile_scope {
+	eu_cscope* previous; /*!< the enclosing scope */
+	eu_table* bound; /*!< bound names, mapped to their names in the environment */
+	int kind; /*!< what kind of form opened this scope */
+	/* procedures */
+	eu_proto* proto; /*!< the procedure's prototype (or the inlined one's) */
+	eu_table* free; /*!< free variable indices, by name in the environment */
+	eu_table* mutated; /*!< bound names that may change after being bound */
+	/* named let loops */
+	eu_value name; /*!< the loop's name, bound to null */
+	eu_value vars; /*!< the loop variables' names in the environment */
+	eu_value temps; /*!< temporaries for all loop variables but the last */
+	int start; /*!< the index of the loop body's first instruction */
+	int in_tail; /*!< whether the loop ends iterations of enclosing loops */
+	int failed; /*!< whether some use of the name can't be a jump */
+};
+
+int compile(europa* s, eu_cscope* sc, eu_proto* proto, eu_value* v,
+	int is_tail);
+int compile_application(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
 
 int check_formals(europa* s, eu_value* formals) {
 	eu_value* v;
@@ -61,325 +104,2040 @@ int check_formals(europa* s, eu_value* formals) {
 	return EU_RESULT_ERROR;
 }
 
-int compile_application(europa* s, eu_proto* proto, eu_value* v, int is_tail) {
-	eu_value *head, *tail;
-	int length, improper, index, aux;
-	eu_proto* subproto;
-	eu_symbol* beginsymbol;
-	eu_value beginsym, beginpair;
+static int compile_quote(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+static int compile_lambda(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+static int compile_define(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+static int compile_set(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+static int compile_guard(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+static int compile_call(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+
+/**
+ * @brief Finds the special form a form's head names.
+ *
+ * @param s The Europa state.
+ * @param head The form's head.
+ * @param out Where to place the syntax. NULL if head is not a keyword.
+ * @return The result of the operation.
+ */
+int find_syntax(europa* s, eu_value* head, const eu_syntax** out) {
+	eu_value* slot;
+
+	*out = NULL;
+	if (!_euvalue_is_type(head, EU_TYPE_SYMBOL))
+		return EU_RESULT_OK;
+
+	_eu_checkreturn(eutable_get(s, _eu_global(s)->syntax, head, &slot));
+	if (slot != NULL)
+		*out = cast(const eu_syntax*, slot->value.p);
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Adds every name defined in a lambda body to its scope.
+ *
+ * Defines may appear anywhere in the body, so every form is searched except for
+ * quoted data and nested lambdas, which have scopes of their own. Searching
+ * too much only makes some global references slower.
+ *
+ * Defined names are bound after the procedure starts running, so they count as
+ * mutated.
+ *
+ * @param s The Europa state.
+ * @param sc The lambda's scope.
+ * @param v The form to search.
+ * @return The result of the operation.
+ */
+int collect_defines(europa* s, eu_cscope* sc, eu_value* v) {
+	eu_value *head, *name, *slot;
+	const eu_syntax* syntax;
+
+	if (!_euvalue_is_type(v, EU_TYPE_PAIR))
+		return EU_RESULT_OK;
 
 	head = _eupair_head(_euvalue_to_pair(v));
-	tail = _eupair_tail(_euvalue_to_pair(v));
+	_eu_checkreturn(find_syntax(s, head, &syntax));
+	if (syntax != NULL) {
+		if (syntax->compile == compile_quote || syntax->compile == compile_lambda)
+			return EU_RESULT_OK;
 
-	/* check whether head is a symbol */
-	if (euvalue_is_type(head, EU_TYPE_SYMBOL)) {
-		/* in which case it may be a special construct */
-		if (eusymbol_equal_cstr(head, "quote")) { /* (quote obj) */
-			/* make sure arity is correct */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"quote can't be called in an improper list."));
-				return EU_RESULT_ERROR;
+		if (syntax->compile == compile_define
+			&& _euvalue_is_type(_eupair_tail(_euvalue_to_pair(v)), EU_TYPE_PAIR)) {
+			name = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+			/* (define (name . formals) body ...) defines a lambda */
+			if (_euvalue_is_type(name, EU_TYPE_PAIR)) {
+				name = _eupair_head(_euvalue_to_pair(name));
+				v = &_null;
 			}
-			if (length != 1) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"bad quote arity: expected 1 argument, got %d.", length));
-				return EU_RESULT_ERROR;
+			if (_euvalue_is_type(name, EU_TYPE_SYMBOL)) {
+				_eu_checkreturn(eutable_create_key(s, sc->bound, name, &slot));
+				*slot = *name;
+				_eu_checkreturn(eutable_create_key(s, sc->mutated, name, &slot));
+				*slot = *name;
 			}
+			if (_euvalue_is_null(v))
+				return EU_RESULT_OK;
+		}
+	}
 
-			/* add the quote's argument to the constant list */
+	/* search the sub forms */
+	for (; _euvalue_is_type(v, EU_TYPE_PAIR); v = _eupair_tail(_euvalue_to_pair(v)))
+		_eu_checkreturn(collect_defines(s, sc, _eupair_head(_euvalue_to_pair(v))));
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Adds every name a form assigns to with set! to a table.
+ *
+ * Nested lambdas are searched too, and shadowing is ignored, so the table may
+ * have more names than needed. Those are only shared by closures when they
+ * could be copied.
+ *
+ * @param s The Europa state.
+ * @param mutated The table of mutated names.
+ * @param v The form to search.
+ * @return The result of the operation.
+ */
+int collect_assigned(europa* s, eu_table* mutated, eu_value* v) {
+	eu_value *tail, *slot;
+	const eu_syntax* syntax;
+
+	if (!_euvalue_is_type(v, EU_TYPE_PAIR))
+		return EU_RESULT_OK;
+
+	_eu_checkreturn(find_syntax(s, _eupair_head(_euvalue_to_pair(v)), &syntax));
+	if (syntax != NULL) {
+		if (syntax->compile == compile_quote)
+			return EU_RESULT_OK;
+
+		tail = _eupair_tail(_euvalue_to_pair(v));
+		if (syntax->compile == compile_set && _euvalue_is_type(tail, EU_TYPE_PAIR)
+			&& _euvalue_is_type(_eupair_head(_euvalue_to_pair(tail)),
+				EU_TYPE_SYMBOL)) {
+			_eu_checkreturn(eutable_create_key(s, mutated,
+				_eupair_head(_euvalue_to_pair(tail)), &slot));
+			*slot = *_eupair_head(_euvalue_to_pair(tail));
+		}
+	}
+
+	/* search the sub forms */
+	for (; _euvalue_is_type(v, EU_TYPE_PAIR); v = _eupair_tail(_euvalue_to_pair(v)))
+		_eu_checkreturn(collect_assigned(s, mutated, _eupair_head(_euvalue_to_pair(v))));
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Creates the scope for a lambda being compiled.
+ *
+ * @param s The Europa state.
+ * @param previous The enclosing scope. NULL at the top level.
+ * @param sc The scope to initialize.
+ * @param proto The lambda's prototype.
+ * @param formals The lambda's formals.
+ * @param body The lambda's body.
+ * @return The result of the operation.
+ */
+int open_scope(europa* s, eu_cscope* previous, eu_cscope* sc, eu_proto* proto,
+	eu_value* formals, eu_value* body) {
+	eu_value* slot;
+
+	sc->previous = previous;
+	sc->kind = SCOPE_LAMBDA;
+	sc->proto = proto;
+	sc->bound = eutable_new(s, 0);
+	sc->free = eutable_new(s, 0);
+	sc->mutated = eutable_new(s, 0);
+	if (sc->bound == NULL || sc->free == NULL || sc->mutated == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	/* add the formals */
+	for (; _euvalue_is_type(formals, EU_TYPE_PAIR);
+		formals = _eupair_tail(_euvalue_to_pair(formals))) {
+		_eu_checkreturn(eutable_create_key(s, sc->bound,
+			_eupair_head(_euvalue_to_pair(formals)), &slot));
+		*slot = *_eupair_head(_euvalue_to_pair(formals));
+	}
+	if (_euvalue_is_type(formals, EU_TYPE_SYMBOL)) {
+		_eu_checkreturn(eutable_create_key(s, sc->bound, formals, &slot));
+		*slot = *formals;
+	}
+
+	/* and whatever the body defines, noting what may change */
+	for (; _euvalue_is_type(body, EU_TYPE_PAIR);
+		body = _eupair_tail(_euvalue_to_pair(body))) {
+		_eu_checkreturn(collect_defines(s, sc,
+			_eupair_head(_euvalue_to_pair(body))));
+		_eu_checkreturn(collect_assigned(s, sc->mutated,
+			_eupair_head(_euvalue_to_pair(body))));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Finds the scope that binds a name.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param name The name.
+ * @param where Where to place the binding scope. NULL if no scope binds the
+ * name, in which case it can only refer to a global variable.
+ * @param out Where to place the name the variable has in the environment.
+ * Null if it names the loop of a named let.
+ * @return The result of the operation.
+ */
+int resolve_name(europa* s, eu_cscope* sc, eu_value* name, eu_cscope** where,
+	eu_value** out) {
+	eu_value* slot;
+
+	for (; sc != NULL; sc = sc->previous) {
+		_eu_checkreturn(eutable_get(s, sc->bound, name, &slot));
+		if (slot != NULL) {
+			*where = sc;
+			*out = slot;
+			return EU_RESULT_OK;
+		}
+	}
+
+	*where = NULL;
+	*out = name;
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets the index of a procedure's free variable, adding it to the
+ * procedure's prototype (and those of enclosing procedures) if needed.
+ *
+ * @param s The Europa state.
+ * @param lambda The procedure's scope.
+ * @param where The scope binding the variable.
+ * @param name The variable's name in the environment.
+ * @param index Where to place the free variable's index.
+ * @return The result of the operation.
+ */
+int capture_variable(europa* s, eu_cscope* lambda, eu_cscope* where,
+	eu_value* name, int* index) {
+	eu_capture capture;
+	eu_cscope* it;
+	eu_value* slot;
+
+	_eu_checkreturn(eutable_get(s, lambda->free, name, &slot));
+	if (slot != NULL) {
+		*index = cast(int, _eunum_i(slot));
+		return EU_RESULT_OK;
+	}
+
+	/* the creating procedure either binds the variable or has it free */
+	for (it = lambda->previous; it != where && it->kind != SCOPE_LAMBDA;
+		it = it->previous);
+	capture.from_free = it != where;
+	capture.index = 0;
+	if (capture.from_free)
+		_eu_checkreturn(capture_variable(s, it, where, name, &capture.index));
+
+	/* variables that may change are shared through their frame, let forms
+	 * rebind theirs in loops */
+	capture.shared = EU_TRUE;
+	if (where->kind == SCOPE_LAMBDA) {
+		_eu_checkreturn(eutable_get(s, where->mutated, name, &slot));
+		capture.shared = slot != NULL;
+	}
+
+	_eu_checkreturn(euproto_add_constant(s, lambda->proto, name, &capture.name));
+	_eu_checkreturn(euproto_add_capture(s, lambda->proto, &capture, index));
+
+	_eu_checkreturn(eutable_create_key(s, lambda->free, name, &slot));
+	_eu_makeint(slot, *index);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Finds out whether a bound variable is free where it is used.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param where The scope binding the variable.
+ * @param name The variable's name in the environment.
+ * @param index Where to place the free variable's index, -1 if the variable
+ * is bound by the running procedure.
+ * @return The result of the operation.
+ */
+int variable_access(europa* s, eu_cscope* sc, eu_cscope* where,
+	eu_value* name, int* index) {
+	for (; sc != where; sc = sc->previous) {
+		if (sc->kind == SCOPE_LAMBDA)
+			return capture_variable(s, sc, where, name, index);
+	}
+
+	*index = -1;
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Compiles a list of expressions in order.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The target prototype.
+ * @param body The (non empty) list of expressions.
+ * @param is_tail Whether the last expression is in tail position.
+ * @return The result of the operation.
+ */
+int compile_body(europa* s, eu_cscope* sc, eu_proto* proto, eu_value* body,
+	int is_tail) {
+	eu_value* v;
+
+	/* compile expressions in order */
+	for (v = body; !_euvalue_is_null(v); v = _eupair_tail(_euvalue_to_pair(v))) {
+		_eu_checkreturn(compile(s, sc, proto,
+			_eupair_head(_euvalue_to_pair(v)),
+			/* in case this is the last expression in the body it should be a
+			 * tail call if the body is in the tail */
+			_euvalue_is_null(_eupair_tail(_euvalue_to_pair(v)))
+			? is_tail : 0));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Compiles a procedure into a sub-prototype and adds the instruction
+ * that closes over it.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The prototype the procedure is created in.
+ * @param formals The procedure's (checked) formals.
+ * @param body The procedure's body.
+ * @param source The procedure's source form.
+ * @return The result of the operation.
+ */
+int compile_procedure(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* formals, eu_value* body, eu_value* source) {
+	eu_proto* subproto;
+	eu_cscope inner, *it;
+	int index;
+
+	/* the procedure would share the variables that loops compiled in place
+	 * bind again at every iteration (say, through a named let that fell back to
+	 * a procedure or an inlined body), so those loops have to be procedures */
+	for (it = sc; it != NULL && it->kind != SCOPE_LAMBDA; it = it->previous) {
+		if (it->kind == SCOPE_LOOP)
+			it->failed = EU_TRUE;
+	}
+
+	/* create a prototype from the formals and source */
+	subproto = euproto_new(s, formals, 0, source, 0, 0);
+	if (subproto == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	/* find out which names the body binds */
+	_eu_checkreturn(open_scope(s, sc, &inner, subproto, formals, body));
+	/* compile the body */
+	_eu_checkreturn(compile_body(s, &inner, subproto, body, TAIL_RETURN));
+	/* add a return instruction */
+	_eu_checkreturn(euproto_append_instruction(s, subproto, IRETURN()));
+	/* clean the code up */
+	if (_eu_global(s)->peephole)
+		_eu_checkreturn(eucode_peephole(s, subproto));
+	/* its code is complete */
+	_eu_checkreturn(euproto_seal(s, subproto));
+	/* add the compiled prototype as a subprototype */
+	_eu_checkreturn(euproto_add_subproto(s, proto, subproto, &index));
+	/* add a close instruction */
+	_eu_checkreturn(euproto_append_instruction(s, proto, ICLOSE(index)));
+
+	return EU_RESULT_OK;
+}
+
+/* (quote obj) */
+static int compile_quote(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value* tail;
+	int length, improper, index;
+
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* make sure arity is correct */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"quote can't be called in an improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length != 1) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"bad quote arity: expected 1 argument, got %d.", length));
+		return EU_RESULT_ERROR;
+	}
+
+	/* add the quote's argument to the constant list */
+	tail = _eupair_head(_euvalue_to_pair(tail));
+	_eu_checkreturn(euproto_add_constant(s, proto, tail, &index));
+
+	/* add the const instruction to the code */
+	_eu_checkreturn(euproto_append_instruction(s, proto, ICONST(index)));
+
+	return EU_RESULT_OK;
+}
+
+/* (lambda formals body...) */
+static int compile_lambda(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *head, *tail;
+	int length, improper;
+
+	head = _eupair_head(_euvalue_to_pair(v));
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* check arity */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"lambda can't be used with an improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length < 2) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"lambda expects at least <formals> and one expression for the <body>."));
+		return EU_RESULT_ERROR;
+	}
+
+	/* compile the function's body */
+	head = _eupair_head(_euvalue_to_pair(tail)); /* get the formals */
+	tail = _eupair_tail(_euvalue_to_pair(tail)); /* get the list containing the body */
+
+	/* check whether formals are valid */
+	_eu_checkreturn(check_formals(s, head));
+
+	/* compile the procedure and place it in the accumulator */
+	_eu_checkreturn(compile_procedure(s, sc, proto, head, tail, v));
+
+	return EU_RESULT_OK;
+}
+
+/* (if test then else) */
+static int compile_if(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *head, *tail;
+	int length, improper, index;
+
+	head = _eupair_head(_euvalue_to_pair(v));
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* check arity */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"if can't be used with improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length > 3 || length <= 1) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"bad if arity: expected 2 or 3 arguments, got %d.", length));
+		return EU_RESULT_ERROR;
+	}
+
+	/* compile the test argument */
+	head = _eupair_head(_euvalue_to_pair(tail)); /* test */
+	_eu_checkreturn(compile(s, sc, proto, head, 0)); /* test is never in tail position */
+
+	/* because the offset of the false branch is not yet known (no
+	 * branches have been compiled), insert a placeholder offset and
+	 * save the instruction's index in order to update it later */
+	index = proto->code_length; /* get instruction index */
+	_eu_checkreturn(euproto_append_instruction(s, proto, ITEST(0)));
+
+	/* compile true branch */
+	tail = _eupair_tail(_euvalue_to_pair(tail)); /* (true . (false . '())) */
+	head = _eupair_head(_euvalue_to_pair(tail)); /* true */
+	_eu_checkreturn(compile(s, sc, proto, head, is_tail)); /* is in tail position if this is in tail position*/
+
+	/* check if there is a false branch */
+	if (!_euvalue_is_null(_eupair_tail(_euvalue_to_pair(tail)))) {
+		/* add a jump instruction to skip the false branch, where to jump
+		* is still not defined, though, so we'll have to do the same as
+		* with the test instruction */
+		length = proto->code_length; /* the index of the jump instruction */
+		_eu_checkreturn(euproto_append_instruction(s, proto, IJUMP(0)));
+
+		/* compile false branch */
+		tail = _eupair_tail(_euvalue_to_pair(tail)); /* (false . '()) */
+		head = _eupair_head(_euvalue_to_pair(tail)); /* false */
+		_eu_checkreturn(compile(s, sc, proto, head, is_tail)); /* is in tail position if this is in tail position */
+		improper = proto->code_length; /* the index of the instruction after the false branch*/
+
+		/* update the test instruction */
+		proto->code[index] = ITEST(length + 1 - index);
+		/* update the jump instruction */
+		proto->code[length] = IJUMP(improper - length);
+	} else {
+		/* update the test statement to point to after the true branch */
+		proto->code[index] = ITEST(proto->code_length - index);
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Keeps track of the procedure a global variable is defined to by the
+ * form being compiled, so that calls after the definition can be inlined.
+ *
+ * @param s The Europa state.
+ * @param name The variable's name.
+ * @param subproto The procedure's prototype. NULL if the variable gets some
+ * other value (or is assigned to).
+ * @return The result of the operation.
+ */
+static int note_definition(europa* s, eu_value* name, eu_proto* subproto) {
+	eu_global* gl;
+	eu_value* slot;
+
+	gl = _eu_global(s);
+	if (gl->unit == NULL) {
+		if (subproto == NULL)
+			return EU_RESULT_OK;
+		gl->unit = eutable_new(s, 0);
+		if (gl->unit == NULL)
+			return EU_RESULT_BAD_ALLOC;
+	}
+
+	_eu_checkreturn(eutable_create_key(s, gl->unit, name, &slot));
+	if (subproto == NULL) {
+		*slot = _null;
+	} else {
+		_eu_makeproto(slot, subproto);
+	}
+
+	return EU_RESULT_OK;
+}
+
+/* (set! var value) */
+static int compile_set(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *head, *tail, *name;
+	eu_cscope* where;
+	int length, improper, index;
+
+	head = _eupair_head(_euvalue_to_pair(v));
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* check arity */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"set! can't be used in an improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length != 2) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"bad set! arity: expected 2 arguments, got %d.", length));
+		return EU_RESULT_ERROR;
+	}
+
+	/* check if variable name parameter is actually a symbol */
+	head = _eupair_head(_euvalue_to_pair(tail));
+	if (!_euvalue_is_type(head, EU_TYPE_SYMBOL)) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"bad set! syntax, expected first argument to be an identifier (symbol)."));
+		return EU_RESULT_ERROR;
+	}
+
+	/* compile the value parameter */
+	tail = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(tail))));
+	_eu_checkreturn(compile(s, sc, proto, tail, 0)); /* the set variable name is never in tail position */
+
+	/* find the variable's name in the environment */
+	_eu_checkreturn(resolve_name(s, sc, head, &where, &name));
+	if (_euvalue_is_null(name)) {
+		/* assigning to a named let's procedure */
+		where->failed = EU_TRUE;
+		name = head;
+	}
+
+	/* variables of enclosing procedures are the closure's free variables */
+	if (where != NULL) {
+		_eu_checkreturn(variable_access(s, sc, where, name, &index));
+		if (index >= 0)
+			return euproto_append_instruction(s, proto, IFASSIGN(index));
+	}
+
+	/* globals that are assigned to aren't inlined */
+	if (where == NULL)
+		_eu_checkreturn(note_definition(s, name, NULL));
+
+	/* add name symbol to the constant list */
+	_eu_checkreturn(euproto_add_constant(s, proto, name, &index));
+	/* append the assign instruction */
+	_eu_checkreturn(euproto_append_instruction(s, proto, IASSIGN(index)));
+
+	return EU_RESULT_OK;
+}
+
+/* (define name value) or (define (name . formals) body...) */
+static int compile_define(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *head, *tail;
+	const eu_syntax* syntax;
+	int length, improper, index;
+
+	head = _eupair_head(_euvalue_to_pair(v));
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* check arity */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"define can't be used in an improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length < 2) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"bad define arity: expected at least 2 arguments, got %d.", length));
+		return EU_RESULT_ERROR;
+	}
+
+	/* make head be name or (name args ...) or (name . arglist) */
+	head = _eupair_head(_euvalue_to_pair(tail));
+	/* cell of third parameter */
+	tail = _eupair_tail(_euvalue_to_pair(tail));
+
+	/* (define name value) */
+	if (_euvalue_is_type(head, EU_TYPE_SYMBOL)) {
+
+		/* compile the value parameter */
+		/* the set variable name is never in tail position */
+		_eu_checkreturn(compile(s, sc, proto,
+			_eupair_head(_euvalue_to_pair(tail)), 0));
+
+		/* top level definitions of procedures can be inlined */
+		if (sc == NULL) {
+			syntax = NULL;
 			tail = _eupair_head(_euvalue_to_pair(tail));
-			_eu_checkreturn(euproto_add_constant(s, proto, tail, &index));
+			if (_euvalue_is_type(tail, EU_TYPE_PAIR))
+				_eu_checkreturn(find_syntax(s, _eupair_head(_euvalue_to_pair(tail)),
+					&syntax));
+			_eu_checkreturn(note_definition(s, head,
+				syntax != NULL && syntax->compile == compile_lambda
+				? proto->subprotos[proto->subprotoc - 1] : NULL));
+		}
+
+		/* add name symbol to the constant list */
+		_eu_checkreturn(euproto_add_constant(s, proto, head, &index));
+		/* append the define instruction */
+		_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+
+		return EU_RESULT_OK;
+	}
+
+	/* (define (name args ...) body ...) also (name args . named) */
+	if (_euvalue_is_type(head, EU_TYPE_PAIR)) {
+
+		/* check whether formals are valid */
+		_eu_checkreturn(check_formals(s, _eupair_tail(_euvalue_to_pair(head))));
+
+		/* compile the procedure and place it in the accumulator */
+		_eu_checkreturn(compile_procedure(s, sc, proto,
+			_eupair_tail(_euvalue_to_pair(head)), tail, v));
+		if (sc == NULL) {
+			_eu_checkreturn(note_definition(s, _eupair_head(_euvalue_to_pair(head)),
+				proto->subprotos[proto->subprotoc - 1]));
+		}
+
+		/* add name symbol to the constant list */
+		_eu_checkreturn(euproto_add_constant(s, proto, _eupair_head(_euvalue_to_pair(head)), &index));
+		/* append the define instruction */
+		_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+
+		return EU_RESULT_OK;
+	}
+
+	_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+		"define's name is of invalid type %s. Expected symbol or list.",
+		eu_type_name(_euvalue_type(head))));
+	return EU_RESULT_ERROR;
+}
+
+/* (call/cc proc) */
+static int compile_callcc(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value* tail;
+	int length, improper;
+
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* check arity */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"call/cc can't be used in an improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length != 1) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"bad call/cc arity: expected 1 arguments, got %d.", length));
+		return EU_RESULT_ERROR;
+	}
+
+	/* TODO: if anything bad happens, check the code below (everything,
+	 * even after the else if */
+
+	/* create continuation instruction, which in case this isn't a tail call
+	 * also pushes the continuation as the return frame (CONTI and FRAME
+	 * would capture exactly the same state) */
+	improper = proto->code_length;
+	_eu_checkreturn(euproto_append_instruction(s, proto,
+		(is_tail & TAIL_RETURN) ? ICONTI(0) : ICONTI_FRAME(0)));
+
+	/* the reason why the frame is created _after_ the continuation is put
+	 * in the accumulator is because if we created the continuation after
+	 * the creation of the frame, restoring the continuation would restore
+	 * also the created frame just below the stack, which breaks everything
+	 * an example of code that would break if the frame was created before
+	 * creating the continuation is:
+	 * ((lambda ()
+	 *     (define counter 0)
+	 *     (define conti #f)
+	 *     (call/cc (lambda (c) (set! conti c)))
+	 *
+	 *     (display counter) (newline)
+	 *     (set! counter (+ counter 1))
+	 *
+	 *     (if (= counter 5)
+	 *         #t
+	 *         (conti))))
+	 * the frame is therefore pushed only after the continuation is captured,
+	 * and since nothing changes in between, the continuation itself is the
+	 * frame.
+	 */
+
+	/* add it to the argument rib */
+	_eu_checkreturn(euproto_append_instruction(s, proto, IARGUMENT()));
+
+	/* compile the argument (which shouldn't be considered to be in tail position) */
+	_eu_checkreturn(compile(s, sc, proto, _eupair_head(_euvalue_to_pair(tail)), 0));
+
+	/* apply */
+	_eu_checkreturn(euproto_append_instruction(s, proto, IAPPLY()));
+
+	/* correct the continuation instruction's offset */
+	proto->code[improper] = (is_tail & TAIL_RETURN) ?
+		ICONTI(proto->code_length - improper) :
+		ICONTI_FRAME(proto->code_length - improper);
+
+	return EU_RESULT_OK;
+}
+
+/* (begin body...) */
+static int compile_begin(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value* tail;
+	int length, improper;
+
+	tail = _eupair_tail(_euvalue_to_pair(v));
+
+	/* check arity */
+	length = eutil_list_length(s, tail, &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"begin can't be used in an improper list."));
+		return EU_RESULT_ERROR;
+	}
+	if (length == 0) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"begin needs at least one expression in its body."));
+		return EU_RESULT_ERROR;
+	}
 
-			/* add the const instruction to the code */
-			_eu_checkreturn(euproto_append_instruction(s, proto, ICONST(index)));
+	return compile_body(s, sc, proto, tail, is_tail);
+}
+
+/**
+ * @brief Creates the name a variable bound by a let form has in the
+ * environment.
+ *
+ * Let forms bind their variables in the enclosing procedure's environment, so
+ * they get names no program can read, unique to the state.
+ *
+ * @param s The Europa state.
+ * @param name The variable's name.
+ * @param out Where to place the generated name.
+ * @return The result of the operation.
+ */
+static int hidden_name(europa* s, eu_value* name, eu_value* out) {
+	char buffer[256];
+	eu_symbol* sym;
+
+	snprintf(buffer, sizeof(buffer), "#%.200s:%u",
+		_euvalue_is_type(name, EU_TYPE_SYMBOL)
+		? _eusymbol_text(_euvalue_to_symbol(name)) : "",
+		_eu_global(s)->hidden_names++);
+
+	sym = eusymbol_new(s, buffer);
+	if (sym == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makesym(out, sym);
+
+	return EU_RESULT_OK;
+}
+
+/* creates a pair while building forms */
+static int cons(europa* s, eu_value* head, eu_value* tail, eu_value* out) {
+	eu_pair* pair;
 
+	pair = eupair_new(s, head, tail);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(out, pair);
+
+	return EU_RESULT_OK;
+}
+
+/* gets a keyword's symbol while building forms, see EU_KEYWORD_LAMBDA */
+static void keyword(europa* s, int which, eu_value* out) {
+	_eu_makesym(out, _eu_global(s)->keywords[which]);
+}
+
+/**
+ * @brief Checks whether a form may create procedures.
+ *
+ * Procedures created while a let form's variables are bound could keep them
+ * alive past the form or, in loops, see them change between iterations, so
+ * those forms need environments of their own. Internal defines need one too.
+ * Forms that only create procedures when they fall back to one (named lets,
+ * do loops and inlined bodies) are caught by compile_procedure instead.
+ *
+ * @param s The Europa state.
+ * @param v The form (or list of forms).
+ * @param out Set if the form may create procedures, left untouched otherwise.
+ * @return The result of the operation.
+ */
+static int may_capture(europa* s, eu_value* v, int* out) {
+	const eu_syntax* syntax;
+
+	if (!_euvalue_is_type(v, EU_TYPE_PAIR))
+		return EU_RESULT_OK;
+
+	_eu_checkreturn(find_syntax(s, _eupair_head(_euvalue_to_pair(v)), &syntax));
+	if (syntax != NULL) {
+		if (syntax->compile == compile_quote)
 			return EU_RESULT_OK;
-		} else if (eusymbol_equal_cstr(head, "lambda")) { /* (lambda formals body...) */
-			/* check arity */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"lambda can't be used with an improper list."));
-				return EU_RESULT_ERROR;
-			}
-			if (length < 2) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"lambda expects at least <formals> and one expression for the <body>."));
-				return EU_RESULT_ERROR;
-			}
+		if (syntax->compile == compile_lambda || syntax->compile == compile_define ||
+			syntax->compile == compile_guard) {
+			*out = EU_TRUE;
+			return EU_RESULT_OK;
+		}
+	}
+
+	for (; _euvalue_is_type(v, EU_TYPE_PAIR); v = _eupair_tail(_euvalue_to_pair(v)))
+		_eu_checkreturn(may_capture(s, _eupair_head(_euvalue_to_pair(v)), out));
+
+	return EU_RESULT_OK;
+}
+
+/* whether code compiled in a scope runs in a procedure's own environment */
+static int in_procedure(eu_cscope* sc) {
+	for (; sc != NULL; sc = sc->previous) {
+		if (sc->kind == SCOPE_LAMBDA)
+			return EU_TRUE;
+	}
+	return EU_FALSE;
+}
+
+/**
+ * @brief Checks a let-like form's shape.
+ *
+ * @param s The Europa state.
+ * @param v The form.
+ * @param name The form's name, for error messages.
+ * @param min_length The minimum number of subforms after the keyword.
+ * @return The result of the operation.
+ */
+static int check_let_form(europa* s, eu_value* v, const char* name,
+	int min_length) {
+	int length, improper;
+
+	length = eutil_list_length(s, _eupair_tail(_euvalue_to_pair(v)), &improper);
+	if (length < 0 || improper) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"%s can't be used in an improper list.", name));
+		return EU_RESULT_ERROR;
+	}
+	if (length < min_length) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"bad %s arity: expected at least %d arguments, got %d.", name,
+			min_length, length));
+		return EU_RESULT_ERROR;
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Checks a list of bindings.
+ *
+ * @param s The Europa state.
+ * @param bindings The list of bindings.
+ * @param name The form's name, for error messages.
+ * @param max_length 2 for (name init) bindings, 3 if a step may follow.
+ * @return The result of the operation.
+ */
+static int check_bindings(europa* s, eu_value* bindings, const char* name,
+	int max_length) {
+	eu_value* binding;
+	int length, improper;
+
+	for (; _euvalue_is_type(bindings, EU_TYPE_PAIR);
+		bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+		binding = _eupair_head(_euvalue_to_pair(bindings));
+		length = eutil_list_length(s, binding, &improper);
+		if (length < 2 || length > max_length || improper
+			|| !_euvalue_is_type(_eupair_head(_euvalue_to_pair(binding)),
+				EU_TYPE_SYMBOL))
+			goto bad_binding;
+	}
+	if (!_euvalue_is_null(bindings))
+		goto bad_binding;
+
+	return EU_RESULT_OK;
+
+	bad_binding:
+	_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+		"bad %s bindings: expected a list of (name init%s).", name,
+		max_length > 2 ? " [step]" : ""));
+	return EU_RESULT_ERROR;
+}
+
+/**
+ * @brief Splits a list of (name init) bindings into a list of names and a
+ * list of inits.
+ *
+ * @param s The Europa state.
+ * @param bindings The (checked) bindings.
+ * @param names Where to place the list of names.
+ * @param inits Where to place the list of inits.
+ * @return The result of the operation.
+ */
+static int split_bindings(europa* s, eu_value* bindings, eu_value* names,
+	eu_value* inits) {
+	eu_value* binding;
+
+	*names = _null;
+	*inits = _null;
+	for (; !_euvalue_is_null(bindings);
+		bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+		binding = _eupair_head(_euvalue_to_pair(bindings));
+
+		_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(binding)), &_null,
+			names));
+		names = _eupair_tail(_euvalue_to_pair(names));
+		_eu_checkreturn(cons(s,
+			_eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(binding)))),
+			&_null, inits));
+		inits = _eupair_tail(_euvalue_to_pair(inits));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Compiles a form inside a procedure of its own that is called
+ * right away.
+ *
+ * Gives let forms at the top level an environment to bind their variables
+ * in, so that they don't end up in the global environment.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The target prototype.
+ * @param v The form.
+ * @param is_tail Whether the form is in tail position.
+ * @return The result of the operation.
+ */
+static int compile_in_procedure(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value form, kw;
+
+	/* ((lambda () v)) */
+	_eu_checkreturn(cons(s, v, &_null, &form));
+	_eu_checkreturn(cons(s, &_null, &form, &form));
+	keyword(s, EU_KEYWORD_LAMBDA, &kw);
+	_eu_checkreturn(cons(s, &kw, &form, &form));
+	_eu_checkreturn(cons(s, &form, &_null, &form));
+
+	return compile(s, sc, proto, &form, is_tail);
+}
+
+/**
+ * @brief Binds a let form's variable in the current environment.
+ *
+ * The variable's value must be in the accumulator.
+ *
+ * @param s The Europa state.
+ * @param scope The let form's scope.
+ * @param proto The target prototype.
+ * @param name The variable's name.
+ * @param hidden Its (already generated) name in the environment.
+ * @return The result of the operation.
+ */
+static int bind_variable(europa* s, eu_cscope* scope, eu_proto* proto,
+	eu_value* name, eu_value* hidden) {
+	eu_value* slot;
+	int index;
+
+	_eu_checkreturn(eutable_create_key(s, scope->bound, name, &slot));
+	*slot = *hidden;
+
+	_eu_checkreturn(euproto_add_constant(s, proto, hidden, &index));
+	return euproto_append_instruction(s, proto, IDEFINE(index));
+}
+
+static int compile_named_let(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail);
+
+/* (let ((name init) ...) body...) and named let */
+static int compile_let(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *bindings, *body, *binding, hidden, names, inits, form, kw;
+	eu_cscope scope;
+	int capture;
+
+	_eu_checkreturn(check_let_form(s, v, "let", 2));
+	bindings = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	body = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+
+	if (_euvalue_is_type(bindings, EU_TYPE_SYMBOL))
+		return compile_named_let(s, sc, proto, v, is_tail);
+	_eu_checkreturn(check_bindings(s, bindings, "let", 2));
+
+	/* a body that may create procedures needs an environment of its own */
+	capture = EU_FALSE;
+	_eu_checkreturn(may_capture(s, body, &capture));
+	if (capture) {
+		/* ((lambda (name ...) body...) init ...) */
+		_eu_checkreturn(split_bindings(s, bindings, &names, &inits));
+		_eu_checkreturn(cons(s, &names, body, &form));
+		keyword(s, EU_KEYWORD_LAMBDA, &kw);
+		_eu_checkreturn(cons(s, &kw, &form, &form));
+		_eu_checkreturn(cons(s, &form, &inits, &form));
+		return compile(s, sc, proto, &form, is_tail);
+	}
+
+	if (!in_procedure(sc))
+		return compile_in_procedure(s, sc, proto, v, is_tail);
+
+	scope.previous = sc;
+	scope.kind = SCOPE_LET;
+	scope.bound = eutable_new(s, 0);
+	if (scope.bound == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	/* evaluate the inits in the enclosing scope, binding each value as soon
+	 * as it is known (the generated names can't be seen by the next inits) */
+	for (; !_euvalue_is_null(bindings);
+		bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+		binding = _eupair_head(_euvalue_to_pair(bindings));
+
+		_eu_checkreturn(compile(s, sc, proto,
+			_eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(binding)))),
+			0));
+		_eu_checkreturn(hidden_name(s, _eupair_head(_euvalue_to_pair(binding)),
+			&hidden));
+		_eu_checkreturn(bind_variable(s, &scope, proto,
+			_eupair_head(_euvalue_to_pair(binding)), &hidden));
+	}
+
+	return compile_body(s, &scope, proto, body, is_tail);
+}
+
+/* (let name ((var init) ...) body...) */
+static int compile_named_let(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *name, *bindings, *body, *binding, *vars, *temps, *slot;
+	eu_value hidden, names, inits, form, kw;
+	eu_cscope scope;
+	int capture, start;
+
+	_eu_checkreturn(check_let_form(s, v, "named let", 3));
+	name = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	bindings = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	body = _eupair_tail(_euvalue_to_pair(bindings));
+	bindings = _eupair_head(_euvalue_to_pair(bindings));
+	_eu_checkreturn(check_bindings(s, bindings, "named let", 2));
+
+	capture = EU_FALSE;
+	_eu_checkreturn(may_capture(s, body, &capture));
+	if (capture)
+		goto procedure;
+
+	if (!in_procedure(sc))
+		return compile_in_procedure(s, sc, proto, v, is_tail);
+
+	/* try compiling the loop in place, which only works if every use of its
+	 * name is a call ending an iteration */
+	start = proto->code_length;
+
+	scope.previous = sc;
+	scope.kind = SCOPE_LOOP;
+	scope.bound = eutable_new(s, 0);
+	if (scope.bound == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	scope.name = *name;
+	scope.vars = _null;
+	scope.temps = _null;
+	scope.in_tail = (is_tail & TAIL_LOOP) != 0;
+	scope.failed = EU_FALSE;
+
+	/* the loop variables shadow the name */
+	_eu_checkreturn(eutable_create_key(s, scope.bound, name, &slot));
+	*slot = _null;
+
+	vars = &scope.vars;
+	temps = &scope.temps;
+	for (; !_euvalue_is_null(bindings);
+		bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+		binding = _eupair_head(_euvalue_to_pair(bindings));
+
+		/* the init is evaluated in the enclosing scope */
+		_eu_checkreturn(compile(s, sc, proto,
+			_eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(binding)))),
+			0));
+		_eu_checkreturn(hidden_name(s, _eupair_head(_euvalue_to_pair(binding)),
+			&hidden));
+		_eu_checkreturn(bind_variable(s, &scope, proto,
+			_eupair_head(_euvalue_to_pair(binding)), &hidden));
+		_eu_checkreturn(cons(s, &hidden, &_null, vars));
+		vars = _eupair_tail(_euvalue_to_pair(vars));
+
+		/* new values are kept aside until all of them are known */
+		if (!_euvalue_is_null(_eupair_tail(_euvalue_to_pair(bindings)))) {
+			_eu_checkreturn(hidden_name(s, _eupair_head(_euvalue_to_pair(binding)),
+				&hidden));
+			_eu_checkreturn(cons(s, &hidden, &_null, temps));
+			temps = _eupair_tail(_euvalue_to_pair(temps));
+		}
+	}
+
+	/* iterations start at the body */
+	scope.start = proto->code_length;
+	_eu_checkreturn(compile_body(s, &scope, proto, body, is_tail | TAIL_LOOP));
+	if (!scope.failed)
+		return EU_RESULT_OK;
+
+	/* the loop needs to be a procedure, drop the code and start over */
+	proto->code_length = start;
+	bindings = _eupair_head(_euvalue_to_pair(
+		_eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))))));
+
+	procedure:
+	/* ((lambda () (define (name var ...) body...) name) init ...) */
+	_eu_checkreturn(split_bindings(s, bindings, &names, &inits));
+	_eu_checkreturn(cons(s, name, &names, &names));
+	_eu_checkreturn(cons(s, &names, body, &form));
+	keyword(s, EU_KEYWORD_DEFINE, &kw);
+	_eu_checkreturn(cons(s, &kw, &form, &form));
+	_eu_checkreturn(cons(s, name, &_null, &names));
+	_eu_checkreturn(cons(s, &form, &names, &form));
+	_eu_checkreturn(cons(s, &_null, &form, &form));
+	keyword(s, EU_KEYWORD_LAMBDA, &kw);
+	_eu_checkreturn(cons(s, &kw, &form, &form));
+	_eu_checkreturn(cons(s, &form, &_null, &form));
+	_eu_checkreturn(cons(s, &form, &inits, &form));
+	return compile(s, sc, proto, &form, is_tail);
+}
+
+/**
+ * @brief Compiles a call that may be the self call of a named let.
+ *
+ * Calls that end an iteration of a loop compiled in place become a jump back
+ * to the start of its body; other uses of the loop's name make it fall back
+ * to being compiled as a procedure.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The target prototype.
+ * @param v The application form.
+ * @param is_tail Whether the form is in tail position.
+ * @param done Where to place whether the call was compiled.
+ * @return The result of the operation.
+ */
+static int compile_loop_call(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail, int* done) {
+	eu_value *args, *vars, *temps, *name;
+	eu_cscope *loop, *it;
+	int length, improper, reachable, index;
+
+	*done = EU_FALSE;
+
+	if (!_euvalue_is_type(_eupair_head(_euvalue_to_pair(v)), EU_TYPE_SYMBOL))
+		return EU_RESULT_OK;
+	_eu_checkreturn(resolve_name(s, sc, _eupair_head(_euvalue_to_pair(v)),
+		&loop, &name));
+	if (loop == NULL || !_euvalue_is_null(name))
+		return EU_RESULT_OK;
+
+	/* the call must end an iteration of every loop it jumps out of, without
+	 * leaving the procedure */
+	reachable = (is_tail & TAIL_LOOP) != 0;
+	for (it = sc; it != loop; it = it->previous) {
+		if (it->kind == SCOPE_LAMBDA || (it->kind == SCOPE_LOOP && !it->in_tail))
+			reachable = EU_FALSE;
+	}
+
+	args = _eupair_tail(_euvalue_to_pair(v));
+	length = eutil_list_length(s, args, &improper);
+	if (!reachable || improper
+		|| length != eutil_list_length(s, &loop->vars, &improper)) {
+		loop->failed = EU_TRUE;
+		return EU_RESULT_OK;
+	}
+
+	/* evaluate the new values, all but the last go to temporaries */
+	vars = &loop->vars;
+	temps = &loop->temps;
+	for (; !_euvalue_is_null(args); args = _eupair_tail(_euvalue_to_pair(args))) {
+		_eu_checkreturn(compile(s, sc, proto, _eupair_head(_euvalue_to_pair(args)),
+			0));
+
+		if (_euvalue_is_null(_eupair_tail(_euvalue_to_pair(args)))) {
+			while (!_euvalue_is_null(_eupair_tail(_euvalue_to_pair(vars))))
+				vars = _eupair_tail(_euvalue_to_pair(vars));
+			name = _eupair_head(_euvalue_to_pair(vars));
+		} else {
+			name = _eupair_head(_euvalue_to_pair(temps));
+			temps = _eupair_tail(_euvalue_to_pair(temps));
+		}
+
+		_eu_checkreturn(euproto_add_constant(s, proto, name, &index));
+		_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+	}
+
+	/* move the temporaries to the loop variables */
+	vars = &loop->vars;
+	for (temps = &loop->temps; !_euvalue_is_null(temps);
+		temps = _eupair_tail(_euvalue_to_pair(temps))) {
+		_eu_checkreturn(euproto_add_constant(s, proto,
+			_eupair_head(_euvalue_to_pair(temps)), &index));
+		_eu_checkreturn(euproto_append_instruction(s, proto, IREFER(index)));
+
+		_eu_checkreturn(euproto_add_constant(s, proto,
+			_eupair_head(_euvalue_to_pair(vars)), &index));
+		_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+		vars = _eupair_tail(_euvalue_to_pair(vars));
+	}
+
+	/* and start the next iteration */
+	_eu_checkreturn(euproto_append_instruction(s, proto,
+		IJUMP(loop->start - proto->code_length)));
+
+	*done = EU_TRUE;
+	return EU_RESULT_OK;
+}
+
+/* (let* ((name init) ...) body...) */
+static int compile_let_star(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *bindings, *body, form, inner;
+
+	_eu_checkreturn(check_let_form(s, v, "let*", 2));
+	bindings = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	body = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	_eu_checkreturn(check_bindings(s, bindings, "let*", 2));
+
+	if (_euvalue_is_null(bindings)
+		|| _euvalue_is_null(_eupair_tail(_euvalue_to_pair(bindings))))
+		return compile_let(s, sc, proto, v, is_tail);
+
+	/* (let (first) (let* (rest...) body...)), nested lets cost nothing */
+	_eu_checkreturn(cons(s, _eupair_tail(_euvalue_to_pair(bindings)), body,
+		&inner));
+	_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(v)), &inner, &inner));
+	_eu_checkreturn(cons(s, &inner, &_null, &form));
+	_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(bindings)), &_null,
+		&inner));
+	_eu_checkreturn(cons(s, &inner, &form, &form));
+	_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(v)), &form, &form));
+
+	return compile_let(s, sc, proto, &form, is_tail);
+}
+
+/* (letrec ((name init) ...) body...), also letrec* */
+static int compile_letrec(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *bindings, *body, *binding, *slot, *defines;
+	eu_value hidden, form, kw;
+	eu_cscope scope;
+	int capture, index;
+
+	_eu_checkreturn(check_let_form(s, v, "letrec", 2));
+	bindings = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	body = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	_eu_checkreturn(check_bindings(s, bindings, "letrec", 2));
+
+	capture = EU_FALSE;
+	_eu_checkreturn(may_capture(s, bindings, &capture));
+	_eu_checkreturn(may_capture(s, body, &capture));
+	if (capture) {
+		/* ((lambda () (define name init) ... body...)) */
+		keyword(s, EU_KEYWORD_DEFINE, &kw);
+		defines = &form;
+		for (; !_euvalue_is_null(bindings);
+			bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+			_eu_checkreturn(cons(s, &kw, _eupair_head(_euvalue_to_pair(bindings)),
+				defines));
+			_eu_checkreturn(cons(s, defines, &_null, defines));
+			defines = _eupair_tail(_euvalue_to_pair(defines));
+		}
+		*defines = *body;
+
+		_eu_checkreturn(cons(s, &_null, &form, &form));
+		keyword(s, EU_KEYWORD_LAMBDA, &kw);
+		_eu_checkreturn(cons(s, &kw, &form, &form));
+		_eu_checkreturn(cons(s, &form, &_null, &form));
+		return compile(s, sc, proto, &form, is_tail);
+	}
+
+	if (!in_procedure(sc))
+		return compile_in_procedure(s, sc, proto, v, is_tail);
+
+	scope.previous = sc;
+	scope.kind = SCOPE_LET;
+	scope.bound = eutable_new(s, 0);
+	if (scope.bound == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	/* all names are visible to all inits */
+	for (binding = bindings; !_euvalue_is_null(binding);
+		binding = _eupair_tail(_euvalue_to_pair(binding))) {
+		_eu_checkreturn(hidden_name(s,
+			_eupair_head(_euvalue_to_pair(_eupair_head(_euvalue_to_pair(binding)))),
+			&hidden));
+		_eu_checkreturn(eutable_create_key(s, scope.bound,
+			_eupair_head(_euvalue_to_pair(_eupair_head(_euvalue_to_pair(binding)))),
+			&slot));
+		*slot = hidden;
+	}
+
+	/* which are evaluated and bound in order */
+	for (; !_euvalue_is_null(bindings);
+		bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+		binding = _eupair_head(_euvalue_to_pair(bindings));
+
+		_eu_checkreturn(compile(s, &scope, proto,
+			_eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(binding)))),
+			0));
+		_eu_checkreturn(eutable_get(s, scope.bound,
+			_eupair_head(_euvalue_to_pair(binding)), &slot));
+		_eu_checkreturn(euproto_add_constant(s, proto, slot, &index));
+		_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+	}
+
+	return compile_body(s, &scope, proto, body, is_tail);
+}
+
+/* (do ((var init step) ...) (test expr ...) command ...) */
+static int compile_do(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *bindings, *clause, *commands, *binding, *lets, *steps, *tail;
+	eu_value name, letlist, steplist, branch, form, kw;
+	int length, improper;
+
+	_eu_checkreturn(check_let_form(s, v, "do", 2));
+	bindings = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	commands = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	clause = _eupair_head(_euvalue_to_pair(commands));
+	commands = _eupair_tail(_euvalue_to_pair(commands));
+	_eu_checkreturn(check_bindings(s, bindings, "do", 3));
+
+	length = eutil_list_length(s, clause, &improper);
+	if (length < 1 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"bad do syntax: expected a (test expr ...) clause."));
+		return EU_RESULT_ERROR;
+	}
+
+	/* it is a named let whose name can't be referred to:
+	 * (let name ((var init) ...)
+	 *   (if test (begin expr ...) (begin command ... (name step ...)))) */
+	keyword(s, EU_KEYWORD_DO, &kw);
+	_eu_checkreturn(hidden_name(s, &kw, &name));
+
+	lets = &letlist;
+	steps = &steplist;
+	for (; !_euvalue_is_null(bindings);
+		bindings = _eupair_tail(_euvalue_to_pair(bindings))) {
+		binding = _eupair_head(_euvalue_to_pair(bindings));
+		tail = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(binding))));
+
+		/* (var init) */
+		_eu_checkreturn(cons(s,
+			_eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(binding)))),
+			&_null, &form));
+		_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(binding)), &form,
+			&form));
+		_eu_checkreturn(cons(s, &form, &_null, lets));
+		lets = _eupair_tail(_euvalue_to_pair(lets));
+
+		/* variables without a step keep their values */
+		_eu_checkreturn(cons(s, _euvalue_is_null(tail)
+			? _eupair_head(_euvalue_to_pair(binding))
+			: _eupair_head(_euvalue_to_pair(tail)), &_null, steps));
+		steps = _eupair_tail(_euvalue_to_pair(steps));
+	}
+	*lets = _null;
+	*steps = _null;
+
+	/* (begin command ... (name step ...)) */
+	_eu_checkreturn(cons(s, &name, &steplist, &form));
+	_eu_checkreturn(cons(s, &form, &_null, &form));
+	steps = &branch;
+	for (; !_euvalue_is_null(commands);
+		commands = _eupair_tail(_euvalue_to_pair(commands))) {
+		_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(commands)), &_null,
+			steps));
+		steps = _eupair_tail(_euvalue_to_pair(steps));
+	}
+	*steps = form;
+	keyword(s, EU_KEYWORD_BEGIN, &kw);
+	_eu_checkreturn(cons(s, &kw, &branch, &branch));
+	_eu_checkreturn(cons(s, &branch, &_null, &form));
+
+	/* (begin expr ...), the value is unspecified without exprs */
+	tail = _eupair_tail(_euvalue_to_pair(clause));
+	if (_euvalue_is_null(tail)) {
+		branch = _true;
+	} else {
+		_eu_checkreturn(cons(s, &kw, tail, &branch));
+	}
+	_eu_checkreturn(cons(s, &branch, &form, &form));
+
+	/* (if test ...) */
+	_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(clause)), &form,
+		&form));
+	keyword(s, EU_KEYWORD_IF, &kw);
+	_eu_checkreturn(cons(s, &kw, &form, &form));
+
+	/* (let name (bindings) (if ...)) */
+	_eu_checkreturn(cons(s, &form, &_null, &form));
+	_eu_checkreturn(cons(s, &letlist, &form, &form));
+	_eu_checkreturn(cons(s, &name, &form, &form));
+	keyword(s, EU_KEYWORD_LET, &kw);
+	_eu_checkreturn(cons(s, &kw, &form, &form));
+
+	return compile_named_let(s, sc, proto, &form, is_tail);
+}
+
+/* whether a clause starts with a given auxiliary keyword (like else) */
+static int is_auxiliary(eu_value* v, const char* name) {
+	return _euvalue_is_type(v, EU_TYPE_SYMBOL) &&
+		strcmp(cast(char*, _eusymbol_text(_euvalue_to_symbol(v))), name) == 0;
+}
+
+/**
+ * @brief Turns the clauses of a guard form into nested ifs.
+ *
+ * Clauses are like cond's: (test expr ...), (test), (test => receiver) and a
+ * final (else expr ...). When no clause applies, the result is the value
+ * given as fallback.
+ *
+ * @param s The Europa state.
+ * @param clauses The clauses.
+ * @param fallback The value of the form when no clause applies.
+ * @param out Where to place the form.
+ * @return The result of the operation.
+ */
+static int guard_clauses(europa* s, eu_value* clauses, eu_value* fallback,
+	eu_value* out) {
+	eu_value *clause, *test, *exprs, rest, temp, form, binding, kw;
+
+	if (_euvalue_is_null(clauses)) {
+		*out = *fallback;
+		return EU_RESULT_OK;
+	}
+
+	clause = _eupair_head(_euvalue_to_pair(clauses));
+	if (!_euvalue_is_type(clause, EU_TYPE_PAIR)) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"bad guard syntax: clauses must be lists."));
+		return EU_RESULT_ERROR;
+	}
+	test = _eupair_head(_euvalue_to_pair(clause));
+	exprs = _eupair_tail(_euvalue_to_pair(clause));
+
+	/* (begin expr ...) */
+	if (is_auxiliary(test, "else")) {
+		keyword(s, EU_KEYWORD_BEGIN, &kw);
+		return cons(s, &kw, exprs, out);
+	}
+
+	_eu_checkreturn(guard_clauses(s, _eupair_tail(_euvalue_to_pair(clauses)),
+		fallback, &rest));
+
+	/* (if test (begin expr ...) rest) */
+	if (_euvalue_is_type(exprs, EU_TYPE_PAIR) &&
+		!is_auxiliary(_eupair_head(_euvalue_to_pair(exprs)), "=>")) {
+		_eu_checkreturn(cons(s, &rest, &_null, &form));
+		keyword(s, EU_KEYWORD_BEGIN, &kw);
+		_eu_checkreturn(cons(s, &kw, exprs, &binding));
+		_eu_checkreturn(cons(s, &binding, &form, &form));
+		_eu_checkreturn(cons(s, test, &form, &form));
+		keyword(s, EU_KEYWORD_IF, &kw);
+		return cons(s, &kw, &form, out);
+	}
+
+	/* (let ((temp test)) (if temp temp rest)), or (receiver temp) with => */
+	keyword(s, EU_KEYWORD_GUARD, &kw);
+	_eu_checkreturn(hidden_name(s, &kw, &temp));
+
+	_eu_checkreturn(cons(s, &rest, &_null, &form));
+	if (_euvalue_is_null(exprs)) {
+		_eu_checkreturn(cons(s, &temp, &form, &form));
+	} else {
+		exprs = _eupair_tail(_euvalue_to_pair(exprs));
+		if (!_euvalue_is_type(exprs, EU_TYPE_PAIR)) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"bad guard syntax: expected a receiver after =>."));
+			return EU_RESULT_ERROR;
+		}
+		_eu_checkreturn(cons(s, &temp, &_null, &binding));
+		_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(exprs)), &binding,
+			&binding));
+		_eu_checkreturn(cons(s, &binding, &form, &form));
+	}
+	_eu_checkreturn(cons(s, &temp, &form, &form));
+	keyword(s, EU_KEYWORD_IF, &kw);
+	_eu_checkreturn(cons(s, &kw, &form, &form));
+	_eu_checkreturn(cons(s, &form, &_null, &form));
+
+	_eu_checkreturn(cons(s, test, &_null, &binding));
+	_eu_checkreturn(cons(s, &temp, &binding, &binding));
+	_eu_checkreturn(cons(s, &binding, &_null, &binding));
+	_eu_checkreturn(cons(s, &binding, &form, &form));
+	keyword(s, EU_KEYWORD_LET, &kw);
+	return cons(s, &kw, &form, out);
+}
+
+/* (guard (var clause ...) body ...)
+ *
+ * it is a call to a closure of euapi_guard, which installs the handler:
+ * (guard-closure (lambda () body ...) (lambda (var) clauses...))
+ * the clauses evaluate to the guard closure itself when none applies, which
+ * makes it raise the object again. */
+static int compile_guard(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *spec, *body, guard, clauses, form, lambda, kw;
+	eu_closure* cl;
+	int length, improper;
+
+	length = eutil_list_length(s, _eupair_tail(_euvalue_to_pair(v)), &improper);
+	if (length < 1 || improper) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"bad guard syntax: expected (guard (var clause ...) body ...)."));
+		return EU_RESULT_ERROR;
+	}
+	spec = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+	body = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(v))));
+
+	length = eutil_list_length(s, spec, &improper);
+	if (length < 1 || improper ||
+		!_euvalue_is_type(_eupair_head(_euvalue_to_pair(spec)), EU_TYPE_SYMBOL)) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"bad guard syntax: expected a (var clause ...) list."));
+		return EU_RESULT_ERROR;
+	}
+
+	cl = eucl_new(s, euapi_guard, NULL, _eu_global_env(s));
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makeclosure(&guard, cl);
+
+	_eu_checkreturn(guard_clauses(s, _eupair_tail(_euvalue_to_pair(spec)),
+		&guard, &clauses));
+	keyword(s, EU_KEYWORD_LAMBDA, &kw);
+
+	/* (lambda (var) clauses) */
+	_eu_checkreturn(cons(s, &clauses, &_null, &form));
+	_eu_checkreturn(cons(s, _eupair_head(_euvalue_to_pair(spec)), &_null,
+		&lambda));
+	_eu_checkreturn(cons(s, &lambda, &form, &form));
+	_eu_checkreturn(cons(s, &kw, &form, &lambda));
+	_eu_checkreturn(cons(s, &lambda, &_null, &form));
+
+	/* (lambda () body ...) */
+	_eu_checkreturn(cons(s, &_null, body, &lambda));
+	_eu_checkreturn(cons(s, &kw, &lambda, &lambda));
+	_eu_checkreturn(cons(s, &lambda, &form, &form));
+
+	_eu_checkreturn(cons(s, &guard, &form, &form));
+	return compile_call(s, sc, proto, &form, is_tail);
+}
+
+/** The special forms every state knows about. */
+static const eu_syntax builtin_syntax[] = {
+	{"quote", compile_quote},
+	{"lambda", compile_lambda},
+	{"if", compile_if},
+	{"set!", compile_set},
+	{"define", compile_define},
+	{"call/cc", compile_callcc},
+	{"call-with-current-continuation", compile_callcc},
+	{"begin", compile_begin},
+	{"let", compile_let},
+	{"let*", compile_let_star},
+	{"letrec", compile_letrec},
+	{"letrec*", compile_letrec},
+	{"do", compile_do},
+	{"guard", compile_guard},
+	{NULL, NULL},
+};
+
+/** Builtins whose results only depend on their arguments, and that return
+ * values that can be shared between calls (no fresh mutable objects). */
+static const eu_cfunc pure_builtins[] = {
+	euapi_numberQ, euapi_complexQ, euapi_rationalQ, euapi_integerQ,
+	euapi_exactQ, euapi_inexactQ, euapi_E, euapi_L, euapi_G, euapi_LE,
+	euapi_GE, euapi_zeroQ, euapi_positiveQ, euapi_negativeQ, euapi_oddQ,
+	euapi_evenQ, euapi_min, euapi_max, euapi_P, euapi_S, euapi_M, euapi_D,
+	euapi_abs, euapi_booleanQ, euapi_not, euapi_booleanEQ, euapi_stringQ,
+	euapi_stringEQ, euapi_symbolQ, euapi_string_to_symbol, euapi_eqQ,
+	euapi_eqvQ, euapi_equalQ, euapi_pairQ, euapi_car, euapi_cdr, euapi_nullQ,
+	NULL,
+};
+
+/**
+ * @brief Gets the pure builtin a global variable holds.
+ *
+ * @param s The Europa state.
+ * @param name The variable's name.
+ * @param out Where to place the builtin. NULL if the variable doesn't hold
+ * one.
+ * @return The result of the operation.
+ */
+static int find_pure_builtin(europa* s, eu_value* name, eu_cfunc* out) {
+	eu_value* slot;
+	eu_closure* cl;
+	int i;
 
-			/* compile the function's body */
-			head = _eupair_head(_euvalue_to_pair(tail)); /* get the formals */
-			tail = _eupair_tail(_euvalue_to_pair(tail)); /* get the list containing the body */
+	*out = NULL;
+	_eu_checkreturn(eutable_get(s, _eu_global_env(s), name, &slot));
+	if (slot == NULL || !_euvalue_is_type(slot, EU_TYPE_CLOSURE))
+		return EU_RESULT_OK;
 
-			/* check whether formals are valid */
-			_eu_checkreturn(check_formals(s, head));
+	cl = _euvalue_to_closure(slot);
+	for (i = 0; cl->cf && pure_builtins[i]; i++) {
+		if (cl->cf == pure_builtins[i]) {
+			*out = cl->cf;
+			break;
+		}
+	}
 
-			/* initialize the begin cell */
-			_eu_makesym(&beginsym, eusymbol_new(s, "begin"));
-			_eu_makepair(&beginpair, eupair_new(s, &beginsym, tail));
+	/* code folded for this builtin is only valid while the global holds it */
+	if (*out) {
+		_eu_checkreturn(eucache_assume(s, name, slot));
+	}
 
-			/* create a prototype from the formals (in head) and source (in v) */
-			subproto = euproto_new(s, head, 0, v, 0, 0);
-			/* compile the body (with the prepended "begin") */
-			_eu_checkreturn(compile_application(s, subproto, &beginpair, 1));
-			/* add a return instruction */
-			_eu_checkreturn(euproto_append_instruction(s, subproto, IRETURN()));
-			/* add the compiled prototype as a subprototype */
-			_eu_checkreturn(euproto_add_subproto(s, proto, subproto, &index));
-			/* add a close instruction */
-			_eu_checkreturn(euproto_append_instruction(s, proto, ICLOSE(index)));
+	return EU_RESULT_OK;
+}
 
-			return EU_RESULT_OK;
-		} else if (eusymbol_equal_cstr(head, "if")) { /* (if test then else) */
-			/* check arity */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"if can't be used with improper list."));
-				return EU_RESULT_ERROR;
-			}
-			if (length > 3 || length <= 1) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"bad if arity: expected 2 or 3 arguments, got %d.", length));
-				return EU_RESULT_ERROR;
-			}
+static int fold_application(europa* s, eu_cscope* sc, eu_value* v,
+	int* folded, eu_value* out, eu_value* guards);
 
-			/* compile the test argument */
-			head = _eupair_head(_euvalue_to_pair(tail)); /* test */
-			_eu_checkreturn(compile(s, proto, head, 0)); /* test is never in tail position */
-
-			/* because the offset of the false branch is not yet known (no
-			 * branches have been compiled), insert a placeholder offset and
-			 * save the instruction's index in order to update it later */
-			index = proto->code_length; /* get instruction index */
-			_eu_checkreturn(euproto_append_instruction(s, proto, ITEST(0)));
-
-			/* compile true branch */
-			tail = _eupair_tail(_euvalue_to_pair(tail)); /* (true . (false . '())) */
-			head = _eupair_head(_euvalue_to_pair(tail)); /* true */
-			_eu_checkreturn(compile(s, proto, head, is_tail)); /* is in tail position if this is in tail position*/
-
-			/* check if there is a false branch */
-			if (!_euvalue_is_null(_eupair_tail(_euvalue_to_pair(tail)))) {
-				/* add a jump instruction to skip the false branch, where to jump
-				* is still not defined, though, so we'll have to do the same as
-				* with the test instruction */
-				length = proto->code_length; /* the index of the jump instruction */
-				_eu_checkreturn(euproto_append_instruction(s, proto, IJUMP(0)));
-
-				/* compile false branch */
-				tail = _eupair_tail(_euvalue_to_pair(tail)); /* (false . '()) */
-				head = _eupair_head(_euvalue_to_pair(tail)); /* false */
-				_eu_checkreturn(compile(s, proto, head, is_tail)); /* is in tail position if this is in tail position */
-				improper = proto->code_length; /* the index of the instruction after the false branch*/
-
-				/* update the test instruction */
-				proto->code[index] = ITEST(length + 1 - index);
-				/* update the jump instruction */
-				proto->code[length] = IJUMP(improper - length);
-			} else {
-				/* update the test statement to point to after the true branch */
-				proto->code[index] = ITEST(proto->code_length - index);
-			}
+/**
+ * @brief Checks whether a division's argument list divides by an exact zero.
+ *
+ * @param args The argument list.
+ * @return Whether a divisor is an exact zero.
+ */
+static int has_zero_divisor(eu_value* args) {
+	eu_value* divisors;
+
+	/* (/ x) divides 1 by x */
+	divisors = _euvalue_is_null(_eupair_tail(_euvalue_to_pair(args))) ? args :
+		_eupair_tail(_euvalue_to_pair(args));
+	for (; _euvalue_is_type(divisors, EU_TYPE_PAIR);
+		divisors = _eupair_tail(_euvalue_to_pair(divisors))) {
+		if (_euvalue_is_type(_eupair_head(_euvalue_to_pair(divisors)), EU_TYPE_NUMBER)
+			&& _eunum_is_exact(_eupair_head(_euvalue_to_pair(divisors)))
+			&& _eunum_i(_eupair_head(_euvalue_to_pair(divisors))) == 0)
+			return EU_TRUE;
+	}
+	return EU_FALSE;
+}
 
-			return EU_RESULT_OK;
-		} else if (eusymbol_equal_cstr(head, "set!")) { /* (set! var value) */
-			/* check arity */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"set! can't be used in an improper list."));
-				return EU_RESULT_ERROR;
-			}
-			if (length != 2) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"bad set! arity: expected 2 arguments, got %d.", length));
-				return EU_RESULT_ERROR;
-			}
+/**
+ * @brief Gets the value of a form known at compile time.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param v The form.
+ * @param known Where to place whether the value is known.
+ * @param out Where to place the value.
+ * @param guards The list of builtins the value relies on, see
+ * fold_application.
+ * @return The result of the operation.
+ */
+static int constant_value(europa* s, eu_cscope* sc, eu_value* v, int* known,
+	eu_value* out, eu_value* guards) {
+	const eu_syntax* syntax;
+	eu_value* tail;
 
-			/* check if variable name parameter is actually a symbol */
-			head = _eupair_head(_euvalue_to_pair(tail));
-			if (!_euvalue_is_type(head, EU_TYPE_SYMBOL)) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"bad set! syntax, expected first argument to be an identifier (symbol)."));
-				return EU_RESULT_ERROR;
-			}
+	*known = EU_FALSE;
+	switch (_euvalue_type(v)) {
+	case EU_TYPE_SYMBOL:
+		return EU_RESULT_OK;
+	case EU_TYPE_PAIR:
+		_eu_checkreturn(find_syntax(s, _eupair_head(_euvalue_to_pair(v)), &syntax));
+		if (syntax == NULL)
+			return fold_application(s, sc, v, known, out, guards);
+
+		/* (quote datum) */
+		tail = _eupair_tail(_euvalue_to_pair(v));
+		if (syntax->compile == compile_quote && _euvalue_is_type(tail, EU_TYPE_PAIR)
+			&& _euvalue_is_null(_eupair_tail(_euvalue_to_pair(tail)))) {
+			*out = *_eupair_head(_euvalue_to_pair(tail));
+			*known = EU_TRUE;
+		}
+		return EU_RESULT_OK;
+	default:
+		*out = *v;
+		*known = EU_TRUE;
+		return EU_RESULT_OK;
+	}
+}
 
-			/* compile the value parameter */
-			tail = _eupair_head(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(tail))));
-			_eu_checkreturn(compile(s, proto, tail, 0)); /* the set variable name is never in tail position */
+/**
+ * @brief Evaluates a call to a pure builtin with constant arguments at compile
+ * time.
+ *
+ * Calls that fail are left for run time, where they report their errors.
+ * Since the variables may be changed before the code runs, the value is only
+ * good while they hold the builtins, so each one called is added to guards as
+ * a (variable . registered name) pair.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param v The application form.
+ * @param folded Where to place whether the call was evaluated.
+ * @param out Where to place its value.
+ * @param guards The list the builtins called are added to.
+ * @return The result of the operation.
+ */
+static int fold_application(europa* s, eu_cscope* sc, eu_value* v,
+	int* folded, eu_value* out, eu_value* guards) {
+	eu_value *head, *tail, *args, list, value, *name, acc, rib, *rib_lastpos,
+		cfname, guard, same;
+	eu_cscope* where;
+	eu_error* err;
+	eu_cfunc cf;
+	int known, res;
+
+	*folded = EU_FALSE;
+
+	/* the head must name a global holding a pure builtin */
+	head = _eupair_head(_euvalue_to_pair(v));
+	if (!_euvalue_is_type(head, EU_TYPE_SYMBOL))
+		return EU_RESULT_OK;
+	_eu_checkreturn(resolve_name(s, sc, head, &where, &name));
+	if (where != NULL)
+		return EU_RESULT_OK;
+	_eu_checkreturn(find_pure_builtin(s, head, &cf));
+	if (cf == NULL)
+		return EU_RESULT_OK;
 
-			/* add name symbol to the constant list */
-			_eu_checkreturn(euproto_add_constant(s, proto, head, &index));
-			/* append the assign instruction */
-			_eu_checkreturn(euproto_append_instruction(s, proto, IASSIGN(index)));
+	/* the code checks the builtin by the name it was registered with */
+	_eu_checkreturn(eucc_cfunc_name(s, cf, &cfname));
+	if (_euvalue_is_null(&cfname))
+		return EU_RESULT_OK;
 
+	/* and every argument must be known */
+	args = &list;
+	for (tail = _eupair_tail(_euvalue_to_pair(v)); _euvalue_is_type(tail, EU_TYPE_PAIR);
+		tail = _eupair_tail(_euvalue_to_pair(tail))) {
+		_eu_checkreturn(constant_value(s, sc, _eupair_head(_euvalue_to_pair(tail)),
+			&known, &value, guards));
+		if (!known)
 			return EU_RESULT_OK;
-		} else if (eusymbol_equal_cstr(head, "define")) { /* (define name thing) || (define (name args) body...) || (define (name . arglist) body...) */
-			/* check arity */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"define can't be used in an improper list."));
-				return EU_RESULT_ERROR;
-			}
-			if (length < 2) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"bad define arity: expected at least 2 arguments, got %d.", length));
-				return EU_RESULT_ERROR;
-			}
 
-			/* make head be name or (name args ...) or (name . arglist) */
-			head = _eupair_head(_euvalue_to_pair(tail));
-			/* cell of third parameter */
-			tail = _eupair_tail(_euvalue_to_pair(tail));
+		_eu_checkreturn(cons(s, &value, &_null, args));
+		args = _eupair_tail(_euvalue_to_pair(args));
+	}
+	if (!_euvalue_is_null(tail))
+		return EU_RESULT_OK;
+	*args = _null;
 
-			/* (define name value) */
-			if (_euvalue_is_type(head, EU_TYPE_SYMBOL)) {
+	/* integer division by zero traps, so it is left for run time */
+	if (cf == euapi_D && has_zero_divisor(&list))
+		return EU_RESULT_OK;
 
-				/* compile the value parameter */
-				/* the set variable name is never in tail position */
-				_eu_checkreturn(compile(s, proto,
-					_eupair_head(_euvalue_to_pair(tail)), 0));
+	/* call it the way the vm would, leaving the state as it was */
+	acc = s->acc;
+	rib = s->rib;
+	rib_lastpos = s->rib_lastpos;
+	err = _eu_err(s);
+
+	s->rib = list;
+	s->rib_lastpos = NULL;
+	res = cf(s);
+	if (res == EU_RESULT_OK) {
+		*out = s->acc;
+		*folded = EU_TRUE;
+	}
 
-				/* add name symbol to the constant list */
-				_eu_checkreturn(euproto_add_constant(s, proto, head, &index));
-				/* append the define instruction */
-				_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+	s->acc = acc;
+	s->rib = rib;
+	s->rib_lastpos = rib_lastpos;
+	_eu_err(s) = err;
 
-				return EU_RESULT_OK;
-			}
+	if (res != EU_RESULT_OK)
+		return res == EU_RESULT_BAD_ALLOC ? res : EU_RESULT_OK;
 
-			/* (define (name args ...) body ...) also (name args . named) */
-			if (_euvalue_is_type(head, EU_TYPE_PAIR)) {
+	/* each variable needs checking only once */
+	for (tail = guards; _euvalue_is_type(tail, EU_TYPE_PAIR);
+		tail = _eupair_tail(_euvalue_to_pair(tail))) {
+		_eu_checkreturn(eusymbol_eqv(head, _eupair_head(_euvalue_to_pair(
+			_eupair_head(_euvalue_to_pair(tail)))), &same));
+		if (_euvalue_to_bool(&same))
+			return EU_RESULT_OK;
+	}
+	_eu_checkreturn(cons(s, head, &cfname, &guard));
+	return cons(s, &guard, guards, guards);
+}
 
-				/* check whether formals are valid */
-				_eu_checkreturn(check_formals(s, _eupair_tail(_euvalue_to_pair(head))));
+/**
+ * @brief Compiles a call that was evaluated at compile time as its value.
+ *
+ * The value is only used while every builtin it came from is still held by
+ * its variable, otherwise the call is made.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The target prototype.
+ * @param v The application form.
+ * @param is_tail Whether the call is in tail position.
+ * @param value The call's value.
+ * @param guards The builtins it relies on, as placed by fold_application.
+ * @return The result of the operation.
+ */
+static int compile_folded_call(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail, eu_value* value, eu_value* guards) {
+	eu_value *tail, *guard;
+	int index, start, count, test, jump;
+
+	/* check the variables still hold the builtins */
+	start = proto->code_length;
+	count = 0;
+	for (tail = guards; _euvalue_is_type(tail, EU_TYPE_PAIR);
+		tail = _eupair_tail(_euvalue_to_pair(tail))) {
+		guard = _eupair_head(_euvalue_to_pair(tail));
+		_eu_checkreturn(euproto_add_constant(s, proto,
+			_eupair_head(_euvalue_to_pair(guard)), &index));
+		_eu_checkreturn(euproto_append_instruction(s, proto, IGREFER(index)));
+		_eu_checkreturn(euproto_add_constant(s, proto,
+			_eupair_tail(_euvalue_to_pair(guard)), &index));
+		_eu_checkreturn(euproto_append_instruction(s, proto, IGUARD(index)));
+		_eu_checkreturn(euproto_append_instruction(s, proto, ITEST(0)));
+		count++;
+	}
 
-				/* initialize the begin cell */
-				_eu_makesym(&beginsym, eusymbol_new(s, "begin"));
-				_eu_makepair(&beginpair, eupair_new(s, &beginsym, tail));
+	/* use the value */
+	_eu_checkreturn(euproto_add_constant(s, proto, value, &index));
+	_eu_checkreturn(euproto_append_instruction(s, proto, ICONST(index)));
+	jump = proto->code_length;
+	_eu_checkreturn(euproto_append_instruction(s, proto, IJUMP(0)));
 
-				/* create a prototype from the formals (in head's cdr) and source (in v) */
-				subproto = euproto_new(s, _eupair_tail(_euvalue_to_pair(head)), 0, v, 0, 0);
-				/* compile the body (with the prepended "begin") */
-				_eu_checkreturn(compile_application(s, subproto, &beginpair, 1));
-				/* add a return instruction */
-				_eu_checkreturn(euproto_append_instruction(s, subproto, IRETURN()));
-				/* add the compiled prototype as a subprototype */
-				_eu_checkreturn(euproto_add_subproto(s, proto, subproto, &index));
-				/* add a close instruction */
-				_eu_checkreturn(euproto_append_instruction(s, proto, ICLOSE(index)));
+	/* or make the call */
+	for (test = start + 2; count > 0; test += 3, count--) {
+		proto->code[test] = ITEST(proto->code_length - test);
+	}
+	_eu_checkreturn(compile_call(s, sc, proto, v, is_tail));
+	proto->code[jump] = IJUMP(proto->code_length - jump);
 
-				/* add name symbol to the constant list */
-				_eu_checkreturn(euproto_add_constant(s, proto, _eupair_head(_euvalue_to_pair(head)), &index));
-				/* append the define instruction */
-				_eu_checkreturn(euproto_append_instruction(s, proto, IDEFINE(index)));
+	return EU_RESULT_OK;
+}
 
-				return EU_RESULT_OK;
-			}
+/* the most nodes an inlined procedure's body may have */
+#define INLINE_BUDGET 24
+/* how many inlined calls may be nested in each other */
+#define INLINE_DEPTH 4
 
-			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-				"define's name is of invalid type %s. Expected symbol or list.",
-				eu_type_name(_euvalue_type(head))));
-			return EU_RESULT_ERROR;
+/**
+ * @brief Checks whether a procedure's body can be compiled in place of a call.
+ *
+ * Bodies can't create procedures or assign to variables, and must only refer
+ * to the procedure's formals and to globals the call site doesn't shadow.
+ *
+ * @param s The Europa state.
+ * @param sc The call site's scope.
+ * @param name The procedure's name.
+ * @param formals The procedure's formals.
+ * @param v The body (or some form in it).
+ * @param size The number of nodes seen so far.
+ * @param ok Cleared if the body can't be inlined, left untouched otherwise.
+ * @return The result of the operation.
+ */
+static int check_inline_body(europa* s, eu_cscope* sc, eu_value* name,
+	eu_value* formals, eu_value* v, int* size, int* ok) {
+	const eu_syntax* syntax;
+	eu_cscope* where;
+	eu_value *f, *bound, same;
+
+	if (++(*size) > INLINE_BUDGET) {
+		*ok = EU_FALSE;
+		return EU_RESULT_OK;
+	}
 
-		} else if (eusymbol_equal_cstr(head, "call/cc") /* (call/cc proc) */
-			|| eusymbol_equal_cstr(head, "call-with-current-continuation")) {
-			/* check arity */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"call/cc can't be used in an improper list."));
-				return EU_RESULT_ERROR;
-			}
-			if (length != 1) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"bad call/cc arity: expected 1 arguments, got %d.", length));
-				return EU_RESULT_ERROR;
+	switch (_euvalue_type(v)) {
+	case EU_TYPE_SYMBOL:
+		/* recursive procedures are never inlined */
+		_eu_checkreturn(eusymbol_eqv(v, name, &same));
+		if (_euvalue_to_bool(&same)) {
+			*ok = EU_FALSE;
+			return EU_RESULT_OK;
+		}
+		for (f = formals; !_euvalue_is_null(f); f = _eupair_tail(_euvalue_to_pair(f))) {
+			_eu_checkreturn(eusymbol_eqv(v, _eupair_head(_euvalue_to_pair(f)), &same));
+			if (_euvalue_to_bool(&same))
+				return EU_RESULT_OK;
+		}
+		_eu_checkreturn(resolve_name(s, sc, v, &where, &bound));
+		if (where != NULL)
+			*ok = EU_FALSE;
+		return EU_RESULT_OK;
+	case EU_TYPE_PAIR:
+		_eu_checkreturn(find_syntax(s, _eupair_head(_euvalue_to_pair(v)), &syntax));
+		if (syntax != NULL) {
+			if (syntax->compile == compile_quote)
+				return EU_RESULT_OK;
+			if (syntax->compile == compile_lambda || syntax->compile == compile_define
+				|| syntax->compile == compile_set) {
+				*ok = EU_FALSE;
+				return EU_RESULT_OK;
 			}
+		}
+
+		for (; *ok && _euvalue_is_type(v, EU_TYPE_PAIR);
+			v = _eupair_tail(_euvalue_to_pair(v))) {
+			_eu_checkreturn(check_inline_body(s, sc, name, formals,
+				_eupair_head(_euvalue_to_pair(v)), size, ok));
+		}
+		if (*ok && !_euvalue_is_null(v))
+			_eu_checkreturn(check_inline_body(s, sc, name, formals, v, size, ok));
+		return EU_RESULT_OK;
+	default:
+		return EU_RESULT_OK;
+	}
+}
 
-			/* TODO: if anything bad happens, check the code below (everything,
-			 * even after the else if */
-
-			/* create continuation instruction */
-			improper = proto->code_length;
-			_eu_checkreturn(euproto_append_instruction(s, proto, ICONTI(0)));
-
-			/* in case this isn't a tail call, add the frame instruction */
-			/* the reason why the frame is created _after_ the continuation is put
-			 * in the accumulator is because if we created the continuation after
-			 * the creation of the frame, restoring the continuation would restore
-			 * also the created frame just below the stack, which breaks everything
-			 * an example of code that would break if the frame was created before
-			 * creating the continuation is:
-			 * ((lambda ()
-			 *     (define counter 0)
-			 *     (define conti #f)
-			 *     (call/cc (lambda (c) (set! conti c)))
-			 *
-			 *     (display counter) (newline)
-			 *     (set! counter (+ counter 1))
-			 *
-			 *     (if (= counter 5)
-			 *         #t
-			 *         (conti))))
-			 */
-			if (!is_tail) {
-				/* since we don't know yet where to return to, use a stub address */
-				index = proto->code_length; /* save instruction's index */
-				_eu_checkreturn(euproto_append_instruction(s, proto, IFRAME(0)));
-			}
+/**
+ * @brief Finds the procedure a call can inline.
+ *
+ * Only calls to globals holding small procedures created at the top level
+ * (or defined earlier in the form being compiled) with the right number of
+ * arguments are inlined.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param v The application form.
+ * @param out Where to place the procedure's prototype. NULL if the call can't
+ * be inlined.
+ * @return The result of the operation.
+ */
+static int find_inline_callee(europa* s, eu_cscope* sc, eu_value* v,
+	eu_proto** out) {
+	eu_value *head, *slot, *name, *formals, *body;
+	eu_cscope* where;
+	eu_closure* cl;
+	eu_proto* callee;
+	int argc, improper, depth, size, ok;
 
-			/* add it to the argument rib */
-			_eu_checkreturn(euproto_append_instruction(s, proto, IARGUMENT()));
+	*out = NULL;
 
-			/* compile the argument (which shouldn't be considered to be in tail position) */
-			_eu_checkreturn(compile(s, proto, _eupair_head(_euvalue_to_pair(tail)), 0));
+	/* the head must name a global */
+	head = _eupair_head(_euvalue_to_pair(v));
+	if (!_euvalue_is_type(head, EU_TYPE_SYMBOL))
+		return EU_RESULT_OK;
+	_eu_checkreturn(resolve_name(s, sc, head, &where, &name));
+	if (where != NULL)
+		return EU_RESULT_OK;
 
-			/* apply */
-			_eu_checkreturn(euproto_append_instruction(s, proto, IAPPLY()));
+	/* that holds a procedure defined at the top level */
+	slot = NULL;
+	if (_eu_global(s)->unit != NULL)
+		_eu_checkreturn(eutable_get(s, _eu_global(s)->unit, head, &slot));
+	if (slot != NULL) {
+		if (!_euvalue_is_type(slot, EU_TYPE_PROTO))
+			return EU_RESULT_OK;
+		callee = _euvalue_to_proto(slot);
+	} else {
+		_eu_checkreturn(eutable_get(s, _eu_global_env(s), head, &slot));
+		if (slot == NULL || !_euvalue_is_type(slot, EU_TYPE_CLOSURE))
+			return EU_RESULT_OK;
+		cl = _euvalue_to_closure(slot);
+		if (cl->cf != NULL || cl->env != _eu_global_env(s) || cl->freec != 0)
+			return EU_RESULT_OK;
+		callee = cl->proto;
+	}
 
-			/* correct the offset from the stub frame instruction if needed */
-			if (!is_tail) {
-				proto->code[index] = IFRAME(proto->code_length - index);
-			}
+	/* with as many (fixed) formals as there are arguments */
+	argc = eutil_list_length(s, _eupair_tail(_euvalue_to_pair(v)), &improper);
+	if (argc < 0 || improper)
+		return EU_RESULT_OK;
+	formals = _euproto_formals(callee);
+	for (; _euvalue_is_type(formals, EU_TYPE_PAIR);
+		formals = _eupair_tail(_euvalue_to_pair(formals)))
+		argc--;
+	if (argc != 0 || !_euvalue_is_null(formals))
+		return EU_RESULT_OK;
 
-			/* correct CONTI instruction offset */
-			proto->code[improper] = ICONTI(proto->code_length - improper);
+	/* the body follows the formals in both (lambda formals body...) and
+	 * (define (name . formals) body...) */
+	body = &callee->source;
+	for (argc = 0; argc < 2 && _euvalue_is_type(body, EU_TYPE_PAIR); argc++)
+		body = _eupair_tail(_euvalue_to_pair(body));
+	if (argc < 2 || !_euvalue_is_type(body, EU_TYPE_PAIR))
+		return EU_RESULT_OK;
 
+	/* procedures aren't inlined into themselves, nor too deeply */
+	depth = 0;
+	for (where = sc; where != NULL && where->kind != SCOPE_LAMBDA;
+		where = where->previous) {
+		if (where->kind != SCOPE_INLINE)
+			continue;
+		if (where->proto == callee || ++depth >= INLINE_DEPTH)
 			return EU_RESULT_OK;
-		} else if (eusymbol_equal_cstr(head, "begin")) { /* (begin body...) */
-			/* check arity */
-			length = eutil_list_length(s, tail, &improper);
-			if (length < 0 || improper) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"begin can't be used in an improper list."));
-				return EU_RESULT_ERROR;
-			}
-			if (length == 0) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"begin needs at least one expression in its body."));
-				return EU_RESULT_ERROR;
-			}
+	}
 
-			/* compile expressions in order */
-			for (head = tail; !_euvalue_is_null(head);
-				head = _eupair_tail(_euvalue_to_pair(head))) {
-				_eu_checkreturn(compile(s, proto,
-					_eupair_head(_euvalue_to_pair(head)),
-					/* in case this is the last expression in the form it should be
-					 a tail call if begin is in the tail */
-					_euvalue_is_null(_eupair_tail(_euvalue_to_pair(head)))
-					? is_tail : 0));
-			}
+	size = 0;
+	ok = EU_TRUE;
+	_eu_checkreturn(check_inline_body(s, sc, head, _euproto_formals(callee), body,
+		&size, &ok));
+	if (ok)
+		*out = callee;
 
-			return EU_RESULT_OK;
-		} /* it's a symbol, but not a special construct. treat as any value */
-	}
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Compiles the code that calls a procedure.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The target prototype.
+ * @param v The application form.
+ * @param is_tail Whether the call is in tail position.
+ * @return The result of the operation.
+ */
+static int compile_call(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *head, *tail;
+	int index;
 
 	/* this is a normal function application, we need to evaluate the arguments
 	 * since scheme does not specify an order and APPLY expects the function to
@@ -388,7 +2146,7 @@ int compile_application(europa* s, eu_proto* proto, eu_value* v, int is_tail) {
 	 * procedure, then do the application */
 
 	/* add a frame creation instruction if this is not in tail position */
-	if (!is_tail) {
+	if (!(is_tail & TAIL_RETURN)) {
 		index = proto->code_length;
 		_eu_checkreturn(euproto_append_instruction(s, proto, IFRAME(0)));
 	}
@@ -401,38 +2159,173 @@ int compile_application(europa* s, eu_proto* proto, eu_value* v, int is_tail) {
 		tail = _eupair_tail(_euvalue_to_pair(tail))) {
 
 		/* compiles the argument (which shouldn't be considered to be at tail position) */
-		_eu_checkreturn(compile(s, proto, _eupair_head(_euvalue_to_pair(tail)), 0));
+		_eu_checkreturn(compile(s, sc, proto, _eupair_head(_euvalue_to_pair(tail)), 0));
 		/* add the argument instruction */
 		_eu_checkreturn(euproto_append_instruction(s, proto, IARGUMENT()));
 	}
 
 	/* compile the procedure (also not in tail position) */
-	_eu_checkreturn(compile(s, proto, head, 0));
+	_eu_checkreturn(compile(s, sc, proto, head, 0));
 	/* apply */
 	_eu_checkreturn(euproto_append_instruction(s, proto, IAPPLY()));
 
 	/* correct the frame instruction's return address offset if not in tail position */
-	if (!is_tail) {
+	if (!(is_tail & TAIL_RETURN)) {
 		proto->code[index] = IFRAME(proto->code_length - index);
 	}
 
 	return EU_RESULT_OK;
 }
 
-int compile(europa* s, eu_proto* proto, eu_value* v, int is_tail) {
+/**
+ * @brief Compiles a call to a small top level procedure by binding the
+ * arguments to its formals in the current environment, like a let form, and
+ * compiling its body in place.
+ *
+ * The inlined body only runs while the variable still holds the procedure,
+ * otherwise whatever it holds is called.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope.
+ * @param proto The target prototype.
+ * @param v The application form.
+ * @param is_tail Whether the call is in tail position.
+ * @param done Where to place whether the call was compiled.
+ * @return The result of the operation.
+ */
+static int compile_inline_call(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail, int* done) {
+	eu_value *formals, *args, *body, value, hidden;
+	eu_proto* callee;
+	eu_cscope scope;
+	int index, test, jump;
+
+	*done = EU_FALSE;
+
+	/* the formals need an environment to be bound in */
+	if (!in_procedure(sc))
+		return EU_RESULT_OK;
+	_eu_checkreturn(find_inline_callee(s, sc, v, &callee));
+	if (callee == NULL)
+		return EU_RESULT_OK;
+
+	/* check the variable still holds the procedure */
+	_eu_checkreturn(compile(s, sc, proto, _eupair_head(_euvalue_to_pair(v)), 0));
+	_eu_makeproto(&value, callee);
+	_eu_checkreturn(euproto_add_constant(s, proto, &value, &index));
+	_eu_checkreturn(euproto_append_instruction(s, proto, IGUARD(index)));
+	test = proto->code_length;
+	_eu_checkreturn(euproto_append_instruction(s, proto, ITEST(0)));
+
+	scope.previous = sc;
+	scope.kind = SCOPE_INLINE;
+	scope.proto = callee;
+	scope.bound = eutable_new(s, 0);
+	if (scope.bound == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	/* bind the arguments */
+	formals = _euproto_formals(callee);
+	for (args = _eupair_tail(_euvalue_to_pair(v)); !_euvalue_is_null(args);
+		args = _eupair_tail(_euvalue_to_pair(args))) {
+		_eu_checkreturn(compile(s, sc, proto, _eupair_head(_euvalue_to_pair(args)),
+			0));
+		_eu_checkreturn(hidden_name(s, _eupair_head(_euvalue_to_pair(formals)),
+			&hidden));
+		_eu_checkreturn(bind_variable(s, &scope, proto,
+			_eupair_head(_euvalue_to_pair(formals)), &hidden));
+		formals = _eupair_tail(_euvalue_to_pair(formals));
+	}
+
+	/* run the body */
+	body = _eupair_tail(_euvalue_to_pair(_eupair_tail(_euvalue_to_pair(
+		&callee->source))));
+	_eu_checkreturn(compile_body(s, &scope, proto, body, is_tail));
+	jump = proto->code_length;
+	_eu_checkreturn(euproto_append_instruction(s, proto, IJUMP(0)));
+
+	/* or call whatever the variable holds instead */
+	proto->code[test] = ITEST(proto->code_length - test);
+	_eu_checkreturn(compile_call(s, sc, proto, v, is_tail));
+	proto->code[jump] = IJUMP(proto->code_length - jump);
+
+	*done = EU_TRUE;
+	return EU_RESULT_OK;
+}
+
+int compile_application(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* v, int is_tail) {
+	eu_value *head, value, guards;
+	const eu_syntax* syntax;
+	int done;
+
+	head = _eupair_head(_euvalue_to_pair(v));
+
+	/* check whether head names a special form, in which case its compiler
+	 * takes over */
+	_eu_checkreturn(find_syntax(s, head, &syntax));
+	if (syntax != NULL)
+		return syntax->compile(s, sc, proto, v, is_tail);
+	/* it's not a special form. treat as any value */
+
+	/* calls ending an iteration of a named let jump back to its start */
+	_eu_checkreturn(compile_loop_call(s, sc, proto, v, is_tail, &done));
+	if (done)
+		return EU_RESULT_OK;
+
+	/* calls to pure builtins with constant arguments become constants */
+	if (_eu_global(s)->peephole) {
+		guards = _null;
+		_eu_checkreturn(fold_application(s, sc, v, &done, &value, &guards));
+		if (done)
+			return compile_folded_call(s, sc, proto, v, is_tail, &value, &guards);
+
+		/* and calls to small procedures run their bodies in place */
+		_eu_checkreturn(compile_inline_call(s, sc, proto, v, is_tail, &done));
+		if (done)
+			return EU_RESULT_OK;
+	}
+
+	return compile_call(s, sc, proto, v, is_tail);
+}
+
+int compile(europa* s, eu_cscope* sc, eu_proto* proto, eu_value* v,
+	int is_tail) {
 	int index;
+	eu_cscope* where;
+	eu_value* name;
 
 	switch (_euvalue_type(v)) {
 	case EU_TYPE_SYMBOL: /* symbol: variable reference */
-		/* add symbol to the prototype's constants */
-		_eu_checkreturn(euproto_add_constant(s, proto, v, &index));
+		/* find out what the name refers to */
+		_eu_checkreturn(resolve_name(s, sc, v, &where, &name));
+		if (_euvalue_is_null(name)) {
+			/* a named let's procedure is needed as a value */
+			where->failed = EU_TRUE;
+			name = v;
+		}
+
+		/* variables of enclosing procedures are the closure's free variables */
+		if (where != NULL) {
+			_eu_checkreturn(variable_access(s, sc, where, name, &index));
+			if (index >= 0) {
+				_eu_checkreturn(euproto_append_instruction(s, proto,
+					IFREFER(index)));
+				break;
+			}
+		}
 
-		/* add refer instruction to the code */
-		_eu_checkreturn(euproto_append_instruction(s, proto, IREFER(index)));
+		/* add the variable's name to the prototype's constants */
+		_eu_checkreturn(euproto_add_constant(s, proto, name, &index));
+
+		/* add refer instruction to the code, names no form binds can only be
+		 * globals and get a cached reference */
+		_eu_checkreturn(euproto_append_instruction(s, proto,
+			where == NULL ? IGREFER(index) : IREFER(index)));
 		break;
 	case EU_TYPE_PAIR: /* function call */
 		/* call function responsible for compiling function applications */
-		_eu_checkreturn(compile_application(s, proto, v, is_tail));
+		_eu_checkreturn(compile_application(s, sc, proto, v, is_tail));
 		break;
 	default: /* constant value */
 		/* add constant to the prototype */
@@ -461,16 +2354,28 @@ int eucode_compile(europa* s, eu_value* v, eu_value* chunk) {
 	eu_proto* top;
 	eu_closure* cl;
 	eu_value argssym;
+	eu_table* unit;
+	int res;
 
 	/* create the top level prototype */
 	top = euproto_new(s, &_null, 0, v, 0, 0);
 	if (top == NULL)
 		return EU_RESULT_BAD_ALLOC;
 
-	/* top level compile call */
-	_eu_checkreturn(compile(s, top, v, 1));
+	/* top level compile call, keeping track of the procedures it defines */
+	unit = _eu_global(s)->unit;
+	_eu_global(s)->unit = NULL;
+	res = compile(s, NULL, top, v, TAIL_RETURN);
+	_eu_global(s)->unit = unit;
+	if (res)
+		return res;
 	/* add return instruction to prototype */
 	_eu_checkreturn(euproto_append_instruction(s, top, IRETURN()));
+	/* clean the code up */
+	if (_eu_global(s)->peephole)
+		_eu_checkreturn(eucode_peephole(s, top));
+	/* its code is complete */
+	_eu_checkreturn(euproto_seal(s, top));
 
 	/* create closure from top level prototype */
 	cl = eucl_new(s, NULL, top, s->global->env);
@@ -485,3 +2390,333 @@ int eucode_compile(europa* s, eu_value* v, eu_value* chunk) {
 
 	return EU_RESULT_OK;
 }
+
+/**
+ * @brief Compiles a form as part of the code being compiled.
+ *
+ * Meant for special form compilers to compile their subforms.
+ *
+ * @param s The Europa state.
+ * @param sc The current scope, as given to the special form's compiler.
+ * @param proto The prototype being compiled.
+ * @param v The form.
+ * @param is_tail Whether the form is in tail position. Pass along what the
+ * special form's compiler got for forms in its tail position, 0 otherwise.
+ * @return The result of the operation.
+ */
+int eucode_compile_form(europa* s, eu_cscope* sc, eu_proto* proto, eu_value* v,
+	int is_tail) {
+	return compile(s, sc, proto, v, is_tail);
+}
+
+/**
+ * @brief Adds a special form to the compiler.
+ *
+ * Forms whose head is the syntax's name are compiled by its compiler function
+ * instead of being treated as applications. Defining a name again replaces its
+ * compiler.
+ *
+ * @param s The Europa state.
+ * @param syntax The syntax. It is referenced, not copied, so it must stay
+ * valid while the state is in use.
+ * @return The result of the operation.
+ */
+int eucode_define_syntax(europa* s, const eu_syntax* syntax) {
+	eu_value name, *slot;
+	eu_symbol* sym;
+
+	if (!s || !syntax || !syntax->name || !syntax->compile)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	sym = eusymbol_new(s, cast(void*, syntax->name));
+	if (sym == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makesym(&name, sym);
+
+	_eu_checkreturn(eutable_create_key(s, _eu_global(s)->syntax, &name, &slot));
+	_eu_makecpointer(slot, cast(void*, syntax));
+
+	/* kept forms may have been compiled with the old meaning */
+	_eu_checkreturn(eucache_clear(s));
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Creates the state's syntax table with the built in special forms.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int eucode_initialize_syntax(europa* s) {
+	const eu_syntax* syntax;
+
+	_eu_global(s)->syntax = eutable_new(s, 16);
+	if (_eu_global(s)->syntax == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	for (syntax = builtin_syntax; syntax->name != NULL; syntax++) {
+		_eu_checkreturn(eucode_define_syntax(s, syntax));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/*
+ * peephole optimizer
+ */
+
+/* instruction decoding helpers */
+#define inst_opc(i) (((i) >> OPCSHIFT) & OPCMASK)
+#define inst_val(i) ((i) & VALMASK)
+#define inst_off(i) (cast(int, inst_val(i)) - OFFBIAS)
+#define inst_reoff(i, off) ((i & (cast(eu_instruction, OPCMASK) << OPCSHIFT)) | offset_part(off))
+
+#define INOP() (opc_part(EU_OP_NOP) | val_part(0))
+
+/* whether the instruction's value is an offset to another instruction */
+#define has_offset(op) ((op) == EU_OP_TEST || (op) == EU_OP_JUMP ||\
+	(op) == EU_OP_CONTI || (op) == EU_OP_FRAME || (op) == EU_OP_CONTI_FRAME)
+/* whether the instruction only overwrites the accumulator */
+#define is_load(op) ((op) == EU_OP_CONST || (op) == EU_OP_REFER ||\
+	(op) == EU_OP_GREFER || (op) == EU_OP_FREFER || (op) == EU_OP_CLOSE)
+/* whether the instruction only overwrites the accumulator and can't fail */
+#define is_pure_load(op) ((op) == EU_OP_CONST || (op) == EU_OP_CLOSE)
+/* whether execution never goes to the next instruction */
+#define is_unconditional(op) ((op) == EU_OP_JUMP || (op) == EU_OP_RETURN ||\
+	(op) == EU_OP_HALT)
+
+/**
+ * @brief Follows a chain of jumps.
+ *
+ * @param code The code.
+ * @param length The code's length.
+ * @param target The first instruction's index.
+ * @return The index of the first instruction in the chain that is not a jump.
+ */
+static int thread_jumps(eu_instruction* code, int length, int target) {
+	int steps;
+
+	/* jumps may form a loop, give up after seeing every instruction */
+	for (steps = 0; target < length && inst_opc(code[target]) == EU_OP_JUMP &&
+		steps < length; steps++) {
+		target += inst_off(code[target]);
+	}
+
+	return target;
+}
+
+/**
+ * @brief Does one round of rewrites, replacing instructions by NOPs whenever
+ * they can be removed.
+ *
+ * @param proto The target prototype.
+ * @param targets Buffer with an element per instruction (plus one).
+ * @return Whether the code was changed.
+ */
+static int peephole_rewrite(eu_proto* proto, eu_byte* targets) {
+	eu_instruction* code;
+	int length, i, j, op, target, changed;
+	eu_value* k;
+
+	code = proto->code;
+	length = proto->code_length;
+	changed = 0;
+
+	/* find which instructions can be reached other than by falling through */
+	for (i = 0; i <= length; i++)
+		targets[i] = 0;
+	for (i = 0; i < length; i++) {
+		if (has_offset(inst_opc(code[i])))
+			targets[i + inst_off(code[i])] = 1;
+	}
+
+	for (i = 0; i < length; i++) {
+		op = inst_opc(code[i]);
+
+		/* branches to jumps go straight to the jumps' destination */
+		if (has_offset(op)) {
+			target = thread_jumps(code, length, i + inst_off(code[i]));
+			if (target != i + inst_off(code[i])) {
+				code[i] = inst_reoff(code[i], target - i);
+				changed = 1;
+			}
+
+			/* a jump to a return returns */
+			if (op == EU_OP_JUMP && target < length
+				&& inst_opc(code[target]) == EU_OP_RETURN) {
+				code[i] = code[target];
+				changed = 1;
+				op = EU_OP_RETURN;
+			} else if ((op == EU_OP_JUMP || op == EU_OP_TEST) && target == i + 1) {
+				/* branching to the next instruction does nothing */
+				code[i] = INOP();
+				changed = 1;
+				continue;
+			}
+		}
+
+		/* a test right after a constant has a known outcome, as long as it
+		 * can't be reached from anywhere else */
+		if (op == EU_OP_CONST && i + 1 < length && !targets[i + 1]
+			&& inst_opc(code[i + 1]) == EU_OP_TEST) {
+			/* only #t doesn't branch (see EU_OP_TEST) */
+			k = &(proto->constants[inst_val(code[i])]);
+			if (_euvalue_is_type(k, EU_TYPE_BOOLEAN) && _euvalue_to_bool(k)) {
+				code[i + 1] = INOP();
+			} else {
+				code[i + 1] = (opc_part(EU_OP_JUMP) | val_part(code[i + 1]));
+			}
+			changed = 1;
+		}
+
+		/* a load whose value is overwritten right away is useless */
+		if (is_pure_load(op) && i + 1 < length
+			&& is_load(inst_opc(code[i + 1]))) {
+			code[i] = INOP();
+			changed = 1;
+			continue;
+		}
+
+		/* nothing after an unconditional branch runs until an instruction that
+		 * is branched to */
+		if (is_unconditional(op)) {
+			for (j = i + 1; j < length && !targets[j]; j++) {
+				if (inst_opc(code[j]) != EU_OP_NOP) {
+					code[j] = INOP();
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	return changed;
+}
+
+/**
+ * @brief Removes NOP instructions, fixing branch offsets.
+ *
+ * @param proto The target prototype.
+ * @param map Buffer with an element per instruction (plus one).
+ */
+static void peephole_compact(eu_proto* proto, int* map) {
+	eu_instruction* code;
+	int length, i, n;
+
+	code = proto->code;
+	length = proto->code_length;
+
+	/* find each instruction's new index, removed instructions are replaced
+	 * by whatever followed them */
+	for (i = 0, n = 0; i < length; i++) {
+		map[i] = n;
+		if (inst_opc(code[i]) != EU_OP_NOP)
+			n++;
+	}
+	map[length] = n;
+
+	/* move the instructions */
+	for (i = 0; i < length; i++) {
+		if (inst_opc(code[i]) == EU_OP_NOP)
+			continue;
+
+		if (has_offset(inst_opc(code[i]))) {
+			code[map[i]] = inst_reoff(code[i], map[i + inst_off(code[i])] - map[i]);
+		} else {
+			code[map[i]] = code[i];
+		}
+	}
+
+	proto->code_length = n;
+}
+
+/**
+ * @brief Replaces common instruction pairs by fused instructions.
+ *
+ * @param proto The target prototype.
+ * @param targets Buffer with an element per instruction (plus one).
+ * @return Whether the code was changed.
+ */
+static int peephole_fuse(eu_proto* proto, eu_byte* targets) {
+	eu_instruction* code;
+	int length, i, op, next, fused, changed;
+
+	code = proto->code;
+	length = proto->code_length;
+	changed = 0;
+
+	for (i = 0; i <= length; i++)
+		targets[i] = 0;
+	for (i = 0; i < length; i++) {
+		if (has_offset(inst_opc(code[i])))
+			targets[i + inst_off(code[i])] = 1;
+	}
+
+	for (i = 0; i + 1 < length; i++) {
+		/* the second instruction must only be reachable through the first */
+		if (targets[i + 1])
+			continue;
+
+		op = inst_opc(code[i]);
+		next = inst_opc(code[i + 1]);
+		if (next == EU_OP_ARGUMENT) {
+			switch (op) {
+			case EU_OP_REFER: fused = EU_OP_REFER_ARG; break;
+			case EU_OP_GREFER: fused = EU_OP_GREFER_ARG; break;
+			case EU_OP_CONST: fused = EU_OP_CONST_ARG; break;
+			default: continue;
+			}
+		} else if (next == EU_OP_APPLY && op == EU_OP_GREFER) {
+			fused = EU_OP_GREFER_APPLY;
+		} else {
+			continue;
+		}
+
+		code[i] = opc_part(fused) | val_part(code[i]);
+		code[i + 1] = INOP();
+		changed = 1;
+		i++;
+	}
+
+	return changed;
+}
+
+/**
+ * @brief Runs the peephole optimizer over a prototype's code.
+ *
+ * Threads jumps, folds tests of constants, removes unreachable code and loads
+ * whose values are never used, then fuses common instruction pairs. Must run
+ * before the prototype's code can be executed.
+ *
+ * @param s The Europa state.
+ * @param proto The target prototype.
+ * @return The result of the operation.
+ */
+int eucode_peephole(europa* s, eu_proto* proto) {
+	eu_byte* targets;
+	int* map;
+
+	if (!s || !proto)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	targets = _eugc_malloc(_eu_gc(s), sizeof(eu_byte) * (proto->code_length + 1));
+	if (targets == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	map = _eugc_malloc(_eu_gc(s), sizeof(int) * (proto->code_length + 1));
+	if (map == NULL) {
+		_eugc_free(_eu_gc(s), targets);
+		return EU_RESULT_BAD_ALLOC;
+	}
+
+	/* keep going while rewrites open up more opportunities */
+	while (peephole_rewrite(proto, targets))
+		peephole_compact(proto, map);
+
+	/* fused instructions are left alone by the rewrites, so fuse last */
+	if (peephole_fuse(proto, targets))
+		peephole_compact(proto, map);
+
+	_eugc_free(_eu_gc(s), map);
+	_eugc_free(_eu_gc(s), targets);
+	return EU_RESULT_OK;
+}
@@ -1,7 +1,8 @@
 #include "europa/rt.h"
 
 eu_continuation* eucont_new(europa* s, eu_continuation* previous, eu_table* env,
-	eu_value* rib, eu_value* rib_lastpos, eu_closure* cl, unsigned int pc) {
+	eu_value* rib, eu_value* rib_lastpos, eu_closure* cl, unsigned int pc,
+	eu_cframe* cframe) {
 	eu_continuation* cont;
 
 	cont = _euobj_to_cont(eugc_new_object(s, EU_TYPE_CONTINUATION |
@@ -15,6 +16,11 @@ eu_continuation* eucont_new(europa* s, eu_continuation* previous, eu_table* env,
 	cont->pc = pc;
 	cont->rib = *rib;
 	cont->rib_lastpos = rib_lastpos;
+	cont->cframe = cframe;
+
+	/* frames are always created within the state's current dynamic extent */
+	cont->handler = s->handler;
+	cont->wind = s->wind;
 
 	return cont;
 }
@@ -44,6 +50,19 @@ int eucont_mark(europa* s, eu_gcmark mark, eu_continuation* cont) {
 		_eu_checkreturn(mark(s, _euproto_to_obj(cont->cl)));
 	}
 
+	/* mark the C closure's frame */
+	if (cont->cframe) {
+		_eu_checkreturn(mark(s, _eucframe_to_obj(cont->cframe)));
+	}
+
+	/* and the frames of its dynamic extent */
+	if (cont->handler) {
+		_eu_checkreturn(mark(s, _eucont_to_obj(cont->handler)));
+	}
+	if (cont->wind) {
+		_eu_checkreturn(mark(s, _eucont_to_obj(cont->wind)));
+	}
+
 	return EU_RESULT_OK;
 }
 
@@ -69,3 +88,54 @@ int eucont_destroy(europa* s, eu_continuation* cont) {
 eu_integer eucont_hash(eu_continuation* cont) {
 	return cast(eu_integer, cont);
 }
+
+/**
+ * @brief Creates a C closure frame.
+ *
+ * The frame's slots start as the empty list and its tag as 0.
+ *
+ * @param s The Europa state.
+ * @param slotc The number of slots.
+ * @return The frame. NULL in case it could not be allocated.
+ */
+eu_cframe* eucframe_new(europa* s, int slotc) {
+	eu_cframe* f;
+	int i;
+
+	if (s == NULL || slotc < 0)
+		return NULL;
+
+	f = _euobj_to_cframe(eugc_new_object(s, EU_TYPE_CFRAME |
+		EU_TYPEFLAG_COLLECTABLE,
+		sizeof(eu_cframe) + sizeof(eu_value) * (slotc > 0 ? slotc - 1 : 0)));
+	if (f == NULL)
+		return NULL;
+
+	f->tag = 0;
+	f->slotc = slotc;
+	for (i = 0; i < slotc; i++) {
+		_eu_makenull(_eucframe_slot(f, i));
+	}
+
+	return f;
+}
+
+/**
+ * @brief Marks the values in a C closure frame.
+ *
+ * @param s The Europa state.
+ * @param mark The marking function.
+ * @param f The target frame.
+ * @return The result of the operation.
+ */
+int eucframe_mark(europa* s, eu_gcmark mark, eu_cframe* f) {
+	int i;
+
+	for (i = 0; i < f->slotc; i++) {
+		if (_euvalue_is_collectable(_eucframe_slot(f, i))) {
+			_eu_checkreturn(mark(s, _euvalue_to_obj(_eucframe_slot(f, i))));
+		}
+	}
+
+	return EU_RESULT_OK;
+}
@@ -14,11 +14,16 @@
 #include "europa/rt.h"
 #include "europa/port.h"
 #include "europa/ports/memory.h"
+#include "europa/util.h"
+#include "europa/cache.h"
+#include "europa/task.h"
 
 #include <stdarg.h>
 #include <stdio.h>
 
 int global_basic_init(eu_global* g, eu_realloc f, void* ud, eu_cfunc panic) {
+	int i;
+
 	/* pretend this is a normal GC object */
 	g->_previous = g->_next = cast(eu_object*, g);
 	g->_color = EUGC_COLOR_WHITE;
@@ -30,6 +35,17 @@ int global_basic_init(eu_global* g, eu_realloc f, void* ud, eu_cfunc panic) {
 	/* initialize other fields */
 	g->panic = panic;
 	g->internalized = NULL;
+	for (i = 0; i < EU_KEYWORD_COUNT; i++)
+		g->keywords[i] = NULL;
+	g->env = NULL;
+	g->syntax = NULL;
+	g->unit = NULL;
+	g->cfuncs = NULL;
+	g->cfunc_list = NULL;
+	g->cfuncc = g->cfuncs_size = 0;
+	g->cache = NULL;
+	g->peephole = EU_TRUE;
+	g->hidden_names = 0;
 
 	return EU_RESULT_OK;
 }
@@ -55,6 +71,11 @@ int global_environment_init(europa* s, int pred_size) {
 	*tv = sv;\
 } while (0)
 
+#define __add_keyword(k, sname, sym, s, t, sv, tv) do {\
+	__add_symbol(sname, sym, s, t, sv, tv);\
+	_eu_global(s)->keywords[k] = sym;\
+} while (0)
+
 /** Bootstraps the internalized table.
  *
  * @param s The Europa state.
@@ -80,6 +101,15 @@ int euglobal_bootstrap_internalized(europa* s) {
 	__add_symbol("@@args", sym, s, t, symvalue, tvalue);
 	__add_symbol("@@call", sym, s, t, symvalue, tvalue);
 
+	/* keywords the compiler puts in the forms it builds */
+	__add_keyword(EU_KEYWORD_LAMBDA, "lambda", sym, s, t, symvalue, tvalue);
+	__add_keyword(EU_KEYWORD_DEFINE, "define", sym, s, t, symvalue, tvalue);
+	__add_keyword(EU_KEYWORD_LET, "let", sym, s, t, symvalue, tvalue);
+	__add_keyword(EU_KEYWORD_IF, "if", sym, s, t, symvalue, tvalue);
+	__add_keyword(EU_KEYWORD_BEGIN, "begin", sym, s, t, symvalue, tvalue);
+	__add_keyword(EU_KEYWORD_DO, "do", sym, s, t, symvalue, tvalue);
+	__add_keyword(EU_KEYWORD_GUARD, "guard", sym, s, t, symvalue, tvalue);
+
 	/* set internalized*/
 	_eu_global(s)->internalized = t;
 
@@ -91,6 +121,12 @@ int euglobal_bootstrap_internalized(europa* s) {
 		*(vptr) = (val)
 
 /** Allocates and initializes a new europa state.
+ *
+ * Every state made here has a heap, collector, symbol table and environment of
+ * its own, and nothing in it is reachable from other states, so several of
+ * them can run at once as long as each is only used by one thread at a time.
+ * What they may share is read only: image bytes (see euimage_load_shared and
+ * euimage_restore_heap) and the process' hash seed.
  *
  * @param f The realloc-like function.
  * @param ud Userdata for the realloc function.
@@ -103,6 +139,9 @@ europa* eu_new(eu_realloc f, void* ud, eu_cfunc panic, int* err) {
 	eu_global* gl;
 	int res;
 
+	/* make sure the hash seed is set before anything gets hashed */
+	eutil_init_hash_seed();
+
 	/* Even the main state is just an instance in the global's GC, so we must
 	 * first allocate a global. */
 	gl = (f)(ud, NULL, sizeof(eu_global));
@@ -137,6 +176,7 @@ europa* eu_new(eu_realloc f, void* ud, eu_cfunc panic, int* err) {
 
 	s->err = NULL;
 	s->global = gl;
+	s->fuel = -1;
 	s->global->main = s;
 
 	/* insert the global into the GC's root set */
@@ -155,6 +195,12 @@ europa* eu_new(eu_realloc f, void* ud, eu_cfunc panic, int* err) {
 		goto fail;
 	}
 
+	/* create the syntax table */
+	if ((res = eucode_initialize_syntax(s))) {
+		_checkset(err, res);
+		goto fail;
+	}
+
 	/* bootstrap internalized table */
 	if ((res = euglobal_bootstrap_internalized(s))) {
 		_checkset(err, res);
@@ -240,7 +286,14 @@ int eu_set_error_nf(europa* s, int flags, eu_error* nested, size_t len,
  */
 int eu_do_string(europa* s, void* text, eu_value* out) {
 	eu_port* p;
-	eu_value obj;
+	eu_value obj, chunk;
+
+	/* go through the compile cache if it is enabled */
+	if (_eu_global(s)->cache) {
+		_eu_checkreturn(eucache_compile_string(s, text, &chunk));
+		_eu_makenull(&obj);
+		return euvm_apply(s, &chunk, &obj, out);
+	}
 
 	/* create a memory port for the text */
 	p = _eumport_to_port(eumport_from_str(s, EU_PORT_FLAG_INPUT | EU_PORT_FLAG_TEXTUAL, text));
@@ -273,6 +326,9 @@ int eu_terminate(europa* s) {
 		return EU_RESULT_OK;
 	}
 
+	/* release the compile cache's entries */
+	_eu_checkreturn(eucache_destroy(s));
+
 	/* save the free function, its user data and the global state */
 	gl = s->global;
 	f = gl->gc.realloc;
@@ -286,6 +342,8 @@ int eu_terminate(europa* s) {
 	res = eugc_destroy(s);
 
 	/* release state and global */
+	if (gl->cfunc_list)
+		(f)(ud, gl->cfunc_list, 0);
 	(f)(ud, s, 0);
 	(f)(ud, gl, 0);
 
@@ -321,6 +379,8 @@ eu_uinteger euglobal_hash(eu_global* gl) {
  * @return The result of the operation.
  */
 int eustate_mark(europa* s, eu_gcmark mark, europa* state) {
+	eu_task* task;
+
 	if (!s || !mark || !state)
 		return EU_RESULT_NULL_ARGUMENT;
 
@@ -334,6 +394,19 @@ int eustate_mark(europa* s, eu_gcmark mark, europa* state) {
 		/* mark the stack */
 		_eu_checkreturn(mark(s, _eucont_to_obj(state->previous)));
 
+		/* mark the running C closure's frame */
+		if (state->cframe) {
+			_eu_checkreturn(mark(s, _eucframe_to_obj(state->cframe)));
+		}
+
+		/* mark the frames of the dynamic extent */
+		if (state->handler) {
+			_eu_checkreturn(mark(s, _eucont_to_obj(state->handler)));
+		}
+		if (state->wind) {
+			_eu_checkreturn(mark(s, _eucont_to_obj(state->wind)));
+		}
+
 		/* mark the rib */
 		if (_euvalue_is_collectable(&state->rib)) {
 			_eu_checkreturn(mark(s, state->rib.value.object));
@@ -345,6 +418,17 @@ int eustate_mark(europa* s, eu_gcmark mark, europa* state) {
 		}
 	}
 
+	/* mark the tasks, queue by queue */
+	if (state->task) {
+		_eu_checkreturn(mark(s, _eutask_to_obj(state->task)));
+	}
+	for (task = state->ready; task; task = task->next) {
+		_eu_checkreturn(mark(s, _eutask_to_obj(task)));
+	}
+	for (task = state->sleeping; task; task = task->next) {
+		_eu_checkreturn(mark(s, _eutask_to_obj(task)));
+	}
+
 	/* mark the global state (which should be in the root set, anyway) */
 	if (state->global) {
 		_eu_checkreturn(mark(s, cast(eu_object*, state->global)));
@@ -367,6 +451,8 @@ int eustate_mark(europa* s, eu_gcmark mark, europa* state) {
  * @return The result of the operation.
  */
 int euglobal_mark(europa* s, eu_gcmark mark, eu_global* gl) {
+	int i;
+
 	if (!s || !mark || !gl)
 		return EU_RESULT_NULL_ARGUMENT;
 
@@ -376,9 +462,28 @@ int euglobal_mark(europa* s, eu_gcmark mark, eu_global* gl) {
 	/* mark internalized table */
 	_eu_checkreturn(mark(s, _eutable_to_obj(gl->internalized)));
 
+	/* mark the compiler's keywords */
+	for (i = 0; i < EU_KEYWORD_COUNT; i++) {
+		_eu_checkreturn(mark(s, _eusymbol_to_obj(gl->keywords[i])));
+	}
+
 	/* mark global environment */
 	_eu_checkreturn(mark(s, _eutable_to_obj(gl->env)));
 
+	/* mark syntax table */
+	_eu_checkreturn(mark(s, _eutable_to_obj(gl->syntax)));
+
+	/* mark the procedures of the form being compiled */
+	_eu_checkreturn(mark(s, _eutable_to_obj(gl->unit)));
+
+	/* mark the C function registry */
+	_eu_checkreturn(mark(s, _eutable_to_obj(gl->cfuncs)));
+
+	/* mark the compiled forms kept by the compile cache */
+	if (gl->cache) {
+		_eu_checkreturn(eucache_mark(s, mark, gl->cache));
+	}
+
 	return EU_RESULT_OK;
 }
 
@@ -409,6 +409,7 @@ int eufport_read_string(europa* s, eu_fport* port, int k, eu_value* out) {
 		remaining -= utf8codepointsize(c);
 	}
 	((char*)cp)[0] = '\0';
+	eustring_rehash(str);
 
 	/* set out */
 	out->type = EU_TYPE_STRING | EU_TYPEFLAG_COLLECTABLE;
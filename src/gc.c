@@ -11,6 +11,7 @@
 #include "europa/vector.h"
 #include "europa/port.h"
 #include "europa/rt.h"
+#include "europa/task.h"
 
 #include <stdio.h>
 
@@ -220,6 +221,18 @@ int eugc_naive_mark(europa* s, eu_object* obj) {
 		_eu_checkreturn(eucont_mark(s, eugc_naive_mark, _euobj_to_cont(obj)));
 		break;
 
+	case EU_TYPE_CFRAME:
+		_eu_checkreturn(eucframe_mark(s, eugc_naive_mark, _euobj_to_cframe(obj)));
+		break;
+
+	case EU_TYPE_TASK:
+		_eu_checkreturn(eutask_mark(s, eugc_naive_mark, _euobj_to_task(obj)));
+		break;
+
+	case EU_TYPE_CHANNEL:
+		_eu_checkreturn(euchannel_mark(s, eugc_naive_mark, _euobj_to_channel(obj)));
+		break;
+
 	case EU_TYPE_PROTO:
 		_eu_checkreturn(euproto_mark(s, eugc_naive_mark, _euobj_to_proto(obj)));
 		break;
@@ -0,0 +1,1893 @@
+/** Binary images of compiled code.
+ *
+ * @file image.c
+ * @author Leonardo G.
+ */
+#include "europa/image.h"
+
+#include "europa/bytevector.h"
+#include "europa/ccont.h"
+#include "europa/character.h"
+#include "europa/error.h"
+#include "europa/gc.h"
+#include "europa/number.h"
+#include "europa/pair.h"
+#include "europa/string.h"
+#include "europa/symbol.h"
+#include "europa/table.h"
+#include "europa/vector.h"
+#include "europa/ports/file.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IMAGE_USE_MMAP
+#endif
+
+/* Images:
+ *
+ * An image holds the prototypes of compiled top level forms, so that programs
+ * can be run without reading and compiling their source again. Integers are
+ * written big endian, except for code:
+ *
+ *   magic       4 bytes, 0x7F 'E' 'U' 'B'
+ *   version     u16, EU_IMAGE_VERSION
+ *   flags       u16, EU_IMAGE_FLAG_LITTLE_CODE if code is little endian
+ *   protoc      u32, number of prototypes
+ *   topc        u32, number of top level prototypes, followed by their u32
+ *               indices, in the order they should run
+ *   table       protoc entries, each the u32 offset of a prototype in the
+ *               image and the u32 index of its parent (NO_PARENT if none)
+ *   prototypes, each:
+ *     formals      value
+ *     source       value
+ *     constantc    u32, followed by that many values
+ *     subprotoc    u32, followed by that many u32 prototype indices
+ *     capturec     u32, followed by that many captures, each a u8 from_free,
+ *                  a u8 shared, a u32 index and a u32 name
+ *     code_length  u32, then zeros up to an offset that is a multiple of 4
+ *                  and that many u32 instructions
+ *
+ * Loading an image only reads its header. Prototypes start out as stubs with
+ * no code and are read (and verified) when they are first needed: top level
+ * ones right away, the rest when a CLOSE first makes a closure from them, so
+ * the memory a program takes follows the code that actually runs. Files are
+ * mapped instead of read where the system allows and, when the code in them
+ * is in the machine's byte order, prototypes run it straight from the mapping.
+ * Hosts with several states can also keep an image's bytes themselves and load
+ * them into every state without copies (see euimage_load_shared).
+ *
+ * Values start with a tag byte. Pairs, strings, vectors and bytevectors are
+ * numbered in the order a prototype's values are written and written again as
+ * that number, which keeps a prototype's source and constants from copying
+ * what they share and lets constants be circular. Symbols are written by
+ * their names and interned again when loading. Prototypes are referenced by
+ * index. Subprototype lists have to agree with the table's parents, so the
+ * loaded prototypes form trees.
+ *
+ * Heap images hold a whole global environment instead, so that a state can
+ * start from what another one had set up (the standard library, a prelude and
+ * whatever else was defined) without running anything:
+ *
+ *   magic       4 bytes, 0x7F 'E' 'U' 'H'
+ *   version     u16, EU_HEAP_IMAGE_VERSION
+ *   flags       u16, as in images
+ *   names       u32, how many names the compiler had generated
+ *   env         value, the global environment table
+ *
+ * Every object in a heap is numbered, not only those in a prototype, and
+ * tables, closures and prototypes are written in place. Closures of C
+ * functions are written as the name their function was registered with (see
+ * eucc_register_cfunc) and bound again by name, as function addresses change
+ * from one process to the next. Tables are filled again key by key, so their
+ * keys are hashed as the restoring process hashes them.
+ */
+
+/** the magic bytes every image starts with */
+static const eu_byte image_magic[] = { 0x7F, 'E', 'U', 'B' };
+
+/** the magic bytes every heap image starts with */
+static const eu_byte heap_magic[] = { 0x7F, 'E', 'U', 'H' };
+
+/** how deeply values may nest (not counting list tails) */
+#define IMAGE_MAX_DEPTH 1024
+
+/** the parent index of top level prototypes */
+#define NO_PARENT 0xFFFFFFFF
+
+/* value tags */
+enum {
+	TAG_NULL,
+	TAG_FALSE,
+	TAG_TRUE,
+	TAG_EOF,
+	TAG_INTEGER, /* u64, two's complement */
+	TAG_REAL, /* u64, IEEE 754 bits */
+	TAG_CHARACTER, /* u32 */
+	TAG_SYMBOL, /* u32 size, then that many bytes of text, NUL included */
+	TAG_STRING, /* same as symbols */
+	TAG_PAIR, /* head value, then tail value */
+	TAG_VECTOR, /* u32 length, then that many values */
+	TAG_BYTEVECTOR, /* u32 length, then that many bytes */
+	TAG_PROTO, /* u32 prototype index */
+	TAG_SHARED, /* u32 number of an object written before */
+	/* heap images only */
+	TAG_TABLE, /* u8 comparator, index value, u32 count, then keys and values */
+	TAG_CLOSURE, /* u8 own_env, prototype or C function name, environment
+	                value, u32 free variable count, then their values */
+	TAG_PROTO_BODY, /* a prototype, as in images but with subprototypes in
+	                   place of their indices */
+};
+
+static int little_endian(void) {
+	const unsigned int one = 1;
+	return *cast(const eu_byte*, &one);
+}
+
+/* writing */
+
+typedef struct {
+	eu_byte* buf; /* the image, which is written to the port at the end */
+	size_t length; /* how many bytes there are */
+	size_t size; /* the buffer's size */
+	eu_table* shared; /* objects written so far (as C pointers), to their numbers */
+	int sharedc; /* number of objects written */
+	eu_table* index; /* prototypes (as C pointers) to their indices */
+	eu_proto** protos; /* prototypes in the image, by index */
+	uint32_t* parents; /* their parents' indices */
+	int protoc; /* number of prototypes */
+	int protos_size; /* size of the prototype arrays */
+	int heap; /* whether a heap is written, prototypes included in place */
+} image_writer;
+
+static int put_u8(europa* s, image_writer* w, eu_byte v) {
+	if (w->length >= w->size) {
+		w->size = w->size * 2 + 256;
+		w->buf = _eugc_realloc(_eu_gc(s), w->buf, w->size);
+		if (w->buf == NULL)
+			return EU_RESULT_BAD_ALLOC;
+	}
+	w->buf[w->length++] = v;
+	return EU_RESULT_OK;
+}
+
+static int put_u16(europa* s, image_writer* w, unsigned int v) {
+	_eu_checkreturn(put_u8(s, w, (v >> 8) & 0xFF));
+	return put_u8(s, w, v & 0xFF);
+}
+
+static int put_u32(europa* s, image_writer* w, uint32_t v) {
+	_eu_checkreturn(put_u16(s, w, (v >> 16) & 0xFFFF));
+	return put_u16(s, w, v & 0xFFFF);
+}
+
+static int put_u64(europa* s, image_writer* w, uint64_t v) {
+	_eu_checkreturn(put_u32(s, w, (v >> 32) & 0xFFFFFFFF));
+	return put_u32(s, w, v & 0xFFFFFFFF);
+}
+
+/** overwrites a u32 written before */
+static void patch_u32(image_writer* w, size_t pos, uint32_t v) {
+	w->buf[pos] = (v >> 24) & 0xFF;
+	w->buf[pos + 1] = (v >> 16) & 0xFF;
+	w->buf[pos + 2] = (v >> 8) & 0xFF;
+	w->buf[pos + 3] = v & 0xFF;
+}
+
+static int put_text(europa* s, image_writer* w, const char* text) {
+	size_t size;
+
+	size = strlen(text) + 1;
+	_eu_checkreturn(put_u32(s, w, size));
+	while (size--) {
+		_eu_checkreturn(put_u8(s, w, *text++));
+	}
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets a prototype's index in the image, giving it the next one if it
+ * has none yet.
+ */
+static int proto_index(europa* s, image_writer* w, eu_proto* proto,
+	int* index) {
+	eu_value key, *slot;
+
+	_eu_makecpointer(&key, proto);
+	_eu_checkreturn(eutable_get(s, w->index, &key, &slot));
+	if (slot) {
+		*index = _eunum_i(slot);
+		return EU_RESULT_OK;
+	}
+
+	if (w->protoc >= w->protos_size) {
+		w->protos_size = w->protos_size * 2 + 8;
+		w->protos = _eugc_realloc(_eu_gc(s), w->protos,
+			sizeof(eu_proto*) * w->protos_size);
+		w->parents = _eugc_realloc(_eu_gc(s), w->parents,
+			sizeof(uint32_t) * w->protos_size);
+		if (w->protos == NULL || w->parents == NULL)
+			return EU_RESULT_BAD_ALLOC;
+	}
+
+	_eu_checkreturn(eutable_create_key(s, w->index, &key, &slot));
+	_eu_makeint(slot, w->protoc);
+	w->protos[w->protoc] = proto;
+	w->parents[w->protoc] = NO_PARENT;
+	*index = w->protoc++;
+	return EU_RESULT_OK;
+}
+
+static int unwritable(europa* s, eu_value* v) {
+	_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+		"Values of type %s can't be written to an image.",
+		eu_type_name(_euvalue_type(v))));
+	return EU_RESULT_ERROR;
+}
+
+/** numbers an object, so that it is written as its number from then on */
+static int number_object(europa* s, image_writer* w, eu_value* v) {
+	eu_value key, *slot;
+
+	/* objects are told apart by identity, eqv? doesn't cover all of them */
+	_eu_makecpointer(&key, _euvalue_to_obj(v));
+	_eu_checkreturn(eutable_create_key(s, w->shared, &key, &slot));
+	_eu_makeint(slot, w->sharedc++);
+	return EU_RESULT_OK;
+}
+
+static int write_proto(europa* s, image_writer* w, eu_proto* proto,
+	int depth);
+static int write_table(europa* s, image_writer* w, eu_value* v, int depth);
+static int write_closure(europa* s, image_writer* w, eu_value* v, int depth);
+
+static int write_value(europa* s, image_writer* w, eu_value* v, int depth) {
+	eu_value key, *slot;
+	eu_bvector* bvec;
+	uint64_t bits;
+	int i;
+
+	if (depth > IMAGE_MAX_DEPTH) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Value nests too deeply to be written to an image."));
+		return EU_RESULT_ERROR;
+	}
+
+	/* list tails are written in a loop, not recursively */
+	for (;;) {
+		switch (_euvalue_type(v)) {
+		case EU_TYPE_TABLE:
+		case EU_TYPE_CLOSURE:
+		case EU_TYPE_PROTO:
+			if (!w->heap)
+				break;
+			/* fallthrough */
+		case EU_TYPE_PAIR:
+		case EU_TYPE_STRING:
+		case EU_TYPE_VECTOR:
+		case EU_TYPE_BYTEVECTOR:
+			/* objects that were already written are referenced by number */
+			_eu_makecpointer(&key, _euvalue_to_obj(v));
+			_eu_checkreturn(eutable_get(s, w->shared, &key, &slot));
+			if (slot) {
+				_eu_checkreturn(put_u8(s, w, TAG_SHARED));
+				return put_u32(s, w, _eunum_i(slot));
+			}
+			/* closures are numbered after their function, see write_closure */
+			if (!_euvalue_is_type(v, EU_TYPE_CLOSURE)) {
+				_eu_checkreturn(number_object(s, w, v));
+			}
+			break;
+		default:
+			break;
+		}
+
+		switch (_euvalue_type(v)) {
+		case EU_TYPE_NULL:
+			return put_u8(s, w, TAG_NULL);
+		case EU_TYPE_BOOLEAN:
+			return put_u8(s, w, _euvalue_to_bool(v) ? TAG_TRUE : TAG_FALSE);
+		case EU_TYPE_EOF:
+			return put_u8(s, w, TAG_EOF);
+		case EU_TYPE_NUMBER:
+			if (_eunum_is_exact(v)) {
+				_eu_checkreturn(put_u8(s, w, TAG_INTEGER));
+				return put_u64(s, w, cast(uint64_t, _eunum_i(v)));
+			}
+			memcpy(&bits, &_eunum_r(v), sizeof(bits));
+			_eu_checkreturn(put_u8(s, w, TAG_REAL));
+			return put_u64(s, w, bits);
+		case EU_TYPE_CHARACTER:
+			_eu_checkreturn(put_u8(s, w, TAG_CHARACTER));
+			return put_u32(s, w, _euvalue_to_char(v));
+		case EU_TYPE_SYMBOL:
+			_eu_checkreturn(put_u8(s, w, TAG_SYMBOL));
+			return put_text(s, w, _eusymbol_text(_euvalue_to_symbol(v)));
+		case EU_TYPE_STRING:
+			_eu_checkreturn(put_u8(s, w, TAG_STRING));
+			return put_text(s, w, _eustring_text(_euvalue_to_string(v)));
+		case EU_TYPE_BYTEVECTOR:
+			bvec = _euvalue_to_bvector(v);
+			_eu_checkreturn(put_u8(s, w, TAG_BYTEVECTOR));
+			_eu_checkreturn(put_u32(s, w, _eubvector_length(bvec)));
+			for (i = 0; i < _eubvector_length(bvec); i++) {
+				_eu_checkreturn(put_u8(s, w, _eubvector_ref(bvec, i)));
+			}
+			return EU_RESULT_OK;
+		case EU_TYPE_VECTOR:
+			_eu_checkreturn(put_u8(s, w, TAG_VECTOR));
+			_eu_checkreturn(put_u32(s, w,
+				_euvector_length(_euvalue_to_vector(v))));
+			for (i = 0; i < _euvector_length(_euvalue_to_vector(v)); i++) {
+				_eu_checkreturn(write_value(s, w,
+					_euvector_ref(_euvalue_to_vector(v), i), depth + 1));
+			}
+			return EU_RESULT_OK;
+		case EU_TYPE_PROTO:
+			if (w->heap) {
+				_eu_checkreturn(put_u8(s, w, TAG_PROTO_BODY));
+				return write_proto(s, w, _euvalue_to_proto(v), depth + 1);
+			}
+			_eu_checkreturn(proto_index(s, w, _euvalue_to_proto(v), &i));
+			_eu_checkreturn(put_u8(s, w, TAG_PROTO));
+			return put_u32(s, w, i);
+		case EU_TYPE_TABLE:
+			if (!w->heap)
+				return unwritable(s, v);
+			return write_table(s, w, v, depth + 1);
+		case EU_TYPE_CLOSURE:
+			if (!w->heap)
+				return unwritable(s, v);
+			return write_closure(s, w, v, depth + 1);
+		case EU_TYPE_PAIR:
+			_eu_checkreturn(put_u8(s, w, TAG_PAIR));
+			_eu_checkreturn(write_value(s, w, _eupair_head(_euvalue_to_pair(v)),
+				depth + 1));
+			v = _eupair_tail(_euvalue_to_pair(v));
+			continue;
+		default:
+			return unwritable(s, v);
+		}
+	}
+}
+
+static int write_proto(europa* s, image_writer* w, eu_proto* proto,
+	int depth) {
+	eu_capture* capture;
+	eu_instruction inst;
+	eu_value sub;
+	int i, index;
+
+	/* objects in images are only shared inside a prototype, so each can be
+	 * read alone */
+	if (!w->heap) {
+		_eu_checkreturn(eutable_clear(s, w->shared));
+		w->sharedc = 0;
+	}
+
+	/* prototypes loaded from images may not have been read yet */
+	_eu_checkreturn(euimage_materialize(s, proto));
+
+	_eu_checkreturn(write_value(s, w, &proto->formals, depth));
+	_eu_checkreturn(write_value(s, w, &proto->source, depth));
+
+	_eu_checkreturn(put_u32(s, w, proto->constantc));
+	for (i = 0; i < proto->constantc; i++) {
+		_eu_checkreturn(write_value(s, w, &(proto->constants[i]), depth));
+	}
+
+	/* heaps have their subprototypes in place */
+	_eu_checkreturn(put_u32(s, w, proto->subprotoc));
+	for (i = 0; i < proto->subprotoc; i++) {
+		if (w->heap) {
+			_eu_makeproto(&sub, proto->subprotos[i]);
+			_eu_checkreturn(write_value(s, w, &sub, depth));
+		} else {
+			_eu_checkreturn(proto_index(s, w, proto->subprotos[i], &index));
+			_eu_checkreturn(put_u32(s, w, index));
+		}
+	}
+
+	_eu_checkreturn(put_u32(s, w, proto->capturec));
+	for (capture = proto->captures;
+		capture < proto->captures + proto->capturec; capture++) {
+		_eu_checkreturn(put_u8(s, w, capture->from_free));
+		_eu_checkreturn(put_u8(s, w, capture->shared));
+		_eu_checkreturn(put_u32(s, w, capture->index));
+		_eu_checkreturn(put_u32(s, w, capture->name));
+	}
+
+	/* code is aligned and in the machine's byte order, so it can be run from
+	 * a mapping of the image on machines like this one */
+	_eu_checkreturn(put_u32(s, w, proto->code_length));
+	while (w->length % sizeof(eu_instruction)) {
+		_eu_checkreturn(put_u8(s, w, 0));
+	}
+	for (i = 0; i < proto->code_length; i++) {
+		inst = proto->code[i];
+		if (little_endian()) {
+			_eu_checkreturn(put_u8(s, w, inst & 0xFF));
+			_eu_checkreturn(put_u8(s, w, (inst >> 8) & 0xFF));
+			_eu_checkreturn(put_u8(s, w, (inst >> 16) & 0xFF));
+			_eu_checkreturn(put_u8(s, w, (inst >> 24) & 0xFF));
+		} else {
+			_eu_checkreturn(put_u32(s, w, inst));
+		}
+	}
+
+	return EU_RESULT_OK;
+}
+
+static int write_table(europa* s, image_writer* w, eu_value* v, int depth) {
+	eu_table* t;
+	eu_value key, index, *value;
+	int count;
+
+	t = _euvalue_to_table(v);
+	_eu_checkreturn(put_u8(s, w, TAG_TABLE));
+	_eu_checkreturn(put_u8(s, w, _eutable_comparator(t)));
+
+	if (_eutable_index(t)) {
+		_eu_maketable(&index, _eutable_index(t));
+	} else {
+		_eu_makenull(&index);
+	}
+	_eu_checkreturn(write_value(s, w, &index, depth));
+
+	/* count the keys, then write them */
+	count = 0;
+	_eu_checkreturn(eutable_next(s, t, NULL, &key, &value));
+	while (value) {
+		count++;
+		_eu_checkreturn(eutable_next(s, t, &key, &key, &value));
+	}
+	_eu_checkreturn(put_u32(s, w, count));
+
+	_eu_checkreturn(eutable_next(s, t, NULL, &key, &value));
+	while (value) {
+		_eu_checkreturn(write_value(s, w, &key, depth));
+		_eu_checkreturn(write_value(s, w, value, depth));
+		_eu_checkreturn(eutable_next(s, t, &key, &key, &value));
+	}
+
+	return EU_RESULT_OK;
+}
+
+static int write_closure(europa* s, image_writer* w, eu_value* v, int depth) {
+	eu_closure* cl;
+	eu_value fn, env;
+	int i;
+
+	cl = _euvalue_to_closure(v);
+	_eu_checkreturn(put_u8(s, w, TAG_CLOSURE));
+	_eu_checkreturn(put_u8(s, w, cl->own_env));
+
+	/* C functions are written as the name they were registered with */
+	if (cl->proto) {
+		_eu_makeproto(&fn, cl->proto);
+	} else {
+		_eu_checkreturn(eucc_cfunc_name(s, cl->cf, &fn));
+		if (_euvalue_is_null(&fn)) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Closure of an unregistered C function can't be written to an "
+				"image."));
+			return EU_RESULT_ERROR;
+		}
+	}
+	_eu_checkreturn(write_value(s, w, &fn, depth));
+
+	/* the closure is only made once its function is read */
+	_eu_checkreturn(number_object(s, w, v));
+
+	if (cl->env) {
+		_eu_maketable(&env, cl->env);
+	} else {
+		_eu_makenull(&env);
+	}
+	_eu_checkreturn(write_value(s, w, &env, depth));
+
+	_eu_checkreturn(put_u32(s, w, cl->freec));
+	for (i = 0; i < cl->freec; i++) {
+		_eu_checkreturn(write_value(s, w, &cl->free[i], depth));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Numbers every prototype reachable from the top level ones, noting
+ * their parents.
+ */
+static int collect_protos(europa* s, image_writer* w) {
+	int i, j, index;
+	eu_proto* proto;
+
+	for (i = 0; i < w->protoc; i++) {
+		proto = w->protos[i];
+
+		/* prototypes loaded from other images may not have been read yet */
+		_eu_checkreturn(euimage_materialize(s, proto));
+
+		for (j = 0; j < proto->subprotoc; j++) {
+			_eu_checkreturn(proto_index(s, w, proto->subprotos[j], &index));
+			w->parents[index] = i;
+		}
+		for (j = 0; j < proto->constantc; j++) {
+			if (_euvalue_is_type(&(proto->constants[j]), EU_TYPE_PROTO)) {
+				_eu_checkreturn(proto_index(s, w,
+					_euvalue_to_proto(&(proto->constants[j])), &index));
+			}
+		}
+	}
+
+	return EU_RESULT_OK;
+}
+
+static int write_image(europa* s, image_writer* w, eu_proto** protos,
+	int count) {
+	size_t table;
+	int i, index;
+
+	/* top level prototypes come first, then everything they reach */
+	for (i = 0; i < count; i++) {
+		_eu_checkreturn(proto_index(s, w, protos[i], &index));
+	}
+	_eu_checkreturn(collect_protos(s, w));
+
+	for (i = 0; i < cast(int, sizeof(image_magic)); i++) {
+		_eu_checkreturn(put_u8(s, w, image_magic[i]));
+	}
+	_eu_checkreturn(put_u16(s, w, EU_IMAGE_VERSION));
+	_eu_checkreturn(put_u16(s, w,
+		little_endian() ? EU_IMAGE_FLAG_LITTLE_CODE : 0));
+
+	_eu_checkreturn(put_u32(s, w, w->protoc));
+	_eu_checkreturn(put_u32(s, w, count));
+	for (i = 0; i < count; i++) {
+		_eu_checkreturn(proto_index(s, w, protos[i], &index));
+		_eu_checkreturn(put_u32(s, w, index));
+	}
+
+	/* the table is filled in as prototypes are written */
+	table = w->length;
+	for (i = 0; i < w->protoc; i++) {
+		_eu_checkreturn(put_u32(s, w, 0));
+		_eu_checkreturn(put_u32(s, w, w->parents[i]));
+	}
+
+	for (i = 0; i < w->protoc; i++) {
+		patch_u32(w, table + 8 * i, w->length);
+		_eu_checkreturn(write_proto(s, w, w->protos[i], 0));
+	}
+
+	return EU_RESULT_OK;
+}
+
+static int writer_init(europa* s, image_writer* w, int heap) {
+	w->buf = NULL;
+	w->length = w->size = 0;
+	w->sharedc = 0;
+	w->protos = NULL;
+	w->parents = NULL;
+	w->protoc = w->protos_size = 0;
+	w->heap = heap;
+	w->shared = eutable_new(s, 0);
+	w->index = eutable_new(s, 0);
+	if (w->shared == NULL || w->index == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	return EU_RESULT_OK;
+}
+
+/** sends what was written to the port, if writing went well, and cleans up */
+static int writer_finish(europa* s, image_writer* w, eu_port* port, int res) {
+	size_t i;
+
+	for (i = 0; res == EU_RESULT_OK && i < w->length; i++) {
+		res = euport_write_u8(s, port, w->buf[i]);
+	}
+
+	if (w->buf)
+		_eugc_free(_eu_gc(s), w->buf);
+	if (w->protos)
+		_eugc_free(_eu_gc(s), w->protos);
+	if (w->parents)
+		_eugc_free(_eu_gc(s), w->parents);
+	return res;
+}
+
+/**
+ * @brief Writes compiled top level prototypes as an image.
+ *
+ * Everything the prototypes reference (subprototypes and constants) is written
+ * along with them. Prototypes made by eucode_compile are top level ones.
+ *
+ * @param s The Europa state.
+ * @param port The binary output port to write the image to.
+ * @param protos The top level prototypes, in the order they should run.
+ * @param count The number of top level prototypes.
+ * @return The result of the operation.
+ */
+int euimage_write(europa* s, eu_port* port, eu_proto** protos, int count) {
+	image_writer w;
+
+	if (!s || !port || (count > 0 && !protos))
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_checkreturn(writer_init(s, &w, EU_FALSE));
+	return writer_finish(s, &w, port, write_image(s, &w, protos, count));
+}
+
+/* loading */
+
+typedef struct {
+	eu_image* image; /* the image read from, NULL for heaps */
+	const eu_byte* data; /* the image's bytes */
+	size_t size; /* their size */
+	size_t pos; /* where reading is at */
+	eu_byte native_code; /* whether code is in the machine's byte order */
+	eu_value* shared; /* objects read so far, by number */
+	int sharedc; /* number of objects read */
+	int shared_size; /* size of the object array */
+	eu_table* parents; /* heap prototypes (as C pointers) to their parents */
+} image_reader;
+
+static void reader_init(image_reader* r, eu_image* image,
+	const eu_byte* data, size_t size, size_t pos) {
+	r->image = image;
+	r->data = data;
+	r->size = size;
+	r->pos = pos;
+	r->native_code = image ? image->native_code : EU_FALSE;
+	r->shared = NULL;
+	r->sharedc = r->shared_size = 0;
+	r->parents = NULL;
+}
+
+/** reads a u32 from the image's table, which was checked to fit */
+static uint32_t table_u32(eu_image* image, size_t pos) {
+	const eu_byte* p = image->data + pos;
+	return (cast(uint32_t, p[0]) << 24) | (cast(uint32_t, p[1]) << 16) |
+		(cast(uint32_t, p[2]) << 8) | p[3];
+}
+
+#define proto_offset(image, i) table_u32(image, (image)->table + 8 * (i))
+#define proto_parent(image, i) table_u32(image, (image)->table + 8 * (i) + 4)
+
+/**
+ * @brief Gets the prototype with some index in an image, creating a stub for
+ * it if there is none.
+ */
+static eu_proto* image_proto(europa* s, eu_image* image, int index) {
+	eu_proto* proto;
+
+	if (image->protos[index])
+		return image->protos[index];
+
+	proto = euproto_new(s, &_null, 0, &_null, 0, 0);
+	if (proto == NULL)
+		return NULL;
+	proto->image = image;
+	proto->image_index = index;
+	image->refs++;
+
+	image->protos[index] = proto;
+	return proto;
+}
+
+static int image_error(europa* s, const char* what) {
+	_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+		"Bad image: %s.", what));
+	return EU_RESULT_ERROR;
+}
+
+/** checks that count things of at least some bytes each can be in the image */
+static int check_remaining(europa* s, image_reader* r, size_t count,
+	size_t size) {
+	if (count > (r->size - r->pos) / size)
+		return image_error(s, "truncated");
+	return EU_RESULT_OK;
+}
+
+static int get_u8(europa* s, image_reader* r, eu_byte* out) {
+	_eu_checkreturn(check_remaining(s, r, 1, 1));
+	*out = r->data[r->pos++];
+	return EU_RESULT_OK;
+}
+
+static int get_u16(europa* s, image_reader* r, unsigned int* out) {
+	_eu_checkreturn(check_remaining(s, r, 1, 2));
+	*out = (cast(unsigned int, r->data[r->pos]) << 8) | r->data[r->pos + 1];
+	r->pos += 2;
+	return EU_RESULT_OK;
+}
+
+static int get_u32(europa* s, image_reader* r, uint32_t* out) {
+	unsigned int high, low;
+
+	_eu_checkreturn(get_u16(s, r, &high));
+	_eu_checkreturn(get_u16(s, r, &low));
+	*out = (cast(uint32_t, high) << 16) | low;
+	return EU_RESULT_OK;
+}
+
+static int get_u64(europa* s, image_reader* r, uint64_t* out) {
+	uint32_t high, low;
+
+	_eu_checkreturn(get_u32(s, r, &high));
+	_eu_checkreturn(get_u32(s, r, &low));
+	*out = (cast(uint64_t, high) << 32) | low;
+	return EU_RESULT_OK;
+}
+
+/** gets an index into something with count elements */
+static int get_index(europa* s, image_reader* r, int count, int* out) {
+	uint32_t v;
+
+	_eu_checkreturn(get_u32(s, r, &v));
+	if (v >= cast(uint32_t, count))
+		return image_error(s, "index out of range");
+	*out = v;
+	return EU_RESULT_OK;
+}
+
+/** gets the count of things of at least some bytes each that follow */
+static int get_count(europa* s, image_reader* r, size_t size, int* out) {
+	uint32_t v;
+
+	_eu_checkreturn(get_u32(s, r, &v));
+	_eu_checkreturn(check_remaining(s, r, v, size));
+	*out = v;
+	return EU_RESULT_OK;
+}
+
+static int get_text(europa* s, image_reader* r, void** out) {
+	const eu_byte* text;
+	int size;
+
+	_eu_checkreturn(get_count(s, r, 1, &size));
+	text = r->data + r->pos;
+	if (size == 0 || text[size - 1] != '\0' || memchr(text, '\0', size - 1))
+		return image_error(s, "malformed text");
+	r->pos += size;
+	*out = cast(void*, text);
+	return EU_RESULT_OK;
+}
+
+/** numbers a read object, so later values can reference it */
+static int share(europa* s, image_reader* r, eu_value* v) {
+	if (r->sharedc >= r->shared_size) {
+		r->shared_size = r->shared_size * 2 + 16;
+		r->shared = _eugc_realloc(_eu_gc(s), r->shared,
+			sizeof(eu_value) * r->shared_size);
+		if (r->shared == NULL)
+			return EU_RESULT_BAD_ALLOC;
+	}
+	r->shared[r->sharedc++] = *v;
+	return EU_RESULT_OK;
+}
+
+static int read_proto(europa* s, image_reader* r, eu_proto* proto,
+	int depth);
+static int read_table(europa* s, image_reader* r, eu_value* out, int depth);
+static int read_closure(europa* s, image_reader* r, eu_value* out,
+	int depth);
+
+static int read_value(europa* s, image_reader* r, eu_value* out, int depth) {
+	eu_byte tag;
+	uint32_t character;
+	uint64_t bits;
+	eu_real real;
+	void* text;
+	eu_symbol* sym;
+	eu_string* str;
+	eu_vector* vec;
+	eu_bvector* bvec;
+	eu_pair* pair;
+	eu_proto* proto;
+	eu_value key, *slot;
+	int length, index, i;
+
+	if (depth > IMAGE_MAX_DEPTH)
+		return image_error(s, "values nest too deeply");
+
+	/* list tails are read in a loop, not recursively */
+	for (;;) {
+		_eu_checkreturn(get_u8(s, r, &tag));
+
+		switch (tag) {
+		case TAG_NULL:
+			_eu_makenull(out);
+			return EU_RESULT_OK;
+		case TAG_FALSE:
+			_eu_makebool(out, EU_FALSE);
+			return EU_RESULT_OK;
+		case TAG_TRUE:
+			_eu_makebool(out, EU_TRUE);
+			return EU_RESULT_OK;
+		case TAG_EOF:
+			_eu_makeeof(out);
+			return EU_RESULT_OK;
+		case TAG_INTEGER:
+			_eu_checkreturn(get_u64(s, r, &bits));
+			_eu_makeint(out, cast(eu_integer, bits));
+			return EU_RESULT_OK;
+		case TAG_REAL:
+			_eu_checkreturn(get_u64(s, r, &bits));
+			memcpy(&real, &bits, sizeof(real));
+			_eu_makereal(out, real);
+			return EU_RESULT_OK;
+		case TAG_CHARACTER:
+			_eu_checkreturn(get_u32(s, r, &character));
+			_eu_makechar(out, cast(int, character));
+			return EU_RESULT_OK;
+		case TAG_SYMBOL:
+			_eu_checkreturn(get_text(s, r, &text));
+			sym = eusymbol_new(s, text);
+			if (sym == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			_eu_makesym(out, sym);
+			return EU_RESULT_OK;
+		case TAG_STRING:
+			_eu_checkreturn(get_text(s, r, &text));
+			str = eustring_new(s, text);
+			if (str == NULL)
+				return image_error(s, "invalid string");
+			_eu_makestring(out, str);
+			return share(s, r, out);
+		case TAG_BYTEVECTOR:
+			_eu_checkreturn(get_count(s, r, 1, &length));
+			bvec = eubvector_new(s, length, cast(eu_byte*, r->data + r->pos));
+			if (bvec == NULL)
+				return image_error(s, "invalid bytevector");
+			r->pos += length;
+			_eu_makebvector(out, bvec);
+			return share(s, r, out);
+		case TAG_VECTOR:
+			_eu_checkreturn(get_count(s, r, 1, &length));
+			vec = euvector_new(s, NULL, length);
+			if (vec == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			for (i = 0; i < length; i++) {
+				_eu_makenull(_euvector_ref(vec, i));
+			}
+			_eu_makevector(out, vec);
+			_eu_checkreturn(share(s, r, out));
+			for (i = 0; i < length; i++) {
+				_eu_checkreturn(read_value(s, r, _euvector_ref(vec, i),
+					depth + 1));
+			}
+			return EU_RESULT_OK;
+		case TAG_PROTO:
+			if (r->image == NULL)
+				return image_error(s, "prototype index in a heap");
+			_eu_checkreturn(get_index(s, r, r->image->protoc, &index));
+			proto = image_proto(s, r->image, index);
+			if (proto == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			_eu_makeproto(out, proto);
+			return EU_RESULT_OK;
+		case TAG_PROTO_BODY:
+			if (r->image != NULL)
+				return image_error(s, "heap value in an image");
+			proto = euproto_new(s, &_null, 0, &_null, 0, 0);
+			if (proto == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			_eu_makeproto(out, proto);
+			_eu_checkreturn(share(s, r, out));
+			/* it is verified once its parent (if any) is known */
+			_eu_makecpointer(&key, proto);
+			_eu_checkreturn(eutable_create_key(s, r->parents, &key, &slot));
+			_eu_makenull(slot);
+			return read_proto(s, r, proto, depth + 1);
+		case TAG_TABLE:
+			if (r->image != NULL)
+				return image_error(s, "heap value in an image");
+			return read_table(s, r, out, depth + 1);
+		case TAG_CLOSURE:
+			if (r->image != NULL)
+				return image_error(s, "heap value in an image");
+			return read_closure(s, r, out, depth + 1);
+		case TAG_SHARED:
+			_eu_checkreturn(get_index(s, r, r->sharedc, &index));
+			*out = r->shared[index];
+			return EU_RESULT_OK;
+		case TAG_PAIR:
+			pair = eupair_new(s, &_null, &_null);
+			if (pair == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			_eu_makepair(out, pair);
+			_eu_checkreturn(share(s, r, out));
+			_eu_checkreturn(read_value(s, r, _eupair_head(pair), depth + 1));
+			out = _eupair_tail(pair);
+			continue;
+		default:
+			return image_error(s, "unknown value tag");
+		}
+	}
+}
+
+
+/**
+ * @brief Reads a prototype into a stub (or an empty one, in heaps).
+ */
+static int read_proto(europa* s, image_reader* r, eu_proto* proto,
+	int depth) {
+	eu_image* image;
+	eu_proto* sub;
+	eu_capture capture;
+	eu_value value, key, *slot;
+	eu_byte flag;
+	uint32_t inst;
+	int count, i, index;
+
+	image = r->image;
+
+	_eu_checkreturn(read_value(s, r, &proto->formals, depth));
+	_eu_checkreturn(read_value(s, r, &proto->source, depth));
+
+	/* constants are read in place, so they are counted as they are read */
+	_eu_checkreturn(get_count(s, r, 1, &count));
+	if (count > 0) {
+		proto->constants = _eugc_malloc(_eu_gc(s), sizeof(eu_value) * count);
+		if (proto->constants == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		proto->constants_size = count;
+	}
+	for (i = 0; i < count; i++) {
+		_eu_makenull(&(proto->constants[i]));
+		proto->constantc++;
+		_eu_checkreturn(read_value(s, r, &(proto->constants[i]), depth));
+	}
+
+	_eu_checkreturn(get_count(s, r, 1, &count));
+	for (i = 0; i < count; i++) {
+		if (image == NULL) {
+			/* heaps have subprototypes in place, which can have one parent */
+			_eu_checkreturn(read_value(s, r, &value, depth));
+			if (!_euvalue_is_type(&value, EU_TYPE_PROTO))
+				return image_error(s, "subprototype is not a prototype");
+			sub = _euvalue_to_proto(&value);
+			_eu_makecpointer(&key, sub);
+			_eu_checkreturn(eutable_get(s, r->parents, &key, &slot));
+			if (slot == NULL || !_euvalue_is_null(slot))
+				return image_error(s, "prototype has more than one parent");
+			_eu_makeproto(slot, proto);
+		} else {
+			_eu_checkreturn(get_index(s, r, image->protoc, &index));
+			if (proto_parent(image, index) != cast(uint32_t, proto->image_index))
+				return image_error(s, "subprototype of another prototype");
+			sub = image_proto(s, image, index);
+			if (sub == NULL)
+				return EU_RESULT_BAD_ALLOC;
+		}
+		_eu_checkreturn(euproto_add_subproto(s, proto, sub, NULL));
+	}
+
+	_eu_checkreturn(get_count(s, r, 10, &count));
+	for (i = 0; i < count; i++) {
+		_eu_checkreturn(get_u8(s, r, &flag));
+		capture.from_free = flag != 0;
+		_eu_checkreturn(get_u8(s, r, &flag));
+		capture.shared = flag != 0;
+		_eu_checkreturn(get_index(s, r, VALMASK + 1, &capture.index));
+		_eu_checkreturn(get_index(s, r, VALMASK + 1, &capture.name));
+		_eu_checkreturn(euproto_add_capture(s, proto, &capture, NULL));
+	}
+
+	_eu_checkreturn(get_u32(s, r, &inst));
+	while (r->pos % sizeof(eu_instruction)) {
+		_eu_checkreturn(get_u8(s, r, &flag));
+	}
+	_eu_checkreturn(check_remaining(s, r, inst, sizeof(eu_instruction)));
+	count = inst;
+
+	if (image && count > 0 && r->native_code && cast(uintptr_t, r->data + r->pos) %
+		sizeof(eu_instruction) == 0) {
+		/* run the code right where it is */
+		proto->code = cast(eu_instruction*, r->data + r->pos);
+		r->pos += sizeof(eu_instruction) * count;
+	} else if (count > 0) {
+		proto->code = _eugc_malloc(_eu_gc(s), sizeof(eu_instruction) * count);
+		if (proto->code == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		for (i = 0; i < count; i++) {
+			if (r->native_code) {
+				memcpy(&inst, r->data + r->pos, sizeof(inst));
+				r->pos += sizeof(inst);
+			} else if (little_endian()) {
+				_eu_checkreturn(get_u32(s, r, &inst));
+			} else {
+				inst = cast(uint32_t, r->data[r->pos]) |
+					(cast(uint32_t, r->data[r->pos + 1]) << 8) |
+					(cast(uint32_t, r->data[r->pos + 2]) << 16) |
+					(cast(uint32_t, r->data[r->pos + 3]) << 24);
+				r->pos += 4;
+			}
+			proto->code[i] = inst;
+		}
+	}
+	proto->code_length = proto->code_size = count;
+
+	return euproto_seal(s, proto);
+}
+
+static int read_table(europa* s, image_reader* r, eu_value* out, int depth) {
+	eu_table* t;
+	eu_value index, key, value, *slot;
+	eu_byte comparator;
+	int count, i;
+
+	t = eutable_new(s, 0);
+	if (t == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_maketable(out, t);
+	_eu_checkreturn(share(s, r, out));
+
+	_eu_checkreturn(get_u8(s, r, &comparator));
+	if (comparator >= EU_TABLE_COMPARATOR_LAST)
+		return image_error(s, "unknown table comparator");
+	_eu_checkreturn(eutable_set_comparator(s, t, comparator));
+
+	_eu_checkreturn(read_value(s, r, &index, depth));
+	if (_euvalue_is_type(&index, EU_TYPE_TABLE)) {
+		_eutable_set_index(t, _euvalue_to_table(&index));
+	} else if (!_euvalue_is_null(&index)) {
+		return image_error(s, "table index is not a table");
+	}
+
+	/* keys are inserted again, as their hashes may differ in this process */
+	_eu_checkreturn(get_count(s, r, 2, &count));
+	for (i = 0; i < count; i++) {
+		_eu_checkreturn(read_value(s, r, &key, depth));
+		_eu_checkreturn(read_value(s, r, &value, depth));
+		if (_euvalue_is_null(&key))
+			return image_error(s, "empty list as a table key");
+		_eu_checkreturn(eutable_create_key(s, t, &key, &slot));
+		if (slot == NULL)
+			return image_error(s, "bad table key");
+		*slot = value;
+	}
+
+	return EU_RESULT_OK;
+}
+
+static int read_closure(europa* s, image_reader* r, eu_value* out,
+	int depth) {
+	eu_closure* cl;
+	eu_cfunc cf;
+	eu_value fn, env;
+	eu_byte own_env;
+	uint32_t count;
+	int i;
+
+	_eu_checkreturn(get_u8(s, r, &own_env));
+
+	/* the function comes first, closures are made to fit it */
+	_eu_checkreturn(read_value(s, r, &fn, depth));
+	if (_euvalue_is_type(&fn, EU_TYPE_PROTO)) {
+		cl = eucl_new(s, NULL, _euvalue_to_proto(&fn), NULL);
+	} else {
+		_eu_checkreturn(eucc_find_cfunc(s, &fn, &cf));
+		if (cf == NULL) {
+			if (!_euvalue_is_type(&fn, EU_TYPE_SYMBOL))
+				return image_error(s, "closure of something not a function");
+			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+				"Bad image: C function %s is not registered.",
+				_eusymbol_text(_euvalue_to_symbol(&fn))));
+			return EU_RESULT_ERROR;
+		}
+		cl = eucl_new(s, cf, NULL, NULL);
+	}
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	cl->own_env = own_env != 0;
+	_eu_makeclosure(out, cl);
+	_eu_checkreturn(share(s, r, out));
+
+	_eu_checkreturn(read_value(s, r, &env, depth));
+	if (_euvalue_is_type(&env, EU_TYPE_TABLE)) {
+		cl->env = _euvalue_to_table(&env);
+	} else if (!_euvalue_is_null(&env)) {
+		return image_error(s, "closure environment is not a table");
+	}
+
+	_eu_checkreturn(get_u32(s, r, &count));
+	if (count != cast(uint32_t, cl->freec))
+		return image_error(s, "wrong number of free variables");
+	for (i = 0; i < cl->freec; i++) {
+		_eu_checkreturn(read_value(s, r, &cl->free[i], depth));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Turns a prototype that failed to be read back into a stub.
+ */
+static void unread_proto(europa* s, eu_proto* proto) {
+	if (proto->code && !_euproto_maps_code(proto))
+		_eugc_free(_eu_gc(s), proto->code);
+	proto->code = NULL;
+	proto->code_length = proto->code_size = 0;
+
+	if (proto->constants)
+		_eugc_free(_eu_gc(s), proto->constants);
+	proto->constants = NULL;
+	proto->constantc = proto->constants_size = 0;
+
+	if (proto->subprotos)
+		_eugc_free(_eu_gc(s), proto->subprotos);
+	proto->subprotos = NULL;
+	proto->subprotoc = proto->subprotos_size = 0;
+
+	if (proto->captures)
+		_eugc_free(_eu_gc(s), proto->captures);
+	proto->captures = NULL;
+	proto->capturec = proto->captures_size = 0;
+
+	_eu_makenull(&proto->formals);
+	_eu_makenull(&proto->source);
+}
+
+/**
+ * @brief Reads and verifies the prototype with some index in an image, whose
+ * parent (if any) was read already.
+ */
+static int materialize_index(europa* s, eu_image* image, int index) {
+	image_reader r;
+	eu_proto *proto, *parent;
+	uint32_t parent_index;
+	int res;
+
+	proto = image_proto(s, image, index);
+	if (proto == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	if (!_euproto_is_stub(proto))
+		return EU_RESULT_OK;
+
+	parent_index = proto_parent(image, index);
+	parent = parent_index == NO_PARENT ? NULL : image->protos[parent_index];
+
+	reader_init(&r, image, image->data, image->size,
+		proto_offset(image, index));
+
+	res = read_proto(s, &r, proto, 0);
+	/* nothing runs unless it passes the verifier */
+	if (res == EU_RESULT_OK)
+		res = euvm_verify(s, proto, parent);
+	if (res != EU_RESULT_OK)
+		unread_proto(s, proto);
+
+	if (r.shared)
+		_eugc_free(_eu_gc(s), r.shared);
+	return res;
+}
+
+/**
+ * @brief Reads a prototype from the image it came from, if it wasn't yet.
+ *
+ * The prototype's ancestors are read first, as verifying a prototype needs
+ * its parent's free variables.
+ *
+ * @param s The Europa state.
+ * @param proto The prototype.
+ * @return The result of the operation.
+ */
+int euimage_materialize(europa* s, eu_proto* proto) {
+	eu_image* image;
+	uint32_t parent;
+	int index, steps;
+
+	if (!s || !proto)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	image = proto->image;
+	while (_euproto_is_stub(proto)) {
+		/* find the oldest ancestor that wasn't read */
+		index = proto->image_index;
+		for (steps = 0; (parent = proto_parent(image, index)) != NO_PARENT &&
+			(image->protos[parent] == NULL ||
+			_euproto_is_stub(image->protos[parent])); steps++) {
+			if (steps >= image->protoc)
+				return image_error(s, "prototype is its own ancestor");
+			index = parent;
+		}
+
+		_eu_checkreturn(materialize_index(s, image, index));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Maps a file into memory, or reads it where that isn't possible.
+ */
+static int map_file(europa* s, const char* filename, const eu_byte** data,
+	size_t* size, int* mapped) {
+	FILE* file;
+	eu_byte* buf;
+	long length;
+#ifdef IMAGE_USE_MMAP
+	struct stat st;
+	void* map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd >= 0) {
+		map = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+			map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		if (map != MAP_FAILED) {
+			*data = map;
+			*size = st.st_size;
+			*mapped = EU_IMAGE_MAPPED;
+			return EU_RESULT_OK;
+		}
+	}
+	/* fall back to reading the file */
+#endif
+
+	file = fopen(filename, "rb");
+	if (file == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not open image file %s.", filename));
+		return EU_RESULT_BAD_RESOURCE;
+	}
+
+	/* read the whole file */
+	buf = NULL;
+	if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 &&
+		fseek(file, 0, SEEK_SET) == 0) {
+		buf = _eugc_malloc(_eu_gc(s), length + 1);
+		if (buf && fread(buf, 1, length, file) != cast(size_t, length)) {
+			_eugc_free(_eu_gc(s), buf);
+			buf = NULL;
+		}
+	}
+	fclose(file);
+
+	if (buf == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not read image file %s.", filename));
+		return EU_RESULT_BAD_RESOURCE;
+	}
+
+	*data = buf;
+	*size = length;
+	*mapped = EU_IMAGE_ALLOCATED;
+	return EU_RESULT_OK;
+}
+
+static void unmap_file(europa* s, const eu_byte* data, size_t size,
+	int mapped) {
+	if (mapped == EU_IMAGE_SHARED)
+		return;
+#ifdef IMAGE_USE_MMAP
+	if (mapped == EU_IMAGE_MAPPED) {
+		munmap(cast(void*, data), size);
+		return;
+	}
+#endif
+	_eugc_free(_eu_gc(s), cast(void*, data));
+}
+
+/**
+ * @brief Releases a prototype's reference to its image, freeing the image
+ * when no prototype references it anymore.
+ *
+ * @param s The Europa state.
+ * @param image The image.
+ * @return The result of the operation.
+ */
+int euimage_release(europa* s, eu_image* image) {
+	if (!s || !image)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if (--image->refs > 0)
+		return EU_RESULT_OK;
+
+	unmap_file(s, image->data, image->size, image->mapped);
+	if (image->protos)
+		_eugc_free(_eu_gc(s), image->protos);
+	_eugc_free(_eu_gc(s), image);
+	return EU_RESULT_OK;
+}
+
+static int read_header(europa* s, image_reader* r, const eu_byte* magic,
+	unsigned int expected) {
+	unsigned int version, flags;
+
+	_eu_checkreturn(check_remaining(s, r, 1, sizeof(image_magic)));
+	if (memcmp(r->data, magic, sizeof(image_magic)))
+		return image_error(s, "not an image");
+	r->pos += sizeof(image_magic);
+
+	_eu_checkreturn(get_u16(s, r, &version));
+	_eu_checkreturn(get_u16(s, r, &flags));
+	if (version != expected || (flags & ~EU_IMAGE_FLAG_LITTLE_CODE))
+		return image_error(s, "unsupported version");
+
+	r->native_code =
+		((flags & EU_IMAGE_FLAG_LITTLE_CODE) != 0) == little_endian();
+	return EU_RESULT_OK;
+}
+
+static int open_image(europa* s, eu_image* image, eu_value* out) {
+	image_reader r;
+	eu_closure* cl;
+	eu_pair* pair;
+	eu_value* slot;
+	uint32_t parent;
+	size_t tops;
+	int topc, i, index;
+
+	reader_init(&r, image, image->data, image->size, 0);
+
+	_eu_checkreturn(read_header(s, &r, image_magic, EU_IMAGE_VERSION));
+	image->native_code = r.native_code;
+
+	/* the table comes after the top level indices */
+	_eu_checkreturn(get_count(s, &r, 8, &image->protoc));
+	_eu_checkreturn(get_count(s, &r, 4, &topc));
+	tops = r.pos;
+	r.pos += 4 * topc;
+	_eu_checkreturn(check_remaining(s, &r, image->protoc, 8));
+	image->table = r.pos;
+
+	image->protos = _eugc_malloc(_eu_gc(s),
+		sizeof(eu_proto*) * (image->protoc + 1));
+	if (image->protos == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	for (i = 0; i < image->protoc; i++) {
+		image->protos[i] = NULL;
+
+		/* prototypes are read wherever the table says, so check it once */
+		parent = proto_parent(image, i);
+		if (proto_offset(image, i) >= image->size ||
+			(parent != NO_PARENT && parent >= cast(uint32_t, image->protoc)))
+			return image_error(s, "bad prototype table");
+	}
+
+	/* read the top level prototypes and make the chunks */
+	r.pos = tops;
+	_eu_makenull(out);
+	slot = out;
+	for (i = 0; i < topc; i++) {
+		_eu_checkreturn(get_index(s, &r, image->protoc, &index));
+		if (proto_parent(image, index) != NO_PARENT)
+			return image_error(s, "top level prototype has a parent");
+		_eu_checkreturn(materialize_index(s, image, index));
+
+		cl = eucl_new(s, NULL, image->protos[index], _eu_global_env(s));
+		if (cl == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		cl->own_env = EU_FALSE;
+
+		pair = eupair_new(s, &_null, &_null);
+		if (pair == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_makeclosure(_eupair_head(pair), cl);
+		_eu_makepair(slot, pair);
+		slot = _eupair_tail(pair);
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Opens an image, taking over its data.
+ */
+static int load_image(europa* s, const eu_byte* data, size_t size,
+	int mapped, eu_value* out) {
+	eu_image* image;
+	int res;
+
+	image = _eugc_malloc(_eu_gc(s), sizeof(eu_image));
+	if (image == NULL) {
+		unmap_file(s, data, size, mapped);
+		return EU_RESULT_BAD_ALLOC;
+	}
+
+	image->data = data;
+	image->size = size;
+	image->mapped = mapped;
+	image->native_code = EU_FALSE;
+	image->protoc = 0;
+	image->table = 0;
+	image->protos = NULL;
+	/* the loader holds a reference of its own while it works, so the image
+	 * stays around even if the stubs it makes are collected */
+	image->refs = 1;
+
+	res = open_image(s, image, out);
+	_eu_checkreturn(euimage_release(s, image));
+	return res;
+}
+
+/**
+ * @brief Loads an image from memory.
+ *
+ * The data is copied. Symbols are interned in the state and prototypes are
+ * checked by the verifier as they are read, which for anything but top level
+ * prototypes is only when they are first used.
+ *
+ * @param s The Europa state.
+ * @param data The image.
+ * @param size The image's size in bytes.
+ * @param out Where to place the list of top level procedures, in the order
+ * they should run.
+ * @return The result of the operation.
+ */
+int euimage_load(europa* s, const eu_byte* data, size_t size, eu_value* out) {
+	eu_byte* copy;
+
+	if (!s || !data || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	copy = _eugc_malloc(_eu_gc(s), size + 1);
+	if (copy == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	memcpy(copy, data, size);
+
+	return load_image(s, copy, size, EU_IMAGE_ALLOCATED, out);
+}
+
+/**
+ * @brief Loads an image from memory the host keeps, without copying it.
+ *
+ * The state only reads the data, so the same bytes (say, a file the host
+ * mapped once) can be loaded by any number of states, each on its own thread.
+ * Prototypes whose code is in the machine's byte order run it from the shared
+ * bytes; everything else the state makes from the image is its own. The data
+ * must stay valid and unchanged for as long as the state lives.
+ *
+ * @param s The Europa state.
+ * @param data The image.
+ * @param size The image's size in bytes.
+ * @param out Where to place the list of top level procedures, in the order
+ * they should run.
+ * @return The result of the operation.
+ */
+int euimage_load_shared(europa* s, const eu_byte* data, size_t size,
+	eu_value* out) {
+	if (!s || !data || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	return load_image(s, data, size, EU_IMAGE_SHARED, out);
+}
+
+/**
+ * @brief Loads an image from a file.
+ *
+ * The file is mapped into memory where the system allows it, so only the
+ * parts of it that are used get read.
+ *
+ * @param s The Europa state.
+ * @param filename The image's file name.
+ * @param out Where to place the list of top level procedures.
+ * @return The result of the operation.
+ */
+int euimage_load_file(europa* s, const char* filename, eu_value* out) {
+	const eu_byte* data;
+	size_t size;
+	int mapped;
+
+	if (!s || !filename || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_checkreturn(map_file(s, filename, &data, &size, &mapped));
+	return load_image(s, data, size, mapped, out);
+}
+
+/**
+ * @brief Compiles every form in a port, without running them.
+ *
+ * The prototypes are placed in a C array for euimage_write, so their closures
+ * are also kept in the list at the tail of keep, which the caller roots.
+ */
+static int compile_forms(europa* s, eu_port* port, eu_pair* keep,
+	eu_proto*** protos, int* count) {
+	eu_value form, chunk;
+	eu_proto** grown;
+	eu_pair* link;
+	int size;
+
+	size = 0;
+	for (;;) {
+		_eu_checkreturn(euport_read(s, port, &form));
+		if (_euvalue_is_type(&form, EU_TYPE_EOF))
+			return EU_RESULT_OK;
+
+		_eu_checkreturn(eucode_compile(s, &form, &chunk));
+		link = eupair_new(s, &chunk, _eupair_tail(keep));
+		if (link == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_makepair(_eupair_tail(keep), link);
+
+		if (*count >= size) {
+			size = size * 2 + 8;
+			grown = _eugc_realloc(_eu_gc(s), *protos, sizeof(eu_proto*) * size);
+			if (grown == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			*protos = grown;
+		}
+		(*protos)[(*count)++] = _euvalue_to_closure(&chunk)->proto;
+	}
+}
+
+static int close_fport(eu_fport* port) {
+	FILE* file;
+
+	file = port->file;
+	port->file = NULL;
+	return fclose(file) ? EU_RESULT_BAD_RESOURCE : EU_RESULT_OK;
+}
+
+/**
+ * @brief Compiles a source file into an image file.
+ *
+ * Forms are compiled one after the other, as they would have been evaluated,
+ * but nothing is run.
+ *
+ * @param s The Europa state.
+ * @param source The source file's name.
+ * @param image The name of the image file to write.
+ * @return The result of the operation.
+ */
+int euimage_compile_file(europa* s, const char* source, const char* image) {
+	eu_fport *in, *out;
+	eu_proto** protos;
+	eu_pair* keep;
+	int count, res;
+
+	if (!s || !source || !image)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	in = eufport_open(s, EU_PORT_FLAG_INPUT | EU_PORT_FLAG_TEXTUAL, source);
+	if (in == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not open source file %s.", source));
+		return EU_RESULT_BAD_RESOURCE;
+	}
+
+	/* the port in use and the compiled procedures stay in the root set until
+	 * the image is written */
+	keep = eupair_new(s, &_null, &_null);
+	if (keep == NULL) {
+		close_fport(in);
+		return EU_RESULT_BAD_ALLOC;
+	}
+	_eu_makeport(_eupair_head(keep), _eufport_to_port(in));
+	_eu_checkreturn(eugc_move_to_root(s, _eupair_to_obj(keep)));
+
+	protos = NULL;
+	count = 0;
+	res = compile_forms(s, _eufport_to_port(in), keep, &protos, &count);
+	close_fport(in);
+
+	if (res == EU_RESULT_OK) {
+		out = eufport_open(s, EU_PORT_FLAG_OUTPUT | EU_PORT_FLAG_BINARY, image);
+		if (out == NULL) {
+			eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+				"Could not open image file %s.", image);
+			res = EU_RESULT_BAD_RESOURCE;
+		} else {
+			_eu_makeport(_eupair_head(keep), _eufport_to_port(out));
+			res = euimage_write(s, _eufport_to_port(out), protos, count);
+			if (close_fport(out) && res == EU_RESULT_OK)
+				res = EU_RESULT_BAD_RESOURCE;
+		}
+	}
+
+	if (protos)
+		_eugc_free(_eu_gc(s), protos);
+	_eu_checkreturn(eugc_move_off_root(s, _eupair_to_obj(keep)));
+	return res;
+}
+
+/**
+ * @brief Runs the top level procedures of a loaded image, one after the other.
+ *
+ * The procedures are called from a prototype made for the purpose, so that
+ * this behaves like euvm_apply: if the machine is already running (from a C
+ * closure) the calls are only prepared and EU_RESULT_CONTINUE is returned.
+ *
+ * @param s The Europa state.
+ * @param chunks The list of top level procedures.
+ * @param out Where to place the value of the last one.
+ * @return The result of the operation.
+ */
+int euimage_run(europa* s, eu_value* chunks, eu_value* out) {
+	eu_proto* proto;
+	eu_closure* cl;
+	eu_value *current, runner;
+	int count, i;
+
+	if (!s || !chunks)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if (!_euvalue_is_null(chunks) && !eulist_is_list(s, chunks)) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Image procedures aren't a proper list."));
+		return EU_RESULT_BAD_ARGUMENT;
+	}
+	count = _euvalue_is_null(chunks) ? 0 :
+		eulist_length(s, _euvalue_to_pair(chunks));
+
+	proto = euproto_new(s, &_null, count + 1, &_null, 0, 3 * count + 2);
+	if (proto == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	/* call every procedure but the last with a frame returning right after
+	 * the call, the last one is a tail call */
+	for (i = 0, current = chunks; i < count;
+		i++, current = _eupair_tail(_euvalue_to_pair(current))) {
+		proto->constants[proto->constantc++] = *_eupair_head(_euvalue_to_pair(current));
+		if (i < count - 1) {
+			_eu_checkreturn(euproto_append_instruction(s, proto,
+				(EU_OP_FRAME << OPCSHIFT) | (OFFBIAS + 3)));
+		}
+		_eu_checkreturn(euproto_append_instruction(s, proto,
+			(EU_OP_CONST << OPCSHIFT) | i));
+		_eu_checkreturn(euproto_append_instruction(s, proto,
+			EU_OP_APPLY << OPCSHIFT));
+	}
+	if (count == 0) {
+		proto->constants[proto->constantc++] = _null;
+		_eu_checkreturn(euproto_append_instruction(s, proto,
+			EU_OP_CONST << OPCSHIFT));
+		_eu_checkreturn(euproto_append_instruction(s, proto,
+			EU_OP_RETURN << OPCSHIFT));
+	}
+	_eu_checkreturn(euproto_seal(s, proto));
+
+	cl = eucl_new(s, NULL, proto, _eu_global_env(s));
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	cl->own_env = EU_FALSE;
+	_eu_makeclosure(&runner, cl);
+
+	return euvm_apply(s, &runner, &_null, out);
+}
+
+/* heap images */
+
+static int write_heap(europa* s, image_writer* w) {
+	eu_value env;
+	int i;
+
+	for (i = 0; i < cast(int, sizeof(heap_magic)); i++) {
+		_eu_checkreturn(put_u8(s, w, heap_magic[i]));
+	}
+	_eu_checkreturn(put_u16(s, w, EU_HEAP_IMAGE_VERSION));
+	_eu_checkreturn(put_u16(s, w,
+		little_endian() ? EU_IMAGE_FLAG_LITTLE_CODE : 0));
+	_eu_checkreturn(put_u32(s, w, _eu_global(s)->hidden_names));
+
+	_eu_maketable(&env, _eu_global_env(s));
+	return write_value(s, w, &env, 0);
+}
+
+/**
+ * @brief Writes the state's global environment, and everything it reaches, as
+ * a heap image.
+ *
+ * Values that only make sense in the running process (ports, continuations,
+ * C pointers, closures of unregistered C functions) can't be written.
+ *
+ * @param s The Europa state.
+ * @param port The binary output port to write the image to.
+ * @return The result of the operation.
+ */
+int euimage_dump_heap(europa* s, eu_port* port) {
+	image_writer w;
+
+	if (!s || !port)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_checkreturn(writer_init(s, &w, EU_TRUE));
+	return writer_finish(s, &w, port, write_heap(s, &w));
+}
+
+/**
+ * @brief Writes a heap image to a file.
+ *
+ * @param s The Europa state.
+ * @param filename The name of the image file to write.
+ * @return The result of the operation.
+ */
+int euimage_dump_heap_file(europa* s, const char* filename) {
+	eu_fport* out;
+	int res;
+
+	if (!s || !filename)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	out = eufport_open(s, EU_PORT_FLAG_OUTPUT | EU_PORT_FLAG_BINARY, filename);
+	if (out == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not open image file %s.", filename));
+		return EU_RESULT_BAD_RESOURCE;
+	}
+
+	res = euimage_dump_heap(s, _eufport_to_port(out));
+	if (close_fport(out) && res == EU_RESULT_OK)
+		res = EU_RESULT_BAD_RESOURCE;
+	return res;
+}
+
+/**
+ * @brief Verifies every prototype read from a heap, once they all are.
+ */
+static int verify_heap(europa* s, image_reader* r) {
+	eu_value key, parent, *value, *slot;
+	int count, steps;
+
+	count = _eutable_count(r->parents);
+	_eu_checkreturn(eutable_next(s, r->parents, NULL, &key, &value));
+	while (value) {
+		/* subprototypes have to form trees */
+		parent = *value;
+		for (steps = 0; !_euvalue_is_null(&parent); steps++) {
+			if (steps >= count)
+				return image_error(s, "prototype is its own ancestor");
+			_eu_makecpointer(&parent, _euvalue_to_proto(&parent));
+			_eu_checkreturn(eutable_get(s, r->parents, &parent, &slot));
+			if (slot == NULL)
+				break;
+			parent = *slot;
+		}
+
+		_eu_checkreturn(euvm_verify(s, cast(eu_proto*, key.value.p),
+			_euvalue_is_null(value) ? NULL : _euvalue_to_proto(value)));
+		_eu_checkreturn(eutable_next(s, r->parents, &key, &key, &value));
+	}
+
+	return EU_RESULT_OK;
+}
+
+static int read_heap(europa* s, image_reader* r, eu_value* env) {
+	uint32_t names;
+
+	_eu_checkreturn(read_header(s, r, heap_magic, EU_HEAP_IMAGE_VERSION));
+	_eu_checkreturn(get_u32(s, r, &names));
+
+	_eu_checkreturn(read_value(s, r, env, 0));
+	if (!_euvalue_is_type(env, EU_TYPE_TABLE))
+		return image_error(s, "heap is not an environment");
+	if (r->pos != r->size)
+		return image_error(s, "trailing data");
+
+	/* nothing runs unless it passes the verifier */
+	_eu_checkreturn(verify_heap(s, r));
+
+	/* names the compiler generates have to stay unique */
+	if (names > _eu_global(s)->hidden_names)
+		_eu_global(s)->hidden_names = names;
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Restores a heap image, replacing the state's global environment.
+ *
+ * The C functions closures in the image refer to must have been registered,
+ * which eutil_register_standard_library does for the standard library's. The
+ * global environment is left as it was if the image can't be restored. The
+ * data is only read, so states on different threads may restore the same
+ * bytes at once.
+ *
+ * @param s The Europa state.
+ * @param data The image.
+ * @param size The image's size in bytes.
+ * @return The result of the operation.
+ */
+int euimage_restore_heap(europa* s, const eu_byte* data, size_t size) {
+	image_reader r;
+	eu_value env;
+	int result;
+
+	if (!s || !data)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	reader_init(&r, NULL, data, size, 0);
+	r.parents = eutable_new(s, 0);
+	if (r.parents == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	result = read_heap(s, &r, &env);
+	if (r.shared)
+		_eugc_free(_eu_gc(s), r.shared);
+	if (result != EU_RESULT_OK)
+		return result;
+
+	if (s->env == _eu_global_env(s))
+		s->env = _euvalue_to_table(&env);
+	_eu_global_env(s) = _euvalue_to_table(&env);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Restores a heap image from a file.
+ *
+ * The file is mapped (or read) once and released when the heap is restored.
+ *
+ * @param s The Europa state.
+ * @param filename The image's file name.
+ * @return The result of the operation.
+ */
+int euimage_restore_heap_file(europa* s, const char* filename) {
+	const eu_byte* data;
+	size_t size;
+	int mapped, result;
+
+	if (!s || !filename)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	_eu_checkreturn(map_file(s, filename, &data, &size, &mapped));
+	result = euimage_restore_heap(s, data, size);
+	unmap_file(s, data, size, mapped);
+	return result;
+}
+
+/* language side api */
+
+int euapi_register_image(europa* s) {
+	eu_table* env;
+
+	env = s->env;
+
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "compile-file", euapi_compile_file));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "load-image", euapi_load_image));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "dump-heap", euapi_dump_heap));
+
+	return EU_RESULT_OK;
+}
+
+int euapi_compile_file(europa* s) {
+	eu_value *source, *image;
+
+	_eucc_arity_proper(s, 2);
+	_eucc_argument_type(s, source, 0, EU_TYPE_STRING);
+	_eucc_argument_type(s, image, 1, EU_TYPE_STRING);
+
+	_eu_checkreturn(euimage_compile_file(s,
+		_eustring_text(_euvalue_to_string(source)),
+		_eustring_text(_euvalue_to_string(image))));
+
+	_eu_makebool(_eucc_return(s), EU_TRUE);
+	return EU_RESULT_OK;
+}
+
+int euapi_load_image(europa* s) {
+	eu_value *image, chunks;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, image, 0, EU_TYPE_STRING);
+
+	_eu_checkreturn(euimage_load_file(s,
+		_eustring_text(_euvalue_to_string(image)), &chunks));
+
+	/* the image's procedures are tail called */
+	return euimage_run(s, &chunks, _eucc_return(s));
+}
+
+int euapi_dump_heap(europa* s) {
+	eu_value* image;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, image, 0, EU_TYPE_STRING);
+
+	_eu_checkreturn(euimage_dump_heap_file(s,
+		_eustring_text(_euvalue_to_string(image))));
+
+	_eu_makebool(_eucc_return(s), EU_TRUE);
+	return EU_RESULT_OK;
+}
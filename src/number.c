@@ -200,35 +200,35 @@ int euapi_register_number(europa* s) {
 
 	env = s->env;
 
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "number?", euapi_numberQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "complex?", euapi_complexQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "real?", euapi_complexQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "rational?", euapi_rationalQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "integer?", euapi_integerQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "exact-integer?", euapi_exactQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "exact?", euapi_exactQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "inexact?", euapi_inexactQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "=", euapi_E));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "<", euapi_L));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, ">", euapi_G));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "<=", euapi_LE));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, ">=", euapi_GE));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "zero?", euapi_zeroQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "positive?", euapi_positiveQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "negative?", euapi_negativeQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "odd?", euapi_oddQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "even?", euapi_evenQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "min", euapi_min));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "max", euapi_max));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "+", euapi_P));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "*", euapi_S));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "-", euapi_M));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "/", euapi_D));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "abs", euapi_abs));
-
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "boolean?", euapi_booleanQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "not", euapi_not));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "boolean=?", euapi_booleanEQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "number?", euapi_numberQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "complex?", euapi_complexQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "real?", euapi_complexQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "rational?", euapi_rationalQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "integer?", euapi_integerQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "exact-integer?", euapi_exactQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "exact?", euapi_exactQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "inexact?", euapi_inexactQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "=", euapi_E));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "<", euapi_L));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, ">", euapi_G));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "<=", euapi_LE));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, ">=", euapi_GE));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "zero?", euapi_zeroQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "positive?", euapi_positiveQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "negative?", euapi_negativeQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "odd?", euapi_oddQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "even?", euapi_evenQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "min", euapi_min));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "max", euapi_max));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "+", euapi_P));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "*", euapi_S));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "-", euapi_M));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "/", euapi_D));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "abs", euapi_abs));
+
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "boolean?", euapi_booleanQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "not", euapi_not));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "boolean=?", euapi_booleanEQ));
 
 	return EU_RESULT_OK;
 }
@@ -15,6 +15,8 @@
 #include "europa/error.h"
 #include "europa/vector.h"
 #include "europa/character.h"
+#include "europa/util.h"
+#include "europa/ccont.h"
 
 /* global "singleton" declarations */
 eu_value _null = EU_VALUE_NULL;
@@ -25,7 +27,7 @@ eu_value _eof = EU_VALUE_EOF;
 const char* eu_type_names[] = {
 	"null", "boolean", "number", "character", "eof", "symbol", "string", "error",
 	"pair", "vector", "bytevector", "table", "port", "closure", "continuation",
-	"prototype", "state", "global", "c-pointer", "userdata", "something-invalid"
+	"prototype", "c-frame", "task", "channel", "state", "global", "c-pointer", "userdata", "something-invalid"
 };
 
 /** Checks whether a value is of a given type.
@@ -86,7 +88,9 @@ eu_uinteger euvalue_hash(eu_value* v) {
 	case EU_TYPE_NULL: return 0;
 	case EU_TYPE_NUMBER: return eunum_hash(v);
 	case EU_TYPE_BOOLEAN: return eubool_hash(v);
-	case EU_TYPE_BYTEVECTOR: return eubvector_hash(_euvalue_to_bvector(v));
+	/* bytevectors are eqv? only to themselves and are mutable, so they are
+	 * hashed by identity here (see euvalue_equal_hash for their contents) */
+	case EU_TYPE_BYTEVECTOR: return cast(eu_integer, _euvalue_to_obj(v));
 	case EU_TYPE_CHARACTER: return euchar_hash(v);
 	case EU_TYPE_CPOINTER: return cast(eu_integer, v->value.p);
 	case EU_TYPE_STRING: return eustring_hash(_euvalue_to_string(v));
@@ -104,6 +108,73 @@ eu_uinteger euvalue_hash(eu_value* v) {
 	}
 }
 
+/* the maximum number of values visited when hashing a structure */
+#define EQUAL_HASH_BUDGET 16
+
+/* mixes a value's hash into an accumulated hash */
+#define mix_hash(h, v) ((h) * 31 + (v))
+
+/** Hashes a value's structure, visiting at most *budget values.
+ *
+ * Values that are `equal?` have the same structure and consume the budget in
+ * the same way, so they always get the same hash.
+ *
+ * @param v The value to hash.
+ * @param budget The number of values that can still be visited.
+ * @return The hash.
+ */
+static eu_uinteger equal_hash(eu_value* v, int* budget) {
+	eu_uinteger h;
+	eu_vector* vec;
+	eu_integer i;
+
+	if (*budget <= 0)
+		return 0;
+	(*budget)--;
+
+	switch (_euvalue_type(v)) {
+	case EU_TYPE_PAIR:
+		h = EU_TYPE_PAIR;
+		while (_euvalue_is_pair(v) && *budget > 0) {
+			h = mix_hash(h, equal_hash(_eupair_head(_euvalue_to_pair(v)), budget));
+			v = _eupair_tail(_euvalue_to_pair(v));
+		}
+		/* hash the improper tail (or the null at the end of the list) */
+		if (!_euvalue_is_pair(v))
+			h = mix_hash(h, equal_hash(v, budget));
+		return h;
+
+	case EU_TYPE_VECTOR:
+		vec = _euvalue_to_vector(v);
+		h = mix_hash(EU_TYPE_VECTOR, _euvector_length(vec));
+		for (i = 0; i < _euvector_length(vec) && *budget > 0; i++)
+			h = mix_hash(h, equal_hash(_euvector_ref(vec, i), budget));
+		return h;
+
+	case EU_TYPE_BYTEVECTOR:
+		return eubvector_hash(_euvalue_to_bvector(v));
+
+	default:
+		return euvalue_hash(v);
+	}
+}
+
+/** Hashes a value so that values that are `equal?` have the same hash.
+ *
+ * Only the first few elements of lists and vectors are taken into account.
+ *
+ * @param v The value to hash.
+ * @return The hash.
+ */
+eu_uinteger euvalue_equal_hash(eu_value* v) {
+	int budget = EQUAL_HASH_BUDGET;
+
+	if (v == NULL)
+		return 0;
+
+	return equal_hash(v, &budget);
+}
+
 /** Checks whether two values are `eqv?`.
  *
  * @param a The first value.
@@ -210,9 +281,29 @@ int euvalue_eq(eu_value* a, eu_value* b, eu_value* out) {
  * @return Whether the operation was successful.
  */
 int euvalue_equal(eu_value* a, eu_value* b, eu_value* out) {
+	eu_vector *va, *vb;
+	eu_bvector *ba, *bb;
+	eu_integer i;
+
 	if (a == NULL || b == NULL || out == NULL)
 		return EU_RESULT_NULL_ARGUMENT;
 
+	/* compare list elements, iterating (instead of recursing) on the tails */
+	while (_euvalue_is_pair(a) && _euvalue_is_pair(b)) {
+		if (_euvalue_to_obj(a) == _euvalue_to_obj(b)) {
+			_eu_makebool(out, EU_TRUE);
+			return EU_RESULT_OK;
+		}
+
+		_eu_checkreturn(euvalue_equal(_eupair_head(_euvalue_to_pair(a)),
+			_eupair_head(_euvalue_to_pair(b)), out));
+		if (!_euvalue_to_bool(out))
+			return EU_RESULT_OK;
+
+		a = _eupair_tail(_euvalue_to_pair(a));
+		b = _eupair_tail(_euvalue_to_pair(b));
+	}
+
 	/* two objects can only be equal? if they're the same type */
 	if (_euvalue_type(a) != _euvalue_type(b)) {
 		_eu_makebool(out, EU_FALSE);
@@ -228,11 +319,34 @@ int euvalue_equal(eu_value* a, eu_value* b, eu_value* out) {
 	case EU_TYPE_CHARACTER: return euchar_eqv(a, b, out);
 	case EU_TYPE_SYMBOL: return eusymbol_eqv(a, b, out);
 	case EU_TYPE_STRING: return eustring_equal(a, b, out);
-	case EU_TYPE_BYTEVECTOR: // TODO: implement
+
+	case EU_TYPE_VECTOR:
+		/* vectors are equal if their elements are */
+		va = _euvalue_to_vector(a);
+		vb = _euvalue_to_vector(b);
+		if (_euvector_length(va) != _euvector_length(vb)) {
+			_eu_makebool(out, EU_FALSE);
+			return EU_RESULT_OK;
+		}
+		_eu_makebool(out, EU_TRUE);
+		for (i = 0; i < _euvector_length(va) && _euvalue_to_bool(out); i++) {
+			_eu_checkreturn(euvalue_equal(_euvector_ref(va, i),
+				_euvector_ref(vb, i), out));
+		}
+		return EU_RESULT_OK;
+
+	case EU_TYPE_BYTEVECTOR:
+		/* bytevectors are equal if their bytes are */
+		ba = _euvalue_to_bvector(a);
+		bb = _euvalue_to_bvector(b);
+		_eu_makebool(out, _eubvector_length(ba) == _eubvector_length(bb) &&
+			!memcmp(_eubvector_data(ba), _eubvector_data(bb),
+				_eubvector_length(ba)));
+		return EU_RESULT_OK;
+
 	case EU_TYPE_PAIR:
 	case EU_TYPE_PORT:
 	case EU_TYPE_TABLE:
-	case EU_TYPE_VECTOR:
 	case EU_TYPE_ERROR:
 	case EU_TYPE_CPOINTER:
 		_eu_makebool(out, _euvalue_to_obj(a) == _euvalue_to_obj(b));
@@ -250,3 +364,54 @@ int euvalue_equal(eu_value* a, eu_value* b, eu_value* out) {
 
 	return EU_RESULT_OK;
 }
+
+/**
+ * @addtogroup language_library
+ * @{
+ */
+
+int euapi_register_object(europa* s) {
+	eu_table* env;
+
+	env = s->env;
+
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "eq?", euapi_eqQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "eqv?", euapi_eqvQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "equal?", euapi_equalQ));
+
+	return EU_RESULT_OK;
+}
+
+int euapi_eqQ(europa* s) {
+	eu_value *a, *b;
+
+	_eucc_arity_proper(s, 2); /* check arity */
+	_eucc_argument(s, a, 0); /* get arguments */
+	_eucc_argument(s, b, 1);
+
+	return euvalue_eq(a, b, _eucc_return(s));
+}
+
+int euapi_eqvQ(europa* s) {
+	eu_value *a, *b;
+
+	_eucc_arity_proper(s, 2); /* check arity */
+	_eucc_argument(s, a, 0); /* get arguments */
+	_eucc_argument(s, b, 1);
+
+	return euvalue_eqv(a, b, _eucc_return(s));
+}
+
+int euapi_equalQ(europa* s) {
+	eu_value *a, *b;
+
+	_eucc_arity_proper(s, 2); /* check arity */
+	_eucc_argument(s, a, 0); /* get arguments */
+	_eucc_argument(s, b, 1);
+
+	return euvalue_equal(a, b, _eucc_return(s));
+}
+
+/**
+ * @}
+ */
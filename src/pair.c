@@ -193,14 +193,14 @@ int euapi_register_pair(europa* s) {
 	env = s->env;
 
 	/* */
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "pair?", euapi_pairQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "cons", euapi_cons));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "car", euapi_car));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "cdr", euapi_cdr));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "set-car!", euapi_set_carB));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "set-cdr!", euapi_set_cdrB));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "null?", euapi_nullQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "list", euapi_list));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "pair?", euapi_pairQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "cons", euapi_cons));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "car", euapi_car));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "cdr", euapi_cdr));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "set-car!", euapi_set_carB));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "set-cdr!", euapi_set_cdrB));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "null?", euapi_nullQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "list", euapi_list));
 
 	return EU_RESULT_OK;
 }
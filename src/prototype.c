@@ -5,6 +5,9 @@
  */
 #include "europa/rt.h"
 #include "europa/number.h"
+#include "europa/table.h"
+#include "europa/util.h"
+#include "europa/image.h"
 
 /** how much to grow the code buffer */
 #define CODE_GROWTH_RATE 5
@@ -12,6 +15,8 @@
 #define CONSTANTS_GROWTH_RATE 5
 /** how much to grow the subprotos array */
 #define SUBPROTOS_GROWTH_RATE 2
+/** how much to grow the captures array */
+#define CAPTURES_GROWTH_RATE 2
 
 int resize_constants(europa* s, eu_proto* proto, int size) {
 	proto->constants_size = size; /* new size */
@@ -37,7 +42,25 @@ int resize_subprotos(europa* s, eu_proto* proto, int size) {
 	return EU_RESULT_OK;
 }
 
+int resize_captures(europa* s, eu_proto* proto, int size) {
+	proto->captures_size = size;
+	proto->captures = _eugc_realloc(_eu_gc(s), proto->captures,
+		sizeof(eu_capture) * size);
+
+	/* check for errors */
+	if (proto->captures == NULL && size > 0)
+		return EU_RESULT_BAD_ALLOC;
+
+	return EU_RESULT_OK;
+}
+
 int resize_code(europa* s, eu_proto* proto, int size) {
+	/* global reference caches are indexed by instruction, drop them */
+	if (proto->gcache) {
+		_eugc_free(_eu_gc(s), proto->gcache);
+		proto->gcache = NULL;
+	}
+
 	proto->code_size = size;
 	proto->code = _eugc_realloc(_eu_gc(s), proto->code,
 		sizeof(eu_instruction) * size);
@@ -85,6 +108,14 @@ eu_proto* euproto_new(europa* s, eu_value* formals, int constants_size,
 	proto->subprotoc = 0;
 	proto->code = NULL;
 	proto->code_length = 0;
+	proto->captures = NULL;
+	proto->capturec = 0;
+	proto->captures_size = 0;
+	proto->framec = 0;
+	proto->gcache = NULL;
+	proto->constant_index = NULL;
+	proto->image = NULL;
+	proto->image_index = 0;
 
 	/* initialize to passed sizes */
 	checkreturnnull(resize_constants(s, proto, constants_size));
@@ -122,6 +153,11 @@ int euproto_mark(europa* s, eu_gcmark mark, eu_proto* p) {
 	/* mark the source object */
 	mark_if_collectable(&(p->source), mark, s)
 
+	/* mark the constant index, if still compiling */
+	if (p->constant_index) {
+		_eu_checkreturn(mark(s, _eutable_to_obj(p->constant_index)));
+	}
+
 	/* mark sub prototypes */
 	for (i = 0; i < p->subprotoc; i++) {
 		_eu_checkreturn(mark(s, _euproto_to_obj(p->subprotos[i])));
@@ -140,8 +176,9 @@ int euproto_mark(europa* s, eu_gcmark mark, eu_proto* p) {
  * @return The result of the operation.
  */
 int euproto_destroy(europa* s, eu_proto* p) {
-	/* only the code buffer is not garbage collected, so free it */
-	if (p->code) {
+	/* only the code buffer is not garbage collected, so free it (unless it is
+	 * part of an image) */
+	if (p->code && !_euproto_maps_code(p)) {
 		_eugc_free(_eu_gc(s), p->code);
 	}
 
@@ -153,6 +190,20 @@ int euproto_destroy(europa* s, eu_proto* p) {
 		_eugc_free(_eu_gc(s), p->subprotos);
 	}
 
+	if (p->captures) {
+		_eugc_free(_eu_gc(s), p->captures);
+	}
+
+	if (p->gcache) {
+		_eugc_free(_eu_gc(s), p->gcache);
+	}
+
+	/* the image may not be needed anymore */
+	if (p->image) {
+		p->image->protos[p->image_index] = NULL;
+		_eu_checkreturn(euimage_release(s, p->image));
+	}
+
 	return EU_RESULT_OK;
 }
 
@@ -198,6 +249,8 @@ eu_integer euproto_append_instruction(europa* s, eu_proto* proto, eu_instruction
  *
  * If the given value is found to be in the constant list already, then its
  * index is returned, but nothing is added (the list won't grow in size).
+ * Constants are found through an `equal?` table that is kept until the
+ * prototype is sealed.
  *
  * @param s The Europa state.
  * @param proto The target prototype.
@@ -207,25 +260,47 @@ eu_integer euproto_append_instruction(europa* s, eu_proto* proto, eu_instruction
  */
 eu_integer euproto_add_constant(europa* s, eu_proto* proto, eu_value* constant,
 	int* index) {
-	int i;
-	eu_value out;
+	eu_value* slot;
+
+	/* create the index on the first constant */
+	if (proto->constant_index == NULL) {
+		proto->constant_index = eutable_new(s, 0);
+		if (proto->constant_index == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_checkreturn(eutable_set_comparator(s, proto->constant_index,
+			EU_TABLE_EQUAL));
+	}
 
-	/* check if constant is in the constant list already */
-	for (i = 0; i < proto->constantc; i++) {
-		_eu_checkreturn(euvalue_equal(&(proto->constants[i]), constant, &out));
-		if (_euvalue_is_type(&out, EU_TYPE_BOOLEAN) && _euvalue_to_bool(&out)) {
+	/* null can't be a table key, look for it in the list */
+	if (_euvalue_is_null(constant)) {
+		for (slot = proto->constants; slot < proto->constants + proto->constantc;
+			slot++) {
+			if (_euvalue_is_null(slot)) {
+				if (index) *index = slot - proto->constants;
+				return EU_RESULT_OK;
+			}
+		}
+	} else {
+		/* check if constant is in the constant list already */
+		_eu_checkreturn(eutable_get(s, proto->constant_index, constant, &slot));
+		if (slot != NULL) {
 			/* value found, set index and return ok */
-			*index = i;
+			if (index) *index = _eunum_i(slot);
 			return EU_RESULT_OK;
 		}
+
+		/* remember where it is going to be */
+		_eu_checkreturn(eutable_create_key(s, proto->constant_index, constant,
+			&slot));
+		_eu_makeint(slot, proto->constantc);
 	}
 
 	/* value not found, we need to add it to the list */
 
 	/* check whether constant fits the array */
 	if (++(proto->constantc) > proto->constants_size) {
-		/* grow it in case it doesn't */
-		_eu_checkreturn(resize_constants(s, proto, proto->constants_size +
+		/* grow it in case it doesn't, geometrically now that lookups are cheap */
+		_eu_checkreturn(resize_constants(s, proto, proto->constants_size * 2 +
 			CONSTANTS_GROWTH_RATE));
 	}
 
@@ -238,6 +313,41 @@ eu_integer euproto_add_constant(europa* s, eu_proto* proto, eu_value* constant,
 	return EU_RESULT_OK;
 }
 
+/**
+ * @brief Marks the end of a prototype's compilation.
+ *
+ * Drops compile time data, trims the code and constant buffers to their
+ * lengths and sizes the frames calls will bind their formals and defines in.
+ *
+ * @param s The Europa state.
+ * @param proto The target prototype.
+ * @return The result of the operation.
+ */
+int euproto_seal(europa* s, eu_proto* proto) {
+	int length, improper, i;
+
+	proto->constant_index = NULL;
+
+	length = eutil_list_length(s, &proto->formals, &improper);
+	proto->framec = length < 0 ? 1 : length + improper;
+	for (i = 0; i < proto->code_length; i++) {
+		if (((proto->code[i] >> OPCSHIFT) & OPCMASK) == EU_OP_DEFINE)
+			proto->framec++;
+	}
+
+	if (proto->constants_size > proto->constantc) {
+		_eu_checkreturn(resize_constants(s, proto, proto->constantc));
+	}
+	if (proto->code_size > proto->code_length) {
+		_eu_checkreturn(resize_code(s, proto, proto->code_length));
+	}
+	if (proto->captures_size > proto->capturec) {
+		_eu_checkreturn(resize_captures(s, proto, proto->capturec));
+	}
+
+	return EU_RESULT_OK;
+}
+
 /**
  * @brief Adds a subprototype to the subprotos array. (Growing it if necessary.)
  *
@@ -268,3 +378,61 @@ eu_integer euproto_add_subproto(europa* s, eu_proto* proto, eu_proto* subproto,
 
 
 
+
+/**
+ * @brief Gets the global reference cache for an instruction.
+ *
+ * Caches are allocated for the whole code the first time one is needed, so
+ * this should only be called once the prototype's code is complete.
+ *
+ * @param s The Europa state.
+ * @param proto The target prototype.
+ * @param pc The instruction's index.
+ * @return The cache. NULL in case it could not be allocated.
+ */
+eu_gcache* euproto_global_cache(europa* s, eu_proto* proto, int pc) {
+	int i;
+
+	if (proto->gcache == NULL) {
+		proto->gcache = _eugc_malloc(_eu_gc(s),
+			sizeof(eu_gcache) * proto->code_length);
+		if (proto->gcache == NULL)
+			return NULL;
+
+		/* no cache starts valid */
+		for (i = 0; i < proto->code_length; i++) {
+			proto->gcache[i].env = NULL;
+			proto->gcache[i].cell = NULL;
+			proto->gcache[i].epoch = 0;
+		}
+	}
+
+	return &(proto->gcache[pc]);
+}
+
+/**
+ * @brief Adds a free variable to a prototype.
+ *
+ * Closures created from the prototype get the variable as described by the
+ * capture, in the order free variables were added.
+ *
+ * @param s The Europa state.
+ * @param proto The target prototype.
+ * @param capture Where closures get the variable from.
+ * @param index Where to place the free variable's index.
+ * @return The result of the operation.
+ */
+int euproto_add_capture(europa* s, eu_proto* proto, eu_capture* capture,
+	int* index) {
+	/* check whether the capture fits the array */
+	if (proto->capturec >= proto->captures_size) {
+		_eu_checkreturn(resize_captures(s, proto, proto->captures_size * 2 +
+			CAPTURES_GROWTH_RATE));
+	}
+
+	proto->captures[proto->capturec] = *capture;
+	if (index) *index = proto->capturec;
+	proto->capturec++;
+
+	return EU_RESULT_OK;
+}
@@ -838,6 +838,8 @@ int pread_bytevector(parser* p, eu_value* out) {
 	while (p->current != CRPAR && !iseof(p->current)) {
 		/* skip any intertoken space */
 		_checkreturn(res, pskip_itspace(p));
+		if (p->current == CRPAR)
+			break;
 
 		/* assert that the next token is a number */
 		if (!(isdecimaldigit(p->current) ||
@@ -865,6 +867,13 @@ int pread_bytevector(parser* p, eu_value* out) {
 			temp.value.i));
 	}
 
+	/* match the closing ')' */
+	if (p->current != CRPAR) {
+		seterror(p, "Unterminated bytevector.");
+		return EU_RESULT_ERROR;
+	}
+	_checkreturn(res, padvance(p));
+
 	/* turn the buf into a bytevector */
 	vec = eubvector_new(p->s, size - remaining, cast(eu_byte*, buf));
 	if (vec == NULL)
@@ -897,8 +906,8 @@ int pread_vector(parser* p, eu_value* out) {
 	/* initialize the vector's size */
 	size = 0;
 
-	/* allocate the vector but only with the size of the GC header */
-	vec = _eugc_malloc(_eu_gc(p->s), sizeof(eu_object));
+	/* allocate the vector with no room for values yet */
+	vec = _eugc_malloc(_eu_gc(p->s), sizeof(eu_vector));
 	if (vec == NULL) {
 		seterror(p, "Could not create read vector header.");
 		return EU_RESULT_BAD_ALLOC;
@@ -907,10 +916,13 @@ int pread_vector(parser* p, eu_value* out) {
 	vec->_color = EUGC_COLOR_WHITE;
 	vec->_previous = vec->_next = _euvector_to_obj(vec);
 	vec->_type = EU_TYPE_VECTOR | EU_TYPEFLAG_COLLECTABLE;
+	vec->length = 0;
 
 	while (p->current != CRPAR && !iseof(p->current)) {
 		/* skip intertoken space */
 		_checkreturn(res, pskip_itspace(p));
+		if (p->current == CRPAR)
+			break;
 		/* read a <datum> element */
 		_checkreturn(res, pread_datum(p, &temp));
 
@@ -949,6 +961,13 @@ int pread_vector(parser* p, eu_value* out) {
 	/* give vector ownership to the GC */
 	_checkreturn(res, eugc_move_off_root(p->s, _euvector_to_obj(vec)));
 
+	/* match the closing ')' */
+	if (p->current != CRPAR) {
+		seterror(p, "Unterminated vector.");
+		return EU_RESULT_ERROR;
+	}
+	_checkreturn(res, padvance(p));
+
 	/* set the return to it */
 	_eu_makevector(out, vec);
 
@@ -1559,6 +1578,9 @@ int pread_datum(parser* p, eu_value* out) {
 		return pread_list(p, out);
 	} else if (isabbrevprefix(p->current)) {
 		return pread_abbreviation(p, out);
+	} else if (iseof(p->current)) {
+		/* nothing left to read */
+		_eu_makeeof(out);
 	}
 
 	return EU_RESULT_OK;
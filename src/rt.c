@@ -4,7 +4,12 @@
 #include <setjmp.h>
 
 #include "europa/ccont.h"
+#include "europa/error.h"
 #include "europa/number.h"
+#include "europa/string.h"
+#include "europa/symbol.h"
+#include "europa/task.h"
+#include "europa/vector.h"
 
 struct europa_jmplist {
 	struct europa_jmplist* previous;
@@ -44,6 +49,176 @@ int eurt_evaluate(europa* s, eu_value* v, eu_value* out) {
 }
 
 
+/**
+ * @brief Calls a procedure with arguments from an array.
+ *
+ * This is the fast way for hosts to call into Europa: nothing is compiled and
+ * Europa closures get their arguments without an argument list being built.
+ *
+ * @param s The Europa state.
+ * @param fn The procedure.
+ * @param argc The number of arguments.
+ * @param argv The arguments. May be NULL if there are none.
+ * @param out Where to place the result.
+ * @return The result of the operation.
+ */
+int eu_call(europa* s, eu_value* fn, int argc, eu_value* argv, eu_value* out) {
+	if (!s || !fn || argc < 0 || (argc > 0 && !argv))
+		return EU_RESULT_NULL_ARGUMENT;
+
+	return euvm_call(s, fn, argc, argv, out);
+}
+
+/**
+ * @brief Looks a global variable up, so that it can be used repeatedly.
+ *
+ * The variable's slot is remembered for as long as it stays put, so using the
+ * reference usually skips the lookup. It follows redefinitions of the
+ * variable.
+ *
+ * @param s The Europa state.
+ * @param name The variable's name.
+ * @param ref The reference to fill.
+ * @return The result of the operation.
+ */
+int eu_global_ref(europa* s, const char* name, eu_gref* ref) {
+	eu_symbol* sym;
+	eu_value* slot;
+
+	if (!s || !name || !ref)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* the reference lives in C, so its name is kept alive by the global */
+	sym = eusymbol_intern(s, cast(void*, name));
+	if (sym == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makesym(&ref->name, sym);
+	ref->cache.env = NULL;
+	ref->cache.cell = NULL;
+	ref->cache.epoch = 0;
+
+	return eu_gref_value(s, ref, &slot);
+}
+
+/**
+ * @brief Gets the slot holding a referenced global variable's value.
+ *
+ * @param s The Europa state.
+ * @param ref The reference.
+ * @param out Where to place the slot.
+ * @return The result of the operation.
+ */
+int eu_gref_value(europa* s, eu_gref* ref, eu_value** out) {
+	if (!s || !ref || !out)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if (ref->cache.env == _eu_global_env(s) &&
+		ref->cache.epoch == _eutable_epoch(ref->cache.env)) {
+		*out = ref->cache.cell;
+		return EU_RESULT_OK;
+	}
+
+	_eu_checkreturn(eutable_get(s, _eu_global_env(s), &ref->name, out));
+	if (*out == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not reference %s in environment.",
+			_eusymbol_text(_euvalue_to_symbol(&ref->name))));
+		return EU_RESULT_ERROR;
+	}
+
+	ref->cache.env = _eu_global_env(s);
+	ref->cache.cell = *out;
+	ref->cache.epoch = _eutable_epoch(ref->cache.env);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Calls the procedure held by a global variable.
+ *
+ * @param s The Europa state.
+ * @param ref The variable's reference, from eu_global_ref.
+ * @param argc The number of arguments.
+ * @param argv The arguments. May be NULL if there are none.
+ * @param out Where to place the result.
+ * @return The result of the operation.
+ */
+int eu_call_global(europa* s, eu_gref* ref, int argc, eu_value* argv,
+	eu_value* out) {
+	eu_value* fn;
+
+	_eu_checkreturn(eu_gref_value(s, ref, &fn));
+	return eu_call(s, fn, argc, argv, out);
+}
+
+/**
+ * @brief Limits how long code in the state runs before returning to the host.
+ *
+ * Fuel is spent at every call and backward jump. When it runs out, the running
+ * code stops and the function that ran it returns EU_RESULT_YIELD. The host may
+ * then do other work, add fuel and pick the code up with eu_resume, or drop it
+ * with eu_recover. Until then, the state can't run anything else.
+ *
+ * @param s The Europa state.
+ * @param fuel The fuel, or a negative number for no limit.
+ * @return The result of the operation.
+ */
+int eu_set_fuel(europa* s, eu_integer fuel) {
+	if (!s)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	s->fuel = fuel < 0 ? -1 : fuel;
+	s->slice = 0;
+	s->budget = 0;
+	euvm_refuel(s);
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets the fuel the state has left.
+ *
+ * @param s The Europa state.
+ * @return The fuel, or -1 if there is no limit.
+ */
+eu_integer eu_get_fuel(europa* s) {
+	eu_integer fuel;
+
+	if (s->fuel < 0)
+		return -1;
+
+	/* the running budget has not been charged yet */
+	fuel = s->fuel - (s->slice - s->budget);
+	return fuel < 0 ? 0 : fuel;
+}
+
+/**
+ * @brief Resumes code that ran out of fuel.
+ *
+ * @param s The Europa state.
+ * @param out Where to place the result, once the code returns.
+ * @return The result of the operation, EU_RESULT_YIELD if the fuel ran out
+ * again.
+ */
+int eu_resume(europa* s, eu_value* out) {
+	if (!s)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if (s->status != EU_SSTATUS_YIELDED) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"There is no suspended code to resume."));
+		return EU_RESULT_ERROR;
+	}
+
+	s->status = EU_SSTATUS_RUNNING;
+	_eu_checkreturn(euvm_execute(s));
+
+	if (out)
+		*out = s->acc;
+
+	return EU_RESULT_OK;
+}
+
+
 int euapi_register_controls(europa* s) {
 	eu_table* env;
 
@@ -53,7 +228,18 @@ int euapi_register_controls(europa* s) {
 	_eu_checkreturn(eucc_define_cclosure(s, env, env, "apply", euapi_apply));
 	_eu_checkreturn(eucc_define_cclosure(s, env, env, "map", euapi_map));
 	_eu_checkreturn(eucc_define_cclosure(s, env, env, "for-each", euapi_for_each));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "vector-map", euapi_vector_map));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "vector-for-each", euapi_vector_for_each));
 	_eu_checkreturn(eucc_define_cclosure(s, env, env, "disassemble", euapi_disassemble));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "dynamic-wind", euapi_dynamic_wind));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "with-exception-handler", euapi_with_exception_handler));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "raise", euapi_raise));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "raise-continuable", euapi_raise_continuable));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "error-object?", euapi_error_objectQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "error-object-message", euapi_error_object_message));
+
+	/* compiled guard forms hold closures of this one */
+	_eu_checkreturn(eucc_register_cfunc(s, "%guard", euapi_guard));
 
 	return EU_RESULT_OK;
 }
@@ -112,191 +298,798 @@ int euapi_apply(europa* s) {
 	/* append it to the current argument */
 	_eu_checkreturn(eulist_copy(s, current, slot));
 
+	/* leaf C closures are just called */
+	if (_eucc_is_leaf(proc))
+		return eucc_apply_leaf(s, _euvalue_to_closure(proc), &args,
+			_eucc_return(s));
+
 	/* since apply can be a tail call, we just need to prepare for the call */
 	return euvm_apply(s, proc, &args, _eucc_return(s));
 }
 
-int euapi_map(europa* s) {
-	eu_table* env;
-	eu_value *proc, *current;
-	eu_value args, *slot, *list, *rslot;
+/* where map and for-each resume after calling their procedure */
+enum {
+	LISTS_START,
+	LISTS_APPLIED,
+};
+
+/**
+ * @brief Sets up the frame of map or for-each, whose slots from first on hold
+ * what is left of each of their lists.
+ *
+ * @param s The Europa state.
+ * @param first The index of the first list's slot.
+ * @param out Where to place the frame.
+ * @return The result of the operation.
+ */
+static int start_lists(europa* s, int first, eu_cframe** out) {
+	eu_value* current;
+	int i;
+
+	_eu_checkreturn(eucc_cframe(s, first +
+		eulist_length(s, _euvalue_to_pair(_eucc_arguments(s))) - 1, out));
+	if (_eucframe_tag(*out) != LISTS_START)
+		return EU_RESULT_OK;
+
+	for (i = first, current = _eupair_tail(_euvalue_to_pair(_eucc_arguments(s)));
+		_euvalue_is_pair(current);
+		i++, current = _eupair_tail(_euvalue_to_pair(current))) {
+		if (!_euvalue_is_pair(_eupair_head(_euvalue_to_pair(current))) &&
+			!_euvalue_is_null(_eupair_head(_euvalue_to_pair(current)))) {
+			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+				"Argument #%d of wrong type. Expected pair, got %s.", i - first + 1,
+				eu_type_name(_euvalue_type(_eupair_head(_euvalue_to_pair(current))))));
+			return EU_RESULT_ERROR;
+		}
+		*_eucframe_slot(*out, i) = *_eupair_head(_euvalue_to_pair(current));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Takes the next element of each list kept in a map or for-each frame.
+ *
+ * @param s The Europa state.
+ * @param f The frame.
+ * @param first The index of the first list's slot.
+ * @param args Where to place the list of elements.
+ * @param done Where to place whether a list had no more elements, in which
+ * case nothing is taken.
+ * @param more Where to place whether all lists have elements left after these.
+ * @return The result of the operation.
+ */
+static int next_arguments(europa* s, eu_cframe* f, int first, eu_value* args,
+	int* done, int* more) {
+	eu_value* list;
 	eu_pair* pair;
+	int i;
+
+	*done = EU_FALSE;
+	*more = EU_TRUE;
+	_eu_makenull(args);
+
+	/* stop at the end of the shortest list */
+	for (i = first; i < _eucframe_slotc(f); i++) {
+		if (!_euvalue_is_pair(_eucframe_slot(f, i))) {
+			*done = EU_TRUE;
+			return EU_RESULT_OK;
+		}
+	}
+
+	/* build the arguments from the last one */
+	for (i = _eucframe_slotc(f) - 1; i >= first; i--) {
+		list = _eucframe_slot(f, i);
+		pair = eupair_new(s, _eupair_head(_euvalue_to_pair(list)), args);
+		if (pair == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_makepair(args, pair);
 
-	env = _eu_env(s);
+		*list = *_eupair_tail(_euvalue_to_pair(list));
+		if (!_euvalue_is_pair(list))
+			*more = EU_FALSE;
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Adds a value to the end of the list map is building.
+ *
+ * @param s The Europa state.
+ * @param f The frame of map, whose slot 0 holds the list and slot 1 its last
+ * pair.
+ * @param v The value.
+ * @return The result of the operation.
+ */
+static int append_result(europa* s, eu_cframe* f, eu_value* v) {
+	eu_value *last;
+	eu_pair* pair;
+
+	pair = eupair_new(s, v, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	last = _eucframe_slot(f, 1);
+	if (_euvalue_is_null(last)) {
+		_eu_makepair(_eucframe_slot(f, 0), pair);
+	} else {
+		_eu_makepair(_eupair_tail(_euvalue_to_pair(last)), pair);
+	}
+	_eu_makepair(last, pair);
+	return EU_RESULT_OK;
+}
+
+int euapi_map(europa* s) {
+	eu_cframe* f;
+	eu_value *proc, args, v;
+	int done, more;
 
 	/* check arity */
 	_eucc_arity_improper(s, 2);
+	_eucc_argument(s, proc, 0);
+
+	/* slot 0 holds the resulting list, slot 1 its last pair */
+	_eu_checkreturn(start_lists(s, 2, &f));
+
+	if (_eucframe_tag(f) == LISTS_APPLIED) {
+		/* the accumulator holds what the procedure returned */
+		_eu_checkreturn(append_result(s, f, _eu_acc(s)));
+	}
+
+	/* leaf C closures are called right here for every element */
+	if (_eucc_is_leaf(proc)) {
+		while (1) {
+			_eu_checkreturn(next_arguments(s, f, 2, &args, &done, &more));
+			if (done)
+				break;
+			_eu_checkreturn(eucc_apply_leaf(s, _euvalue_to_closure(proc), &args,
+				&v));
+			_eu_checkreturn(append_result(s, f, &v));
+		}
+	} else {
+		_eu_checkreturn(next_arguments(s, f, 2, &args, &done, &more));
+	}
 
-	_eucc_dispatcher(s,
-		/* first action is setting up environment */
-		_eucc_dtag(environment_setup)
-
-		/* at this point, the environment has been properly set up, so we can */
-		rslot = cast(eu_value*, env->nodes[1].value.value.p);
-
-		/* continue dispatcher */
-		_eucc_dtag(apply_procedure)
-	)
-
-	/* the following code should be ran only once for configuring the environment */
-	_eucc_tag(s, environment_setup,
-		env = eutable_new(s, 3); /* create the environment */
-		_eutable_set_index(env, s->env);
-
-		if (env == NULL) return EU_RESULT_BAD_ALLOC;
-		/* setup result rib value */
-		_eutable_count(env) = 3;
-		/* create field for returned list */
-		_eu_makeint(&(env->nodes[0].key), 0);
-		_eu_makenull(&(env->nodes[0].value));
-		/* create field for current slot to place pair */
-		_eu_makeint(&(env->nodes[1].key), 1);
-		_eu_makecpointer(&(env->nodes[1].value), &(env->nodes[0].value));
-		/* create field to place whether this is the last call */
-		_eu_makeint(&(env->nodes[2].key), 2);
-		_eu_makebool(&(env->nodes[2].value), EU_FALSE);
-
-		s->env = env;
-
-		/* this will return from the function and restart it at after environment_setup */
-		_eucc_continue(s);
-	);
-
-	/* get the procedure argument */
+	if (done) {
+		*_eucc_return(s) = *_eucframe_slot(f, 0);
+		return EU_RESULT_OK;
+	}
+
+	/* apply the procedure and come back for its result */
+	return eucc_call(s, LISTS_APPLIED, proc, &args);
+}
+
+int euapi_for_each(europa* s) {
+	eu_cframe* f;
+	eu_value *proc, args;
+	int done, more;
+
+	/* check arity */
+	_eucc_arity_improper(s, 2);
 	_eucc_argument(s, proc, 0);
 
-	/* get the first list argument's node */
-	current = _eupair_tail(_euvalue_to_pair(_eucc_arguments(s)));
+	_eu_checkreturn(start_lists(s, 0, &f));
+	_eu_checkreturn(next_arguments(s, f, 0, &args, &done, &more));
+	if (done) {
+		_eu_makenull(_eucc_return(s));
+		return EU_RESULT_OK;
+	}
 
-	/* initialize argument list */
-	args = _null;
-	slot = &args;
+	/* leaf C closures are called right here for every element */
+	if (_eucc_is_leaf(proc)) {
+		while (!done) {
+			_eu_checkreturn(eucc_apply_leaf(s, _euvalue_to_closure(proc), &args,
+				_eucc_return(s)));
+			_eu_checkreturn(next_arguments(s, f, 0, &args, &done, &more));
+		}
+		return EU_RESULT_OK;
+	}
+
+	/* the last application is a tail call, there is nothing to come back to */
+	if (!more)
+		return euvm_apply(s, proc, &args, NULL);
+
+	return eucc_call(s, LISTS_APPLIED, proc, &args);
+}
 
-	/* iterate through passed lists */
-	while (!_euvalue_is_null(current)) {
-		list = _eupair_head(_euvalue_to_pair(current)); /* current list's head */
+/**
+ * @brief Gets the length of the shortest vector passed to vector-map or
+ * vector-for-each.
+ *
+ * @param s The Europa state.
+ * @param length Where to place the length.
+ * @return The result of the operation.
+ */
+static int vectors_length(europa* s, eu_integer* length) {
+	eu_value* current;
+	eu_value* vec;
+	int i;
+
+	*length = -1;
+	for (i = 1, current = _eupair_tail(_euvalue_to_pair(_eucc_arguments(s)));
+		_euvalue_is_pair(current);
+		i++, current = _eupair_tail(_euvalue_to_pair(current))) {
+		vec = _eupair_head(_euvalue_to_pair(current));
+		if (!_euvalue_is_type(vec, EU_TYPE_VECTOR)) {
+			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+				"Argument #%d of wrong type. Expected vector, got %s.", i,
+				eu_type_name(_euvalue_type(vec))));
+			return EU_RESULT_ERROR;
+		}
+		if (*length < 0 || _euvector_length(_euvalue_to_vector(vec)) < *length)
+			*length = _euvector_length(_euvalue_to_vector(vec));
+	}
 
-		/* create a pair for the current application argument */
-		pair = eupair_new(s, _eupair_head(_euvalue_to_pair(list)), &_null);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Makes the argument list with the elements at an index of the vectors
+ * passed to vector-map or vector-for-each.
+ *
+ * @param s The Europa state.
+ * @param index The index.
+ * @param args Where to place the argument list.
+ * @return The result of the operation.
+ */
+static int vectors_arguments(europa* s, eu_integer index, eu_value* args) {
+	eu_value *current, *slot;
+	eu_pair* pair;
+
+	_eu_makenull(args);
+	slot = args;
+	for (current = _eupair_tail(_euvalue_to_pair(_eucc_arguments(s)));
+		_euvalue_is_pair(current);
+		current = _eupair_tail(_euvalue_to_pair(current))) {
+		pair = eupair_new(s, _euvector_ref(_euvalue_to_vector(
+			_eupair_head(_euvalue_to_pair(current))), index), &_null);
 		if (pair == NULL)
 			return EU_RESULT_BAD_ALLOC;
 		_eu_makepair(slot, pair);
 		slot = _eupair_tail(pair);
+	}
 
-		/* because the values on rib will be kept in this continuation and
-		 * the argument list is ours, we can keep our state in it.
-		 */
-		*list = *_eupair_tail(_euvalue_to_pair(list));
+	return EU_RESULT_OK;
+}
+
+int euapi_vector_map(europa* s) {
+	eu_cframe* f;
+	eu_value *proc, *result, *index, args;
+	eu_vector* vec;
+	eu_integer length, i;
+
+	/* check arity */
+	_eucc_arity_improper(s, 2);
+	_eucc_argument(s, proc, 0);
+	_eu_checkreturn(vectors_length(s, &length));
 
-		/* check whether this should be the last call to map */
-		if (_euvalue_is_null(list)) {
-			/* in which case set the value in the environment to signal that it is */
-			_eu_makebool(&(env->nodes[2].value), EU_TRUE);
+	/* slot 0 holds the resulting vector, slot 1 the index being mapped */
+	_eu_checkreturn(eucc_cframe(s, 2, &f));
+	result = _eucframe_slot(f, 0);
+	index = _eucframe_slot(f, 1);
+
+	if (_eucframe_tag(f) == LISTS_START) {
+		vec = euvector_new(s, NULL, length);
+		if (vec == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		for (i = 0; i < length; i++)
+			_eu_makenull(_euvector_ref(vec, i));
+		_eu_makevector(result, vec);
+		_eu_makeint(index, 0);
+	} else {
+		/* the accumulator holds what the procedure returned */
+		vec = _euvalue_to_vector(result);
+		_euvector_set(vec, _eunum_i(index), *_eu_acc(s));
+		_eunum_i(index)++;
+	}
+
+	/* leaf C closures are called right here for every element */
+	if (_eucc_is_leaf(proc)) {
+		for (; _eunum_i(index) < length; _eunum_i(index)++) {
+			_eu_checkreturn(vectors_arguments(s, _eunum_i(index), &args));
+			_eu_checkreturn(eucc_apply_leaf(s, _euvalue_to_closure(proc), &args,
+				_euvector_ref(vec, _eunum_i(index))));
 		}
+	}
 
-		/* go to next argument */
-		current = _eupair_tail(_euvalue_to_pair(current));
+	if (_eunum_i(index) >= length) {
+		*_eucc_return(s) = *result;
+		return EU_RESULT_OK;
 	}
 
-	/* apply the procedure to the arguments */
-	_eucc_tag(s, apply_procedure,
-		_eu_checkreturn(eucc_frame(s)); /* create a frame with current call info */
-		_eu_checkreturn(euvm_apply(s, proc, &args, NULL)); /* call proc passing arguments */
-	);
+	/* apply the procedure and come back for its result */
+	_eu_checkreturn(vectors_arguments(s, _eunum_i(index), &args));
+	return eucc_call(s, LISTS_APPLIED, proc, &args);
+}
 
-	/* at this point, the accumulator is the value returned from the procedure,
-	 * so we create a new pair with its value in the head */
-	pair = eupair_new(s, _eu_acc(s), &_null);
-	if (!pair)
-		return EU_RESULT_BAD_ALLOC;
+int euapi_vector_for_each(europa* s) {
+	eu_cframe* f;
+	eu_value *proc, *index, args;
+	eu_integer length;
 
-	/* place the pair in the slot */
-	_eu_makepair(rslot, pair);
-	rslot = _eupair_tail(pair);
+	/* check arity */
+	_eucc_arity_improper(s, 2);
+	_eucc_argument(s, proc, 0);
+	_eu_checkreturn(vectors_length(s, &length));
+
+	/* slot 0 holds the index of the next element */
+	_eu_checkreturn(eucc_cframe(s, 1, &f));
+	index = _eucframe_slot(f, 0);
+	if (_eucframe_tag(f) == LISTS_START)
+		_eu_makeint(index, 0);
 
-	/* return the resulting list's first pair if the end was reached */
-	if (_eubool_is_true(&(env->nodes[2].value))) {
-		/* set return to list */
-		*_eucc_return(s) = env->nodes[0].value;
+	if (_eunum_i(index) >= length) {
+		_eu_makenull(_eucc_return(s));
+		return EU_RESULT_OK;
+	}
+
+	/* leaf C closures are called right here for every element */
+	if (_eucc_is_leaf(proc)) {
+		for (; _eunum_i(index) < length; _eunum_i(index)++) {
+			_eu_checkreturn(vectors_arguments(s, _eunum_i(index), &args));
+			_eu_checkreturn(eucc_apply_leaf(s, _euvalue_to_closure(proc), &args,
+				_eucc_return(s)));
+		}
 		return EU_RESULT_OK;
 	}
 
-	/* if this wasn't the last call to procedure, we need to do another call */
-	/* update the value for rslot in env */
-	env->nodes[1].value.value.p = rslot;
-	/* set the current continuation's PC to the value for after the environment
-	 * setup */
-	s->pc = 1; /* TODO: careful when modifying this function */
-	/* signal a continuation to the VM */
-	return EU_RESULT_CONTINUE;
+	/* the last application is a tail call, there is nothing to come back to */
+	_eu_checkreturn(vectors_arguments(s, _eunum_i(index), &args));
+	_eunum_i(index)++;
+	if (_eunum_i(index) >= length)
+		return euvm_apply(s, proc, &args, NULL);
+	return eucc_call(s, LISTS_APPLIED, proc, &args);
 }
 
-int euapi_for_each(europa* s) {
-	eu_table* env;
-	eu_value *proc, *current;
-	eu_value args, *slot, *list, *rslot;
+/* exceptions and dynamic-wind
+ *
+ * Exception handlers and dynamic-wind calls are marked by frames: the C
+ * closures that install them call their thunks through a frame of their own
+ * and make it the state's innermost handler (or wind) frame. Every frame
+ * remembers the innermost ones when it is created, so returning and jumping
+ * through continuations restores them and installing a handler costs nothing
+ * more than that frame. */
+
+enum {
+	WIND_START,
+	WIND_BEFORE,
+	WIND_THUNK,
+	WIND_AFTER,
+};
+
+/**
+ * @brief Gives the running C closure a copy of its frame with another tag.
+ *
+ * Continuations may resume the closure from a frame more than once, so frames
+ * captured by continuations that can be entered again must not have their
+ * tags changed afterwards.
+ *
+ * @param s The Europa state.
+ * @param tag The copy's tag.
+ * @param out Where to place the copy.
+ * @return The result of the operation.
+ */
+static int copy_cframe(europa* s, int tag, eu_cframe** out) {
+	eu_cframe* f;
+	int i;
+
+	f = eucframe_new(s, _eucframe_slotc(s->cframe));
+	if (f == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	for (i = 0; i < _eucframe_slotc(f); i++)
+		*_eucframe_slot(f, i) = *_eucframe_slot(s->cframe, i);
+	_eucframe_tag(f) = tag;
+
+	s->cframe = f;
+	*out = f;
+	return EU_RESULT_OK;
+}
+
+int euapi_dynamic_wind(europa* s) {
+	eu_cframe* f;
+	eu_value *before, *thunk, *after;
+
+	/* check arity */
+	_eucc_arity_proper(s, 3);
+	_eucc_argument(s, before, 0);
+	_eucc_argument(s, thunk, 1);
+	_eucc_argument(s, after, 2);
+
+	/* slot 0 holds before, slot 1 after (for rewinding) and slot 2 the
+	 * thunk's result */
+	_eu_checkreturn(eucc_cframe(s, 3, &f));
+	switch (_eucframe_tag(f)) {
+	case WIND_START:
+		*_eucframe_slot(f, 0) = *before;
+		*_eucframe_slot(f, 1) = *after;
+		return eucc_call(s, WIND_BEFORE, before, &_null);
+
+	case WIND_BEFORE:
+		/* the thunk's return frame marks the extent, it may be returned to
+		 * again, so it keeps a frame of its own */
+		_eu_checkreturn(copy_cframe(s, WIND_THUNK, &f));
+		_eu_checkreturn(eucc_frame(s));
+		s->wind = s->previous;
+		return euvm_apply(s, thunk, &_null, NULL);
+
+	case WIND_THUNK:
+		_eu_checkreturn(copy_cframe(s, WIND_THUNK, &f));
+		*_eucframe_slot(f, 2) = *_eu_acc(s);
+		return eucc_call(s, WIND_AFTER, after, &_null);
+
+	default:
+		*_eucc_return(s) = *_eucframe_slot(f, 2);
+		return EU_RESULT_OK;
+	}
+}
+
+/**
+ * @brief Adds a dynamic-wind thunk to a list of thunks to call when jumping.
+ *
+ * @param s The Europa state.
+ * @param wind The dynamic-wind frame.
+ * @param slot The thunk's slot in the frame (0 for before, 1 for after).
+ * @param tail The rest of the list.
+ * @param out Where to place the list, a (thunk . frame) pair followed by tail.
+ * @return The result of the operation.
+ */
+static int wind_step(europa* s, eu_continuation* wind, int slot, eu_value* tail,
+	eu_value* out) {
+	eu_value step;
 	eu_pair* pair;
-	int reached_end = 0;
 
-	env = _eu_env(s);
+	_eu_makecont(&step, wind);
+	pair = eupair_new(s, _eucframe_slot(wind->cframe, slot), &step);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&step, pair);
+
+	pair = eupair_new(s, &step, tail);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(out, pair);
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Lists the thunks to call when jumping between two dynamic extents.
+ *
+ * The after thunks of the extents being left come first, innermost first,
+ * followed by the before thunks of the ones being entered, outermost first.
+ *
+ * @param s The Europa state.
+ * @param from The innermost wind frame being left.
+ * @param to The innermost wind frame being entered.
+ * @param out Where to place the list.
+ * @return The result of the operation.
+ */
+static int wind_steps(europa* s, eu_continuation* from, eu_continuation* to,
+	eu_value* out) {
+	eu_continuation* c;
+	eu_value entries, *exits;
+	int from_depth, to_depth;
+
+	for (from_depth = 0, c = from; c != NULL; c = c->wind)
+		from_depth++;
+	for (to_depth = 0, c = to; c != NULL; c = c->wind)
+		to_depth++;
+
+	_eu_makenull(out);
+	_eu_makenull(&entries);
+	exits = out;
+
+	/* walk both up to the innermost frame they share */
+	for (; from_depth > to_depth; from_depth--, from = from->wind) {
+		_eu_checkreturn(wind_step(s, from, 1, &_null, exits));
+		exits = _eupair_tail(_euvalue_to_pair(exits));
+	}
+	for (; to_depth > from_depth; to_depth--, to = to->wind)
+		_eu_checkreturn(wind_step(s, to, 0, &entries, &entries));
+	for (; from != to; from = from->wind, to = to->wind) {
+		_eu_checkreturn(wind_step(s, from, 1, &_null, exits));
+		exits = _eupair_tail(_euvalue_to_pair(exits));
+		_eu_checkreturn(wind_step(s, to, 0, &entries, &entries));
+	}
+
+	*exits = entries;
+	return EU_RESULT_OK;
+}
+
+enum {
+	REWIND_START,
+	REWIND_STEP,
+};
+
+/**
+ * @brief Jumps to a continuation through dynamic-wind calls.
+ *
+ * Takes the continuation and the value to pass it, calls the before and after
+ * thunks of the dynamic-wind calls being entered and left, each in the extent
+ * of its call, and only then jumps. The VM calls this instead of jumping
+ * straight to continuations whose extent is not the current one.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int eurt_rewind(europa* s) {
+	eu_cframe* f;
+	eu_value *cont, *steps, *step;
+	eu_continuation* wind;
 
 	/* check arity */
-	_eucc_arity_improper(s, 2);
+	_eucc_arity_proper(s, 2);
+	_eucc_argument_type(s, cont, 0, EU_TYPE_CONTINUATION);
+
+	/* slot 0 holds the thunks left to call */
+	_eu_checkreturn(eucc_cframe(s, 1, &f));
+	steps = _eucframe_slot(f, 0);
+	if (_eucframe_tag(f) == REWIND_START) {
+		_eu_checkreturn(wind_steps(s, s->wind, _euvalue_to_cont(cont)->wind,
+			steps));
+	}
 
-	/* get the procedure argument */
-	_eucc_argument(s, proc, 0);
+	if (_euvalue_is_null(steps)) {
+		/* we're in the continuation's extent, it can be entered */
+		s->wind = _euvalue_to_cont(cont)->wind;
+		return euvm_apply(s, cont, _eupair_tail(_euvalue_to_pair(&s->rib)), NULL);
+	}
 
-	/* get the first list argument's node */
-	current = _eupair_tail(_euvalue_to_pair(_eucc_arguments(s)));
+	step = _eupair_head(_euvalue_to_pair(steps));
+	*steps = *_eupair_tail(_euvalue_to_pair(steps));
 
-	/* initialize argument list */
-	args = _null;
-	slot = &args;
+	/* thunks are called in the extent of their dynamic-wind call */
+	wind = _euvalue_to_cont(_eupair_tail(_euvalue_to_pair(step)));
+	s->wind = wind->wind;
+	return eucc_call(s, REWIND_STEP, _eupair_head(_euvalue_to_pair(step)),
+		&_null);
+}
+
+enum {
+	HANDLER_START,
+	HANDLER_THUNK,
+};
+
+/**
+ * @brief Calls a thunk from a C closure, making its return frame the innermost
+ * exception handler.
+ *
+ * The closure is resumed with the given tag when the thunk returns, and the
+ * handler found in its frame's slot 0.
+ *
+ * @param s The Europa state.
+ * @param tag The tag to resume the closure with.
+ * @param thunk The thunk.
+ * @return The result of the operation.
+ */
+static int call_handled(europa* s, int tag, eu_value* thunk) {
+	eu_cframe* f;
+
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+	_eucframe_tag(f) = tag;
+	_eu_checkreturn(eucc_frame(s));
+	s->handler = s->previous;
+	return euvm_apply(s, thunk, &_null, NULL);
+}
+
+int euapi_with_exception_handler(europa* s) {
+	eu_cframe* f;
+	eu_value *handler, *thunk;
+
+	/* check arity */
+	_eucc_arity_proper(s, 2);
+	_eucc_argument(s, handler, 0);
+	_eucc_argument(s, thunk, 1);
+
+	/* slot 0 holds the handler */
+	_eu_checkreturn(eucc_cframe(s, 1, &f));
+	if (_eucframe_tag(f) == HANDLER_THUNK)
+		return EU_RESULT_OK; /* the thunk's result is in the accumulator */
+
+	*_eucframe_slot(f, 0) = *handler;
+	return call_handled(s, HANDLER_THUNK, thunk);
+}
 
-	/* iterate through passed lists */
-	while (!_euvalue_is_null(current)) {
-		list = _eupair_head(_euvalue_to_pair(current)); /* current list's head */
+enum {
+	GUARD_START,
+	GUARD_BODY,
+	GUARD_CAUGHT,
+	GUARD_CLAUSES,
+};
+
+/**
+ * @brief Resumes a guard with an object raised in its body.
+ *
+ * The guard's activation is resumed from a copy of its frame, whose C frame
+ * holds the object and the continuation of the raise.
+ *
+ * @param s The Europa state.
+ * @param guard The guard's frame.
+ * @param obj The raised object.
+ * @param raised The continuation of the raise.
+ * @return The result of the operation.
+ */
+static int guard_catch(europa* s, eu_continuation* guard, eu_value* obj,
+	eu_continuation* raised) {
+	eu_continuation* landing;
+	eu_cframe* f;
+	eu_value cont, args;
+	eu_pair* pair;
+
+	/* slot 0 holds the clauses, slot 1 the object and slot 2 the raise */
+	f = eucframe_new(s, 3);
+	if (f == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eucframe_tag(f) = GUARD_CAUGHT;
+	*_eucframe_slot(f, 0) = *_eucframe_slot(guard->cframe, 0);
+	*_eucframe_slot(f, 1) = *obj;
+	_eu_makecont(_eucframe_slot(f, 2), raised);
+
+	landing = eucont_new(s, guard->previous, guard->env, &guard->rib,
+		guard->rib_lastpos, guard->cl, guard->pc, f);
+	if (landing == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	landing->handler = guard->handler;
+	landing->wind = guard->wind;
+
+	pair = eupair_new(s, obj, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
 
-		/* create a pair for the current application argument */
-		pair = eupair_new(s, _eupair_head(_euvalue_to_pair(list)), &_null);
+	_eu_makecont(&cont, landing);
+	return euvm_apply(s, &cont, &args, NULL);
+}
+
+/**
+ * @brief Runs a guard form.
+ *
+ * Compiled guard forms call this with a thunk for their body and a procedure
+ * that takes the raised object and runs their clauses. That procedure returns
+ * the guard's own closure when no clause applies, in which case the object is
+ * raised again where it first was.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int euapi_guard(europa* s) {
+	eu_cframe* f;
+	eu_value *body, *clauses, args;
+	eu_pair* pair;
+
+	/* check arity */
+	_eucc_arity_proper(s, 2);
+	_eucc_argument(s, body, 0);
+	_eucc_argument(s, clauses, 1);
+
+	_eu_checkreturn(eucc_cframe(s, 3, &f));
+	switch (_eucframe_tag(f)) {
+	case GUARD_START:
+		*_eucframe_slot(f, 0) = *clauses;
+		return call_handled(s, GUARD_BODY, body);
+
+	case GUARD_CAUGHT:
+		/* the clauses run in the extent of the guard */
+		pair = eupair_new(s, _eucframe_slot(f, 1), &_null);
 		if (pair == NULL)
 			return EU_RESULT_BAD_ALLOC;
-		_eu_makepair(slot, pair);
-		slot = _eupair_tail(pair);
+		_eu_makepair(&args, pair);
+		return eucc_call(s, GUARD_CLAUSES, _eucframe_slot(f, 0), &args);
 
-		/* because the values on rib will be kept in this continuation and
-		 * the argument list is ours, we can keep our state in it.
-		 */
-		*list = *_eupair_tail(_euvalue_to_pair(list));
+	case GUARD_CLAUSES:
+		if (!_euvalue_is_type(_eu_acc(s), EU_TYPE_CLOSURE) ||
+			_euvalue_to_closure(_eu_acc(s)) != s->ccl)
+			return EU_RESULT_OK;
 
-		/* check whether this should be the last call to map */
-		if (_euvalue_is_null(list)) {
-			reached_end = EU_TRUE;
-		}
+		/* no clause applied, go back to the raise */
+		pair = eupair_new(s, _eucframe_slot(f, 1), &_null);
+		if (pair == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_makepair(&args, pair);
+		return euvm_apply(s, _eucframe_slot(f, 2), &args, NULL);
 
-		/* go to next argument */
-		current = _eupair_tail(_euvalue_to_pair(current));
+	default:
+		return EU_RESULT_OK; /* the body's result is in the accumulator */
+	}
+}
+
+enum {
+	RAISE_START,
+	RAISE_HANDLED,
+	RAISE_DECLINED,
+};
+
+/**
+ * @brief Hands the argument of raise or raise-continuable to the innermost
+ * exception handler.
+ *
+ * @param s The Europa state.
+ * @param continuable Whether the handler may return to the raise.
+ * @return The result of the operation.
+ */
+static int raise_object(europa* s, int continuable) {
+	eu_cframe* f;
+	eu_continuation* handler;
+	eu_value *obj, args;
+	eu_pair* pair;
+
+	/* check arity */
+	_eucc_arity_proper(s, 1);
+	_eucc_argument(s, obj, 0);
+
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+	if (_eucframe_tag(f) == RAISE_HANDLED) {
+		if (continuable)
+			return EU_RESULT_OK; /* the handler's result is in the accumulator */
+
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Exception handler returned from a non-continuable raise."));
+		return EU_RESULT_ERROR;
+	}
+
+	handler = s->handler;
+	if (handler == NULL) {
+		/* nobody handles it, so it becomes the state's error */
+		if (_euvalue_is_type(obj, EU_TYPE_ERROR)) {
+			_eu_err(s) = _euvalue_to_error(obj);
+		} else {
+			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+				"Uncaught exception (a %s).", eu_type_name(_euvalue_type(obj))));
+		}
+		return EU_RESULT_ERROR;
 	}
 
-	/* if this isn't the last iteration, we will need to continue the for-each
-	 * loop, so we need to create a frame for the current function activation
-	 * record in order to tell the VM to resume this function after proc has
-	 * returned.
-	 *
-	 * In case this is the last iteration, meaning at least one of the passed
-	 * lists has been entirely consumed, we can treat the call to proc as a
-	 * tail call, where we don't need to create a new frame for the call.
-	 *
-	 * The "stopping" condition for this function is actually reaching the end
-	 * of at least one list, because that will not insert a frame and the VM
-	 * will never call back our function. While none of the lists are over, a
-	 * frame will be added, resulting on this function being called after the
-	 * application of proc
-	 */
-	if (!reached_end) {
+	/* handlers run in the extent of the raise, minus themselves */
+	s->handler = handler->handler;
+
+	/* the last handler of a spawned task fails the task */
+	if (handler->cl->cf == eutask_main)
+		return eutask_fail(s, obj);
+
+	/* guards come back here if none of their clauses applies */
+	if (handler->cl->cf == euapi_guard) {
+		_eucframe_tag(f) = RAISE_DECLINED;
 		_eu_checkreturn(eucc_frame(s));
+		return guard_catch(s, handler, obj, s->previous);
 	}
 
-	/* lastly, apply the procedure. */
-	return euvm_apply(s, proc, &args, NULL);
+	pair = eupair_new(s, obj, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+	return eucc_call(s, RAISE_HANDLED, _eucframe_slot(handler->cframe, 0),
+		&args);
+}
+
+int euapi_raise(europa* s) {
+	return raise_object(s, EU_FALSE);
+}
+
+int euapi_raise_continuable(europa* s) {
+	return raise_object(s, EU_TRUE);
+}
+
+int euapi_error_objectQ(europa* s) {
+	eu_value* obj;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument(s, obj, 0);
+
+	_eu_makebool(_eucc_return(s), _euvalue_is_type(obj, EU_TYPE_ERROR));
+	return EU_RESULT_OK;
+}
+
+int euapi_error_object_message(europa* s) {
+	eu_value* obj;
+	eu_string* str;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, obj, 0, EU_TYPE_ERROR);
+
+	str = eustring_new(s, _euerror_message(_euvalue_to_error(obj)));
+	if (str == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makestring(_eucc_return(s), str);
+	return EU_RESULT_OK;
 }
@@ -9,6 +9,7 @@
 
 #include "europa/util.h"
 #include "europa/number.h"
+#include "europa/ccont.h"
 #include "utf8.h"
 
 /* Strings, like symbols, hold their text along their structure's memory.
@@ -152,3 +153,87 @@ int eustring_equal(eu_value* a, eu_value* b, eu_value* out) {
 		_eustring_text(_euvalue_to_string(b))) ? EU_FALSE : EU_TRUE);
 	return EU_RESULT_OK;
 }
+
+/**
+ * @addtogroup language_library
+ * @{
+ */
+
+int euapi_register_string(europa* s) {
+	eu_table* env;
+
+	env = s->env;
+
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "string?", euapi_stringQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "string=?", euapi_stringEQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "string-hash", euapi_string_hash));
+
+	return EU_RESULT_OK;
+}
+
+int euapi_stringQ(europa* s) {
+	eu_value* object;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument(s, object, 0); /* get argument */
+
+	_eu_makebool(_eucc_return(s), _euvalue_is_type(object, EU_TYPE_STRING));
+	return EU_RESULT_OK;
+}
+
+int euapi_stringEQ(europa* s) {
+	eu_value *current, *previous, *cv, *pv;
+
+	_eucc_arity_improper(s, 1); /* check arity */
+
+	/* initialize previous and current arguments */
+	previous = _eucc_arguments(s);
+	pv = _eupair_head(_euvalue_to_pair(previous));
+	_eucc_check_type(s, pv, "argument", EU_TYPE_STRING);
+	current = _eupair_tail(_euvalue_to_pair(previous));
+
+	_eu_makebool(_eucc_return(s), EU_TRUE);
+	while (!_euvalue_is_null(current)) {
+		cv = _eupair_head(_euvalue_to_pair(current));
+		_eucc_check_type(s, cv, "argument", EU_TYPE_STRING);
+
+		/* compare adjacent strings */
+		_eu_checkreturn(eustring_equal(pv, cv, _eucc_return(s)));
+		if (!_euvalue_to_bool(_eucc_return(s)))
+			return EU_RESULT_OK;
+
+		pv = cv;
+		current = _eupair_tail(_euvalue_to_pair(current));
+	}
+
+	return EU_RESULT_OK;
+}
+
+int euapi_string_hash(europa* s) {
+	eu_value *string, *bound;
+	eu_uinteger hash;
+
+	_eucc_arity_improper(s, 1); /* check arity */
+	_eucc_argument_type(s, string, 0, EU_TYPE_STRING); /* get arguments */
+	_eucc_optional_argument(s, bound, 1);
+
+	/* hashes are returned as non-negative integers */
+	hash = eustring_hash(_euvalue_to_string(string)) & (~cast(eu_uinteger, 0) >> 1);
+
+	if (bound != NULL) {
+		_eucc_check_type(s, bound, "bound", EU_TYPE_NUMBER);
+		if (!_eunum_is_exact(bound) || _eunum_i(bound) <= 0) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Hash bound must be a positive integer."));
+			return EU_RESULT_ERROR;
+		}
+		hash %= _eunum_i(bound);
+	}
+
+	_eu_makeint(_eucc_return(s), hash);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @}
+ */
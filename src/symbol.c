@@ -71,6 +71,37 @@ eu_symbol* eusymbol_new(europa* s, void* text) {
 	return sym;
 }
 
+/** Gets a symbol that lives as long as the global state.
+ *
+ * The symbol is added to the internalized table if it wasn't there, so it is
+ * kept from collection and later calls get the same one. Meant for names C code
+ * holds on to, which nothing else would keep alive.
+ *
+ * @param s the Europa state.
+ * @param text the symbol's text.
+ * @return The symbol.
+ */
+eu_symbol* eusymbol_intern(europa* s, void* text) {
+	eu_symbol* sym;
+	eu_value sv, *tv;
+
+	if (eutable_rget_symbol(s, _eu_global(s)->internalized, text, &tv))
+		return NULL;
+	if (tv != NULL)
+		return _euvalue_to_symbol(tv);
+
+	sym = eusymbol_new(s, text);
+	if (sym == NULL)
+		return NULL;
+	_eu_makesym(&sv, sym);
+
+	if (eutable_create_key(s, _eu_global(s)->internalized, &sv, &tv) || tv == NULL)
+		return NULL;
+	*tv = sv;
+
+	return sym;
+}
+
 /** Returns the address of the utf-8 text buffer.
  *
  * @param sym The symbol structure.
@@ -157,9 +188,9 @@ int euapi_register_symbol(europa* s) {
 
 	env = s->env;
 
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "symbol?", euapi_symbolQ));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "symbol->string", euapi_symbol_to_string));
-	_eu_checkreturn(eucc_define_cclosure(s, env, env, "string->symbol", euapi_string_to_symbol));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "symbol?", euapi_symbolQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "symbol->string", euapi_symbol_to_string));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "string->symbol", euapi_string_to_symbol));
 
 	return EU_RESULT_OK;
 }
@@ -8,6 +8,8 @@
 #include "europa/number.h"
 #include "europa/string.h"
 #include "europa/symbol.h"
+#include "europa/pair.h"
+#include "europa/ccont.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -26,6 +28,31 @@
  * credit is handled, please do contact me.
  */
 
+/* hashes a string key */
+static eu_uinteger string_hash(eu_value* v) {
+	return eustring_hash(_euvalue_to_string(v));
+}
+
+/* the hash and equality functions used for each key comparator */
+static const struct {
+	eu_uinteger (*hash)(eu_value* v);
+	int (*equal)(eu_value* a, eu_value* b, eu_value* out);
+} comparators[EU_TABLE_COMPARATOR_LAST] = {
+	{ euvalue_hash, euvalue_eqv }, /* EU_TABLE_EQV */
+	{ euvalue_hash, euvalue_eq }, /* EU_TABLE_EQ */
+	{ euvalue_equal_hash, euvalue_equal }, /* EU_TABLE_EQUAL */
+	{ string_hash, eustring_equal }, /* EU_TABLE_STRING */
+};
+
+#define _table_hash(t, key) (comparators[_eutable_comparator(t)].hash(key))
+#define _table_equal(t, a, b, out) \
+	(comparators[_eutable_comparator(t)].equal((a), (b), (out)))
+
+/* checks whether a key can be stored in a table */
+#define _table_accepts_key(t, key) \
+	(!_euvalue_is_null(key) && (_eutable_comparator(t) != EU_TABLE_STRING ||\
+		_euvalue_is_type(key, EU_TYPE_STRING)))
+
 static eu_tnode _dummy = {
 	.key = EU_VALUE_NULL,
 	.value = EU_VALUE_NULL,
@@ -96,61 +123,262 @@ static int set_nodes_length(europa* s, eu_table* t, size_t length) {
 	return EU_RESULT_OK;
 }
 
-int eutable_resize(europa* s, eu_table* t, size_t new_length) {
-	size_t old_llen, old_len, new_llen;
-	eu_tnode* old_nodes;
-	eu_value* v;
-	int i;
+/* the array part holds at most 2^MAXABITS elements */
+#define MAXABITS 24
+#define MAXASIZE twoto(MAXABITS)
 
-	/* check whether trying to shrink a table beyond the number of elements it
-	 * has in it */
-	if (_eutable_count(t) > new_length)
-		return EU_RESULT_BAD_ARGUMENT;
+/** Returns the array part index for a key.
+ *
+ * @param key The key.
+ * @param asize The size of the array part.
+ * @return The index of the key in the array part. -1 if the key does not
+ * belong in it.
+ */
+static int array_index(eu_value* key, int asize) {
+	eu_integer i;
 
-	/* already check for the 0-length case */
-	if (_eutable_nodes(t) == &_dummy && new_length == 0)
-		return EU_RESULT_OK;
-	else if (new_length == 0)
-		return set_nodes_length(s, t, 0);
+	/* only exact integers are array keys */
+	if (!_euvalue_is_type(key, EU_TYPE_NUMBER) || !_eunum_is_exact(key))
+		return -1;
 
-	/* adjusting lengths to fit powers of two */
-	old_llen = t->lsize;
-	old_len = _eutable_nodes(t) == &_dummy ? 0 : twoto(old_llen);
-	new_llen = ceil_log2(new_length);
-	new_length = twoto(new_llen);
+	i = _eunum_i(key);
+	if (i < 0 || i >= asize)
+		return -1;
 
-	/* check whether table is already of the required length */
-	if (new_llen == old_llen && _eutable_nodes(t) != &_dummy)
-		return EU_RESULT_OK;
+	return cast(int, i);
+}
+
+/** Counts a key as a candidate for the array part.
+ *
+ * Keys are counted in slices of nums, where nums[i] is the number of integer
+ * keys k such that 2^(i - 1) < k + 1 <= 2^i.
+ *
+ * @param key The key.
+ * @param nums The slice counters.
+ * @return 1 if the key was counted, 0 otherwise.
+ */
+static int count_int(eu_value* key, int* nums) {
+	eu_integer i;
+
+	if (!_euvalue_is_type(key, EU_TYPE_NUMBER) || !_eunum_is_exact(key))
+		return 0;
+
+	i = _eunum_i(key);
+	if (i < 0 || i >= MAXASIZE)
+		return 0;
+
+	nums[ceil_log2(cast(unsigned int, i + 1))]++;
+	return 1;
+}
+
+/** Counts the keys in the array part, slice by slice.
+ *
+ * @param t The target table.
+ * @param nums The slice counters.
+ * @return The number of keys in the array part.
+ */
+static int count_array(eu_table* t, int* nums) {
+	int i, lg, ttlg, lc, total;
+
+	total = 0;
+	i = 0;
+	for (lg = 0, ttlg = 1; lg <= MAXABITS; lg++, ttlg *= 2) {
+		lc = 0;
+		/* slice lg holds indexes [2^(lg - 1), 2^lg) */
+		for (; i < ttlg && i < _eutable_asize(t); i++) {
+			if (!_eutable_aslot_is_empty(_eutable_aslot(t, i)))
+				lc++;
+		}
+		nums[lg] += lc;
+		total += lc;
 
-	/* save old node array */
+		if (i >= _eutable_asize(t))
+			break;
+	}
+
+	return total;
+}
+
+/** Counts the keys in the hash part, adding integer keys to the slices.
+ *
+ * @param t The target table.
+ * @param nums The slice counters.
+ * @param na Incremented by the number of integer keys found.
+ * @return The number of keys in the hash part.
+ */
+static int count_hash(eu_table* t, int* nums, int* na) {
+	int i, total;
+	eu_tnode* node;
+
+	total = 0;
+	for (i = 0; i < _eutable_size(t); i++) {
+		node = _eutable_node(t, i);
+		if (!_euvalue_is_null(_eutnode_key(node))) {
+			*na += count_int(_eutnode_key(node), nums);
+			total++;
+		}
+	}
+
+	return total;
+}
+
+/** Computes the optimal size for the array part.
+ *
+ * The array part's size is the largest power of two n such that more than
+ * half of the slots 0..n-1 would be in use.
+ *
+ * @param nums The slice counters.
+ * @param na The number of integer keys. Receives the number of keys that will
+ * go to the array part.
+ * @return The optimal array part size.
+ */
+static int compute_array_size(int* nums, int* na) {
+	int i, twotoi, a, nna, optimal;
+
+	a = 0;
+	nna = 0;
+	optimal = 0;
+	for (i = 0, twotoi = 1; i <= MAXABITS && *na > twotoi / 2; i++, twotoi *= 2) {
+		if (nums[i] > 0) {
+			a += nums[i];
+			if (a > twotoi / 2) {
+				optimal = twotoi;
+				nna = a;
+			}
+		}
+	}
+
+	*na = nna;
+	return optimal;
+}
+
+/** Redistributes a table's elements between its array and hash parts.
+ *
+ * The sizes are computed from the keys currently in the table plus an
+ * optional extra key about to be inserted.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param extra A key about to be inserted (or NULL).
+ * @return The result of the operation.
+ */
+static int rehash(europa* s, eu_table* t, eu_value* extra) {
+	int nums[MAXABITS + 1];
+	int i, na, total, asize;
+
+	for (i = 0; i <= MAXABITS; i++)
+		nums[i] = 0;
+
+	/* count keys in both parts */
+	na = count_array(t, nums);
+	total = na;
+	total += count_hash(t, nums, &na);
+
+	/* count the extra key */
+	if (extra) {
+		na += count_int(extra, nums);
+		total++;
+	}
+
+	/* compute the new sizes */
+	asize = compute_array_size(nums, &na);
+
+	return eutable_resize(s, t, asize, total - na);
+}
+
+/** Resizes both parts of a table, migrating elements between them.
+ *
+ * Integer keys that fit the new array part are moved into it, while array part
+ * elements beyond its new size are moved into the hash part.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param array_length The new size of the array part.
+ * @param hash_length The new minimum size of the hash part.
+ * @return The result of the operation.
+ */
+int eutable_resize(europa* s, eu_table* t, size_t array_length,
+	size_t hash_length) {
+	eu_tnode *old_nodes, *old_last_free, *node;
+	eu_value *old_array, *v, key;
+	int old_asize, old_len, old_lsize, i;
+
+	/* check whether trying to shrink a table beyond the number of elements it
+	 * has in it */
+	if (_eutable_count(t) + _eutable_acount(t) > array_length + hash_length)
+		return EU_RESULT_BAD_ARGUMENT;
+
+	/* save old parts */
+	old_array = _eutable_array(t);
+	old_asize = _eutable_asize(t);
 	old_nodes = _eutable_nodes(t);
-	/* create a new nodes array */
-	if (set_nodes_length(s, t, new_length)) {
-		/* if it fails, restore old nodes and return */
-		_eutable_nodes(t) = old_nodes;
-		return EU_RESULT_BAD_ALLOC;
+	old_last_free = _eutable_last_free(t);
+	old_lsize = _eutable_lsize(t);
+	old_len = _eutable_size(t);
+
+	/* create the new array part */
+	t->array = NULL;
+	if (array_length > 0) {
+		t->array = cast(eu_value*, _eugc_malloc(_eu_gc(s),
+			sizeof(eu_value) * array_length));
+		if (t->array == NULL)
+			goto fail;
+
+		for (i = 0; i < array_length; i++)
+			_eutable_aslot_clear(_eutable_aslot(t, i));
+	}
+	t->asize = array_length;
+
+	/* create a new nodes array (set_nodes_length must not free the old one) */
+	t->nodes = &_dummy;
+	t->last_free = NULL;
+	if (set_nodes_length(s, t, hash_length)) {
+		if (t->array)
+			_eugc_free(_eu_gc(s), t->array);
+		goto fail;
 	}
 
-	/* reset table count to zero as eutable_create_key will increment it*/
+	/* reset counts as eutable_create_key will increment them */
 	_eutable_count(t) = 0;
-	/* insert old_nodes' elements into the new `nodes` */
+	_eutable_acount(t) = 0;
+
+	/* insert the old array part's elements */
+	for (i = 0; i < old_asize; i++) {
+		if (!_eutable_aslot_is_empty(&(old_array[i]))) {
+			_eu_makeint(&key, i);
+			_eu_checkreturn(eutable_create_key(s, t, &key, &v));
+			*v = old_array[i];
+		}
+	}
+
+	/* insert the old hash part's elements */
 	for (i = 0; i < old_len; i++) {
-		/* check if key-value pair is valid */
-		if (!_euvalue_is_null(_eutnode_key(&(old_nodes[i])))) {
-			/* insert the key into the table */
-			_eu_checkreturn(eutable_create_key(s, t,
-				_eutnode_key(&(old_nodes[i])), &v));
-			/* copy the value into the new slot */
-			*v = *(_eutnode_value(&(old_nodes[i])));
+		node = &(old_nodes[i]);
+		if (!_euvalue_is_null(_eutnode_key(node))) {
+			_eu_checkreturn(eutable_create_key(s, t, _eutnode_key(node), &v));
+			*v = *_eutnode_value(node);
 		}
 	}
 
-	/* free old nodes */
+	/* free old parts */
+	if (old_array)
+		_eugc_free(_eu_gc(s), old_array);
 	if (old_nodes != &_dummy)
 		_eugc_free(_eu_gc(s), old_nodes);
 
+	/* every value slot is somewhere else now */
+	_eutable_epoch(t) += 1;
+
 	return EU_RESULT_OK;
+
+	fail:
+	/* restore the old parts */
+	t->array = old_array;
+	t->asize = old_asize;
+	t->nodes = old_nodes;
+	t->last_free = old_last_free;
+	t->lsize = old_lsize;
+	return EU_RESULT_BAD_ALLOC;
 }
 
 /** Finds a free position in the table.
@@ -191,6 +419,11 @@ eu_table* eutable_new(europa* s, size_t length) {
 	t->last_free = NULL;
 	t->nodes = &_dummy;
 
+	/* tables start with no array part, it grows as integer keys are added */
+	t->array = NULL;
+	t->asize = 0;
+	t->acount = 0;
+
 	/* initialize the node array with the specified length */
 	if (set_nodes_length(s, t, length)) {
 		/* error initializing nodes, return NULL */
@@ -198,11 +431,95 @@ eu_table* eutable_new(europa* s, size_t length) {
 	}
 
 	t->index = NULL;
+	t->epoch = 0;
 	t->count = 0;
+	t->comparator = EU_TABLE_EQV;
 
 	return t;
 }
 
+/** Sets how keys are compared in a table.
+ *
+ * @param s The Europa state.
+ * @param t The target table. Must be empty.
+ * @param comparator One of the `eu_table_comparator` values.
+ * @return The result of the operation.
+ */
+int eutable_set_comparator(europa* s, eu_table* t, eu_byte comparator) {
+	if (!s || !t)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* keys already in the table would be in the wrong positions */
+	if (comparator >= EU_TABLE_COMPARATOR_LAST ||
+		_eutable_count(t) + _eutable_acount(t) > 0)
+		return EU_RESULT_BAD_ARGUMENT;
+
+	_eutable_comparator(t) = comparator;
+	return EU_RESULT_OK;
+}
+
+/** Removes all keys from a table, releasing both of its parts.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @return The result of the operation.
+ */
+int eutable_clear(europa* s, eu_table* t) {
+	if (!s || !t)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* release the hash part */
+	_eu_checkreturn(set_nodes_length(s, t, 0));
+	_eutable_count(t) = 0;
+
+	/* release the array part */
+	if (t->array != NULL)
+		_eugc_free(_eu_gc(s), t->array);
+	t->array = NULL;
+	t->asize = 0;
+	t->acount = 0;
+	_eutable_epoch(t) += 1;
+
+	return EU_RESULT_OK;
+}
+
+/** Creates a copy of a table with the same keys, values, comparator and index.
+ *
+ * @param s The Europa state.
+ * @param t The table to copy.
+ * @return The new table. NULL in case there was an error.
+ */
+eu_table* eutable_copy(europa* s, eu_table* t) {
+	eu_table* c;
+	eu_value key, *val, *cval;
+
+	if (!s || !t)
+		return NULL;
+
+	/* create a table with parts as big as t's */
+	c = eutable_new(s, 0);
+	if (c == NULL)
+		return NULL;
+	_eutable_comparator(c) = _eutable_comparator(t);
+	_eutable_set_index(c, _eutable_index(t));
+	if (eutable_resize(s, c, _eutable_asize(t), _eutable_count(t)))
+		return NULL;
+
+	/* copy every key */
+	if (eutable_next(s, t, NULL, &key, &val))
+		return NULL;
+	while (val != NULL) {
+		if (eutable_create_key(s, c, &key, &cval))
+			return NULL;
+		*cval = *val;
+
+		if (eutable_next(s, t, &key, &key, &val))
+			return NULL;
+	}
+
+	return c;
+}
+
 /** Calculates a hash for the target table.
  *
  * @param t The target table.
@@ -228,6 +545,11 @@ int eutable_destroy(europa* s, eu_table* t) {
 		_eugc_free(_eu_gc(s), t->nodes);
 	}
 
+	/* and the array part */
+	if (t->array != NULL) {
+		_eugc_free(_eu_gc(s), t->array);
+	}
+
 	return EU_RESULT_OK;
 }
 
@@ -244,8 +566,16 @@ int eutable_mark(europa* s, eu_gcmark mark, eu_table* t) {
 	eu_value* v;
 	eu_tnode* n;
 
-	/* mark elements in table */
-	len = twoto(t->lsize);
+	/* mark elements in the array part */
+	for (i = 0; i < _eutable_asize(t); i++) {
+		v = _eutable_aslot(t, i);
+		if (!_eutable_aslot_is_empty(v) && _euvalue_is_collectable(v)) {
+			_eu_checkreturn(mark(s, _euvalue_to_obj(v)));
+		}
+	}
+
+	/* mark elements in the hash part */
+	len = _eutable_size(t);
 	for (i = 0; i < len; i++) {
 		n = _eutable_node(t, i);
 		v = _eutnode_key(n);
@@ -258,7 +588,7 @@ int eutable_mark(europa* s, eu_gcmark mark, eu_table* t) {
 
 			/* mark the associated value */
 			v = _eutnode_value(n);
-			if (!_euvalue_is_collectable(v)) {
+			if (_euvalue_is_collectable(v)) {
 				_eu_checkreturn(mark(s, _euvalue_to_obj(v)));
 			}
 		}
@@ -272,65 +602,93 @@ int eutable_mark(europa* s, eu_gcmark mark, eu_table* t) {
 	return EU_RESULT_OK;
 }
 
-/** Gets a pointer to the value associated to a given key.
+/** Finds the hash part node holding a given key.
  *
  * @param s The Europa state.
  * @param t The target table.
  * @param key The desired key.
- * @param val Where to place the pointer to the node's value.
- * @return A pointer to the associated value. NULL if key is not found in the
- * table.
+ * @param node Where to place the node. Receives NULL if the key is not in the
+ * hash part.
+ * @param prev Where to place the node preceding it in its collision chain.
+ * Receives NULL if the node is the chain's head. May be NULL.
+ * @return The result of the operation.
  */
-int eutable_get(europa* s, eu_table* t, eu_value* key, eu_value** val) {
-	eu_uinteger vhash;
-	int pos;
-	eu_tnode* node;
+static int find_node(europa* s, eu_table* t, eu_value* key, eu_tnode** node,
+	eu_tnode** prev) {
+	eu_tnode *n, *p;
 	eu_value out;
 
-	/* return error in case any of the arguments is invalid */
-	if (!s || !t || !key)
-		return EU_RESULT_NULL_ARGUMENT;
+	*node = NULL;
+	if (prev)
+		*prev = NULL;
 
 	/* table has no elements */
-	if (_eutable_size(t) == 0) {
-		*val = NULL;
+	if (_eutable_size(t) == 0)
 		return EU_RESULT_OK;
-	}
 
-	/* calculate the value's hash */
-	vhash = euvalue_hash(key);
-	/* find the position in the table */
-	pos = vhash % _eutable_size(t);
-	/* get the node */
-	node = _eutable_node(t, pos);
+	/* keys the table can't hold are never in it */
+	if (!_table_accepts_key(t, key))
+		return EU_RESULT_OK;
+
+	/* get the node at the key's main position */
+	n = _eutable_node(t, _table_hash(t, key) % _eutable_size(t));
 
 	/* check whether the found node is empty */
-	if (_euvalue_is_null(_eutnode_key(node))) {
-		*val = NULL;
+	if (_euvalue_is_null(_eutnode_key(n)))
 		return EU_RESULT_OK;
-	}
 
+	p = NULL;
 	do {
 		/* check if colliding element and key are the same */
-		_eu_checkreturn(euvalue_eqv(key, _eutnode_key(node), &out));
+		_eu_checkreturn(_table_equal(t, key, _eutnode_key(n), &out));
 
-		/* in case they are, return the current node's value field */
+		/* in case they are, we found the node */
 		if (_euvalue_to_bool(&out)) {
-			*val = _eutnode_value(node);
+			*node = n;
+			if (prev)
+				*prev = p;
 			return EU_RESULT_OK;
 		}
 
-		/* we haven't found the key; try the next colliding element if there
-		 * are any */
-		if (_eutnode_next(node) >= 0) {
-			node = _eutable_node(t, _eutnode_next(node));
-		} else {
+		/* try the next colliding element if there are any */
+		if (_eutnode_next(n) < 0)
 			break;
-		}
+		p = n;
+		n = _eutable_node(t, _eutnode_next(n));
 	} while (1);
 
-	/* the key wasn't found in its collision chain, so object not found */
-	*val = NULL;
+	/* the key wasn't found in its collision chain */
+	return EU_RESULT_OK;
+}
+
+/** Gets a pointer to the value associated to a given key.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param key The desired key.
+ * @param val Where to place the pointer to the node's value.
+ * @return A pointer to the associated value. NULL if key is not found in the
+ * table.
+ */
+int eutable_get(europa* s, eu_table* t, eu_value* key, eu_value** val) {
+	int pos;
+	eu_tnode* node;
+
+	/* return error in case any of the arguments is invalid */
+	if (!s || !t || !key)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* integer keys in the array part's range are directly indexed */
+	if ((pos = array_index(key, _eutable_asize(t))) >= 0) {
+		*val = _eutable_aslot(t, pos);
+		if (_eutable_aslot_is_empty(*val))
+			*val = NULL;
+		return EU_RESULT_OK;
+	}
+
+	/* search the key's collision chain */
+	_eu_checkreturn(find_node(s, t, key, &node, NULL));
+	*val = node ? _eutnode_value(node) : NULL;
 	return EU_RESULT_OK;
 }
 
@@ -471,13 +829,30 @@ int eutable_create_key(europa* s, eu_table* t, eu_value* key, eu_value** val) {
 	if (!s || !t || !key || !val)
 		return EU_RESULT_NULL_ARGUMENT;
 
-	/* grow the table if it does not fit an extra element */
+	/* null keys mark empty nodes, so they can't be inserted, and string tables
+	 * only hold strings */
+	if (!_table_accepts_key(t, key))
+		return EU_RESULT_BAD_ARGUMENT;
+
+	/* keys in the array part's range go straight into their slot */
+	if ((pos = array_index(key, _eutable_asize(t))) >= 0) {
+		*val = _eutable_aslot(t, pos);
+		if (_eutable_aslot_is_empty(*val)) {
+			_eu_makenull(*val);
+			_eutable_acount(t) += 1;
+		}
+		return EU_RESULT_OK;
+	}
+
+	/* redistribute the table if the hash part does not fit an extra element,
+	 * the key may end up belonging to the array part after that */
 	if (_eutable_size(t) <= _eutable_count(t)) {
-		_eu_checkreturn(eutable_resize(s, t, _eutable_size(t) + 1));
+		_eu_checkreturn(rehash(s, t, key));
+		return eutable_create_key(s, t, key, val);
 	}
 
 	/* calculate key's position */
-	vhash = euvalue_hash(key);
+	vhash = _table_hash(t, key);
 	/* find the position in the table */
 	pos = vhash % _eutable_size(t);
 	/* get the node */
@@ -493,7 +868,7 @@ int eutable_create_key(europa* s, eu_table* t, eu_value* key, eu_value** val) {
 		}
 
 		/* get the colliding node */
-		cnode = _eutable_node(t, euvalue_hash(_eutnode_key(node)) % _eutable_size(t));
+		cnode = _eutable_node(t, _table_hash(t, _eutnode_key(node)) % _eutable_size(t));
 
 		if (cnode != node) { /* colliding node isn't in main position */
 			/* find whatever node previously pointed to it */
@@ -503,6 +878,8 @@ int eutable_create_key(europa* s, eu_table* t, eu_value* key, eu_value** val) {
 			_eutnode_next(cnode) = fnode - _eutable_nodes(t);
 			/* place the colliding node in the free slot */
 			*fnode = *node;
+			/* its value slot moved */
+			_eutable_epoch(t) += 1;
 
 			/* mark the main position node as free */
 			_eutnode_next(node) = -1;
@@ -532,7 +909,7 @@ int eutable_create_key(europa* s, eu_table* t, eu_value* key, eu_value** val) {
 	}
 	/* whenever we reach this point we're at three possible situations:
 	 * a) the key's main position is empty.
-	 *    In which case, `fnode` points to the csh -c "$(curl -fsSL https://raw.githubusercontent.com/robbyrussell/oh-my-zsh/master/tools/install.sh)"orrect position and has the
+	 *    In which case, `fnode` points to the correct position and has the
 	 *    correct `next` value (-1).
 	 * b) the key's main position wasn't empty, but the colliding key was **not**
 	 *    in it's main position.
@@ -555,6 +932,140 @@ int eutable_create_key(europa* s, eu_table* t, eu_value* key, eu_value** val) {
 	return EU_RESULT_OK; /* everything went fine */
 }
 
+/* tables whose parts are larger than this are shrunk when less than a quarter
+ * of their slots are in use */
+#define MINSHRINKSIZE 8
+
+/** Removes a key from the table.
+ *
+ * When the removed node is the head of a collision chain, the next node in the
+ * chain is moved into its place so that chain heads are always at their main
+ * position. The table is shrunk if it becomes too sparse.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param key The key to remove.
+ * @return The result of the operation. Removing a key that is not in the table
+ * is not an error.
+ */
+int eutable_remove(europa* s, eu_table* t, eu_value* key) {
+	int pos, capacity;
+	eu_tnode *node, *prev, *next;
+	eu_value* v;
+
+	/* check parameters */
+	if (!s || !t || !key)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	if ((pos = array_index(key, _eutable_asize(t))) >= 0) {
+		/* the key is in the array part, so just clear its slot */
+		v = _eutable_aslot(t, pos);
+		if (_eutable_aslot_is_empty(v))
+			return EU_RESULT_OK;
+
+		_eutable_aslot_clear(v);
+		_eutable_acount(t) -= 1;
+	} else {
+		_eu_checkreturn(find_node(s, t, key, &node, &prev));
+		if (node == NULL)
+			return EU_RESULT_OK;
+
+		if (prev != NULL) {
+			/* the node is in the middle of a chain, unlink it */
+			_eutnode_next(prev) = _eutnode_next(node);
+		} else if (_eutnode_next(node) >= 0) {
+			/* the node is the head of a chain and is at the main position for
+			 * all keys in it, move the next node into it and free that instead */
+			next = _eutable_node(t, _eutnode_next(node));
+			*node = *next;
+			node = next;
+		}
+
+		/* free the node */
+		_eu_makenull(_eutnode_key(node));
+		_eu_makenull(_eutnode_value(node));
+		_eutnode_next(node) = -1;
+
+		/* make sure the free node can be found by eutnode_free_position */
+		if (node >= _eutable_last_free(t))
+			t->last_free = node + 1;
+
+		_eutable_count(t) -= 1;
+	}
+
+	/* the removed slot (and possibly a moved one) is no longer valid */
+	_eutable_epoch(t) += 1;
+
+	/* shrink the table if it became too sparse */
+	capacity = _eutable_size(t) + _eutable_asize(t);
+	if (capacity > MINSHRINKSIZE &&
+		(_eutable_count(t) + _eutable_acount(t)) * 4 < capacity) {
+		_eu_checkreturn(rehash(s, t, NULL));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/** Gets the key and value following a given key in the table.
+ *
+ * Keys are traversed in a fixed order: the array part in increasing index
+ * order and then the hash part in node order. The order stays the same as long
+ * as no keys are added or removed, which may relocate elements. Values may be
+ * changed during the traversal.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param key The current key. NULL to get the first key in the table.
+ * @param nkey Where to place the next key. May be the same as key.
+ * @param nval Where to place the pointer to the next key's value. Receives NULL
+ * when there are no more keys.
+ * @return The result of the operation. BAD_ARGUMENT if key is not in the table.
+ */
+int eutable_next(europa* s, eu_table* t, eu_value* key, eu_value* nkey,
+	eu_value** nval) {
+	int i;
+	eu_tnode* node;
+
+	/* check parameters */
+	if (!s || !t || !nkey || !nval)
+		return EU_RESULT_NULL_ARGUMENT;
+
+	/* find the position after the current key */
+	if (key == NULL) {
+		i = 0;
+	} else if ((i = array_index(key, _eutable_asize(t))) >= 0) {
+		i++;
+	} else {
+		_eu_checkreturn(find_node(s, t, key, &node, NULL));
+		if (node == NULL)
+			return EU_RESULT_BAD_ARGUMENT;
+		i = _eutable_asize(t) + (node - _eutable_nodes(t)) + 1;
+	}
+
+	/* search the array part */
+	for (; i < _eutable_asize(t); i++) {
+		if (!_eutable_aslot_is_empty(_eutable_aslot(t, i))) {
+			_eu_makeint(nkey, i);
+			*nval = _eutable_aslot(t, i);
+			return EU_RESULT_OK;
+		}
+	}
+
+	/* search the hash part */
+	for (i -= _eutable_asize(t); i < _eutable_size(t); i++) {
+		node = _eutable_node(t, i);
+		if (!_euvalue_is_null(_eutnode_key(node))) {
+			*nkey = *_eutnode_key(node);
+			*nval = _eutnode_value(node);
+			return EU_RESULT_OK;
+		}
+	}
+
+	/* no more keys */
+	*nval = NULL;
+	return EU_RESULT_OK;
+}
+
 int eutable_rget(europa* s, eu_table* t, eu_value* key, eu_value** val);
 int eutable_rget_string(europa* s, eu_table* t, const char* str,
 	eu_value** val);
@@ -646,3 +1157,598 @@ int eutable_define_symbol(europa* s, eu_table* t, void* text, eu_value** val) {
 
 	return EU_RESULT_OK;
 }
+
+/**
+ * @addtogroup language_library
+ * @{
+ */
+
+int euapi_register_table(europa* s) {
+	eu_table* env;
+
+	env = s->env;
+
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "make-hash-table", euapi_make_hash_table));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "make-eq-hash-table", euapi_make_eq_hash_table));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "make-eqv-hash-table", euapi_make_eqv_hash_table));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "make-equal-hash-table", euapi_make_equal_hash_table));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "make-string-hash-table", euapi_make_string_hash_table));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table?", euapi_hash_tableQ));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-ref", euapi_hash_table_ref));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-ref/default", euapi_hash_table_ref_default));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-set!", euapi_hash_table_setB));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-delete!", euapi_hash_table_deleteB));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-contains?", euapi_hash_table_containsQ));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-exists?", euapi_hash_table_containsQ));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-update!", euapi_hash_table_updateB));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-update!/default", euapi_hash_table_updateB_default));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-size", euapi_hash_table_size));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-keys", euapi_hash_table_keys));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-values", euapi_hash_table_values));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table->alist", euapi_hash_table_to_alist));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-walk", euapi_hash_table_walk));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-fold", euapi_hash_table_fold));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-copy", euapi_hash_table_copy));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-table-clear!", euapi_hash_table_clearB));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash", euapi_hash));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "hash-by-identity", euapi_hash_by_identity));
+
+	return EU_RESULT_OK;
+}
+
+/* what table_to_list places in each element of the list */
+#define TLIST_KEYS 0
+#define TLIST_VALUES 1
+#define TLIST_PAIRS 2
+
+/** Creates a list with a table's keys, values or key-value pairs.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param what One of TLIST_KEYS, TLIST_VALUES or TLIST_PAIRS.
+ * @param out Where to place the list.
+ * @return The result of the operation.
+ */
+static int table_to_list(europa* s, eu_table* t, int what, eu_value* out) {
+	eu_value key, element, *val, *slot;
+	eu_pair* pair;
+
+	*out = _null;
+	slot = out;
+
+	_eu_checkreturn(eutable_next(s, t, NULL, &key, &val));
+	while (val != NULL) {
+		/* create the element */
+		if (what == TLIST_KEYS) {
+			element = key;
+		} else if (what == TLIST_VALUES) {
+			element = *val;
+		} else {
+			pair = eupair_new(s, &key, val);
+			if (pair == NULL)
+				return EU_RESULT_BAD_ALLOC;
+			_eu_makepair(&element, pair);
+		}
+
+		/* append it to the list */
+		pair = eupair_new(s, &element, &_null);
+		if (pair == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_makepair(slot, pair);
+		slot = _eupair_tail(pair);
+
+		_eu_checkreturn(eutable_next(s, t, &key, &key, &val));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/* checks whether a value can be used as a key in a table */
+#define _check_key(s, t, key) \
+	do {\
+		if (!_table_accepts_key(t, key)) {\
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL, \
+				_euvalue_is_null(key) ?\
+				"The empty list cannot be used as a hash table key." :\
+				"String hash tables only accept string keys."));\
+			return EU_RESULT_ERROR;\
+		}\
+	} while (0)
+
+/* makes a non-negative integer out of a hash */
+#define _hash_to_int(h) cast(eu_integer, (h) & (~cast(eu_uinteger, 0) >> 1))
+
+/** Creates a new table with a given comparator in the return value.
+ *
+ * @param s The Europa state.
+ * @param comparator The table's comparator.
+ * @return The result of the operation.
+ */
+static int new_hash_table(europa* s, eu_byte comparator) {
+	eu_table* t;
+
+	t = eutable_new(s, 0);
+	if (t == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eutable_comparator(t) = comparator;
+
+	_eu_maketable(_eucc_return(s), t);
+	return EU_RESULT_OK;
+}
+
+/** Builds a list with one value.
+ *
+ * @param s The Europa state.
+ * @param v The value.
+ * @param out Where to place the list.
+ * @return The result of the operation.
+ */
+static int make_single_list(europa* s, eu_value* v, eu_value* out) {
+	eu_pair* pair;
+
+	pair = eupair_new(s, v, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(out, pair);
+	return EU_RESULT_OK;
+}
+
+/** Stores the value in the accumulator in a table's key. Used by the procedures
+ * that update keys after calling back into Europa code.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+static int store_updated_value(europa* s) {
+	eu_value *table, *key, *val;
+
+	/* reload the arguments from the rib */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE);
+	_eucc_argument(s, key, 1);
+
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+	if (val == NULL) {
+		_eu_checkreturn(eutable_create_key(s, _euvalue_to_table(table), key, &val));
+	}
+	*val = *_eucc_return(s);
+
+	_eu_makenull(_eucc_return(s));
+	return EU_RESULT_OK;
+}
+
+/* (make-hash-table [equivalence [hash]])
+ *
+ * the equivalence procedure must be one of eq?, eqv?, equal? or string=?, which
+ * select the table's comparator. because each comparator comes with its own
+ * hash function, the hash procedure is accepted for compatibility but ignored.
+ */
+int euapi_make_hash_table(europa* s) {
+	eu_value* equivalence;
+	eu_cfunc cf;
+
+	_eucc_optional_argument(s, equivalence, 0);
+	if (equivalence == NULL)
+		return new_hash_table(s, EU_TABLE_EQV);
+
+	/* find out which comparator the equivalence procedure stands for */
+	cf = _euvalue_is_type(equivalence, EU_TYPE_CLOSURE) ?
+		_euvalue_to_closure(equivalence)->cf : NULL;
+	if (cf == euapi_eqQ) {
+		return new_hash_table(s, EU_TABLE_EQ);
+	} else if (cf == euapi_eqvQ) {
+		return new_hash_table(s, EU_TABLE_EQV);
+	} else if (cf == euapi_equalQ) {
+		return new_hash_table(s, EU_TABLE_EQUAL);
+	} else if (cf == euapi_stringEQ) {
+		return new_hash_table(s, EU_TABLE_STRING);
+	}
+
+	_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+		"Unsupported hash table equivalence procedure. Expected one of eq?, "
+		"eqv?, equal? or string=?."));
+	return EU_RESULT_ERROR;
+}
+
+int euapi_make_eq_hash_table(europa* s) {
+	return new_hash_table(s, EU_TABLE_EQ);
+}
+
+int euapi_make_eqv_hash_table(europa* s) {
+	return new_hash_table(s, EU_TABLE_EQV);
+}
+
+int euapi_make_equal_hash_table(europa* s) {
+	return new_hash_table(s, EU_TABLE_EQUAL);
+}
+
+int euapi_make_string_hash_table(europa* s) {
+	return new_hash_table(s, EU_TABLE_STRING);
+}
+
+int euapi_hash_tableQ(europa* s) {
+	eu_value* obj;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument(s, obj, 0); /* get argument */
+
+	_eu_makebool(_eucc_return(s), _euvalue_is_type(obj, EU_TYPE_TABLE));
+	return EU_RESULT_OK;
+}
+
+/* (hash-table-ref table key [failure [success]])
+ *
+ * failure and success are tail called, so no frame needs to be created. */
+int euapi_hash_table_ref(europa* s) {
+	eu_value *table, *key, *failure, *success, *val, args;
+
+	_eucc_arity_improper(s, 2); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+	_eucc_optional_argument(s, failure, 2);
+	_eucc_optional_argument(s, success, 3);
+
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+
+	if (val == NULL) {
+		if (failure == NULL) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Key not found in hash table."));
+			return EU_RESULT_ERROR;
+		}
+		return euvm_apply(s, failure, &_null, NULL);
+	}
+
+	if (success != NULL) {
+		_eu_checkreturn(make_single_list(s, val, &args));
+		return euvm_apply(s, success, &args, NULL);
+	}
+
+	*_eucc_return(s) = *val;
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_ref_default(europa* s) {
+	eu_value *table, *key, *def, *val;
+
+	_eucc_arity_proper(s, 3); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+	_eucc_argument(s, def, 2);
+
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+	*_eucc_return(s) = val ? *val : *def;
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_setB(europa* s) {
+	eu_value *table, *key, *value, *val;
+
+	_eucc_arity_proper(s, 3); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+	_eucc_argument(s, value, 2);
+	_check_key(s, _euvalue_to_table(table), key);
+
+	/* get the key's slot, creating it if needed */
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+	if (val == NULL) {
+		_eu_checkreturn(eutable_create_key(s, _euvalue_to_table(table), key, &val));
+	}
+	*val = *value;
+
+	_eu_makenull(_eucc_return(s));
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_deleteB(europa* s) {
+	eu_value *table, *key;
+
+	_eucc_arity_proper(s, 2); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+
+	_eu_checkreturn(eutable_remove(s, _euvalue_to_table(table), key));
+
+	_eu_makenull(_eucc_return(s));
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_containsQ(europa* s) {
+	eu_value *table, *key, *val;
+
+	_eucc_arity_proper(s, 2); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+	_eu_makebool(_eucc_return(s), val != NULL);
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_size(europa* s) {
+	eu_value* table;
+	eu_table* t;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get argument */
+
+	t = _euvalue_to_table(table);
+	_eu_makeint(_eucc_return(s), _eutable_count(t) + _eutable_acount(t));
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_keys(europa* s) {
+	eu_value* table;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get argument */
+
+	return table_to_list(s, _euvalue_to_table(table), TLIST_KEYS,
+		_eucc_return(s));
+}
+
+int euapi_hash_table_values(europa* s) {
+	eu_value* table;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get argument */
+
+	return table_to_list(s, _euvalue_to_table(table), TLIST_VALUES,
+		_eucc_return(s));
+}
+
+int euapi_hash_table_to_alist(europa* s) {
+	eu_value* table;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get argument */
+
+	return table_to_list(s, _euvalue_to_table(table), TLIST_PAIRS,
+		_eucc_return(s));
+}
+
+/* where the procedures calling back into Europa code resume */
+enum {
+	RESUME_START,
+	RESUME_VALUE_READY,
+	RESUME_UPDATED,
+	RESUME_NEXT,
+};
+
+/* (hash-table-update! table key proc [failure])
+ *
+ * the value is obtained (calling failure if needed), passed to proc and its
+ * result is stored back in the table. */
+int euapi_hash_table_updateB(europa* s) {
+	eu_value *table, *key, *proc, *failure, *val, args;
+	eu_cframe* f;
+
+	_eucc_arity_improper(s, 3); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+	_eucc_argument(s, proc, 2);
+	_eucc_optional_argument(s, failure, 3);
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+
+	switch (_eucframe_tag(f)) {
+	case RESUME_START:
+		_check_key(s, _euvalue_to_table(table), key);
+
+		/* get the value to be updated in the accumulator */
+		_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+		if (val == NULL && failure == NULL) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Key not found in hash table."));
+			return EU_RESULT_ERROR;
+		}
+		if (val == NULL) {
+			/* call failure to get the value */
+			return eucc_call(s, RESUME_VALUE_READY, failure, &_null);
+		}
+		*_eucc_return(s) = *val;
+		/* fall through */
+
+	case RESUME_VALUE_READY:
+		/* call proc with the value */
+		_eu_checkreturn(make_single_list(s, _eucc_return(s), &args));
+		return eucc_call(s, RESUME_UPDATED, proc, &args);
+
+	default:
+		/* proc's result is in the accumulator */
+		return store_updated_value(s);
+	}
+}
+
+/* (hash-table-update!/default table key proc default) */
+int euapi_hash_table_updateB_default(europa* s) {
+	eu_value *table, *key, *proc, *def, *val, args;
+	eu_cframe* f;
+
+	_eucc_arity_proper(s, 4); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, key, 1);
+	_eucc_argument(s, proc, 2);
+	_eucc_argument(s, def, 3);
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+
+	if (_eucframe_tag(f) == RESUME_UPDATED) {
+		/* proc's result is in the accumulator */
+		return store_updated_value(s);
+	}
+
+	/* call proc with the current (or default) value */
+	_check_key(s, _euvalue_to_table(table), key);
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(table), key, &val));
+	_eu_checkreturn(make_single_list(s, val ? val : def, &args));
+	return eucc_call(s, RESUME_UPDATED, proc, &args);
+}
+
+/** Gets the key-value pairs left to visit by walk or fold.
+ *
+ * Procedures that call back into Europa code for each key iterate through a
+ * snapshot of the table's pairs, kept in slot 0 of their frame, instead of the
+ * table itself, so the table can be changed by the called procedures.
+ *
+ * @param s The Europa state.
+ * @param t The target table.
+ * @param slot Where to place the slot holding the remaining pairs.
+ * @return The result of the operation.
+ */
+static int snapshot_slot(europa* s, eu_table* t, eu_value** slot) {
+	eu_cframe* f;
+
+	_eu_checkreturn(eucc_cframe(s, 1, &f));
+	*slot = _eucframe_slot(f, 0);
+	if (_eucframe_tag(f) == RESUME_START) {
+		_eu_checkreturn(table_to_list(s, t, TLIST_PAIRS, *slot));
+	}
+	return EU_RESULT_OK;
+}
+
+/* (hash-table-walk table proc) */
+int euapi_hash_table_walk(europa* s) {
+	eu_value *table, *proc, *slot, *kv, args;
+	eu_pair* pair;
+
+	_eucc_arity_proper(s, 2); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, proc, 1);
+
+	/* get the next pair */
+	_eu_checkreturn(snapshot_slot(s, _euvalue_to_table(table), &slot));
+	if (_euvalue_is_null(slot)) {
+		_eu_makenull(_eucc_return(s));
+		return EU_RESULT_OK;
+	}
+	kv = _eupair_head(_euvalue_to_pair(slot));
+	*slot = *_eupair_tail(_euvalue_to_pair(slot));
+
+	/* build the argument list (key value) */
+	_eu_checkreturn(make_single_list(s, _eupair_tail(_euvalue_to_pair(kv)), &args));
+	pair = eupair_new(s, _eupair_head(_euvalue_to_pair(kv)), &args);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+
+	/* the last call is a tail call, otherwise come back for the next pair */
+	if (!_euvalue_is_null(slot))
+		return eucc_call(s, RESUME_NEXT, proc, &args);
+	return euvm_apply(s, proc, &args, NULL);
+}
+
+/* (hash-table-fold table kons knil) */
+int euapi_hash_table_fold(europa* s) {
+	eu_value *table, *kons, *knil, *slot, *kv, args;
+	eu_pair* pair;
+	eu_cframe* f;
+
+	_eucc_arity_proper(s, 3); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get arguments */
+	_eucc_argument(s, kons, 1);
+	_eucc_argument(s, knil, 2);
+
+	/* the accumulated value is in the accumulator */
+	_eu_checkreturn(eucc_cframe(s, 1, &f));
+	if (_eucframe_tag(f) == RESUME_START)
+		*_eucc_return(s) = *knil;
+
+	_eu_checkreturn(snapshot_slot(s, _euvalue_to_table(table), &slot));
+	if (_euvalue_is_null(slot))
+		return EU_RESULT_OK;
+	kv = _eupair_head(_euvalue_to_pair(slot));
+	*slot = *_eupair_tail(_euvalue_to_pair(slot));
+
+	/* build the argument list (key value accumulated) */
+	_eu_checkreturn(make_single_list(s, _eucc_return(s), &args));
+	pair = eupair_new(s, _eupair_tail(_euvalue_to_pair(kv)), &args);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+	pair = eupair_new(s, _eupair_head(_euvalue_to_pair(kv)), &args);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+
+	/* the last call is a tail call, otherwise come back for the next pair */
+	if (!_euvalue_is_null(slot))
+		return eucc_call(s, RESUME_NEXT, kons, &args);
+	return euvm_apply(s, kons, &args, NULL);
+}
+
+int euapi_hash_table_copy(europa* s) {
+	eu_value* table;
+	eu_table* t;
+
+	_eucc_arity_improper(s, 1); /* check arity (mutability is ignored) */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get argument */
+
+	t = eutable_copy(s, _euvalue_to_table(table));
+	if (t == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	_eu_maketable(_eucc_return(s), t);
+	return EU_RESULT_OK;
+}
+
+int euapi_hash_table_clearB(europa* s) {
+	eu_value* table;
+
+	_eucc_arity_proper(s, 1); /* check arity */
+	_eucc_argument_type(s, table, 0, EU_TYPE_TABLE); /* get argument */
+
+	_eu_checkreturn(eutable_clear(s, _euvalue_to_table(table)));
+
+	_eu_makenull(_eucc_return(s));
+	return EU_RESULT_OK;
+}
+
+/** Places a hash in the return value, reducing it to an optional bound.
+ *
+ * @param s The Europa state.
+ * @param hash The hash.
+ * @return The result of the operation.
+ */
+static int return_hash(europa* s, eu_uinteger hash) {
+	eu_value* bound;
+	eu_integer h;
+
+	h = _hash_to_int(hash);
+
+	_eucc_optional_argument(s, bound, 1);
+	if (bound != NULL) {
+		_eucc_check_type(s, bound, "bound", EU_TYPE_NUMBER);
+		if (!_eunum_is_exact(bound) || _eunum_i(bound) <= 0) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Hash bound must be a positive integer."));
+			return EU_RESULT_ERROR;
+		}
+		h %= _eunum_i(bound);
+	}
+
+	_eu_makeint(_eucc_return(s), h);
+	return EU_RESULT_OK;
+}
+
+/* (hash obj [bound]), consistent with equal? */
+int euapi_hash(europa* s) {
+	eu_value* obj;
+
+	_eucc_arity_improper(s, 1); /* check arity */
+	_eucc_argument(s, obj, 0); /* get argument */
+
+	return return_hash(s, euvalue_equal_hash(obj));
+}
+
+/* (hash-by-identity obj [bound]), consistent with eq? */
+int euapi_hash_by_identity(europa* s) {
+	eu_value* obj;
+
+	_eucc_arity_improper(s, 1); /* check arity */
+	_eucc_argument(s, obj, 0); /* get argument */
+
+	return return_hash(s, euvalue_hash(obj));
+}
+
+/**
+ * @}
+ */
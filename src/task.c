@@ -0,0 +1,599 @@
+/** Tasks (green threads) and channels.
+ *
+ * @file task.c
+ * @author Leonardo G.
+ */
+#include "europa/task.h"
+
+#include <time.h>
+
+#include "europa/ccont.h"
+#include "europa/error.h"
+#include "europa/number.h"
+#include "europa/pair.h"
+
+/* Tasks are built on frames, like everything else that suspends code. A task
+ * that waits is the return frame of the builtin it called (yield, join, ...)
+ * and one that is preempted is a frame made where it stopped, so switching
+ * tasks is only placing another frame in the state; nothing is copied.
+ *
+ * The host's computation is a task too (the root task), created the first time
+ * it has to wait. Spawned tasks run under eutask_main, which never returns: when
+ * their thunk returns, another task runs in their place. Tasks queued when the
+ * host's computation returns stay queued until code runs again. */
+
+eu_task* eutask_new(europa* s, eu_value* thunk) {
+	eu_task* task;
+
+	task = _euobj_to_task(eugc_new_object(s, EU_TYPE_TASK |
+		EU_TYPEFLAG_COLLECTABLE, sizeof(eu_task)));
+	if (task == NULL)
+		return NULL;
+
+	task->status = EU_TASK_READY;
+	task->root = EU_FALSE;
+	task->failed = EU_FALSE;
+	task->next = NULL;
+	task->waiters = NULL;
+	task->cont = NULL;
+	task->value = *thunk;
+	task->wake = 0;
+
+	return task;
+}
+
+/**
+ * @brief Marks task references.
+ *
+ * The task's queue link is not followed; whatever holds the queue marks the
+ * tasks in it, which keeps long queues from nesting the marking.
+ *
+ * @param s The Europa state.
+ * @param mark The marking function.
+ * @param task The target task.
+ * @return The result of the operation.
+ */
+int eutask_mark(europa* s, eu_gcmark mark, eu_task* task) {
+	eu_task* waiter;
+
+	for (waiter = task->waiters; waiter; waiter = waiter->next) {
+		_eu_checkreturn(mark(s, _eutask_to_obj(waiter)));
+	}
+
+	if (task->cont) {
+		_eu_checkreturn(mark(s, _eucont_to_obj(task->cont)));
+	}
+
+	if (_euvalue_is_collectable(&task->value)) {
+		_eu_checkreturn(mark(s, _euvalue_to_obj(&task->value)));
+	}
+
+	return EU_RESULT_OK;
+}
+
+eu_channel* euchannel_new(europa* s) {
+	eu_channel* chan;
+
+	chan = _euobj_to_channel(eugc_new_object(s, EU_TYPE_CHANNEL |
+		EU_TYPEFLAG_COLLECTABLE, sizeof(eu_channel)));
+	if (chan == NULL)
+		return NULL;
+
+	chan->values = _null;
+	chan->last = &chan->values;
+	chan->receivers = NULL;
+	chan->receivers_last = NULL;
+
+	return chan;
+}
+
+/**
+ * @brief Marks channel references.
+ *
+ * @param s The Europa state.
+ * @param mark The marking function.
+ * @param chan The target channel.
+ * @return The result of the operation.
+ */
+int euchannel_mark(europa* s, eu_gcmark mark, eu_channel* chan) {
+	eu_task* receiver;
+
+	if (_euvalue_is_collectable(&chan->values)) {
+		_eu_checkreturn(mark(s, _euvalue_to_obj(&chan->values)));
+	}
+
+	for (receiver = chan->receivers; receiver; receiver = receiver->next) {
+		_eu_checkreturn(mark(s, _eutask_to_obj(receiver)));
+	}
+
+	return EU_RESULT_OK;
+}
+
+/*
+ * Scheduling
+ */
+
+/* monotonic time, in seconds */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return cast(double, ts.tv_sec) + cast(double, ts.tv_nsec) / 1e9;
+}
+
+/* adds a task to the end of the run queue */
+static void enqueue(europa* s, eu_task* task) {
+	task->status = EU_TASK_READY;
+	task->next = NULL;
+
+	if (s->ready_last) {
+		s->ready_last->next = task;
+	} else {
+		s->ready = task;
+	}
+	s->ready_last = task;
+}
+
+/* moves sleeping tasks whose time has come to the run queue */
+static void wake_sleepers(europa* s) {
+	eu_task* task;
+	double t;
+
+	if (s->sleeping == NULL)
+		return;
+
+	t = now();
+	while (s->sleeping && s->sleeping->wake <= t) {
+		task = s->sleeping;
+		s->sleeping = task->next;
+		_eu_makenull(&task->value);
+		enqueue(s, task);
+	}
+}
+
+/**
+ * @brief Suspends the running task at the state's previous frame.
+ *
+ * The task resumes by returning to that frame, so callers either return to
+ * their caller when resumed or push a frame of their own before suspending.
+ *
+ * @param s The Europa state.
+ * @param out Where to place the suspended task.
+ * @return The result of the operation.
+ */
+static int suspend(europa* s, eu_task** out) {
+	if (s->task == NULL) {
+		/* the host's computation had no task yet */
+		s->task = eutask_new(s, &_null);
+		if (s->task == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		s->task->root = EU_TRUE;
+	}
+
+	s->task->status = EU_TASK_WAITING;
+	s->task->cont = s->previous;
+	_eu_makenull(&s->task->value);
+
+	*out = s->task;
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Runs a task, replacing whatever was running.
+ *
+ * @param s The Europa state.
+ * @param task The task.
+ * @return The result of the operation.
+ */
+static int run(europa* s, eu_task* task) {
+	eu_closure* cl;
+	eu_pair* pair;
+	eu_value v, args;
+
+	s->task = task;
+	task->status = EU_TASK_RUNNING;
+	task->next = NULL;
+	euvm_refuel(s);
+
+	if (task->cont != NULL || task->root)
+		return euvm_resume(s, task->cont, &task->value);
+
+	/* new tasks start outside of everything else */
+	cl = eucl_new(s, eutask_main, NULL, _eu_global_env(s));
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	_eu_maketask(&v, task);
+	pair = eupair_new(s, &v, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+
+	s->previous = NULL;
+	s->handler = NULL;
+	s->wind = NULL;
+
+	_eu_makeclosure(&v, cl);
+	return euvm_apply(s, &v, &args, NULL);
+}
+
+/**
+ * @brief Runs the next ready task.
+ *
+ * The running task must have been suspended or finished already. If no task is
+ * ready, this waits for the first sleeping one.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+static int switch_task(europa* s) {
+	eu_task* task;
+	struct timespec ts;
+	double delay;
+
+	for (;;) {
+		wake_sleepers(s);
+
+		if ((task = s->ready) != NULL) {
+			s->ready = task->next;
+			if (s->ready == NULL)
+				s->ready_last = NULL;
+			return run(s, task);
+		}
+
+		if (s->sleeping == NULL) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Deadlock: every task is waiting."));
+			return EU_RESULT_ERROR;
+		}
+
+		delay = s->sleeping->wake - now();
+		if (delay > 0) {
+			ts.tv_sec = cast(time_t, delay);
+			ts.tv_nsec = cast(long, (delay - cast(double, ts.tv_sec)) * 1e9);
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+/**
+ * @brief Gives other tasks a turn once the running one used its budget.
+ *
+ * Called by the VM at calls and backward jumps, once the budget was renewed,
+ * with the running code's state as it should be resumed. If no other task is
+ * ready, the running one simply goes on.
+ *
+ * @param s The Europa state.
+ * @return EU_RESULT_CONTINUE if another task took over, EU_RESULT_OK if the
+ * running code should go on.
+ */
+int eutask_preempt(europa* s) {
+	eu_continuation* cont;
+	eu_task* task;
+
+	wake_sleepers(s);
+	if (s->ready == NULL)
+		return EU_RESULT_OK;
+
+	/* the preempted code resumes exactly where it stopped */
+	cont = eucont_new(s, s->previous, s->env, &s->rib, s->rib_lastpos, s->ccl,
+		s->pc, s->cframe);
+	if (cont == NULL) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Could not create continuation."));
+		return EU_RESULT_ERROR;
+	}
+
+	s->previous = cont;
+	_eu_checkreturn(suspend(s, &task));
+	task->value = s->acc;
+	enqueue(s, task);
+
+	return switch_task(s);
+}
+
+/**
+ * @brief Finishes the running task, waking the tasks that joined it.
+ *
+ * @param s The Europa state.
+ * @param value The task's result or what it raised.
+ * @param failed Whether it raised.
+ * @return The result of the operation.
+ */
+static int finish(europa* s, eu_value* value, int failed) {
+	eu_task *task, *waiter;
+
+	task = s->task;
+	task->status = EU_TASK_DONE;
+	task->failed = failed ? EU_TRUE : EU_FALSE;
+	task->cont = NULL;
+	task->value = *value;
+
+	while ((waiter = task->waiters) != NULL) {
+		task->waiters = waiter->next;
+		enqueue(s, waiter);
+	}
+
+	s->task = NULL;
+	return switch_task(s);
+}
+
+/**
+ * @brief Finishes the running task with an object it did not handle.
+ *
+ * Called when a raise reaches the frame of eutask_main. Tasks that join the
+ * failed task raise the object again.
+ *
+ * @param s The Europa state.
+ * @param obj The raised object.
+ * @return The result of the operation.
+ */
+int eutask_fail(europa* s, eu_value* obj) {
+	return finish(s, obj, EU_TRUE);
+}
+
+enum {
+	TASK_START,
+	TASK_THUNK,
+};
+
+/**
+ * @brief Runs a spawned task's thunk.
+ *
+ * The thunk's return frame is also the task's handler of last resort, which
+ * raises recognize to fail the task instead of the whole state.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int eutask_main(europa* s) {
+	eu_cframe* f;
+	eu_value* task;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, task, 0, EU_TYPE_TASK);
+
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+	if (_eucframe_tag(f) == TASK_START) {
+		_eucframe_tag(f) = TASK_THUNK;
+		_eu_checkreturn(eucc_frame(s));
+		s->handler = s->previous;
+		return euvm_apply(s, &_euvalue_to_task(task)->value, &_null, NULL);
+	}
+
+	return finish(s, _eu_acc(s), EU_FALSE);
+}
+
+/*
+ * Library
+ */
+
+int euapi_register_tasks(europa* s) {
+	eu_table* env;
+
+	env = s->env;
+
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "spawn", euapi_spawn));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "yield", euapi_yield));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "sleep", euapi_sleep));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "join", euapi_join));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "task?", euapi_taskQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "make-channel", euapi_make_channel));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "channel?", euapi_channelQ));
+	_eu_checkreturn(eucc_define_leaf_cclosure(s, env, env, "channel-send", euapi_channel_send));
+	_eu_checkreturn(eucc_define_cclosure(s, env, env, "channel-receive", euapi_channel_receive));
+
+	return EU_RESULT_OK;
+}
+
+/* checks that a builtin got no arguments */
+#define check_no_arguments(s) \
+	if (!_euvalue_is_null(_eucc_arguments(s))) {\
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL, \
+			"Procedure expected no arguments, but some were provided."));\
+		return EU_RESULT_ERROR;\
+	}
+
+int euapi_spawn(europa* s) {
+	eu_value* thunk;
+	eu_task* task;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument(s, thunk, 0);
+
+	task = eutask_new(s, thunk);
+	if (task == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	enqueue(s, task);
+
+	_eu_maketask(_eucc_return(s), task);
+	return EU_RESULT_OK;
+}
+
+int euapi_yield(europa* s) {
+	eu_task* task;
+
+	check_no_arguments(s);
+	_eu_makenull(_eucc_return(s));
+
+	wake_sleepers(s);
+	if (s->ready == NULL)
+		return EU_RESULT_OK;
+
+	_eu_checkreturn(suspend(s, &task));
+	enqueue(s, task);
+	return switch_task(s);
+}
+
+int euapi_sleep(europa* s) {
+	eu_value* seconds;
+	eu_task *task, **slot;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, seconds, 0, EU_TYPE_NUMBER);
+
+	_eu_checkreturn(suspend(s, &task));
+	task->wake = now() + _eunum_to_real(seconds);
+
+	/* the sleeping queue is kept sorted by wake time */
+	for (slot = &s->sleeping; *slot && (*slot)->wake <= task->wake;
+		slot = &(*slot)->next)
+		;
+	task->next = *slot;
+	*slot = task;
+
+	return switch_task(s);
+}
+
+enum {
+	JOIN_START,
+	JOIN_WOKEN,
+};
+
+int euapi_join(europa* s) {
+	eu_value* tv;
+	eu_task *task, *self;
+	eu_closure* cl;
+	eu_cframe* f;
+	eu_pair* pair;
+	eu_value args;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, tv, 0, EU_TYPE_TASK);
+	task = _euvalue_to_task(tv);
+
+	if (task->status == EU_TASK_DONE) {
+		if (!task->failed) {
+			*_eucc_return(s) = task->value;
+			return EU_RESULT_OK;
+		}
+
+		/* raise what the task raised, from here */
+		cl = eucl_new(s, euapi_raise, NULL, _eu_global_env(s));
+		if (cl == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		pair = eupair_new(s, &task->value, &_null);
+		if (pair == NULL)
+			return EU_RESULT_BAD_ALLOC;
+		_eu_makepair(&args, pair);
+		_eu_makeclosure(_eucc_return(s), cl);
+		return euvm_apply(s, _eucc_return(s), &args, NULL);
+	}
+
+	if (task == s->task) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"A task can't join itself."));
+		return EU_RESULT_ERROR;
+	}
+
+	/* come back here once the task finishes */
+	_eu_checkreturn(eucc_cframe(s, 0, &f));
+	_eucframe_tag(f) = JOIN_WOKEN;
+	_eu_checkreturn(eucc_frame(s));
+
+	_eu_checkreturn(suspend(s, &self));
+	self->next = task->waiters;
+	task->waiters = self;
+
+	return switch_task(s);
+}
+
+int euapi_taskQ(europa* s) {
+	eu_value* obj;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument(s, obj, 0);
+
+	_eu_makebool(_eucc_return(s), _euvalue_is_type(obj, EU_TYPE_TASK));
+	return EU_RESULT_OK;
+}
+
+int euapi_make_channel(europa* s) {
+	eu_channel* chan;
+
+	check_no_arguments(s);
+
+	chan = euchannel_new(s);
+	if (chan == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	_eu_makechannel(_eucc_return(s), chan);
+	return EU_RESULT_OK;
+}
+
+int euapi_channelQ(europa* s) {
+	eu_value* obj;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument(s, obj, 0);
+
+	_eu_makebool(_eucc_return(s), _euvalue_is_type(obj, EU_TYPE_CHANNEL));
+	return EU_RESULT_OK;
+}
+
+int euapi_channel_send(europa* s) {
+	eu_value *cv, *value;
+	eu_channel* chan;
+	eu_task* receiver;
+	eu_pair* pair;
+
+	_eucc_arity_proper(s, 2);
+	_eucc_argument_type(s, cv, 0, EU_TYPE_CHANNEL);
+	_eucc_argument(s, value, 1);
+	chan = _euvalue_to_channel(cv);
+
+	_eu_makenull(_eucc_return(s));
+
+	/* hand the value to the first receiver still waiting, if any */
+	while ((receiver = chan->receivers) != NULL) {
+		chan->receivers = receiver->next;
+		if (chan->receivers == NULL)
+			chan->receivers_last = NULL;
+
+		if (receiver->status == EU_TASK_WAITING) {
+			enqueue(s, receiver);
+			receiver->value = *value;
+			return EU_RESULT_OK;
+		}
+	}
+
+	pair = eupair_new(s, value, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(chan->last, pair);
+	chan->last = _eupair_tail(pair);
+
+	return EU_RESULT_OK;
+}
+
+int euapi_channel_receive(europa* s) {
+	eu_value* cv;
+	eu_channel* chan;
+	eu_task* self;
+	eu_pair* pair;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument_type(s, cv, 0, EU_TYPE_CHANNEL);
+	chan = _euvalue_to_channel(cv);
+
+	if (_euvalue_is_pair(&chan->values)) {
+		pair = _euvalue_to_pair(&chan->values);
+		*_eucc_return(s) = *_eupair_head(pair);
+		chan->values = *_eupair_tail(pair);
+		if (_euvalue_is_null(&chan->values))
+			chan->last = &chan->values;
+		return EU_RESULT_OK;
+	}
+
+	/* wait for a sender, which resumes this task with the value */
+	_eu_checkreturn(suspend(s, &self));
+	self->next = NULL;
+	if (chan->receivers_last) {
+		chan->receivers_last->next = self;
+	} else {
+		chan->receivers = self;
+	}
+	chan->receivers_last = self;
+
+	return switch_task(s);
+}
@@ -12,29 +12,207 @@
 #include "europa/port.h"
 #include "europa/ports/file.h"
 #include "europa/rt.h"
+#include "europa/table.h"
+#include "europa/task.h"
+#include "europa/image.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
 
-eu_uinteger eutil_strb_hash(eu_byte* str, eu_uint len) {
-	eu_uinteger hash = 5381;
-	int c;
-	eu_uint i;
+/* Byte string hashing.
+ *
+ * This is a port of wyhash (final version 4) by Wang Yi, which is released into
+ * the public domain (https://github.com/wangyi-fudan/wyhash). The 64x64->128
+ * bit multiplication is done with 32-bit halves so no compiler extensions are
+ * needed.
+ *
+ * Hashes are seeded with a per-process random value so that colliding keys
+ * can't be precomputed. Hashes are therefore only meaningful inside the process
+ * that computed them and must not be stored across runs.
+ */
+
+static const uint64_t wyp[4] = {
+	0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+	0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+/* the seed is set once per process, 0 means it wasn't yet */
+static uint64_t hash_seed = 0;
+
+/* states may be created on several threads at once, so the first seed made
+ * is the one every state uses */
+#if defined(__GNUC__)
+#define seed_is_set() (__atomic_load_n(&hash_seed, __ATOMIC_ACQUIRE) != 0)
+#define claim_seed(seed) __sync_bool_compare_and_swap(&hash_seed, 0, (seed))
+#else
+/* without atomics, the first state must be created before other threads */
+#define seed_is_set() (hash_seed != 0)
+#define claim_seed(seed) (hash_seed = (seed))
+#endif
 
-	for (i = 0; i < len; i++)
-		hash = ((hash << 5) + hash) + c;
+/* multiplies a and b, placing the low 64 bits in a and the high in b */
+static void wymum(uint64_t* a, uint64_t* b) {
+	uint64_t ha = *a >> 32, hb = *b >> 32;
+	uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t, lo, c;
 
-	return (eu_integer)hash;
+	t = rl + (rm0 << 32);
+	c = t < rl;
+	lo = t + (rm1 << 32);
+	c += lo < t;
+
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
 }
 
-eu_uinteger eutil_cstr_hash(const char* str) {
-	eu_uinteger hash = 5381;
-	int c;
+static uint64_t wymix(uint64_t a, uint64_t b) {
+	wymum(&a, &b);
+	return a ^ b;
+}
+
+/* unaligned little-endian-agnostic reads (hashes never leave the process) */
+static uint64_t wyr8(const eu_byte* p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static uint64_t wyr4(const eu_byte* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static uint64_t wyr3(const eu_byte* p, size_t k) {
+	return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+/** Hashes a sequence of bytes with a given seed.
+ *
+ * @param data The bytes.
+ * @param len The number of bytes.
+ * @param seed The seed.
+ * @return The hash.
+ */
+eu_uinteger eutil_hash_bytes(const void* data, size_t len, eu_uinteger seed) {
+	const eu_byte* p = data;
+	uint64_t a, b, see1, see2;
+	size_t i;
+
+	seed ^= wymix(seed ^ wyp[0], wyp[1]);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+			b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = wyr3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		i = len;
+		if (i > 48) {
+			see1 = see2 = seed;
+			do {
+				seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+				see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+				see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = wyr8(p + i - 16);
+		b = wyr8(p + i - 8);
+	}
+
+	a ^= wyp[1];
+	b ^= seed;
+	wymum(&a, &b);
+	return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
 
-	while ((c = *str++))
-		hash = ((hash << 5) + hash) + c;
+/** Initializes the process' hash seed, if it wasn't already.
+ *
+ * The seed is read from the system's random source when available, falling
+ * back to a mix of the current time and some addresses otherwise. This is safe
+ * to call from several threads at once.
+ */
+void eutil_init_hash_seed(void) {
+	FILE* f;
+	uint64_t seed = 0;
+	int local;
+
+	if (seed_is_set())
+		return;
+
+	f = fopen("/dev/urandom", "rb");
+	if (f != NULL) {
+		if (fread(&seed, sizeof(seed), 1, f) != 1)
+			seed = 0;
+		fclose(f);
+	}
+
+	if (seed == 0) {
+		seed = wymix((uint64_t)time(NULL) ^ wyp[2],
+			(uint64_t)clock() ^ (uint64_t)(uintptr_t)&local ^ wyp[3]);
+	}
+	if (seed == 0)
+		seed = wyp[0];
+
+	claim_seed(seed);
+}
+
+/** Sets the process' hash seed.
+ *
+ * This must be called before any state is created, as objects that were
+ * already hashed would be placed in the wrong positions in their tables.
+ *
+ * @param seed The new seed. A seed of 0 is replaced by one made as usual.
+ */
+void eutil_set_hash_seed(eu_uinteger seed) {
+	hash_seed = seed;
+}
 
-	return (eu_uinteger)hash;
+/** Gets the process' hash seed.
+ *
+ * @return The seed.
+ */
+eu_uinteger eutil_hash_seed(void) {
+	return hash_seed;
+}
+
+/** Hashes a byte string with the process' seed.
+ *
+ * @param str The bytes.
+ * @param len The number of bytes.
+ * @return The hash.
+ */
+eu_uinteger eutil_strb_hash(eu_byte* str, eu_uint len) {
+	return eutil_hash_bytes(str, len, hash_seed);
+}
+
+/** Hashes a NUL-terminated string with the process' seed.
+ *
+ * The terminator is not part of the hashed data, so a string hashes the same as
+ * its bytes passed to eutil_strb_hash.
+ *
+ * @param str The string.
+ * @return The hash.
+ */
+eu_uinteger eutil_cstr_hash(const char* str) {
+	return eutil_hash_bytes(str, strlen(str), hash_seed);
 }
 
 int unicodetoutf8(int c) {
@@ -132,16 +310,25 @@ int eutil_register_standard_library(europa* s) {
 	/* set the correct environment */
 	s->env = _eu_global_env(s);
 
+	/* equivalence predicates */
+	_eu_checkreturn(euapi_register_object(s));
 	/* numeric standard library */
 	_eu_checkreturn(euapi_register_number(s));
 	/* pair and list functions*/
 	_eu_checkreturn(euapi_register_pair(s));
 	/* symbol functions */
 	_eu_checkreturn(euapi_register_symbol(s));
+	/* string functions */
+	_eu_checkreturn(euapi_register_string(s));
 	/* control functions */
 	_eu_checkreturn(euapi_register_controls(s));
 	/* port functions */
 	_eu_checkreturn(euapi_register_port(s));
+	/* hash table functions */
+	_eu_checkreturn(euapi_register_table(s));
+	/* precompiled images */
+	_eu_checkreturn(euapi_register_image(s));
+	_eu_checkreturn(euapi_register_tasks(s));
 
 	return EU_RESULT_OK;
 }
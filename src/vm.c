@@ -6,6 +6,8 @@
 #include "europa/util.h"
 #include "europa/port.h"
 #include "europa/ccont.h"
+#include "europa/image.h"
+#include "europa/task.h"
 
 #define OPCMASK 0xFF
 #define OPCSHIFT 24
@@ -13,11 +15,57 @@
 
 #define opc_part(x) ((x >> OPCSHIFT) & OPCMASK)
 #define val_part(x) (x & VALMASK)
-#define off_part(x) (val_part(x) - (VALMASK >> 1))
+#define off_part(x) (cast(int, val_part(x)) - (VALMASK >> 1))
 
 #define CALL_META_NAME "@@call"
 #define ARGS_KEY_NAME "@@args"
 
+/**
+ * @brief Creates the table binding the variables of a call to a closure.
+ *
+ * @param s The Europa state.
+ * @param cl The closure being called.
+ * @param out Where to place the table.
+ * @return The result of the operation.
+ */
+static int new_frame(europa* s, eu_closure* cl, eu_table** out) {
+	/* room for the formals and for what the code defines */
+	*out = eutable_new(s, cl->proto->framec);
+	if (*out == NULL) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Could not create new environment."));
+		return EU_RESULT_ERROR;
+	}
+	/* set its index to point to the closure's environment */
+	_eutable_set_index(*out, cl->env);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Binds a formal parameter in a call's frame.
+ *
+ * @param s The Europa state.
+ * @param frame The call's frame.
+ * @param formal The formal's name.
+ * @param v The argument.
+ * @return The result of the operation.
+ */
+static int bind_formal(europa* s, eu_table* frame, eu_value* formal,
+	eu_value* v) {
+	eu_value* tv;
+
+	_eu_checkreturn(eutable_create_key(s, frame, formal, &tv));
+	if (tv == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not add formal %s to the new environment.",
+			_eusymbol_text(_euvalue_to_symbol(formal))));
+		return EU_RESULT_ERROR;
+	}
+	/* place the value */
+	*tv = *v;
+	return EU_RESULT_OK;
+}
+
 /**
  * @brief Prepares the state's environment for running a closure, by extending
  * the environment in which it was defined and setting the state's environment to
@@ -29,10 +77,8 @@
  * @return The result of the operation.
  */
 int prepare_environment(europa* s, eu_closure* cl, eu_value* args) {
-	eu_proto* proto;
-	eu_value *tv, *cv, *cf;
+	eu_value *cv, *cf;
 	eu_table* new_env;
-	eu_value key;
 	int length, improper, i;
 
 	/* beacause C functions don't need to use the argument rib, we can leave
@@ -62,14 +108,7 @@ int prepare_environment(europa* s, eu_closure* cl, eu_value* args) {
 	/* europa closure */
 	/* count number of parameters in environment */
 	length = eutil_list_length(s, _euproto_formals(cl->proto), &improper);
-	new_env = eutable_new(s, length + improper);
-	if (new_env == NULL) {
-		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-			"Could not create new environment."));
-		return EU_RESULT_ERROR;
-	}
-	/* set its index to point to the closure's environment */
-	_eutable_set_index(new_env, cl->env);
+	_eu_checkreturn(new_frame(s, cl, &new_env));
 
 	/* add proper elements */
 	for (i = 0, cv = args, cf = _euproto_formals(cl->proto);
@@ -94,17 +133,8 @@ int prepare_environment(europa* s, eu_closure* cl, eu_value* args) {
 			return EU_RESULT_ERROR;
 		}
 
-		/* create formal key */
-		_eu_checkreturn(eutable_create_key(s, new_env,
-			_eupair_head(_euvalue_to_pair(cf)), &tv));
-		if (tv == NULL) {
-			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-				"Could not add formal %s to the new environment.",
-				_eusymbol_text(_euvalue_to_symbol(_eupair_head(_euvalue_to_pair(cf))))));
-			return EU_RESULT_ERROR;
-		}
-		/* place the value */
-		*tv = *(_eupair_head(_euvalue_to_pair(cv)));
+		_eu_checkreturn(bind_formal(s, new_env, _eupair_head(_euvalue_to_pair(cf)),
+			_eupair_head(_euvalue_to_pair(cv))));
 	}
 
 	/* if cv isn't the null value, formals was either an improper list or a
@@ -112,20 +142,90 @@ int prepare_environment(europa* s, eu_closure* cl, eu_value* args) {
 	 * cf is the correct parameter symbol in the environment and cv is the
 	 * correct value for it */
 	if (!_euvalue_is_null(cf)) {
-		/* get the slot in the environment */
-		_eu_checkreturn(eutable_create_key(s, new_env, cf, &tv));
-		if (tv == NULL) {
+		/* place the argument list there */
+		_eu_checkreturn(bind_formal(s, new_env, cf, cv));
+	}
+
+	/* set the new environment, potentially losing the previous one */
+	s->env = new_env;
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Makes a list out of an array of values.
+ *
+ * @param s The Europa state.
+ * @param argc The number of values.
+ * @param argv The values.
+ * @param out Where to place the list.
+ * @return The result of the operation.
+ */
+static int argument_list(europa* s, int argc, eu_value* argv, eu_value* out) {
+	eu_pair* pair;
+
+	_eu_makenull(out);
+	while (argc-- > 0) {
+		pair = eupair_new(s, &argv[argc], out);
+		if (pair == NULL) {
+			_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+				"Could not create pair to hold argument."));
+			return EU_RESULT_ERROR;
+		}
+		_eu_makepair(out, pair);
+	}
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Prepares the state's environment for running a Europa closure whose
+ * arguments are in an array.
+ *
+ * Works like prepare_environment, but binds the arguments straight into the
+ * call's frame instead of walking an argument list. Only the arguments taken
+ * by a rest parameter are made into a list.
+ *
+ * @param s The Europa state.
+ * @param cl The target closure. Must not be a C closure.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The result of the operation.
+ */
+static int prepare_environment_array(europa* s, eu_closure* cl, int argc,
+	eu_value* argv) {
+	eu_value *cf, rest;
+	eu_table* new_env;
+	int length, improper, i;
+
+	if (!(cl->own_env)) {
+		s->env = cl->env;
+		_eu_makenull(&s->rib);
+		s->rib_lastpos = &s->rib;
+		return EU_RESULT_OK;
+	}
+
+	_eu_checkreturn(new_frame(s, cl, &new_env));
+
+	for (i = 0, cf = _euproto_formals(cl->proto);
+		_euvalue_is_type(cf, EU_TYPE_PAIR);
+		i++, cf = _eupair_tail(_euvalue_to_pair(cf))) {
+		if (i >= argc) {
+			length = eutil_list_length(s, _euproto_formals(cl->proto), &improper);
 			_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-				"Could not add formal %s to the new environment.",
-				_eusymbol_text(_euvalue_to_symbol(cf))));
+				"Expected %s%d arguments in closure application, got %d.",
+				improper ? ">" : "", length, i));
 			return EU_RESULT_ERROR;
 		}
+		_eu_checkreturn(bind_formal(s, new_env, _eupair_head(_euvalue_to_pair(cf)),
+			&argv[i]));
+	}
 
-		/* place the argument list there */
-		*tv = *cv;
+	/* a rest parameter takes whatever is left */
+	if (!_euvalue_is_null(cf)) {
+		_eu_checkreturn(argument_list(s, argc - i, argv + i, &rest));
+		_eu_checkreturn(bind_formal(s, new_env, cf, &rest));
 	}
 
-	/* set the new environment, potentially losing the previous one */
 	s->env = new_env;
 
 	return EU_RESULT_OK;
@@ -134,6 +234,9 @@ int prepare_environment(europa* s, eu_closure* cl, eu_value* args) {
 void set_cc(europa* s, eu_continuation* cont) {
 	if (cont == NULL) { /* nothing else to run */
 		s->ccl = NULL;
+		s->cframe = NULL;
+		s->handler = NULL;
+		s->wind = NULL;
 		s->env = _eu_global_env(s);
 		s->pc = 0;
 		s->status = EU_SSTATUS_STOPPED;
@@ -146,11 +249,15 @@ void set_cc(europa* s, eu_continuation* cont) {
 	s->env = cont->env;
 	s->rib = cont->rib;
 	s->rib_lastpos = cont->rib_lastpos;
+	s->cframe = cont->cframe;
+	s->handler = cont->handler;
+	s->wind = cont->wind;
 }
 
 /* WARNING: DOES NOT PREPARE THE ENVIRONMENT, USE prepare_environment FOR THAT */
 void set_closure(europa* s, eu_closure* cl) {
 	s->ccl = cl; /* set current closure */
+	s->cframe = NULL; /* a new activation, C closures start without a frame */
 
 	/* only clean up the rib if closure is not C closure, because arguments of a
 	 * c closure are passed through it */
@@ -206,7 +313,7 @@ int check_val_in_subprotos(europa* s, int val, const char* inst) {
  * @return int
  */
 int check_off_in_code(europa* s, int off, const char* inst) {
-	if (s->pc + off > s->ccl->proto->code_length) {
+	if (s->pc + off < 0 || s->pc + off > s->ccl->proto->code_length) {
 		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
 			"Invalid jumping offset for %s instruction.", inst));
 		return EU_RESULT_ERROR;
@@ -229,6 +336,42 @@ int prepare_for_closure(europa* s, eu_closure* cl, eu_value* args) {
 	return EU_RESULT_OK;
 }
 
+/**
+ * @brief Prepares the state for jumping to a continuation whose dynamic extent
+ * is not the current one.
+ *
+ * The jump is made by a call to eurt_rewind, which calls the dynamic-wind
+ * thunks in between first.
+ *
+ * @param s The Europa state.
+ * @param cont The continuation.
+ * @param value The value passed to the continuation.
+ * @return The result of the operation.
+ */
+static int prepare_for_rewind(europa* s, eu_continuation* cont,
+	eu_value* value) {
+	eu_closure* cl;
+	eu_pair* pair;
+	eu_value args;
+
+	cl = eucl_new(s, eurt_rewind, NULL, _eu_global_env(s));
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	pair = eupair_new(s, value, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+	_eu_makecont(&s->acc, cont);
+	pair = eupair_new(s, &s->acc, &args);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+
+	_eu_makeclosure(_eu_acc(s), cl);
+	return prepare_for_closure(s, cl, &args);
+}
+
 /**
  * @brief Prepares the state for running a continuation.
  *
@@ -238,19 +381,204 @@ int prepare_for_closure(europa* s, eu_closure* cl, eu_value* args) {
  * @return int
  */
 int prepare_for_continuation(europa* s, eu_continuation* cont, eu_value* args) {
+	eu_value value;
+
 	/* we need to set the accumulator to the first argument */
 	if (!_euvalue_is_pair(args)) {
-		s->acc = s->rib;
+		value = s->rib;
 	} else {
-		s->acc = *_eupair_head(_euvalue_to_pair(args));
+		value = *_eupair_head(_euvalue_to_pair(args));
 	}
 
+	/* leaving or entering dynamic-wind calls runs their thunks first */
+	if (cont->wind != s->wind)
+		return prepare_for_rewind(s, cont, &value);
+
 	/* place the continuation in the state */
+	s->acc = value;
 	set_cc(s, cont);
 
 	return EU_RESULT_OK;
 }
 
+/**
+ * @brief Gets the slot of the variable named by a REFER-like instruction.
+ *
+ * @param s The Europa state.
+ * @param proto The running prototype.
+ * @param ir The instruction.
+ * @param out Where to place the variable's slot.
+ * @return The result of the operation.
+ */
+static int local_reference(europa* s, eu_proto* proto, eu_instruction ir,
+	eu_value** out) {
+	/* check if instruction value is in constant range */
+	_eu_checkreturn(check_val_in_constant(s, val_part(ir), "REFER"));
+	/* get the env's value for the symbol constant key */
+	_eu_checkreturn(eutable_rget(s, s->env,
+		&(proto->constants[val_part(ir)]), out));
+	/* check if could get reference */
+	if (*out == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not reference %s in environment.",
+			_eusymbol_text(_euvalue_to_symbol(&(proto->constants[val_part(ir)])))));
+		return EU_RESULT_ERROR;
+	}
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets the slot of the global variable named by a GREFER-like
+ * instruction.
+ *
+ * The compiler knows the variable can only be a global one, so the value slot
+ * is remembered for as long as the global environment's slots don't move.
+ *
+ * @param s The Europa state.
+ * @param proto The running prototype.
+ * @param ir The instruction.
+ * @param out Where to place the variable's slot.
+ * @return The result of the operation.
+ */
+static int global_reference(europa* s, eu_proto* proto, eu_instruction ir,
+	eu_value** out) {
+	eu_gcache* gc;
+
+	/* check if instruction value is in constant range */
+	_eu_checkreturn(check_val_in_constant(s, val_part(ir), "GREFER"));
+
+	gc = euproto_global_cache(s, proto, s->pc);
+	if (gc == NULL) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Could not allocate global reference cache."));
+		return EU_RESULT_ERROR;
+	}
+	if (gc->env == _eu_global_env(s) && gc->epoch == _eutable_epoch(gc->env)) {
+		*out = gc->cell;
+		return EU_RESULT_OK;
+	}
+
+	/* cache miss, look the variable up (only in the global table, so that the
+	 * slot is known to belong to it) */
+	_eu_checkreturn(eutable_get(s, _eu_global_env(s),
+		&(proto->constants[val_part(ir)]), out));
+	if (*out == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not reference %s in environment.",
+			_eusymbol_text(_euvalue_to_symbol(&(proto->constants[val_part(ir)])))));
+		return EU_RESULT_ERROR;
+	}
+
+	/* remember it */
+	gc->env = _eu_global_env(s);
+	gc->cell = *out;
+	gc->epoch = _eutable_epoch(gc->env);
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gets the slot of the free variable named by a FREFER-like
+ * instruction.
+ *
+ * Shared free variables live in the table of the frame that binds them,
+ * others were copied into the closure when it was created.
+ *
+ * @param s The Europa state.
+ * @param cl The running closure.
+ * @param ir The instruction.
+ * @param out Where to place the variable's slot.
+ * @return The result of the operation.
+ */
+static int free_reference(europa* s, eu_closure* cl, eu_instruction ir,
+	eu_value** out) {
+	eu_capture* capture;
+
+	/* check if instruction value is in free variable range */
+	if (cl->freec <= cast(int, val_part(ir))) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Invalid free variable index at FREFER instruction."));
+		return EU_RESULT_ERROR;
+	}
+
+	capture = &(cl->proto->captures[val_part(ir)]);
+	if (!capture->shared) {
+		*out = &(cl->free[val_part(ir)]);
+		return EU_RESULT_OK;
+	}
+
+	/* get the frame's value for the name */
+	_eu_checkreturn(eutable_get(s, _euvalue_to_table(&(cl->free[val_part(ir)])),
+		&(cl->proto->constants[capture->name]), out));
+	if (*out == NULL) {
+		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+			"Could not reference %s in environment.",
+			_eusymbol_text(_euvalue_to_symbol(&(cl->proto->constants[capture->name])))));
+		return EU_RESULT_ERROR;
+	}
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Gives a new closure its free variables.
+ *
+ * @param s The Europa state.
+ * @param cl The closure creating it, whose frame is running.
+ * @param c The new closure.
+ * @return The result of the operation.
+ */
+static int capture_free_variables(europa* s, eu_closure* cl, eu_closure* c) {
+	eu_capture* capture;
+	eu_value* tv;
+	int i;
+
+	for (i = 0; i < c->freec; i++) {
+		capture = &(c->proto->captures[i]);
+
+		if (capture->from_free) {
+			/* whatever the creator holds, be it a value or a frame */
+			c->free[i] = cl->free[capture->index];
+		} else if (capture->shared) {
+			/* the variable is bound in the running frame */
+			_eu_maketable(&(c->free[i]), s->env);
+		} else {
+			_eu_checkreturn(eutable_get(s, s->env,
+				&(c->proto->constants[capture->name]), &tv));
+			if (tv == NULL) {
+				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+					"Could not capture %s from environment.",
+					_eusymbol_text(_euvalue_to_symbol(&(c->proto->constants[capture->name])))));
+				return EU_RESULT_ERROR;
+			}
+			c->free[i] = *tv;
+		}
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Adds a value to the end of the argument rib.
+ *
+ * @param s The Europa state.
+ * @param v The value.
+ * @return The result of the operation.
+ */
+static int push_argument(europa* s, eu_value* v) {
+	eu_pair* pair;
+
+	pair = eupair_new(s, v, &_null);
+	if (pair == NULL) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"Could not create pair to hold argument."));
+		return EU_RESULT_ERROR;
+	}
+	/* add it to the rib */
+	_eu_makepair(s->rib_lastpos, pair);
+	/* update last pos */
+	s->rib_lastpos = _eupair_tail(pair);
+	return EU_RESULT_OK;
+}
+
 int solve_value_application(europa* s, eu_value* v) {
 	eu_value *tv;
 	eu_pair* pair;
@@ -296,24 +624,80 @@ int solve_value_application(europa* s, eu_value* v) {
 	return EU_RESULT_OK;
 }
 /**
- * @brief Starts a vm execution loop.
+ * @brief Charges the fuel used since it was last charged and starts a new
+ * budget.
  *
- * This will make the vm continue executing from its current state. In order to
- * start running code, whatever it is that calls this function should've
- * properly set the state already.
+ * The budget counts down at every call and backward jump and never exceeds
+ * the fuel left, so running out of it is when the VM checks both for fuel and
+ * for other tasks. Operations are charged as they run and only stopped when
+ * nothing is left for them, so a slice of N runs N of them.
+ *
+ * @param s The Europa state.
+ */
+void euvm_refuel(europa* s) {
+	if (s->fuel >= 0) {
+		s->fuel -= s->slice - s->budget;
+		if (s->fuel < 0)
+			s->fuel = 0;
+	}
+
+	s->slice = (s->fuel >= 0 && s->fuel < EU_TASK_BUDGET) ? cast(int, s->fuel) :
+		EU_TASK_BUDGET;
+	s->budget = s->slice;
+}
+
+/**
+ * @brief Handles the running code's budget running out.
+ *
+ * If the host's fuel is over, the code stops where it is, to be picked up by
+ * eu_resume. Otherwise other tasks may get a turn.
+ *
+ * @param s The Europa state.
+ * @return EU_RESULT_OK if the code should go on, EU_RESULT_CONTINUE if
+ * something else is running in its place and EU_RESULT_YIELD if the VM should
+ * stop.
+ */
+static int out_of_budget(europa* s) {
+	euvm_refuel(s);
+	if (s->fuel == 0) {
+		s->status = EU_SSTATUS_YIELDED;
+		return EU_RESULT_YIELD;
+	}
+
+	return eutask_preempt(s);
+}
+
+/**
+ * @brief Fails if the state holds code that ran out of fuel.
  *
  * @param s The Europa state.
  * @return The result of the operation.
  */
-int euvm_execute(europa* s) {
+static int check_not_yielded(europa* s) {
+	if (s->status == EU_SSTATUS_YIELDED) {
+		_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+			"The state is suspended. Resume or recover it first."));
+		return EU_RESULT_ERROR;
+	}
+
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Runs the fetch/decode/execute loop until the code returns or fails.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+static int execute(europa* s) {
 	int res;
 	eu_instruction ir;
 	eu_value* tv;
 	eu_proto* proto, *p;
 	eu_closure *c;
 	eu_continuation* cont;
-	eu_pair* pair;
 	eu_closure* cl;
+	eu_cfunc cf;
 
 	/* we need to do the execution loop
 	 *
@@ -381,22 +765,66 @@ int euvm_execute(europa* s) {
 		switch (opc_part(ir)) {
 		case EU_OP_NOP: break;
 		case EU_OP_REFER:
-			/* check if instruction value is in constant range */
-			_eu_checkreturn(check_val_in_constant(s, val_part(ir), "REFER"));
-			/* get the env's value for the symbol constant key */
-			_eu_checkreturn(eutable_rget(s, s->env,
-				&(proto->constants[val_part(ir)]), &tv));
-			/* check if could get reference */
-			if (tv == NULL) {
-				_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
-					"Could not reference %s in environment.",
-					_eusymbol_text(_euvalue_to_symbol(&(proto->constants[val_part(ir)])))));
-				return EU_RESULT_ERROR;
-			}
+			_eu_checkreturn(local_reference(s, proto, ir, &tv));
 			/* put the value in the accumulator */
 			s->acc = *tv;
 			break;
 
+		case EU_OP_REFER_ARG:
+			_eu_checkreturn(local_reference(s, proto, ir, &tv));
+			_eu_checkreturn(push_argument(s, tv));
+			break;
+
+		case EU_OP_GREFER:
+			_eu_checkreturn(global_reference(s, proto, ir, &tv));
+			/* put the value in the accumulator */
+			s->acc = *tv;
+			break;
+
+		case EU_OP_GREFER_ARG:
+			_eu_checkreturn(global_reference(s, proto, ir, &tv));
+			_eu_checkreturn(push_argument(s, tv));
+			break;
+
+		case EU_OP_GREFER_APPLY:
+			_eu_checkreturn(global_reference(s, proto, ir, &tv));
+			s->acc = *tv;
+			goto vmapply;
+
+		case EU_OP_FREFER:
+			_eu_checkreturn(free_reference(s, cl, ir, &tv));
+			s->acc = *tv;
+			break;
+
+		case EU_OP_FASSIGN:
+			_eu_checkreturn(free_reference(s, cl, ir, &tv));
+			*tv = s->acc;
+			break;
+
+		case EU_OP_GUARD:
+			/* check if instruction value is in constant range */
+			_eu_checkreturn(check_val_in_constant(s, val_part(ir), "GUARD"));
+			/* whether the accumulator still holds the procedure that was
+			 * inlined, any closure of a top level prototype will do, or the
+			 * builtin registered with the name whose call was folded */
+			tv = &(proto->constants[val_part(ir)]);
+			if (_euvalue_is_type(tv, EU_TYPE_PROTO)) {
+				res = _euvalue_is_type(_eu_acc(s), EU_TYPE_CLOSURE) &&
+					_euvalue_to_closure(_eu_acc(s))->proto == _euvalue_to_proto(tv);
+			} else {
+				_eu_checkreturn(eucc_find_cfunc(s, tv, &cf));
+				res = cf != NULL && _euvalue_is_type(_eu_acc(s), EU_TYPE_CLOSURE) &&
+					_euvalue_to_closure(_eu_acc(s))->cf == cf;
+			}
+			_eu_makebool(_eu_acc(s), res);
+			break;
+
+		case EU_OP_CONST_ARG:
+			/* check if instruction value is in constant range */
+			_eu_checkreturn(check_val_in_constant(s, val_part(ir), "CONST_ARG"));
+			_eu_checkreturn(push_argument(s, &(proto->constants[val_part(ir)])));
+			break;
+
 		case EU_OP_CONST:
 			/* check if instruction value is in constant range */
 			_eu_checkreturn(check_val_in_constant(s, val_part(ir), "CONST"));
@@ -409,13 +837,19 @@ int euvm_execute(europa* s) {
 			_eu_checkreturn(check_val_in_subprotos(s, val_part(ir), "CLOSE"));
 			/* get the subproto */
 			p = proto->subprotos[val_part(ir)];
-			/* create a new closure from it and current environment */
-			c = eucl_new(s, NULL, p, s->env);
+			/* prototypes from images are only read when first used */
+			if (_euproto_is_stub(p)) {
+				_eu_checkreturn(euimage_materialize(s, p));
+			}
+			/* create a new closure from it, which only keeps its free variables
+			 * and the environment the running code was created in (for globals) */
+			c = eucl_new(s, NULL, p, cl->env);
 			if (c == NULL) {
 				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
 					"Could not create closure."));
 				return EU_RESULT_BAD_ALLOC;
 			}
+			_eu_checkreturn(capture_free_variables(s, cl, c));
 			/* place it in the accumulator */
 			_eu_makeclosure(_eu_acc(s), c);
 			break;
@@ -436,6 +870,15 @@ int euvm_execute(europa* s) {
 		case EU_OP_JUMP:
 			/* check whether offset is in boundaries */
 			_eu_checkreturn(check_off_in_code(s, off_part(ir), "JUMP"));
+			/* loops give other tasks a turn, resuming at the jump itself */
+			if (off_part(ir) < 0) {
+				if (s->budget <= 0 && (res = out_of_budget(s)) != EU_RESULT_OK) {
+					if (res == EU_RESULT_CONTINUE)
+						continue;
+					return res;
+				}
+				s->budget--;
+			}
 			s->pc += off_part(ir);
 			goto vmfetch;
 
@@ -459,8 +902,9 @@ int euvm_execute(europa* s) {
 		case EU_OP_DEFINE:
 			/* check whether value is in constant range */
 			_eu_checkreturn(check_val_in_constant(s, val_part(ir), "DEFINE"));
-			/* get the env's value for the symbol constant key */
-			_eu_checkreturn(eutable_rget(s, s->env, &(proto->constants[val_part(ir)]),
+			/* get the current env's value for the symbol constant key, defines
+			 * never touch enclosing environments */
+			_eu_checkreturn(eutable_get(s, s->env, &(proto->constants[val_part(ir)]),
 				&tv));
 			/* check if could get reference */
 			if (tv == NULL) {
@@ -478,7 +922,7 @@ int euvm_execute(europa* s) {
 
 			/* create a continuation from the current state */
 			cont = eucont_new(s, s->previous, s->env, &s->rib, s->rib_lastpos,
-				s->ccl, s->pc + off_part(ir));
+				s->ccl, s->pc + off_part(ir), s->cframe);
 			if (cont == NULL) {
 				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
 					"Could not create continuation."));
@@ -488,12 +932,31 @@ int euvm_execute(europa* s) {
 			_eu_makecont(_eu_acc(s), cont);
 			break;
 
+		case EU_OP_CONTI_FRAME:
+			/* check if continuation address is in boundaries */
+			_eu_checkreturn(check_off_in_code(s, off_part(ir), "CONTI_FRAME"));
+
+			/* the captured continuation is also the return frame */
+			cont = eucont_new(s, s->previous, s->env, &s->rib, s->rib_lastpos,
+				s->ccl, s->pc + off_part(ir), s->cframe);
+			if (cont == NULL) {
+				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
+					"Could not create continuation."));
+				return EU_RESULT_ERROR;
+			}
+			_eu_makecont(_eu_acc(s), cont);
+
+			s->previous = cont;
+			s->rib = _null;
+			s->rib_lastpos = &s->rib;
+			break;
+
 		case EU_OP_FRAME:
 			/* check if return offset is valid */
 			_eu_checkreturn(check_off_in_code(s, off_part(ir), "FRAME"));
 			/* create a new continuation */
 			cont = eucont_new(s, s->previous, s->env, &s->rib, s->rib_lastpos,
-				s->ccl, s->pc + off_part(ir));
+				s->ccl, s->pc + off_part(ir), s->cframe);
 			if (cont == NULL) {
 				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
 					"Could not create continuation."));
@@ -509,19 +972,19 @@ int euvm_execute(europa* s) {
 
 		case EU_OP_ARGUMENT:
 			/* add the accumulator to the rib */
-			pair = eupair_new(s, _eu_acc(s), &_null);
-			if (pair == NULL) {
-				_eu_checkreturn(eu_set_error(s, EU_ERROR_NONE, NULL,
-					"Could not create pair to hold argument."));
-				return EU_RESULT_ERROR;
-			}
-			/* add it to the rib */
-			_eu_makepair(s->rib_lastpos, pair);
-			/* update last pos */
-			s->rib_lastpos = _eupair_tail(pair);
+			_eu_checkreturn(push_argument(s, _eu_acc(s)));
 			break;
 
 		case EU_OP_APPLY: /* handle calling a value (can be closure, continuation or a table) */
+			vmapply:
+			/* so do calls, resuming at the instruction that makes the call */
+			if (s->budget <= 0 && (res = out_of_budget(s)) != EU_RESULT_OK) {
+				if (res == EU_RESULT_CONTINUE)
+					continue;
+				return res;
+			}
+			s->budget--;
+
 			/* turn application's target into something callable (a closure or
 			 * continuation) */
 			_eu_checkreturn(solve_value_application(s, _eu_acc(s)));
@@ -542,7 +1005,7 @@ int euvm_execute(europa* s) {
 				cont = _euvalue_to_cont(_eu_acc(s));
 
 				/* prepare the state's environment */
-				prepare_for_continuation(s, cont, &(s->rib));
+				_eu_checkreturn(prepare_for_continuation(s, cont, &(s->rib)));
 
 				continue; /* start the loop again */
 			}
@@ -569,6 +1032,81 @@ int euvm_execute(europa* s) {
 	return EU_RESULT_OK;
 }
 
+/**
+ * @brief Raises the state's error in the running code.
+ *
+ * The failed activation is replaced by a call to raise with the error object,
+ * so the innermost handler is called as if the code had raised it.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+static int raise_error(europa* s) {
+	eu_closure* cl;
+	eu_pair* pair;
+	eu_value args;
+
+	cl = eucl_new(s, euapi_raise, NULL, _eu_global_env(s));
+	if (cl == NULL)
+		return EU_RESULT_BAD_ALLOC;
+
+	_eu_makeerror(&args, s->err);
+	pair = eupair_new(s, &args, &_null);
+	if (pair == NULL)
+		return EU_RESULT_BAD_ALLOC;
+	_eu_makepair(&args, pair);
+	s->err = NULL;
+
+	_eu_makeclosure(_eu_acc(s), cl);
+	return prepare_for_closure(s, cl, &args);
+}
+
+/**
+ * @brief Starts a vm execution loop.
+ *
+ * This will make the vm continue executing from its current state. In order to
+ * start running code, whatever it is that calls this function should've
+ * properly set the state already.
+ *
+ * Errors are handed to the innermost exception handler, if there is one, and
+ * execution goes on from there. Handlers are frames like any other, so there
+ * is nothing to set up for them here.
+ *
+ * If the host's fuel runs out, this returns EU_RESULT_YIELD and the state is
+ * left as it was, so that calling this again picks the code up.
+ *
+ * @param s The Europa state.
+ * @return The result of the operation.
+ */
+int euvm_execute(europa* s) {
+	int result;
+
+	while ((result = execute(s)) == EU_RESULT_ERROR && s->handler != NULL &&
+		s->err != NULL) {
+		_eu_checkreturn(raise_error(s));
+	}
+
+	return result;
+}
+
+/**
+ * @brief Resumes a frame with a value, as if returning it to the frame.
+ *
+ * Unlike calling a continuation, this does not go through dynamic-wind thunks,
+ * which is what switching between tasks needs: each task has its own dynamic
+ * extent. Meant to be returned from C closures.
+ *
+ * @param s The Europa state.
+ * @param cont The frame, NULL to return to the host.
+ * @param value The value.
+ * @return EU_RESULT_CONTINUE.
+ */
+int euvm_resume(europa* s, eu_continuation* cont, eu_value* value) {
+	s->acc = *value;
+	set_cc(s, cont);
+	return EU_RESULT_CONTINUE;
+}
+
 /**
  * @brief Initializes necessary fields in an Europa state.
  *
@@ -580,6 +1118,17 @@ int euvm_initialize_state(europa* s) {
 	s->env = _eu_global_env(s);
 	s->ccl = NULL;
 	s->previous = NULL;
+	s->cframe = NULL;
+	s->handler = NULL;
+	s->wind = NULL;
+	s->task = NULL;
+	s->ready = NULL;
+	s->ready_last = NULL;
+	s->sleeping = NULL;
+	s->status = EU_SSTATUS_STOPPED;
+	s->slice = 0;
+	s->budget = 0;
+	euvm_refuel(s);
 	s->rib = _null;
 	s->rib_lastpos = &s->rib;
 	s->level = 0;
@@ -597,6 +1146,8 @@ int euvm_initialize_state(europa* s) {
  * @return The result of the operation.
  */
 int euvm_doclosure(europa* s, eu_closure* cl, eu_value* args, eu_value* out) {
+	_eu_checkreturn(check_not_yielded(s));
+
 	/* place the closure in the current continuation */
 	_eu_checkreturn(prepare_environment(s, cl, args));
 	set_closure(s, cl);
@@ -624,6 +1175,8 @@ int euvm_doclosure(europa* s, eu_closure* cl, eu_value* args, eu_value* out) {
 int euvm_apply(europa* s, eu_value* v, eu_value* args, eu_value* out) {
 	int running = 0;
 
+	_eu_checkreturn(check_not_yielded(s));
+
 	/* check if anything is being executed already */
 	if (s->ccl != NULL) {
 		running = 1;
@@ -646,7 +1199,8 @@ int euvm_apply(europa* s, eu_value* v, eu_value* args, eu_value* out) {
 			args));
 		break;
 	case EU_TYPE_CONTINUATION:
-		prepare_for_continuation(s, _euvalue_to_cont(_eu_acc(s)), args);
+		_eu_checkreturn(prepare_for_continuation(s, _euvalue_to_cont(_eu_acc(s)),
+			args));
 		break;
 	default:
 		_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
@@ -668,18 +1222,191 @@ int euvm_apply(europa* s, eu_value* v, eu_value* args, eu_value* out) {
 	return EU_RESULT_OK;
 }
 
+/**
+ * @brief Calls a value with arguments taken from an array.
+ *
+ * Behaves like euvm_apply, but Europa closures get their arguments bound
+ * straight from the array, without building an argument list. Other values
+ * (C closures, continuations and tables) still get one.
+ *
+ * @param s The target state.
+ * @param v The target value.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param out Where to place the resulting value.
+ * @return The result of the operation.
+ */
+int euvm_call(europa* s, eu_value* v, int argc, eu_value* argv, eu_value* out) {
+	eu_closure* cl;
+	eu_value args;
+	int running;
+
+	if (!_euvalue_is_type(v, EU_TYPE_CLOSURE) || _euvalue_to_closure(v)->cf) {
+		_eu_checkreturn(argument_list(s, argc, argv, &args));
+		return euvm_apply(s, v, &args, out);
+	}
+
+	_eu_checkreturn(check_not_yielded(s));
+
+	/* check if anything is being executed already */
+	running = s->ccl != NULL;
+
+	cl = _euvalue_to_closure(v);
+	s->acc = *v;
+	_eu_checkreturn(prepare_environment_array(s, cl, argc, argv));
+	set_closure(s, cl);
+
+	/* if we're running anything, return a CONTINUE signal */
+	if (running)
+		return EU_RESULT_CONTINUE;
+
+	_eu_checkreturn(euvm_execute(s));
+
+	if (out) /* return the value, if asked */
+		*out = s->acc;
+
+	return EU_RESULT_OK;
+}
+
+/* operand kinds, as checked by the verifier */
+enum {
+	OPERAND_NONE,
+	OPERAND_CONSTANT, /* any constant */
+	OPERAND_NAME, /* a symbol constant */
+	OPERAND_GUARD, /* a prototype or a symbol constant */
+	OPERAND_SUBPROTO,
+	OPERAND_OFFSET,
+	OPERAND_FREE,
+};
+
+static int verify_error(europa* s, eu_proto* proto, int pc, const char* what) {
+	_eu_checkreturn(eu_set_error_nf(s, EU_ERROR_NONE, NULL, 1024,
+		"Bad prototype 0x%lx at instruction %d: %s.",
+		cast(unsigned long, proto), pc, what));
+	return EU_RESULT_ERROR;
+}
+
+static int verify_constant(europa* s, eu_proto* proto, int pc, int index,
+	int type) {
+	if (index >= proto->constantc)
+		return verify_error(s, proto, pc, "constant index out of range");
+	if (type != EU_TYPE_LAST &&
+		!_euvalue_is_type(&(proto->constants[index]), type))
+		return verify_error(s, proto, pc, "constant of the wrong type");
+	return EU_RESULT_OK;
+}
+
+/**
+ * @brief Checks that a prototype's code can't take the machine outside of it.
+ *
+ * Instruction operands must index into the prototype's constants, subprotos
+ * and free variables with the types the instructions expect, jumps must land
+ * inside the code and the code can't run past its last instruction. The
+ * compiler only produces code that passes, this is meant for code that comes
+ * from elsewhere (like images). Subprototypes are not checked.
+ *
+ * @param s The Europa state.
+ * @param proto The target prototype.
+ * @param parent The prototype whose code closes over it, NULL for top level
+ * prototypes.
+ * @return The result of the operation.
+ */
+int euvm_verify(europa* s, eu_proto* proto, eu_proto* parent) {
+	static const eu_byte operands[] = {
+		OPERAND_NONE, OPERAND_NAME, OPERAND_CONSTANT, OPERAND_SUBPROTO,
+		OPERAND_OFFSET, OPERAND_OFFSET, OPERAND_NAME, OPERAND_NONE,
+		OPERAND_OFFSET, OPERAND_NONE, OPERAND_NONE, OPERAND_OFFSET, OPERAND_NAME,
+		OPERAND_NONE, OPERAND_NAME, OPERAND_NAME, OPERAND_NAME, OPERAND_CONSTANT,
+		OPERAND_NAME, OPERAND_FREE, OPERAND_FREE, OPERAND_GUARD, OPERAND_OFFSET,
+	};
+	eu_instruction ir;
+	eu_capture* capture;
+	int pc, val, target;
+
+	/* captures name symbol constants and, if they come from the creator's free
+	 * variables, one of those */
+	if (parent == NULL && proto->capturec > 0)
+		return verify_error(s, proto, -1, "top level prototype has free variables");
+	for (capture = proto->captures;
+		capture < proto->captures + proto->capturec; capture++) {
+		_eu_checkreturn(verify_constant(s, proto, -1, capture->name,
+			EU_TYPE_SYMBOL));
+		if (capture->from_free && (capture->index < 0 ||
+			capture->index >= parent->capturec))
+			return verify_error(s, proto, -1, "free variable capture out of range");
+	}
+
+	if (proto->code_length <= 0)
+		return verify_error(s, proto, 0, "empty code");
+
+	for (pc = 0; pc < proto->code_length; pc++) {
+		ir = proto->code[pc];
+		val = val_part(ir);
+
+		if (opc_part(ir) > EU_OP_CONTI_FRAME)
+			return verify_error(s, proto, pc, "unknown instruction");
+
+		switch (operands[opc_part(ir)]) {
+		case OPERAND_CONSTANT:
+			_eu_checkreturn(verify_constant(s, proto, pc, val, EU_TYPE_LAST));
+			break;
+		case OPERAND_NAME:
+			_eu_checkreturn(verify_constant(s, proto, pc, val, EU_TYPE_SYMBOL));
+			break;
+		case OPERAND_GUARD:
+			_eu_checkreturn(verify_constant(s, proto, pc, val, EU_TYPE_LAST));
+			if (!_euvalue_is_type(&(proto->constants[val]), EU_TYPE_SYMBOL)) {
+				_eu_checkreturn(verify_constant(s, proto, pc, val, EU_TYPE_PROTO));
+			}
+			break;
+		case OPERAND_SUBPROTO:
+			if (val >= proto->subprotoc)
+				return verify_error(s, proto, pc, "subproto index out of range");
+			break;
+		case OPERAND_OFFSET:
+			target = pc + off_part(ir);
+			if (target < 0 || target >= proto->code_length)
+				return verify_error(s, proto, pc, "jump out of the code");
+			break;
+		case OPERAND_FREE:
+			if (val >= proto->capturec)
+				return verify_error(s, proto, pc, "free variable index out of range");
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* the last instruction must leave the prototype's code */
+	switch (opc_part(proto->code[proto->code_length - 1])) {
+	case EU_OP_RETURN:
+	case EU_OP_HALT:
+	case EU_OP_JUMP:
+	case EU_OP_APPLY:
+	case EU_OP_GREFER_APPLY:
+		break;
+	default:
+		return verify_error(s, proto, proto->code_length - 1,
+			"code runs past its end");
+	}
+
+	return EU_RESULT_OK;
+}
+
 int _disas_inst(europa* s, eu_port* port, eu_proto* proto, eu_instruction inst) {
 	static const char* opc_names[] = {
 		"nop", "refer", "const", "close", "test", "jump", "assign", "argument",
-		"conti", "apply", "return", "frame", "define", "halt"
+		"conti", "apply", "return", "frame", "define", "halt", "grefer",
+		"refer-arg", "grefer-arg", "const-arg", "grefer-apply", "frefer",
+		"fassign", "guard", "conti-frame"
 	};
 	static const int opc_types[] = {
-		0, 1, 1, 3, 2, 2, 1, 0, 2, 0, 0, 0, 1, 0,
+		0, 1, 1, 3, 2, 2, 1, 0, 2, 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 4, 4, 1, 2,
 	};
 
 	int opindex = opc_part(inst);
 
-	if (opindex > EU_OP_HALT) {
+	if (opindex > EU_OP_CONTI_FRAME) {
 		_eu_checkreturn(euport_write_string(s, port, "\tUNKNOWN INSTRUCTION\n"));
 		return EU_RESULT_OK;
 	}
@@ -712,6 +1439,16 @@ int _disas_inst(europa* s, eu_port* port, eu_proto* proto, eu_instruction inst)
 			_eu_checkreturn(euport_write_char(s, port, '>'));
 		}
 		break;
+	case 4:
+		_eu_checkreturn(euport_write_string(s, port, " ["));
+		_eu_checkreturn(euport_write_integer(s, port, val_part(inst)));
+		_eu_checkreturn(euport_write_char(s, port, ']'));
+		if (proto && cast(int, val_part(inst)) < proto->capturec) {
+			_eu_checkreturn(euport_write_string(s, port, "\t; "));
+			_eu_checkreturn(euport_write(s, port,
+				&(proto->constants[proto->captures[val_part(inst)].name])));
+		}
+		break;
 	case 0:
 		break;
 	default:
@@ -724,6 +1461,10 @@ int _disas_inst(europa* s, eu_port* port, eu_proto* proto, eu_instruction inst)
 int _disas_proto(europa* s, eu_port* port, eu_proto* proto, int pc) {
 	int i;
 
+	if (_euproto_is_stub(proto)) {
+		_eu_checkreturn(euimage_materialize(s, proto));
+	}
+
 	_eu_checkreturn(euport_write_string(s, port, "Prototype 0x"));
 	_eu_checkreturn(euport_write_hex_uint(s, port, cast(eu_uinteger, proto)));
 	_eu_checkreturn(euport_write_string(s, port, ":\nSource:\n"));
@@ -743,6 +1484,19 @@ int _disas_proto(europa* s, eu_port* port, eu_proto* proto, int pc) {
 
 	_eu_checkreturn(euport_write_string(s, port, ")"));
 
+	if (proto->capturec > 0) {
+		_eu_checkreturn(euport_write_string(s, port, "\nFree:\n#("));
+		for (i = 0; i < proto->capturec; i++) {
+			if (i != 0) {
+				_eu_checkreturn(euport_write_char(s, port, ' '));
+			}
+
+			_eu_checkreturn(euport_write(s, port,
+				&(proto->constants[proto->captures[i].name])));
+		}
+		_eu_checkreturn(euport_write_string(s, port, ")"));
+	}
+
 	_eu_checkreturn(euport_write_string(s, port, "\nCode:\n"));
 
 	for (i = 0; i < proto->code_length; i++) {
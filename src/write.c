@@ -18,6 +18,7 @@
 #include "europa/bytevector.h"
 #include "europa/vector.h"
 #include "europa/table.h"
+#include "europa/task.h"
 
 #include "utf8.h"
 
@@ -302,6 +303,16 @@ int euport_write_simple(europa* s, eu_port* port, eu_value* v) {
 		return euport_write_char(s, port, '>');
 		break;
 
+	case EU_TYPE_TASK:
+		_eu_checkreturn(euport_write_string(s, port, "#<task 0x"));
+		_eu_checkreturn(euport_write_hex_uint(s, port, cast(eu_uinteger, v->value.object)));
+		return euport_write_char(s, port, '>');
+
+	case EU_TYPE_CHANNEL:
+		_eu_checkreturn(euport_write_string(s, port, "#<channel 0x"));
+		_eu_checkreturn(euport_write_hex_uint(s, port, cast(eu_uinteger, v->value.object)));
+		return euport_write_char(s, port, '>');
+
 	case EU_TYPE_EOF:
 		_eu_checkreturn(euport_write_string(s, port, "#<eof>"));
 		break;
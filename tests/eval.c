@@ -3,8 +3,11 @@
 #include "helpers.h"
 #include "europa.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 static void* eval_setup(MunitParameter params[], void* user_data) {
 	europa* s;
@@ -184,6 +187,106 @@ MunitResult test_c_closures(MunitParameter params[], void* fixture) {
 	return MUNIT_OK;
 }
 
+/* calls its argument three times, summing what it returns */
+int cl_sum_calls(europa* s) {
+	eu_cframe* f;
+	eu_value* proc;
+
+	_eucc_arity_proper(s, 1);
+	_eucc_argument(s, proc, 0);
+	_eu_checkreturn(eucc_cframe(s, 1, &f));
+
+	if (_eucframe_tag(f) == 0) {
+		_eu_makeint(_eucframe_slot(f, 0), 0);
+	} else {
+		_eucframe_slot(f, 0)->value.i += _eu_acc(s)->value.i;
+	}
+
+	if (_eucframe_tag(f) < 3)
+		return eucc_call(s, _eucframe_tag(f) + 1, proc, &_null);
+
+	*_eucc_return(s) = *_eucframe_slot(f, 0);
+	return EU_RESULT_OK;
+}
+
+MunitResult test_c_frames(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+
+	/* C closures keep their state in frames across calls */
+	assert_ok(eucc_define_cclosure(s, s->global->env, s->global->env,
+		"sum-calls", cl_sum_calls));
+	assert_ok(eu_do_string(s,
+		"(let ((n 0)) (sum-calls (lambda () (set! n (+ n 1)) n)))", &result));
+	assertv_int(&result, ==, 6);
+	assert_ok(eu_do_string(s,
+		"(sum-calls (lambda () (sum-calls (lambda () 2))))", &result));
+	assertv_int(&result, ==, 18);
+
+	/* map and for-each */
+	assert_ok(eu_do_string(s, "(map + '(1 2 3) '(10 20))", &result));
+	munit_assert_true(_euvalue_is_pair(&result));
+	assertv_int(_eupair_head(_euvalue_to_pair(&result)), ==, 11);
+	assert_ok(eu_do_string(s, "(map car '())", &result));
+	munit_assert_true(_euvalue_is_null(&result));
+	assert_ok(eu_do_string(s,
+		"(car (cdr (map (lambda (x) (map (lambda (y) (* x y)) '(1 2))) '(1 2 3))))",
+		&result));
+	assertv_int(_eupair_head(_euvalue_to_pair(_eupair_tail(
+		_euvalue_to_pair(&result)))), ==, 4);
+	assert_ok(eu_do_string(s,
+		"(let ((n 0)) (for-each (lambda (x y) (set! n (+ n (* x y)))) '(1 2) '(3 4)) n)",
+		&result));
+	assertv_int(&result, ==, 11);
+	munit_assert_int(eu_do_string(s, "(map car 1)", &result), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_leaf_closures(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result, *v;
+
+	/* leaf C closures are called directly by map, for-each and apply */
+	assert_ok(eu_do_string(s, "(map car '((1 2) (3 4)))", &result));
+	assertv_int(_eupair_head(_euvalue_to_pair(&result)), ==, 1);
+	assert_ok(eu_do_string(s, "(map + '(1 2 3) '(10 20))", &result));
+	munit_assert_int(eulist_length(s, _euvalue_to_pair(&result)), ==, 2);
+	assertv_int(_eupair_head(_euvalue_to_pair(_eupair_tail(
+		_euvalue_to_pair(&result)))), ==, 22);
+	assert_ok(eu_do_string(s, "(for-each + '(1 2) '(3 4))", &result));
+	assertv_int(&result, ==, 6);
+	assert_ok(eu_do_string(s, "(apply + 1 2 '(3 4))", &result));
+	assertv_int(&result, ==, 10);
+	assert_ok(eu_do_string(s, "(+ 1 (apply * '(2 3)))", &result));
+	assertv_int(&result, ==, 7);
+
+	/* but not closures that may call back */
+	assert_ok(eu_do_string(s, "(map map (list car cdr) '(((1 2)) ((3 4))))", &result));
+	v = _eupair_head(_euvalue_to_pair(&result));
+	assertv_int(_eupair_head(_euvalue_to_pair(v)), ==, 1);
+
+	/* vector variants */
+	assert_ok(eu_do_string(s, "(vector-map + #(1 2 3) #(10 20 30 40))", &result));
+	assertv_type(&result, EU_TYPE_VECTOR);
+	munit_assert_int(_euvector_length(_euvalue_to_vector(&result)), ==, 3);
+	assertv_int(_euvector_ref(_euvalue_to_vector(&result), 2), ==, 33);
+	assert_ok(eu_do_string(s, "(vector-map (lambda (x) (* x x)) #(1 2 3))", &result));
+	assertv_int(_euvector_ref(_euvalue_to_vector(&result), 2), ==, 9);
+	assert_ok(eu_do_string(s, "(vector-map car #())", &result));
+	munit_assert_int(_euvector_length(_euvalue_to_vector(&result)), ==, 0);
+	assert_ok(eu_do_string(s,
+		"(let ((n 0)) (vector-for-each (lambda (x y) (set! n (+ n (* x y)))) #(1 2) #(3 4 5)) n)",
+		&result));
+	assertv_int(&result, ==, 11);
+	munit_assert_int(eu_do_string(s, "(vector-map car '(1))", &result), !=,
+		EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	return MUNIT_OK;
+}
+
 MunitResult test_simple_callcc(MunitParameter params[], void* fixture) {
 	europa* s = cast(europa*, fixture);
 	eu_value result;
@@ -199,6 +302,1043 @@ MunitResult test_simple_callcc(MunitParameter params[], void* fixture) {
 	assertv_type(&result, EU_TYPE_NUMBER);
 	assertv_int(&result, ==, 1234);
 
+	/* escaping from a call/cc that is not in tail position */
+	assert_ok(eu_do_string(s,
+		"(+ 1 (call/cc (lambda (k) (+ 10 (k 100)))))", &result));
+	assertv_int(&result, ==, 101);
+
+	/* re-entering it */
+	assert_ok(eu_do_string(s,
+		"((lambda (counter conti)"
+		"   (+ 1000 (call/cc (lambda (c) (set! conti c) 0)))"
+		"   (set! counter (+ counter 1))"
+		"   (if (= counter 5) counter (conti 0)))"
+		" 0 #f)", &result));
+	assertv_int(&result, ==, 5);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_hash_tables(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+
+	/* equal? tables compare keys structurally */
+	assert_ok(eu_do_string(s, "(define h (make-hash-table equal?))", &result));
+	assert_ok(eu_do_string(s, "(hash-table-set! h (list 1 2) 10)", &result));
+	assert_ok(eu_do_string(s, "(hash-table-ref h (list 1 2))", &result));
+	assertv_type(&result, EU_TYPE_NUMBER);
+	assertv_int(&result, ==, 10);
+
+	/* failure thunk */
+	assert_ok(eu_do_string(s, "(hash-table-ref h 'missing (lambda () 20))", &result));
+	assertv_int(&result, ==, 20);
+
+	/* updates call back into Europa code before storing the value */
+	assert_ok(eu_do_string(s,
+		"(hash-table-update! h 'count (lambda (x) (+ x 1)) (lambda () 41))", &result));
+	assert_ok(eu_do_string(s, "(hash-table-ref/default h 'count #f)", &result));
+	assertv_int(&result, ==, 42);
+	assert_ok(eu_do_string(s,
+		"(hash-table-update!/default h 'count (lambda (x) (* x 2)) 0)", &result));
+	assert_ok(eu_do_string(s, "(hash-table-ref/default h 'count #f)", &result));
+	assertv_int(&result, ==, 84);
+
+	/* walking and folding */
+	assert_ok(eu_do_string(s, "(define n 0)", &result));
+	assert_ok(eu_do_string(s, "(hash-table-walk h (lambda (k v) (set! n (+ n v))))",
+		&result));
+	assert_ok(eu_do_string(s, "n", &result));
+	assertv_int(&result, ==, 94);
+	assert_ok(eu_do_string(s, "(hash-table-fold h (lambda (k v acc) (+ acc 1)) 0)",
+		&result));
+	assertv_int(&result, ==, 2);
+
+	/* string tables */
+	assert_ok(eu_do_string(s, "(define st (make-hash-table string=?))", &result));
+	assert_ok(eu_do_string(s, "(hash-table-set! st \"key\" 1)", &result));
+	assert_ok(eu_do_string(s, "(hash-table-ref/default st \"key\" 0)", &result));
+	assertv_int(&result, ==, 1);
+
+	/* hashes can be reduced to a bound, an exact positive integer */
+	assert_ok(eu_do_string(s, "(< -1 (hash \"key\" 7) 7)", &result));
+	assertv_true(&result);
+	munit_assert_int(eu_do_string(s, "(hash 5 2.5)", &result), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+	munit_assert_int(eu_do_string(s, "(hash 5 0)", &result), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+	assert_ok(eu_do_string(s, "(< -1 (string-hash \"key\" 7) 7)", &result));
+	assertv_true(&result);
+	munit_assert_int(eu_do_string(s, "(string-hash \"a\" 2.5)", &result), !=,
+		EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_global_references(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	char buf[64];
+	int i;
+
+	assert_ok(eu_do_string(s, "(define g 5)", &result));
+	assert_ok(eu_do_string(s, "(define (h y) (+ y g))", &result));
+	assert_ok(eu_do_string(s, "(h 1)", &result));
+	assertv_int(&result, ==, 6);
+
+	/* growing the global environment moves its slots */
+	for (i = 0; i < 200; i++) {
+		snprintf(buf, sizeof(buf), "(define global-%d %d)", i, i);
+		assert_ok(eu_do_string(s, buf, &result));
+	}
+	assert_ok(eu_do_string(s, "(h 1)", &result));
+	assertv_int(&result, ==, 6);
+
+	/* assignments are seen through the cached slot */
+	assert_ok(eu_do_string(s, "(set! g 10)", &result));
+	assert_ok(eu_do_string(s, "(h 1)", &result));
+	assertv_int(&result, ==, 11);
+
+	/* formals and internal defines shadow globals */
+	assert_ok(eu_do_string(s, "((lambda (g) (+ g 1)) 1)", &result));
+	assertv_int(&result, ==, 2);
+	assert_ok(eu_do_string(s,
+		"((lambda () (define (k) g) (define g 3) (k)))", &result));
+	assertv_int(&result, ==, 3);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_constant_pool(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	eu_proto* proto;
+
+	assert_ok(eu_do_string(s,
+		"(lambda (x) (list x x x \"a\" \"a\" '(1 2) '(1 2) '() '()))", &result));
+	assertv_type(&result, EU_TYPE_CLOSURE);
+	proto = _euvalue_to_closure(&result)->proto;
+
+	/* x, list, "a", (1 2) and () are stored once each */
+	munit_assert_int(proto->constantc, ==, 5);
+	/* and the finished prototype holds no slack */
+	munit_assert_int(proto->constants_size, ==, proto->constantc);
+	munit_assert_int(proto->code_size, ==, proto->code_length);
+	munit_assert_null(proto->constant_index);
+
+	return MUNIT_OK;
+}
+
+/* writes the code section of a closure's disassembly into buf */
+static void disassembled_code(europa* s, eu_value* v, char* buf, size_t size) {
+	eu_mport* port;
+	eu_byte* c;
+	char *text, *start, *end;
+	size_t len;
+
+	port = eumport_from_str(s, EU_PORT_FLAG_TEXTUAL | EU_PORT_FLAG_OUTPUT, "");
+	munit_assert_not_null(port);
+	assert_ok(euvm_disassemble(s, _eumport_to_port(port), v));
+
+	/* memory ports keep the terminators of written strings, skip them */
+	text = munit_malloc(port->next - port->mem + 1);
+	for (len = 0, c = port->mem; c < port->next; c++) {
+		if (*c != '\0')
+			text[len++] = *c;
+	}
+	text[len] = '\0';
+
+	start = strstr(text, "Code:\n");
+	munit_assert_not_null(start);
+	start += strlen("Code:\n");
+	end = strstr(start, "Subprototypes");
+	munit_assert_not_null(end);
+	munit_assert_size(end - start, <, size);
+
+	memcpy(buf, start, end - start);
+	buf[end - start] = '\0';
+	free(text);
+}
+
+MunitResult test_peephole(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	char before[512], after[512];
+
+	/* (if #f 1 2) */
+	_eu_global(s)->peephole = EU_FALSE;
+	assert_ok(eu_do_string(s, "(lambda (x) (if #f 1 2))", &result));
+	disassembled_code(s, &result, before, sizeof(before));
+	munit_assert_string_equal(before,
+		"\tconst [0]\t; #f\n"
+		"\ttest 3\n"
+		"\tconst [1]\t; 1\n"
+		"\tjump 2\n"
+		"\tconst [2]\t; 2\n"
+		"\treturn\n");
+
+	_eu_global(s)->peephole = EU_TRUE;
+	assert_ok(eu_do_string(s, "(lambda (x) (if #f 1 2))", &result));
+	disassembled_code(s, &result, after, sizeof(after));
+	munit_assert_string_equal(after,
+		"\tconst [2]\t; 2\n"
+		"\treturn\n");
+
+	/* jumps to returns return, code after them is dropped */
+	_eu_global(s)->peephole = EU_FALSE;
+	assert_ok(eu_do_string(s, "(lambda (x) (if x (if x 1 2) 3))", &result));
+	disassembled_code(s, &result, before, sizeof(before));
+	munit_assert_string_equal(before,
+		"\trefer [0]\t; x\n"
+		"\ttest 7\n"
+		"\trefer [0]\t; x\n"
+		"\ttest 3\n"
+		"\tconst [1]\t; 1\n"
+		"\tjump 2\n"
+		"\tconst [2]\t; 2\n"
+		"\tjump 2\n"
+		"\tconst [3]\t; 3\n"
+		"\treturn\n");
+
+	_eu_global(s)->peephole = EU_TRUE;
+	assert_ok(eu_do_string(s, "(define (g x) (if x (if x 1 2) 3))", &result));
+	disassembled_code(s, &result, after, sizeof(after));
+	munit_assert_string_equal(after,
+		"\trefer [0]\t; x\n"
+		"\ttest 7\n"
+		"\trefer [0]\t; x\n"
+		"\ttest 3\n"
+		"\tconst [1]\t; 1\n"
+		"\treturn\n"
+		"\tconst [2]\t; 2\n"
+		"\treturn\n"
+		"\tconst [3]\t; 3\n"
+		"\treturn\n");
+
+	/* and the optimized code still works */
+	assert_ok(eu_do_string(s, "(g #t)", &result));
+	assertv_int(&result, ==, 1);
+	assert_ok(eu_do_string(s, "(g #f)", &result));
+	assertv_int(&result, ==, 3);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_superinstructions(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	char code[512];
+
+	assert_ok(eu_do_string(s, "(define (inc y) (+ y 1))", &result));
+	disassembled_code(s, &result, code, sizeof(code));
+	munit_assert_string_equal(code,
+		"\trefer-arg [0]\t; y\n"
+		"\tconst-arg [1]\t; 1\n"
+		"\tgrefer-apply [2]\t; +\n"
+		"\treturn\n");
+
+	assert_ok(eu_do_string(s, "(inc (inc 1))", &result));
+	assertv_int(&result, ==, 3);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_let_forms(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	char code[1024];
+
+	assert_ok(eu_do_string(s, "(define x 10)", &result));
+	assert_ok(eu_do_string(s, "(let ((x 1) (y x)) (+ x y))", &result));
+	assertv_int(&result, ==, 11);
+	assert_ok(eu_do_string(s, "(let* ((x 1) (y (+ x 1))) (* x y))", &result));
+	assertv_int(&result, ==, 2);
+	assert_ok(eu_do_string(s, "(letrec* ((a 1) (b (+ a 1))) (* a b))", &result));
+	assertv_int(&result, ==, 2);
+	assert_ok(eu_do_string(s, "(do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i 5) acc))",
+		&result));
+	assertv_int(&result, ==, 10);
+	/* let variables never leak into the global environment */
+	assert_ok(eu_do_string(s, "x", &result));
+	assertv_int(&result, ==, 10);
+
+	/* named let loops run in place, their self calls jump back */
+	assert_ok(eu_do_string(s,
+		"(define (sum n) (let loop ((i 0) (acc 0))"
+		" (if (= i n) acc (loop (+ i 1) (+ acc i)))))", &result));
+	disassembled_code(s, &result, code, sizeof(code));
+	munit_assert_null(strstr(code, "close"));
+	munit_assert_not_null(strstr(code, "jump -"));
+	assert_ok(eu_do_string(s, "(sum 1000)", &result));
+	assertv_int(&result, ==, 499500);
+
+	/* other uses of the name need a procedure */
+	assert_ok(eu_do_string(s,
+		"(let f ((n 5)) (if (= n 0) 1 (* n (f (- n 1)))))", &result));
+	assertv_int(&result, ==, 120);
+
+	/* procedures created in a loop see fresh bindings */
+	assert_ok(eu_do_string(s,
+		"(let loop ((i 0) (fs '()))"
+		" (if (= i 2) ((car (cdr fs))) (loop (+ i 1) (cons (lambda () i) fs))))",
+		&result));
+	assertv_int(&result, ==, 0);
+
+	/* also when a nested loop falls back to being a procedure */
+	assert_ok(eu_do_string(s,
+		"(define (f) (let loop ((i 0) (acc '()))"
+		" (if (< i 3) (loop (+ i 1) (cons (let g ((k 0)) (if (= k 1) i g)) acc))"
+		" acc)))", &result));
+	assert_ok(eu_do_string(s, "(equal? (map (lambda (g) (g 1)) (f)) '(2 1 0))",
+		&result));
+	assertv_true(&result);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_flat_closures(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	eu_closure* cl;
+
+	/* closures copy the free variables they use, not the creation frame */
+	assert_ok(eu_do_string(s, "(define (adder x) (lambda (y) (+ x y)))", &result));
+	assert_ok(eu_do_string(s, "(adder 3)", &result));
+	assertv_type(&result, EU_TYPE_CLOSURE);
+	cl = _euvalue_to_closure(&result);
+	munit_assert_ptr_equal(cl->env, _eu_global_env(s));
+	munit_assert_int(cl->freec, ==, 1);
+	assertv_int(&cl->free[0], ==, 3);
+	assert_ok(eu_do_string(s, "((adder 3) 4)", &result));
+	assertv_int(&result, ==, 7);
+
+	/* variables that change are shared, also across nested closures */
+	assert_ok(eu_do_string(s,
+		"(define (counter n) (lambda () (lambda () (set! n (+ n 1)) n)))", &result));
+	assert_ok(eu_do_string(s, "(define c ((counter 10)))", &result));
+	assert_ok(eu_do_string(s, "(c)", &result));
+	assert_ok(eu_do_string(s, "(c)", &result));
+	assertv_int(&result, ==, 12);
+
+	/* internal defines are seen by closures created before them */
+	assert_ok(eu_do_string(s,
+		"((lambda () (define (k) g) (define g 3) (k)))", &result));
+	assertv_int(&result, ==, 3);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_constant_folding(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	char code[512];
+
+	/* calls to builtins on constants are evaluated when compiling, the value
+	 * being used while the builtins are still there */
+	assert_ok(eu_do_string(s, "(lambda () (* 60 60 (- 30 6)))", &result));
+	disassembled_code(s, &result, code, sizeof(code));
+	munit_assert_string_equal(code,
+		"\tgrefer [0]\t; *\n"
+		"\tguard [0]\t; *\n"
+		"\ttest 6\n"
+		"\tgrefer [1]\t; -\n"
+		"\tguard [1]\t; -\n"
+		"\ttest 3\n"
+		"\tconst [2]\t; 86400\n"
+		"\treturn\n"
+		"\tconst-arg [3]\t; 60\n"
+		"\tconst-arg [3]\t; 60\n"
+		"\tgrefer [1]\t; -\n"
+		"\tguard [1]\t; -\n"
+		"\ttest 3\n"
+		"\tconst [4]\t; 24\n"
+		"\tjump 5\n"
+		"\tframe\n"
+		"\tconst-arg [5]\t; 30\n"
+		"\tconst-arg [6]\t; 6\n"
+		"\tgrefer-apply [1]\t; -\n"
+		"\targument\n"
+		"\tgrefer-apply [0]\t; *\n"
+		"\treturn\n");
+	assert_ok(eu_do_string(s, "(car (cdr '(1 2)))", &result));
+	assertv_int(&result, ==, 2);
+
+	/* but not when the name is bound to something else */
+	assert_ok(eu_do_string(s, "((lambda (+) (+ 1 2)) -)", &result));
+	assertv_int(&result, ==, -1);
+	assert_ok(eu_do_string(s, "(define (max a b) a)", &result));
+	assert_ok(eu_do_string(s, "(max 1 2)", &result));
+	assertv_int(&result, ==, 1);
+
+	/* calls that fail are left to fail when they run */
+	assert_ok(eu_do_string(s, "(lambda () (car 1))", &result));
+	munit_assert_int(eu_do_string(s, "(car 1)", &result), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	/* builtins redefined after folding are called instead */
+	assert_ok(eu_do_string(s, "(define (f) (+ 1 2))", &result));
+	assert_ok(eu_do_string(s, "(define (g) (* 2 (+ 1 2)))", &result));
+	assert_ok(eu_do_string(s, "(g)", &result));
+	assertv_int(&result, ==, 6);
+	assert_ok(eu_do_string(s, "(define (+ a b) 0)", &result));
+	assert_ok(eu_do_string(s, "(f)", &result));
+	assertv_int(&result, ==, 0);
+	assert_ok(eu_do_string(s, "(g)", &result));
+	assertv_int(&result, ==, 0);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_inlining(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	char code[1024];
+
+	/* small procedures run in place, guarded by a check of the variable */
+	assert_ok(eu_do_string(s, "(define (square x) (* x x))", &result));
+	assert_ok(eu_do_string(s, "(define (f y) (+ (square y) 1))", &result));
+	disassembled_code(s, &result, code, sizeof(code));
+	munit_assert_not_null(strstr(code, "guard"));
+	assert_ok(eu_do_string(s, "(f 5)", &result));
+	assertv_int(&result, ==, 26);
+
+	/* which calls whatever the variable holds once it changes */
+	assert_ok(eu_do_string(s, "(define (square x) (- x))", &result));
+	assert_ok(eu_do_string(s, "(f 5)", &result));
+	assertv_int(&result, ==, -4);
+
+	/* bodies keep referring to globals the call site shadows */
+	assert_ok(eu_do_string(s, "(define (first p) (car p))", &result));
+	assert_ok(eu_do_string(s, "(define (g car) (first car))", &result));
+	assert_ok(eu_do_string(s, "(g '(1 2))", &result));
+	assertv_int(&result, ==, 1);
+
+	/* procedures defined earlier in the same form are inlined too */
+	assert_ok(eu_do_string(s,
+		"(begin (define (dbl x) (+ x x)) (define (quad x) (dbl (dbl x))) (quad 3))",
+		&result));
+	assertv_int(&result, ==, 12);
+	assert_ok(eu_do_string(s, "(set! dbl (lambda (x) x))", &result));
+	assert_ok(eu_do_string(s, "(quad 3)", &result));
+	assertv_int(&result, ==, 3);
+
+	/* recursive procedures are called */
+	assert_ok(eu_do_string(s,
+		"(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))", &result));
+	assert_ok(eu_do_string(s, "((lambda () (fact 5)))", &result));
+	assertv_int(&result, ==, 120);
+
+	return MUNIT_OK;
+}
+
+/* (second a b) compiles to b, a is never evaluated */
+static int compile_second(europa* s, eu_cscope* sc, eu_proto* proto,
+	eu_value* form, int is_tail) {
+	eu_value* args;
+
+	args = _eupair_tail(_euvalue_to_pair(form));
+	args = _eupair_tail(_euvalue_to_pair(args));
+	return eucode_compile_form(s, sc, proto, _eupair_head(_euvalue_to_pair(args)),
+		is_tail);
+}
+
+static const eu_syntax second_syntax = {"second", compile_second};
+
+MunitResult test_images(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	static const char* forms[] = {
+		"(define (sq x) (* x x))",
+		"(define greeting \"hi\")",
+		"(define (count-to n)"
+		"  (let loop ((i 0) (acc '()))"
+		"    (if (= i n) acc (loop (+ i 1) (cons i acc)))))",
+		"(if (eq? (car '(a \"b\" #\\c 2.5)) 'a)"
+		"  (+ (sq 7) (if (string? greeting) 2 0) (car (count-to 3)) 1.5)"
+		"  0)",
+	};
+	eu_proto *protos[4], *proto;
+	eu_value form, chunk, chunks, result;
+	eu_port* port;
+	eu_byte data[4096];
+	FILE* file;
+	size_t size;
+	int i;
+
+	/* compile the forms without running them */
+	for (i = 0; i < 4; i++) {
+		port = _eumport_to_port(eumport_from_str(s,
+			EU_PORT_FLAG_INPUT | EU_PORT_FLAG_TEXTUAL, cast(void*, forms[i])));
+		assert_ok(euport_read(s, port, &form));
+		assert_ok(eucode_compile(s, &form, &chunk));
+		protos[i] = _euvalue_to_closure(&chunk)->proto;
+	}
+
+	/* write them to an image */
+	file = tmpfile();
+	munit_assert_not_null(file);
+	port = _eufport_to_port(eufport_from_file(s,
+		EU_PORT_FLAG_OUTPUT | EU_PORT_FLAG_BINARY, file));
+	assert_ok(euimage_write(s, port, protos, 4));
+	rewind(file);
+	size = fread(data, 1, sizeof(data), file);
+	munit_assert_size(size, >, 0);
+	munit_assert_size(size, <, sizeof(data));
+
+	/* load and run it, sq's lambda is only read once it is closed over */
+	assert_ok(euimage_load(s, data, size, &chunks));
+	proto = _euvalue_to_closure(_eupair_head(_euvalue_to_pair(&chunks)))->proto;
+	munit_assert_null(proto->subprotos[0]->code);
+	assert_ok(euimage_run(s, &chunks, &result));
+	assertv_real(&result, ==, 54.5);
+	munit_assert_not_null(proto->subprotos[0]->code);
+	assert_ok(eu_do_string(s, "(sq 8)", &result));
+	assertv_int(&result, ==, 64);
+
+	/* truncated or corrupted images are refused, though the last prototype (a
+	 * lambda) is only checked when it is used */
+	munit_assert_int(euimage_load(s, data, 20, &chunks), !=, EU_RESULT_OK);
+	assert_ok(euimage_load(s, data, size - 1, &chunks));
+	munit_assert_int(euimage_run(s, &chunks, &result), !=, EU_RESULT_OK);
+	memset(data + size - 4, 0xFF, 4);
+	assert_ok(euimage_load(s, data, size, &chunks));
+	munit_assert_int(euimage_run(s, &chunks, &result), !=, EU_RESULT_OK);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_image_files(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	char source[] = "/tmp/europa-source-XXXXXX", image[] = "/tmp/europa-image-XXXXXX";
+	eu_value chunks, result;
+	eu_proto* proto;
+	FILE* file;
+	int fd;
+
+	fd = mkstemp(source);
+	munit_assert_int(fd, >=, 0);
+	file = fdopen(fd, "w");
+	munit_assert_not_null(file);
+	fputs("(define (cube x) (* x x x))\n(cube 3)\n", file);
+	fclose(file);
+	fd = mkstemp(image);
+	munit_assert_int(fd, >=, 0);
+	close(fd);
+
+	/* empty files can't be mapped and are read, but aren't images */
+	munit_assert_int(euimage_load_file(s, image, &chunks), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	/* compiled files are mapped, with prototypes read as they are needed */
+	assert_ok(euimage_compile_file(s, source, image));
+	assert_ok(euimage_load_file(s, image, &chunks));
+	proto = _euvalue_to_closure(_eupair_head(_euvalue_to_pair(&chunks)))->proto;
+	munit_assert_int(proto->image->mapped, ==, EU_IMAGE_MAPPED);
+	munit_assert_true(_euproto_is_stub(proto->subprotos[0]));
+	assert_ok(euimage_run(s, &chunks, &result));
+	assertv_int(&result, ==, 27);
+	munit_assert_false(_euproto_is_stub(proto->subprotos[0]));
+	assert_ok(eu_do_string(s, "(cube 4)", &result));
+	assertv_int(&result, ==, 64);
+
+	/* missing files are reported */
+	remove(source);
+	remove(image);
+	munit_assert_int(euimage_load_file(s, image, &chunks), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+	munit_assert_int(euimage_compile_file(s, source, image), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_heap_images(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	static const char* forms[] = {
+		"(define (make-counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))",
+		"(define c (make-counter))",
+		"(c)",
+		"(define data (list 1 \"two\" 'three 4.5))",
+		"(define (sq x) (* x x))",
+		"(define (use) (sq 3))",
+		"(define first car)",
+	};
+	eu_value result;
+	eu_port* port;
+	eu_byte data[16384];
+	europa* restored;
+	FILE* file;
+	size_t size;
+	int i, err;
+
+	for (i = 0; i < 7; i++) {
+		assert_ok(eu_do_string(s, cast(void*, forms[i]), &result));
+	}
+
+	/* dump the heap */
+	file = tmpfile();
+	munit_assert_not_null(file);
+	port = _eufport_to_port(eufport_from_file(s,
+		EU_PORT_FLAG_OUTPUT | EU_PORT_FLAG_BINARY, file));
+	assert_ok(euimage_dump_heap(s, port));
+	rewind(file);
+	size = fread(data, 1, sizeof(data), file);
+	munit_assert_size(size, >, 0);
+	munit_assert_size(size, <, sizeof(data));
+
+	/* a new state starts where the old one was */
+	restored = eu_new(rlike, NULL, NULL, &err);
+	munit_assert_not_null(restored);
+	assert_ok(eutil_register_standard_library(restored));
+	assert_ok(euimage_restore_heap(restored, data, size));
+
+	assert_ok(eu_do_string(restored, "(c)", &result));
+	assertv_int(&result, ==, 2);
+	assert_ok(eu_do_string(restored, "(c)", &result));
+	assertv_int(&result, ==, 3);
+	assert_ok(eu_do_string(restored, "(car (cdr data))", &result));
+	assertv_string_equal(&result, "two");
+	assert_ok(eu_do_string(restored, "(use)", &result));
+	assertv_int(&result, ==, 9);
+	assert_ok(eu_do_string(restored, "(first data)", &result));
+	assertv_int(&result, ==, 1);
+
+	/* the old state is left alone */
+	assert_ok(eu_do_string(s, "(c)", &result));
+	assertv_int(&result, ==, 2);
+
+	/* bad images leave the environment as it was */
+	munit_assert_int(euimage_restore_heap(restored, data, size - 1), !=,
+		EU_RESULT_OK);
+	eu_recover(restored, NULL);
+	assert_ok(eu_do_string(restored, "(c)", &result));
+	assertv_int(&result, ==, 4);
+
+	eu_terminate(restored);
+	return MUNIT_OK;
+}
+
+/* what a worker thread runs and what it got */
+typedef struct {
+	const eu_byte* heap;
+	size_t heap_size;
+	const eu_byte* code;
+	size_t code_size;
+	int n;
+	eu_integer result;
+	int ok;
+} worker_job;
+
+static void* run_worker(void* ud) {
+	worker_job* job = cast(worker_job*, ud);
+	eu_value chunks, result;
+	char text[64];
+	europa* s;
+	int err;
+
+	s = eu_new(rlike, NULL, NULL, &err);
+	if (s == NULL)
+		return NULL;
+
+	/* the heap and the code are the same bytes for every worker */
+	if (eutil_register_standard_library(s) == EU_RESULT_OK &&
+		euimage_restore_heap(s, job->heap, job->heap_size) == EU_RESULT_OK &&
+		euimage_load_shared(s, job->code, job->code_size, &chunks) == EU_RESULT_OK &&
+		euimage_run(s, &chunks, &result) == EU_RESULT_OK) {
+		snprintf(text, sizeof(text), "(sum-squares %d)", job->n);
+		if (eu_do_string(s, text, &result) == EU_RESULT_OK &&
+			_euvalue_is_type(&result, EU_TYPE_NUMBER)) {
+			job->result = _eunum_i(&result);
+			job->ok = 1;
+		}
+	}
+
+	eu_terminate(s);
+	return NULL;
+}
+
+MunitResult test_workers(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value form, chunk, result;
+	eu_port* port;
+	eu_proto* proto;
+	eu_byte heap[16384], code[4096];
+	size_t heap_size, code_size;
+	worker_job jobs[4];
+	pthread_t threads[4];
+	FILE* file;
+	int i;
+
+	/* the prelude goes in a heap image, the program in a code image */
+	assert_ok(eu_do_string(s, "(define (sq x) (* x x))", &result));
+	file = tmpfile();
+	munit_assert_not_null(file);
+	port = _eufport_to_port(eufport_from_file(s,
+		EU_PORT_FLAG_OUTPUT | EU_PORT_FLAG_BINARY, file));
+	assert_ok(euimage_dump_heap(s, port));
+	rewind(file);
+	heap_size = fread(heap, 1, sizeof(heap), file);
+	munit_assert_size(heap_size, >, 0);
+	munit_assert_size(heap_size, <, sizeof(heap));
+
+	port = _eumport_to_port(eumport_from_str(s,
+		EU_PORT_FLAG_INPUT | EU_PORT_FLAG_TEXTUAL,
+		"(define (sum-squares n) (let loop ((i 1) (acc 0))"
+		"  (if (> i n) acc (loop (+ i 1) (+ acc (sq i))))))"));
+	assert_ok(euport_read(s, port, &form));
+	assert_ok(eucode_compile(s, &form, &chunk));
+	proto = _euvalue_to_closure(&chunk)->proto;
+	file = tmpfile();
+	munit_assert_not_null(file);
+	port = _eufport_to_port(eufport_from_file(s,
+		EU_PORT_FLAG_OUTPUT | EU_PORT_FLAG_BINARY, file));
+	assert_ok(euimage_write(s, port, &proto, 1));
+	rewind(file);
+	code_size = fread(code, 1, sizeof(code), file);
+	munit_assert_size(code_size, >, 0);
+	munit_assert_size(code_size, <, sizeof(code));
+
+	/* each worker has a state of its own, on a thread of its own */
+	for (i = 0; i < 4; i++) {
+		jobs[i].heap = heap;
+		jobs[i].heap_size = heap_size;
+		jobs[i].code = code;
+		jobs[i].code_size = code_size;
+		jobs[i].n = 1000 * (i + 1);
+		jobs[i].ok = 0;
+		munit_assert_int(pthread_create(&threads[i], NULL, run_worker, &jobs[i]),
+			==, 0);
+	}
+	for (i = 0; i < 4; i++) {
+		munit_assert_int(pthread_join(threads[i], NULL), ==, 0);
+		munit_assert_true(jobs[i].ok);
+		munit_assert_llong(jobs[i].result, ==, cast(eu_integer, jobs[i].n) *
+			(jobs[i].n + 1) * (2 * jobs[i].n + 1) / 6);
+	}
+
+	return MUNIT_OK;
+}
+
+MunitResult test_compile_cache(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result, chunk;
+
+	assert_ok(eucache_set_limit(s, 64 * 1024));
+
+	/* running the same text again uses the kept form */
+	assert_ok(eucache_lookup(s, "(+ 1 2)", &chunk));
+	munit_assert_true(_euvalue_is_null(&chunk));
+	assert_ok(eu_do_string(s, "(+ 1 2)", &result));
+	assertv_int(&result, ==, 3);
+	assert_ok(eucache_lookup(s, "(+ 1 2)", &chunk));
+	munit_assert_true(_euvalue_is_type(&chunk, EU_TYPE_CLOSURE));
+	assert_ok(eu_do_string(s, "(+ 1 2)", &result));
+	assertv_int(&result, ==, 3);
+
+	/* forms are kept by their text, so they still see the current globals */
+	assert_ok(eu_do_string(s, "(define x 1)", &result));
+	assert_ok(eu_do_string(s, "x", &result));
+	assertv_int(&result, ==, 1);
+	assert_ok(eu_do_string(s, "(define x 2)", &result));
+	assert_ok(eu_do_string(s, "x", &result));
+	assertv_int(&result, ==, 2);
+
+	/* forms folded for a builtin are compiled again when it is redefined */
+	assert_ok(eu_do_string(s, "(car '(1 2))", &result));
+	assertv_int(&result, ==, 1);
+	assert_ok(eu_do_string(s, "(define car cdr)", &result));
+	assert_ok(eu_do_string(s, "(car '(1 2))", &result));
+	munit_assert_true(_euvalue_is_pair(&result));
+
+	/* the least recently used forms are dropped to stay within the limit */
+	assert_ok(eucache_set_limit(s, 1));
+	assert_ok(eucache_lookup(s, "(+ 1 2)", &chunk));
+	munit_assert_true(_euvalue_is_null(&chunk));
+	assert_ok(eu_do_string(s, "(+ 1 2)", &result));
+	assertv_int(&result, ==, 3);
+	assert_ok(eucache_lookup(s, "(+ 1 2)", &chunk));
+	munit_assert_true(_euvalue_is_null(&chunk));
+
+	/* and a limit of 0 turns the cache off */
+	assert_ok(eucache_set_limit(s, 0));
+	munit_assert_null(_eu_global(s)->cache);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_direct_calls(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result, fn, args[3];
+	eu_gref ref;
+	char name[32];
+	int i;
+
+	_eu_makeint(&args[0], 1);
+	_eu_makeint(&args[1], 2);
+	_eu_makeint(&args[2], 3);
+
+	/* arguments go straight to the procedure */
+	assert_ok(eu_do_string(s, "(lambda (a b c) (- (+ a b) c))", &fn));
+	assert_ok(eu_call(s, &fn, 3, args, &result));
+	assertv_int(&result, ==, 0);
+	munit_assert_int(eu_call(s, &fn, 2, args, &result), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	/* rest parameters get a list */
+	assert_ok(eu_do_string(s, "(lambda (a . r) r)", &fn));
+	assert_ok(eu_call(s, &fn, 3, args, &result));
+	munit_assert_true(_euvalue_is_pair(&result));
+	assertv_int(_eupair_head(_euvalue_to_pair(&result)), ==, 2);
+	assert_ok(eu_call(s, &fn, 1, args, &result));
+	munit_assert_true(_euvalue_is_null(&result));
+	assert_ok(eu_do_string(s, "(lambda () 7)", &fn));
+	assert_ok(eu_call(s, &fn, 0, NULL, &result));
+	assertv_int(&result, ==, 7);
+
+	/* C closures work too */
+	assert_ok(eu_do_string(s, "+", &fn));
+	assert_ok(eu_call(s, &fn, 3, args, &result));
+	assertv_int(&result, ==, 6);
+
+	/* globals are looked up once and follow redefinitions */
+	assert_ok(eu_do_string(s, "(define (hook x) (* x 10))", &result));
+	assert_ok(eu_global_ref(s, "hook", &ref));
+	assert_ok(eu_call_global(s, &ref, 1, &args[1], &result));
+	assertv_int(&result, ==, 20);
+	assert_ok(eu_do_string(s, "(define (hook x) (* x 100))", &result));
+	assert_ok(eu_call_global(s, &ref, 1, &args[1], &result));
+	assertv_int(&result, ==, 200);
+
+	/* even when the global environment grows */
+	for (i = 0; i < 64; i++) {
+		sprintf(name, "(define g%d %d)", i, i);
+		assert_ok(eu_do_string(s, name, &result));
+	}
+	assert_ok(eu_call_global(s, &ref, 1, &args[2], &result));
+	assertv_int(&result, ==, 300);
+
+	/* the reference's name survives collections, even when the lookup misses */
+	assert_ok(eu_global_ref(s, "hook", &ref));
+	assert_ok(eugc_naive_collect(s));
+	for (i = 64; i < 364; i++) {
+		sprintf(name, "(define g%d %d)", i, i);
+		assert_ok(eu_do_string(s, name, &result));
+	}
+	assert_ok(eu_call_global(s, &ref, 1, &args[0], &result));
+	assertv_int(&result, ==, 100);
+
+	munit_assert_int(eu_global_ref(s, "no-such-hook", &ref), !=, EU_RESULT_OK);
+	eu_recover(s, NULL);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_exceptions(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	eu_error* err;
+
+	assert_ok(eu_do_string(s, "(guard (e ((symbol? e) e)) (+ 1 (raise 'boom)))",
+		&result));
+	assertv_symbol_equal(&result, "boom");
+
+	/* clauses that don't apply pass the object on */
+	assert_ok(eu_do_string(s,
+		"(guard (e ((symbol? e) 'outer))"
+		"  (guard (e ((string? e) 'inner)) (raise 'x)))", &result));
+	assertv_symbol_equal(&result, "outer");
+	assert_ok(eu_do_string(s, "(guard (e ((string? e) 0) ((pair? e) (* (car e) 2))"
+		"  (else 1)) (raise '(21)))", &result));
+	assertv_int(&result, ==, 42);
+
+	/* errors from the VM and from C closures are raised as error objects */
+	assert_ok(eu_do_string(s, "(guard (e ((error-object? e) 'error)) (car 5))",
+		&result));
+	assertv_symbol_equal(&result, "error");
+	assert_ok(eu_do_string(s,
+		"(guard (e ((error-object? e) 'error)) (map (lambda (x) (car x)) '(1)))",
+		&result));
+	assertv_symbol_equal(&result, "error");
+
+	assert_ok(eu_do_string(s, "(with-exception-handler (lambda (c) 10)"
+		"  (lambda () (+ 1 (raise-continuable 'oops))))", &result));
+	assertv_int(&result, ==, 11);
+
+	/* handlers run with the outer handlers installed */
+	assert_ok(eu_do_string(s, "(guard (e ((symbol? e) e))"
+		"  (with-exception-handler (lambda (c) (raise 'second))"
+		"    (lambda () (raise 'first))))", &result));
+	assertv_symbol_equal(&result, "second");
+
+	/* handlers can't return to raise */
+	assert_ok(eu_do_string(s, "(guard (e ((error-object? e) 'returned))"
+		"  (with-exception-handler (lambda (c) 1) (lambda () (raise 'x))))",
+		&result));
+	assertv_symbol_equal(&result, "returned");
+
+	/* and what isn't handled reaches the host */
+	munit_assert_int(eu_do_string(s, "(guard (e ((string? e) 1)) (raise 'x))",
+		&result), ==, EU_RESULT_ERROR);
+	eu_recover(s, &err);
+	munit_assert_not_null(err);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_dynamic_wind(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+
+	assert_ok(eu_do_string(s, "(define trace '())", &result));
+	assert_ok(eu_do_string(s, "(define (note x) (set! trace (cons x trace)))",
+		&result));
+
+	assert_ok(eu_do_string(s, "(dynamic-wind (lambda () (note 'in))"
+		"  (lambda () 'body) (lambda () (note 'out)))", &result));
+	assertv_symbol_equal(&result, "body");
+	assert_ok(eu_do_string(s, "(equal? trace '(out in))", &result));
+	assertv_true(&result);
+
+	/* leaving through a continuation or a raise runs the after thunk */
+	assert_ok(eu_do_string(s, "(set! trace '())", &result));
+	assert_ok(eu_do_string(s, "(+ 1 (call/cc (lambda (k)"
+		"  (dynamic-wind (lambda () (note 'in)) (lambda () (k 10))"
+		"    (lambda () (note 'out))))))", &result));
+	assertv_int(&result, ==, 11);
+	assert_ok(eu_do_string(s, "(guard (e (#t (equal? trace '(out in out in))))"
+		"  (dynamic-wind (lambda () (note 'in)) (lambda () (raise 'x))"
+		"    (lambda () (note 'out))))", &result));
+	assertv_true(&result);
+
+	/* and entering it again runs the before thunk */
+	assert_ok(eu_do_string(s,
+		"((lambda (trace k n)"
+		"   (dynamic-wind (lambda () (set! trace (cons 'in trace)))"
+		"     (lambda () (call/cc (lambda (c) (set! k c))) (set! n (+ n 1)))"
+		"     (lambda () (set! trace (cons 'out trace))))"
+		"   (if (< n 3) (k #f) (equal? trace '(out in out in out in))))"
+		" '() #f 0)", &result));
+	assertv_true(&result);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_tasks(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+
+	assert_ok(eu_do_string(s, "(join (spawn (lambda () (+ 1 2))))", &result));
+	assertv_int(&result, ==, 3);
+
+	/* receiving waits for the sender, which yields between values */
+	assert_ok(eu_do_string(s, "(define c (make-channel))", &result));
+	assert_ok(eu_do_string(s, "(spawn (lambda ()"
+		"  (channel-send c 1) (yield) (channel-send c 2)))", &result));
+	assertv_type(&result, EU_TYPE_TASK);
+	assert_ok(eu_do_string(s, "(equal? (list (channel-receive c)"
+		"  (channel-receive c)) '(1 2))", &result));
+	assertv_true(&result);
+
+	/* a long loop gets preempted, so the other task runs before it ends */
+	assert_ok(eu_do_string(s, "(define flag #f)", &result));
+	assert_ok(eu_do_string(s, "(define (spin n) (if (= n 0) flag (spin (- n 1))))",
+		&result));
+	assert_ok(eu_do_string(s, "(spawn (lambda () (set! flag #t)))", &result));
+	assert_ok(eu_do_string(s, "(spin 10000)", &result));
+	assertv_true(&result);
+
+	/* joining a task that raised raises the same object */
+	assert_ok(eu_do_string(s, "(guard (e ((symbol? e) e))"
+		"  (join (spawn (lambda () (raise 'oops)))))", &result));
+	assertv_symbol_equal(&result, "oops");
+
+	/* tasks are cheap */
+	assert_ok(eu_do_string(s, "(define (spawn-all i acc) (if (= i 0) acc"
+		"  (spawn-all (- i 1) (cons (spawn (lambda () i)) acc))))", &result));
+	assert_ok(eu_do_string(s, "(define (join-all l acc) (if (null? l) acc"
+		"  (join-all (cdr l) (+ acc (join (car l))))))", &result));
+	assert_ok(eu_do_string(s, "(join-all (spawn-all 10000 '()) 0)", &result));
+	assertv_int(&result, ==, 50005000);
+
+	return MUNIT_OK;
+}
+
+/* runs text with fuel for each slice, counting the slices */
+static int run_fueled(europa* s, char* text, eu_integer fuel,
+	eu_value* out, int* slices) {
+	int res;
+
+	_eu_checkreturn(eu_set_fuel(s, fuel));
+	*slices = 1;
+	res = eu_do_string(s, text, out);
+	while (res == EU_RESULT_YIELD && *slices < 1000) {
+		(*slices)++;
+		_eu_checkreturn(eu_set_fuel(s, fuel));
+		res = eu_resume(s, out);
+	}
+
+	return res;
+}
+
+MunitResult test_fuel(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+	int slices, halved, res;
+
+	assert_ok(eu_do_string(s, "(define (count n acc) (if (= n 0) acc"
+		"  (count (- n 1) (+ acc 1))))", &result));
+
+	/* the loop runs in slices, resuming where the last one stopped */
+	assert_ok(eu_set_fuel(s, 1000));
+	slices = 1;
+	res = eu_do_string(s, "(count 100000 0)", &result);
+	while (res == EU_RESULT_YIELD) {
+		munit_assert_int(eu_get_fuel(s), ==, 0);
+		slices++;
+		assert_ok(eu_set_fuel(s, 1000));
+		res = eu_resume(s, &result);
+	}
+	assert_ok(res);
+	assertv_int(&result, ==, 100000);
+	munit_assert_int(slices, >, 100);
+
+	/* every slice makes progress, however small */
+	assert_ok(run_fueled(s, "(+ (count 3 0) 2)", 1, &result, &slices));
+	assertv_int(&result, ==, 5);
+	assert_ok(run_fueled(s, "(let loop ((i 0)) (if (< i 10) (loop (+ i 1)) i))",
+		1, &result, &slices));
+	assertv_int(&result, ==, 10);
+	assert_ok(run_fueled(s, "(let loop ((i 0)) (if (< i 10) (loop (+ i 1)) i))",
+		2, &result, &halved));
+	assertv_int(&result, ==, 10);
+	munit_assert_int(halved, <=, (slices + 1) / 2);
+
+	/* suspended code must be resumed or dropped before anything else runs */
+	assert_ok(eu_set_fuel(s, 10));
+	munit_assert_int(eu_do_string(s, "(count 100 0)", &result), ==, EU_RESULT_YIELD);
+	munit_assert_int(eu_do_string(s, "(+ 1 2)", &result), ==, EU_RESULT_ERROR);
+	assert_ok(eu_recover(s, NULL));
+	assert_ok(eu_set_fuel(s, -1));
+	assert_ok(eu_do_string(s, "(count 100 0)", &result));
+	assertv_int(&result, ==, 100);
+	munit_assert_int(eu_get_fuel(s), ==, -1);
+
+	return MUNIT_OK;
+}
+
+MunitResult test_syntax_extension(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_value result;
+
+	assert_ok(eucode_define_syntax(s, &second_syntax));
+	assert_ok(eu_do_string(s, "(second (car '()) (+ 1 2))", &result));
+	assertv_type(&result, EU_TYPE_NUMBER);
+	assertv_int(&result, ==, 3);
+
+	/* subforms are compiled in the enclosing scope */
+	assert_ok(eu_do_string(s, "((lambda (x) (second y x)) 5)", &result));
+	assertv_int(&result, ==, 5);
+
 	return MUNIT_OK;
 }
 
@@ -243,6 +1383,182 @@ MunitTest evaltests[] = {
 		MUNIT_TEST_OPTION_NONE,
 		NULL,
 	},
+	{
+		"/hash-tables",
+		test_hash_tables,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/global-references",
+		test_global_references,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/constant-pool",
+		test_constant_pool,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/peephole",
+		test_peephole,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/superinstructions",
+		test_superinstructions,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/let-forms",
+		test_let_forms,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/flat-closures",
+		test_flat_closures,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/constant-folding",
+		test_constant_folding,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/inlining",
+		test_inlining,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/images",
+		test_images,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/image-files",
+		test_image_files,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/heap-images",
+		test_heap_images,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/workers",
+		test_workers,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/compile-cache",
+		test_compile_cache,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/direct-calls",
+		test_direct_calls,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/c-frames",
+		test_c_frames,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/leaf-closures",
+		test_leaf_closures,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/exceptions",
+		test_exceptions,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/dynamic-wind",
+		test_dynamic_wind,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/tasks",
+		test_tasks,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/fuel",
+		test_fuel,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/syntax-extension",
+		test_syntax_extension,
+		eval_setup,
+		eval_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
 	{NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
 
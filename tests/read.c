@@ -500,6 +500,20 @@ MunitResult test_read_vector(MunitParameter params[], void* fixture) {
 	munit_assert_int(_euvector_ref(vec, 1)->value.i, ==, 10);
 	munit_assert_int(_euvector_ref(vec, 2)->type, ==, EU_TYPE_NUMBER);
 
+	/* vectors end at their closing parenthesis, even inside lists */
+	port = eumport_from_str(s, EU_PORT_FLAG_TEXTUAL | EU_PORT_FLAG_INPUT,
+		"(#(1 2 ) #() 3)");
+	munit_assert_not_null(port);
+
+	munit_assert_int(euport_read(s, port, &out), ==, EU_RESULT_OK);
+	munit_assert_int(out.type, &, EU_TYPE_PAIR);
+	munit_assert_int(eulist_length(s, _euvalue_to_pair(&out)), ==, 3);
+	vec = _euvalue_to_vector(_eupair_head(_euvalue_to_pair(&out)));
+	munit_assert_int(_euvector_length(vec), ==, 2);
+	vec = _euvalue_to_vector(_eupair_head(_euvalue_to_pair(
+		_eupair_tail(_euvalue_to_pair(&out)))));
+	munit_assert_int(_euvector_length(vec), ==, 0);
+
 	return MUNIT_OK;
 }
 
@@ -6,6 +6,10 @@
 #include "europa/symbol.h"
 #include "europa/string.h"
 #include "europa/number.h"
+#include "europa/util.h"
+
+#include <stdio.h>
+#include <string.h>
 
 static void* table_setup(MunitParameter params[], void* user_data) {
 	europa* s;
@@ -157,6 +161,165 @@ MunitResult simple_index(MunitParameter params[], void* fixture) {
 	return MUNIT_OK;
 }
 
+MunitResult array_part(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_table* t;
+	eu_symbol* k;
+	eu_value key, *rv;
+	int i;
+
+	// create the table with no hash part
+	t = eutable_new(s, 0);
+	munit_assert_not_null(t);
+
+	// insert sequential integer keys
+	for (i = 0; i < 100; i++) {
+		_eu_makeint(&key, i);
+		munit_assert_int(eutable_create_key(s, t, &key, &rv), ==, EU_RESULT_OK);
+		munit_assert_not_null(rv);
+		_eu_makeint(rv, i * 2);
+	}
+
+	// all of them should have gone into the array part
+	munit_assert_int(_eutable_acount(t), ==, 100);
+	munit_assert_int(_eutable_count(t), ==, 0);
+	munit_assert_int(_eutable_asize(t), >=, 100);
+
+	// add a non-integer key and a sparse integer key, which go into the hash part
+	k = eusymbol_new(s, "not-an-index");
+	munit_assert_not_null(k);
+	_eu_makesym(&key, k);
+	munit_assert_int(eutable_create_key(s, t, &key, &rv), ==, EU_RESULT_OK);
+	munit_assert_not_null(rv);
+	_eu_makeint(rv, -1);
+
+	_eu_makeint(&key, 1 << 20);
+	munit_assert_int(eutable_create_key(s, t, &key, &rv), ==, EU_RESULT_OK);
+	munit_assert_not_null(rv);
+	_eu_makeint(rv, -2);
+
+	munit_assert_int(_eutable_count(t), ==, 2);
+	munit_assert_int(_eutable_acount(t), ==, 100);
+
+	// check the values
+	for (i = 0; i < 100; i++) {
+		_eu_makeint(&key, i);
+		munit_assert_int(eutable_get(s, t, &key, &rv), ==, EU_RESULT_OK);
+		munit_assert_not_null(rv);
+		munit_assert_int(_eunum_i(rv), ==, i * 2);
+	}
+
+	_eu_makesym(&key, k);
+	munit_assert_int(eutable_get(s, t, &key, &rv), ==, EU_RESULT_OK);
+	munit_assert_not_null(rv);
+	munit_assert_int(_eunum_i(rv), ==, -1);
+
+	_eu_makeint(&key, 1 << 20);
+	munit_assert_int(eutable_get(s, t, &key, &rv), ==, EU_RESULT_OK);
+	munit_assert_not_null(rv);
+	munit_assert_int(_eunum_i(rv), ==, -2);
+
+	// integer keys past the end of the array part are not present
+	_eu_makeint(&key, 100);
+	munit_assert_int(eutable_get(s, t, &key, &rv), ==, EU_RESULT_OK);
+	munit_assert_null(rv);
+
+	return MUNIT_OK;
+}
+
+MunitResult remove_and_next(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_table* t;
+	eu_value keys[64], key, *rv;
+	char text[16];
+	int i, found;
+
+	t = eutable_new(s, 0);
+	munit_assert_not_null(t);
+
+	// insert symbol keys (hash part) and integer keys (array part)
+	for (i = 0; i < 32; i++) {
+		snprintf(text, sizeof(text), "key-%d", i);
+		_eu_makesym(&keys[i], eusymbol_new(s, text));
+		munit_assert_not_null(_euvalue_to_obj(&keys[i]));
+		_eu_makeint(&keys[32 + i], i);
+	}
+	for (i = 0; i < 64; i++) {
+		munit_assert_int(eutable_create_key(s, t, &keys[i], &rv), ==, EU_RESULT_OK);
+		_eu_makeint(rv, i);
+	}
+
+	// remove every other key, which breaks up collision chains
+	for (i = 0; i < 64; i += 2) {
+		munit_assert_int(eutable_remove(s, t, &keys[i]), ==, EU_RESULT_OK);
+	}
+	// removing keys that are not present is not an error
+	munit_assert_int(eutable_remove(s, t, &keys[0]), ==, EU_RESULT_OK);
+	munit_assert_int(_eutable_count(t) + _eutable_acount(t), ==, 32);
+
+	for (i = 0; i < 64; i++) {
+		munit_assert_int(eutable_get(s, t, &keys[i], &rv), ==, EU_RESULT_OK);
+		if (i % 2) {
+			munit_assert_not_null(rv);
+			munit_assert_int(_eunum_i(rv), ==, i);
+		} else {
+			munit_assert_null(rv);
+		}
+	}
+
+	// iterate through the table, every remaining key must be visited once
+	found = 0;
+	munit_assert_int(eutable_next(s, t, NULL, &key, &rv), ==, EU_RESULT_OK);
+	while (rv != NULL) {
+		munit_assert_int(_eunum_i(rv) % 2, ==, 1);
+		found++;
+		munit_assert_int(eutable_next(s, t, &key, &key, &rv), ==, EU_RESULT_OK);
+	}
+	munit_assert_int(found, ==, 32);
+
+	// removing almost everything should shrink the table
+	for (i = 1; i < 60; i += 2) {
+		munit_assert_int(eutable_remove(s, t, &keys[i]), ==, EU_RESULT_OK);
+	}
+	munit_assert_int(_eutable_count(t) + _eutable_acount(t), ==, 2);
+	munit_assert_int(_eutable_size(t) + _eutable_asize(t), <=, 8);
+
+	for (i = 61; i < 64; i += 2) {
+		munit_assert_int(eutable_get(s, t, &keys[i], &rv), ==, EU_RESULT_OK);
+		munit_assert_not_null(rv);
+		munit_assert_int(_eunum_i(rv), ==, i);
+	}
+
+	return MUNIT_OK;
+}
+
+MunitResult seeded_hashing(MunitParameter params[], void* fixture) {
+	europa* s = cast(europa*, fixture);
+	eu_symbol* sym;
+	eu_string* str;
+	const char* text = "a reasonably long key, longer than forty-eight bytes";
+
+	// C strings and byte strings hash the same
+	munit_assert_uint64(eutil_cstr_hash(text), ==,
+		eutil_strb_hash((eu_byte*)text, strlen(text)));
+
+	// objects hash like their text
+	sym = eusymbol_new(s, "some-symbol");
+	munit_assert_not_null(sym);
+	munit_assert_uint64(eusymbol_hash(sym), ==, eusymbol_hash_cstr("some-symbol"));
+	str = eustring_new(s, (void*)text);
+	munit_assert_not_null(str);
+	munit_assert_uint64(eustring_hash(str), ==, eustring_hash_cstr(text));
+
+	// the seed changes the hash
+	munit_assert_uint64(eutil_hash_bytes(text, strlen(text), 1), !=,
+		eutil_hash_bytes(text, strlen(text), 2));
+	munit_assert_uint64(eutil_hash_bytes("ab", 2, 1), !=,
+		eutil_hash_bytes("ba", 2, 1));
+
+	return MUNIT_OK;
+}
+
 MunitTest tabletests[] = {
 	{
 		"/simple",
@@ -182,6 +345,30 @@ MunitTest tabletests[] = {
 		MUNIT_TEST_OPTION_NONE,
 		NULL,
 	},
+	{
+		"/array-part",
+		array_part,
+		table_setup,
+		table_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/remove-next",
+		remove_and_next,
+		table_setup,
+		table_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
+	{
+		"/seeded-hashing",
+		seeded_hashing,
+		table_setup,
+		table_teardown,
+		MUNIT_TEST_OPTION_NONE,
+		NULL,
+	},
 	{ NULL },
 };
 